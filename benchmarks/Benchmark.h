@@ -0,0 +1,214 @@
+/**
+ * @file
+ *  This file is part of PUML
+ *
+ *  For conditions of distribution and use, please see the copyright
+ *  notice in the file 'COPYING' at the root directory of this package
+ *  and the copyright notice at https://github.com/TUM-I5/PUML
+ *
+ * @copyright 2013 Technische Universitaet Muenchen
+ * @author Sebastian Rettenberger <rettenbs@in.tum.de>
+ */
+
+#ifndef PUML_BENCHMARK_H
+#define PUML_BENCHMARK_H
+
+#ifdef PARALLEL
+#include <mpi.h>
+#endif // PARALLEL
+
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <sstream>
+#include <string>
+
+#include "PUML/IOCounters.h"
+#include "PUML/NetcdfPum.h"
+
+namespace benchmark
+{
+
+/**
+ * Common functionality of all benchmarks
+ *
+ * Parameters are passed as <code>--name=value</code>. Each measurement is
+ * printed by the first rank as one JSON object per line.
+ */
+class Benchmark
+{
+private:
+	/** Name of the benchmark */
+	std::string m_name;
+
+	/** Parameters from the command line */
+	std::map<std::string, std::string> m_args;
+
+	/** Parameters used by the benchmark (printed with each result) */
+	std::map<std::string, std::string> m_params;
+
+	int m_rank;
+
+	int m_size;
+
+	/** Start of the current measurement */
+	double m_start;
+
+public:
+	Benchmark(const char* name, int argc, char* argv[])
+		: m_name(name), m_rank(0), m_size(1), m_start(0)
+	{
+#ifdef PARALLEL
+		MPI_Init(&argc, &argv);
+		MPI_Comm_rank(MPI_COMM_WORLD, &m_rank);
+		MPI_Comm_size(MPI_COMM_WORLD, &m_size);
+#endif // PARALLEL
+
+		for (int i = 1; i < argc; i++) {
+			std::string arg = argv[i];
+			if (arg.compare(0, 2, "--") != 0)
+				continue;
+
+			size_t pos = arg.find('=');
+			if (pos == std::string::npos)
+				m_args[arg.substr(2)] = "1";
+			else
+				m_args[arg.substr(2, pos-2)] = arg.substr(pos+1);
+		}
+	}
+
+	virtual ~Benchmark()
+	{
+#ifdef PARALLEL
+		MPI_Finalize();
+#endif // PARALLEL
+	}
+
+	/**
+	 * @return The value of a parameter or the default value
+	 */
+	unsigned long param(const char* name, unsigned long defaultValue)
+	{
+		std::map<std::string, std::string>::const_iterator it = m_args.find(name);
+		unsigned long value = (it == m_args.end() ? defaultValue : strtoul(it->second.c_str(), 0L, 10));
+
+		setParam(name, value);
+		return value;
+	}
+
+	/**
+	 * @overload
+	 */
+	std::string param(const char* name, const char* defaultValue)
+	{
+		std::map<std::string, std::string>::const_iterator it = m_args.find(name);
+		std::string value = (it == m_args.end() ? defaultValue : it->second);
+
+		m_params[name] = '"' + value + '"';
+		return value;
+	}
+
+	/**
+	 * Sets a parameter that is printed with the next results
+	 */
+	void setParam(const char* name, unsigned long value)
+	{
+		std::ostringstream s;
+		s << value;
+		m_params[name] = s.str();
+	}
+
+	int rank() const
+	{
+		return m_rank;
+	}
+
+	int size() const
+	{
+		return m_size;
+	}
+
+	/**
+	 * Creates a new file with the given number of partitions
+	 */
+	bool create(PUML::NetcdfPum &pum, const char* path, size_t numPartitions)
+	{
+#ifdef PARALLEL
+		return pum.create(path, numPartitions, MPI_COMM_WORLD);
+#else // PARALLEL
+		return pum.create(path, numPartitions);
+#endif // PARALLEL
+	}
+
+	bool open(PUML::NetcdfPum &pum, const char* path)
+	{
+#ifdef PARALLEL
+		return pum.open(path, MPI_COMM_WORLD);
+#else // PARALLEL
+		return pum.open(path);
+#endif // PARALLEL
+	}
+
+	/**
+	 * Synchronizes all ranks and starts a measurement
+	 */
+	void start()
+	{
+#ifdef PARALLEL
+		MPI_Barrier(MPI_COMM_WORLD);
+#endif // PARALLEL
+		m_start = PUML::IOCounters::time();
+	}
+
+	/**
+	 * Stops the measurement and prints the result
+	 *
+	 * @param test Name of the measurement
+	 * @param bytes Number of bytes transferred by this rank
+	 * @param ops Number of operations on this rank (for the latency)
+	 */
+	void stop(const char* test, unsigned long bytes, unsigned long ops)
+	{
+		double time = PUML::IOCounters::time() - m_start;
+
+		double times[3] = {time, time, time};
+		unsigned long totals[2] = {bytes, ops};
+#ifdef PARALLEL
+		MPI_Allreduce(MPI_IN_PLACE, &times[0], 1, MPI_DOUBLE, MPI_MIN, MPI_COMM_WORLD);
+		MPI_Allreduce(MPI_IN_PLACE, &times[1], 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+		MPI_Allreduce(MPI_IN_PLACE, &times[2], 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+		MPI_Allreduce(MPI_IN_PLACE, totals, 2, MPI_UNSIGNED_LONG, MPI_SUM, MPI_COMM_WORLD);
+#endif // PARALLEL
+
+		if (m_rank != 0)
+			return;
+
+		printf("{\"benchmark\": \"%s\", \"test\": \"%s\", \"ranks\": %d", m_name.c_str(), test, m_size);
+		for (std::map<std::string, std::string>::const_iterator i = m_params.begin();
+				i != m_params.end(); i++)
+			printf(", \"%s\": %s", i->first.c_str(), i->second.c_str());
+		printf(", \"bytes\": %lu, \"ops\": %lu, \"timeMin\": %g, \"timeMax\": %g, \"timeAvg\": %g",
+			totals[0], totals[1], times[0], times[1], times[2] / m_size);
+		// Throughput and latency are limited by the slowest rank
+		printf(", \"throughput\": %g, \"latency\": %g}\n",
+			(times[1] > 0 ? totals[0] / times[1] : 0.),
+			(totals[1] > 0 ? times[1] * m_size / totals[1] : 0.));
+		fflush(stdout);
+	}
+
+	/**
+	 * Prints an error and aborts the benchmark
+	 */
+	void fail(const char* message)
+	{
+		fprintf(stderr, "%s: %s (rank %d)\n", m_name.c_str(), message, m_rank);
+#ifdef PARALLEL
+		MPI_Abort(MPI_COMM_WORLD, 1);
+#endif // PARALLEL
+		exit(1);
+	}
+};
+
+}
+
+#endif // PUML_BENCHMARK_H
@@ -0,0 +1,97 @@
+/**
+ * @file
+ *  This file is part of PUML
+ *
+ *  For conditions of distribution and use, please see the copyright
+ *  notice in the file 'COPYING' at the root directory of this package
+ *  and the copyright notice at https://github.com/TUM-I5/PUML
+ *
+ * @copyright 2013 Technische Universitaet Muenchen
+ * @author Sebastian Rettenberger <rettenbs@in.tum.de>
+ */
+
+/**
+ * Measures contiguous put and get of whole partitions
+ *
+ * Parameters:
+ *  --file Name of the test file
+ *  --size Number of elements per partition
+ *  --components Number of values per element
+ *  --partitions Number of partitions per rank
+ *  --repeat Number of repetitions
+ */
+
+#include <cstdio>
+#include <vector>
+
+#include "Benchmark.h"
+
+int main(int argc, char* argv[])
+{
+	benchmark::Benchmark bench("ContiguousIO", argc, argv);
+
+	std::string file = bench.param("file", "bench_contiguous.nc.pum");
+	unsigned long size = bench.param("size", 1000000);
+	unsigned long components = bench.param("components", 3);
+	unsigned long partitions = bench.param("partitions", 1);
+	unsigned long repeat = bench.param("repeat", 3);
+
+	std::vector<double> values(size * components);
+	for (size_t i = 0; i < values.size(); i++)
+		values[i] = i;
+	unsigned long bytes = partitions * values.size() * sizeof(double);
+
+	for (unsigned long r = 0; r < repeat; r++) {
+		bench.setParam("iteration", r);
+
+		// Write
+		PUML::NetcdfPum pum;
+		if (!bench.create(pum, file.c_str(), partitions * bench.size()))
+			bench.fail("Could not create file");
+
+		PUML::NetcdfGroup* group = pum.createGroup("values");
+		PUML::Dimension dim = group->createDimension("components", components);
+		PUML::NetcdfEntity* entity = group->createEntity("values", PUML::Type::Double, 1, &dim);
+		if (!entity || !pum.endDefinition())
+			bench.fail("Could not define file");
+
+		for (unsigned long p = 0; p < partitions; p++) {
+			if (!group->setSize(bench.rank() + p*bench.size(), size))
+				bench.fail("Could not set size");
+		}
+		entity->setCollective(true);
+
+		bench.start();
+		for (unsigned long p = 0; p < partitions; p++) {
+			if (!entity->put(bench.rank() + p*bench.size(), size, &values[0]))
+				bench.fail("Could not put values");
+		}
+		if (!pum.close())
+			bench.fail("Could not close file");
+		bench.stop("put", bytes, partitions);
+
+		// Read
+		if (!bench.open(pum, file.c_str()))
+			bench.fail("Could not open file");
+
+		group = pum.getGroup("values");
+		entity = (group ? group->getEntity("values") : 0L);
+		if (!entity)
+			bench.fail("Could not load entity");
+		entity->setCollective(true);
+
+		bench.start();
+		for (unsigned long p = 0; p < partitions; p++) {
+			if (!entity->get(bench.rank() + p*bench.size(), size, &values[0]))
+				bench.fail("Could not get values");
+		}
+		bench.stop("get", bytes, partitions);
+
+		pum.close();
+	}
+
+	if (bench.rank() == 0)
+		remove(file.c_str());
+
+	return 0;
+}
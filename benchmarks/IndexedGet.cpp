@@ -0,0 +1,103 @@
+/**
+ * @file
+ *  This file is part of PUML
+ *
+ *  For conditions of distribution and use, please see the copyright
+ *  notice in the file 'COPYING' at the root directory of this package
+ *  and the copyright notice at https://github.com/TUM-I5/PUML
+ *
+ * @copyright 2013 Technische Universitaet Muenchen
+ * @author Sebastian Rettenberger <rettenbs@in.tum.de>
+ */
+
+/**
+ * Measures indexed get with different fragmentation
+ *
+ * The index of each partition consists of contiguous runs of elements
+ * in reverse order. The run length is varied from 1 to maxRun (in powers of 4).
+ *
+ * Parameters:
+ *  --file Name of the test file
+ *  --size Number of elements per partition
+ *  --maxRun Maximum length of contiguous runs in the index
+ *  --repeat Number of repetitions for each run length
+ *  --collective Use collective I/O (0 or 1)
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#include "Benchmark.h"
+
+int main(int argc, char* argv[])
+{
+	benchmark::Benchmark bench("IndexedGet", argc, argv);
+
+	std::string file = bench.param("file", "bench_indexed.nc.pum");
+	unsigned long size = bench.param("size", 1000000);
+	unsigned long maxRun = bench.param("maxRun", 4096);
+	unsigned long repeat = bench.param("repeat", 3);
+	bool collective = bench.param("collective", 1);
+
+	std::vector<double> values(size);
+	for (size_t i = 0; i < size; i++)
+		values[i] = i;
+	std::vector<unsigned long> index(size);
+
+	for (unsigned long run = 1; run <= maxRun; run *= 4) {
+		bench.setParam("run", run);
+
+		// Runs in reverse order
+		unsigned long start = bench.rank() * size;
+		size_t pos = 0;
+		for (unsigned long r = (size + run - 1) / run; r > 0; r--) {
+			for (unsigned long i = (r-1) * run; i < std::min(r * run, size); i++)
+				index[pos++] = start + i;
+		}
+
+		PUML::NetcdfPum pum;
+		if (!bench.create(pum, file.c_str(), bench.size()))
+			bench.fail("Could not create file");
+
+		PUML::NetcdfGroup* group = pum.createGroupIndexed("values");
+		PUML::NetcdfEntity* entity = group->createEntity("values", PUML::Type::Double);
+		if (!entity || !pum.endDefinition())
+			bench.fail("Could not define file");
+
+		if (!group->setSize(bench.rank(), size))
+			bench.fail("Could not set size");
+		if (!group->putIndex(bench.rank(), size, &index[0]))
+			bench.fail("Could not write index");
+		entity->setCollective(collective);
+		if (!entity->put(bench.rank(), size, &values[0]))
+			bench.fail("Could not put values");
+		if (!pum.close())
+			bench.fail("Could not close file");
+
+		for (unsigned long r = 0; r < repeat; r++) {
+			bench.setParam("iteration", r);
+
+			if (!bench.open(pum, file.c_str()))
+				bench.fail("Could not open file");
+
+			group = pum.getGroup("values");
+			entity = (group ? group->getEntity("values") : 0L);
+			if (!entity)
+				bench.fail("Could not load entity");
+			entity->setCollective(collective);
+
+			bench.start();
+			if (!entity->get(bench.rank(), size, &values[0]))
+				bench.fail("Could not get values");
+			bench.stop("get", size * sizeof(double), (size + run - 1) / run);
+
+			pum.close();
+		}
+	}
+
+	if (bench.rank() == 0)
+		remove(file.c_str());
+
+	return 0;
+}
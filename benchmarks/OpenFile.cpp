@@ -0,0 +1,116 @@
+/**
+ * @file
+ *  This file is part of PUML
+ *
+ *  For conditions of distribution and use, please see the copyright
+ *  notice in the file 'COPYING' at the root directory of this package
+ *  and the copyright notice at https://github.com/TUM-I5/PUML
+ *
+ * @copyright 2013 Technische Universitaet Muenchen
+ * @author Sebastian Rettenberger <rettenbs@in.tum.de>
+ */
+
+/**
+ * Measures the time to open files with many groups and entities
+ *
+ * Parameters:
+ *  --file Name of the test file
+ *  --groups Number of groups
+ *  --entities Number of entities per group
+ *  --partitions Number of partitions per rank
+ *  --broadcast Broadcast the metadata (0 or 1, parallel only)
+ *  --repeat Number of repetitions
+ */
+
+#include <cstdio>
+#include <sstream>
+#include <vector>
+
+#include "Benchmark.h"
+
+static std::string name(const char* prefix, unsigned long i)
+{
+	std::ostringstream s;
+	s << prefix << i;
+	return s.str();
+}
+
+int main(int argc, char* argv[])
+{
+	benchmark::Benchmark bench("OpenFile", argc, argv);
+
+	std::string file = bench.param("file", "bench_open.nc.pum");
+	unsigned long numGroups = bench.param("groups", 100);
+	unsigned long numEntities = bench.param("entities", 10);
+	unsigned long partitions = bench.param("partitions", 1);
+#ifdef PARALLEL
+	bool broadcast = bench.param("broadcast", 0ul);
+#endif // PARALLEL
+	unsigned long repeat = bench.param("repeat", 3);
+
+	// Create the schema
+	{
+		PUML::NetcdfPum pum;
+		if (!bench.create(pum, file.c_str(), partitions * bench.size()))
+			bench.fail("Could not create file");
+
+		std::vector<PUML::NetcdfGroup*> groups(numGroups);
+		for (unsigned long g = 0; g < numGroups; g++) {
+			groups[g] = pum.createGroup(name("group", g).c_str());
+			if (!groups[g])
+				bench.fail("Could not create group");
+
+			for (unsigned long e = 0; e < numEntities; e++) {
+				if (!groups[g]->createEntity(name("entity", e).c_str(), PUML::Type::Double))
+					bench.fail("Could not create entity");
+			}
+		}
+		if (!pum.endDefinition())
+			bench.fail("Could not define file");
+
+		for (unsigned long g = 0; g < numGroups; g++) {
+			for (unsigned long p = 0; p < partitions; p++) {
+				if (!groups[g]->setSize(bench.rank() + p*bench.size(), 1))
+					bench.fail("Could not set size");
+			}
+		}
+
+		if (!pum.close())
+			bench.fail("Could not close file");
+	}
+
+	for (unsigned long r = 0; r < repeat; r++) {
+		bench.setParam("iteration", r);
+
+		PUML::NetcdfPum pum;
+#ifdef PARALLEL
+		pum.setBroadcastMetadata(broadcast);
+#endif // PARALLEL
+
+		bench.start();
+		if (!bench.open(pum, file.c_str()))
+			bench.fail("Could not open file");
+		bench.stop("open", 0, 1);
+
+		// Groups and entities are loaded on demand
+		bench.start();
+		for (unsigned long g = 0; g < numGroups; g++) {
+			PUML::NetcdfGroup* group = pum.getGroup(name("group", g).c_str());
+			if (!group)
+				bench.fail("Could not load group");
+
+			for (unsigned long e = 0; e < numEntities; e++) {
+				if (!group->getEntity(name("entity", e).c_str()))
+					bench.fail("Could not load entity");
+			}
+		}
+		bench.stop("load", 0, numGroups * (numEntities + 1));
+
+		pum.close();
+	}
+
+	if (bench.rank() == 0)
+		remove(file.c_str());
+
+	return 0;
+}
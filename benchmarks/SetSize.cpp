@@ -0,0 +1,72 @@
+/**
+ * @file
+ *  This file is part of PUML
+ *
+ *  For conditions of distribution and use, please see the copyright
+ *  notice in the file 'COPYING' at the root directory of this package
+ *  and the copyright notice at https://github.com/TUM-I5/PUML
+ *
+ * @copyright 2013 Technische Universitaet Muenchen
+ * @author Sebastian Rettenberger <rettenbs@in.tum.de>
+ */
+
+/**
+ * Measures Group::setSize with many partitions
+ *
+ * Parameters:
+ *  --file Name of the test file
+ *  --partitions Number of partitions per rank
+ *  --groups Number of groups
+ *  --repeat Number of repetitions
+ */
+
+#include <cstdio>
+#include <sstream>
+#include <vector>
+
+#include "Benchmark.h"
+
+int main(int argc, char* argv[])
+{
+	benchmark::Benchmark bench("SetSize", argc, argv);
+
+	std::string file = bench.param("file", "bench_setsize.nc.pum");
+	unsigned long partitions = bench.param("partitions", 1000);
+	unsigned long numGroups = bench.param("groups", 1);
+	unsigned long repeat = bench.param("repeat", 3);
+
+	for (unsigned long r = 0; r < repeat; r++) {
+		bench.setParam("iteration", r);
+
+		PUML::NetcdfPum pum;
+		if (!bench.create(pum, file.c_str(), partitions * bench.size()))
+			bench.fail("Could not create file");
+
+		std::vector<PUML::NetcdfGroup*> groups(numGroups);
+		for (unsigned long g = 0; g < numGroups; g++) {
+			std::ostringstream name;
+			name << "group" << g;
+			groups[g] = pum.createGroup(name.str().c_str());
+			if (!groups[g])
+				bench.fail("Could not create group");
+		}
+		if (!pum.endDefinition())
+			bench.fail("Could not define file");
+
+		bench.start();
+		for (unsigned long g = 0; g < numGroups; g++) {
+			for (unsigned long p = 0; p < partitions; p++) {
+				if (!groups[g]->setSize(bench.rank() + p*bench.size(), 10 + p % 7))
+					bench.fail("Could not set size");
+			}
+		}
+		bench.stop("setSize", 0, numGroups * partitions);
+
+		pum.close();
+	}
+
+	if (bench.rank() == 0)
+		remove(file.c_str());
+
+	return 0;
+}
@@ -0,0 +1,38 @@
+#! /usr/bin/python
+
+# @file
+#  This file is part of PUML
+#
+#  For conditions of distribution and use, please see the copyright
+#  notice in the file 'COPYING' at the root directory of this package
+#  and the copyright notice at https://github.com/TUM-I5/PUML
+# 
+# @copyright 2013 Technische Universitaet Muenchen
+# @author Sebastian Rettenberger <rettenbs@in.tum.de>
+#
+
+def generate(env, **kw):
+    conf = env.Configure()
+        
+    if 'required' in kw:
+        required = kw['required']
+    else:
+        required = False
+        
+    if not conf.CheckLibWithHeader('hdf5', 'hdf5.h', 'c'):
+        if required:
+            print 'Could not find HDF5!'
+            env.Exit(1)
+        else:
+            conf.Finish()
+            return
+
+    if not conf.CheckLibWithHeader('hdf5_hl', ['hdf5.h', 'hdf5_hl.h'], 'c'):
+        if required:
+            print 'Could not find the HDF5 high level library!'
+            env.Exit(1)
+            
+    conf.Finish()
+
+def exists(env):
+    return True
@@ -17,6 +17,12 @@ const size_t PUML::Group::UNLIMITED = 0;
 const char* PUML::Group::DIM_PARTITION = "_partition";
 const char* PUML::Group::DIM_SIZE = "_size";
 const char* PUML::Group::DIM_INDEXSIZE = "_indexsize";
+const char* PUML::Group::DIM_CELLTYPE = "_celltype";
+const char* PUML::Group::DIM_TIME = "_time";
 
 const char* PUML::Group::VAR_OFFSET = "_offset";
+const char* PUML::Group::VAR_TOTALSIZE = "_totalsize";
 const char* PUML::Group::VAR_INDEX = "_index";
+const char* PUML::Group::VAR_TYPEOFFSET = "_typeoffset";
+const char* PUML::Group::VAR_MIN_SUFFIX = "_min";
+const char* PUML::Group::VAR_MAX_SUFFIX = "_max";
@@ -16,12 +16,99 @@
 namespace PUML
 {
 
+/**
+ * Supported cell types
+ *
+ * The numeric values are used in the type offset table of mixed cell groups
+ * and must not be changed.
+ */
 enum CellType
 {
-	// TODO add more types
-	TETRAHEDRON
+	TETRAHEDRON,
+	HEXAHEDRON,
+	PRISM,
+	PYRAMID,
+	TRIANGLE,
+	/** Number of cell types (not a valid cell type) */
+	NUM_CELL_TYPES
+};
+
+/**
+ * Compile-time properties of a cell type
+ *
+ * Use these in kernels that are instantiated for each cell type to get
+ * loops with fixed trip count.
+ */
+template<CellType Type>
+struct CellTraits;
+
+template<>
+struct CellTraits<TETRAHEDRON>
+{
+	static const CellType TYPE = TETRAHEDRON;
+	static const unsigned int DIMENSION = 3;
+	static const unsigned int NUM_VERTICES = 4;
+	static const unsigned int NUM_FACES = 4;
 };
 
+template<>
+struct CellTraits<HEXAHEDRON>
+{
+	static const CellType TYPE = HEXAHEDRON;
+	static const unsigned int DIMENSION = 3;
+	static const unsigned int NUM_VERTICES = 8;
+	static const unsigned int NUM_FACES = 6;
+};
+
+template<>
+struct CellTraits<PRISM>
+{
+	static const CellType TYPE = PRISM;
+	static const unsigned int DIMENSION = 3;
+	static const unsigned int NUM_VERTICES = 6;
+	static const unsigned int NUM_FACES = 5;
+};
+
+template<>
+struct CellTraits<PYRAMID>
+{
+	static const CellType TYPE = PYRAMID;
+	static const unsigned int DIMENSION = 3;
+	static const unsigned int NUM_VERTICES = 5;
+	static const unsigned int NUM_FACES = 5;
+};
+
+template<>
+struct CellTraits<TRIANGLE>
+{
+	static const CellType TYPE = TRIANGLE;
+	static const unsigned int DIMENSION = 2;
+	static const unsigned int NUM_VERTICES = 3;
+	static const unsigned int NUM_FACES = 1;
+};
+
+/**
+ * @return The number of vertices of a cell type (runtime version of
+ *  CellTraits::NUM_VERTICES)
+ */
+inline unsigned int numVertices(CellType cellType)
+{
+	switch (cellType) {
+	case TETRAHEDRON:
+		return CellTraits<TETRAHEDRON>::NUM_VERTICES;
+	case HEXAHEDRON:
+		return CellTraits<HEXAHEDRON>::NUM_VERTICES;
+	case PRISM:
+		return CellTraits<PRISM>::NUM_VERTICES;
+	case PYRAMID:
+		return CellTraits<PYRAMID>::NUM_VERTICES;
+	case TRIANGLE:
+		return CellTraits<TRIANGLE>::NUM_VERTICES;
+	default:
+		return 0;
+	}
+}
+
 }
 
-#endif // PUML_ENTITY_H
+#endif // PUML_CELL_TYPE_H
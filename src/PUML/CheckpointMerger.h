@@ -0,0 +1,408 @@
+/**
+ * @file
+ *  This file is part of PUML
+ *
+ *  For conditions of distribution and use, please see the copyright
+ *  notice in the file 'COPYING' at the root directory of this package
+ *  and the copyright notice at https://github.com/TUM-I5/PUML
+ *
+ * @copyright 2013 Technische Universitaet Muenchen
+ * @author Sebastian Rettenberger <rettenbs@in.tum.de>
+ */
+
+#ifndef PUML_CHECKPOINT_MERGER_H
+#define PUML_CHECKPOINT_MERGER_H
+
+#ifdef PARALLEL
+#include <mpi.h>
+#endif // PARALLEL
+
+#include <algorithm>
+#include <list>
+#include <string>
+#include <vector>
+
+#include <netcdf.h>
+
+#include "PUML/MPIElement.h"
+#include "PUML/NetcdfGroup.h"
+#include "PUML/NetcdfPum.h"
+
+namespace PUML
+{
+
+/**
+ * Merges checkpoint files into a single PUM file
+ *
+ * All checkpoint files must have the same groups and entities. The sizes of
+ * all partitions are collected once. Afterwards the merged file is created
+ * with fixed dimensions and each rank copies its checkpoint files with
+ * independent I/O.
+ *
+ * For indexed groups the data of each checkpoint file is stored as one block
+ * and the index is shifted accordingly. Elements that are shared by several
+ * checkpoint files are stored once per checkpoint file.
+ *
+ * Mixed cell groups and time-dependent entities are not supported.
+ *
+ * @see NetcdfPum::createCheckpoint
+ */
+class CheckpointMerger : protected MPIElement
+{
+private:
+	/**
+	 * Groups and entities of the checkpoint files
+	 */
+	struct GroupInfo
+	{
+		std::string name;
+		bool indexed;
+		std::vector<std::string> entities;
+	};
+
+#ifdef PARALLEL
+	MPI_Info m_info;
+#endif // PARALLEL
+
+public:
+	CheckpointMerger()
+#ifdef PARALLEL
+		: m_info(MPI_INFO_NULL)
+#endif // PARALLEL
+	{
+	}
+
+#ifdef PARALLEL
+	/**
+	 * Merges checkpoint files
+	 *
+	 * Checkpoint file i is copied by rank i % size. The number of ranks can
+	 * differ from the number of ranks that wrote the checkpoint. This is a
+	 * collective function.
+	 *
+	 * @param checkpoints The checkpoint files
+	 * @param path The merged file
+	 */
+	bool merge(const std::vector<std::string> &checkpoints, const char* path,
+			MPI_Comm comm, MPI_Info info = MPI_INFO_NULL)
+	{
+		setMPIComm(comm);
+		m_info = info;
+		return mergeFiles(checkpoints, path);
+	}
+#else // PARALLEL
+	/**
+	 * Merges checkpoint files
+	 *
+	 * @param checkpoints The checkpoint files
+	 * @param path The merged file
+	 */
+	bool merge(const std::vector<std::string> &checkpoints, const char* path)
+	{
+		return mergeFiles(checkpoints, path);
+	}
+#endif // PARALLEL
+
+private:
+	bool mergeFiles(const std::vector<std::string> &checkpoints, const char* path)
+	{
+		if (checkpoints.empty())
+			return false;
+
+		// Open the checkpoint files of this rank
+		std::vector<size_t> fileIds;
+		std::list<NetcdfPum> files;
+		std::vector<std::vector<size_t> > partitions;
+		unsigned long numPartitions = 0;
+		bool success = true;
+		for (size_t i = mpiRank(); i < checkpoints.size() && success; i += mpiSize()) {
+			fileIds.push_back(i);
+			files.push_back(NetcdfPum());
+			partitions.push_back(std::vector<size_t>());
+
+			size_t np;
+			success = openCheckpoint(files.back(), checkpoints[i])
+				&& files.back().checkpointPartitions(partitions.back(), np)
+				&& (numPartitions == 0 || numPartitions == np);
+			numPartitions = np;
+		}
+
+		// Get the structure from the first file of this rank
+		NetcdfPum first;
+		std::vector<GroupInfo> groups;
+		if (success) {
+			if (files.empty())
+				success = openCheckpoint(first, checkpoints[0]) && readStructure(first, groups);
+			else
+				success = readStructure(files.front(), groups);
+		}
+
+		if (!agree(success))
+			return false;
+
+#ifdef PARALLEL
+		MPI_Allreduce(MPI_IN_PLACE, &numPartitions, 1, MPI_UNSIGNED_LONG, MPI_MAX, mpiComm());
+#endif // PARALLEL
+
+		// Collect the size of all partitions and of the data of all files
+		// (for indexed groups)
+		size_t stride = numPartitions + checkpoints.size();
+		std::vector<unsigned long> sizes(groups.size() * stride, 0);
+		std::list<NetcdfPum>::iterator file = files.begin();
+		for (size_t f = 0; f < fileIds.size(); f++, file++) {
+			for (size_t g = 0; g < groups.size(); g++) {
+				NetcdfGroup* group = file->getGroup(groups[g].name.c_str());
+				if (!group) {
+					success = false;
+					continue;
+				}
+
+				for (size_t p = 0; p < partitions[f].size(); p++) {
+					if (partitions[f][p] >= numPartitions)
+						success = false;
+					else
+						sizes[g*stride + partitions[f][p]] = group->size(p);
+				}
+				if (groups[g].indexed)
+					sizes[g*stride + numPartitions + fileIds[f]] = group->dataSize();
+			}
+		}
+
+#ifdef PARALLEL
+		MPI_Allreduce(MPI_IN_PLACE, &sizes[0], sizes.size(), MPI_UNSIGNED_LONG, MPI_SUM, mpiComm());
+#endif // PARALLEL
+
+		if (!agree(success))
+			return false;
+
+		// Create the merged file
+		NetcdfPum out;
+#ifdef PARALLEL
+		success = out.create(path, numPartitions, mpiComm(), m_info);
+#else // PARALLEL
+		success = out.create(path, numPartitions);
+#endif // PARALLEL
+
+		NetcdfPum &structure = (files.empty() ? first : files.front());
+		std::vector<NetcdfGroup*> outGroups(groups.size());
+		for (size_t g = 0; g < groups.size() && success; g++) {
+			unsigned long total = 0;
+			for (size_t p = 0; p < numPartitions; p++)
+				total += sizes[g*stride + p];
+
+			if (groups[g].indexed) {
+				unsigned long dataTotal = 0;
+				for (size_t f = 0; f < checkpoints.size(); f++)
+					dataTotal += sizes[g*stride + numPartitions + f];
+				outGroups[g] = out.createGroupIndexed(groups[g].name.c_str(), dataTotal, total);
+			} else
+				outGroups[g] = out.createGroup(groups[g].name.c_str(), total);
+
+			success = outGroups[g] && outGroups[g]->copyDefinition(*structure.getGroup(groups[g].name.c_str()));
+		}
+
+		success = success && out.endDefinition();
+
+		for (size_t g = 0; g < groups.size() && success; g++)
+			success = outGroups[g]->setSizes(&sizes[g*stride]);
+
+		if (!agree(success)) {
+			out.close();
+			return false;
+		}
+
+		// Write the index (collective)
+		unsigned long numLocalPartitions = 0;
+		for (size_t f = 0; f < partitions.size(); f++)
+			numLocalPartitions += partitions[f].size();
+		unsigned long maxLocalPartitions = numLocalPartitions;
+#ifdef PARALLEL
+		MPI_Allreduce(MPI_IN_PLACE, &maxLocalPartitions, 1, MPI_UNSIGNED_LONG, MPI_MAX, mpiComm());
+#endif // PARALLEL
+
+		for (size_t g = 0; g < groups.size(); g++) {
+			if (!groups[g].indexed)
+				continue;
+
+			unsigned long count = 0;
+			file = files.begin();
+			for (size_t f = 0; f < fileIds.size(); f++, file++) {
+				NetcdfGroup* group = file->getGroup(groups[g].name.c_str());
+				unsigned long base = dataBase(sizes, g*stride + numPartitions, fileIds[f]);
+
+				for (size_t p = 0; p < partitions[f].size(); p++, count++) {
+					std::vector<unsigned long> index(std::max(group->size(p), static_cast<size_t>(1)));
+					if (success)
+						success = group->getIndex(p, group->size(p), &index[0]);
+					for (size_t i = 0; i < group->size(p); i++)
+						index[i] += base;
+
+					if (!outGroups[g]->putIndex(partitions[f][p], (success ? group->size(p) : 0), &index[0]))
+						success = false;
+				}
+			}
+
+			// Other ranks may have more partitions
+			unsigned long dummy = 0;
+			for (; count < maxLocalPartitions; count++) {
+				if (!outGroups[g]->putIndex(0, 0, &dummy))
+					success = false;
+			}
+		}
+
+		// Copy the data (independent)
+		file = files.begin();
+		for (size_t f = 0; f < fileIds.size() && success; f++, file++) {
+			for (size_t g = 0; g < groups.size() && success; g++)
+				success = copyGroup(*file->getGroup(groups[g].name.c_str()), groups[g], partitions[f],
+					(groups[g].indexed ? dataBase(sizes, g*stride + numPartitions, fileIds[f]) : 0),
+					*outGroups[g]);
+		}
+
+		success = agree(success);
+
+		return out.close() && success;
+	}
+
+	/**
+	 * Opens a checkpoint file on this rank only
+	 */
+	static bool openCheckpoint(NetcdfPum &pum, const std::string &path)
+	{
+#ifdef PARALLEL
+		return pum.open(path.c_str(), MPI_COMM_SELF);
+#else // PARALLEL
+		return pum.open(path.c_str());
+#endif // PARALLEL
+	}
+
+	/**
+	 * Reads the groups and entities of a checkpoint file
+	 */
+	static bool readStructure(NetcdfPum &pum, std::vector<GroupInfo> &groups)
+	{
+		int numGroups;
+		if (nc_inq_grps(pum.identifier(), &numGroups, 0L) != NC_NOERR)
+			return false;
+		std::vector<int> groupIds(numGroups);
+		if (numGroups > 0 && nc_inq_grps(pum.identifier(), 0L, &groupIds[0]) != NC_NOERR)
+			return false;
+
+		for (std::vector<int>::const_iterator i = groupIds.begin(); i != groupIds.end(); i++) {
+			char name[NC_MAX_NAME+1];
+			if (nc_inq_grpname(*i, name) != NC_NOERR)
+				return false;
+
+			NetcdfGroup* group = pum.getGroup(name);
+			if (!group || group->mixed())
+				return false;
+
+			GroupInfo info;
+			info.name = name;
+			info.indexed = group->indexed();
+
+			int numVars;
+			if (nc_inq_varids(*i, &numVars, 0L) != NC_NOERR)
+				return false;
+			std::vector<int> varIds(numVars);
+			if (numVars > 0 && nc_inq_varids(*i, 0L, &varIds[0]) != NC_NOERR)
+				return false;
+
+			for (std::vector<int>::const_iterator j = varIds.begin(); j != varIds.end(); j++) {
+				if (nc_inq_varname(*i, *j, name) != NC_NOERR)
+					return false;
+				if (group->isInternal(name))
+					continue;
+
+				Entity* entity = group->getEntity(name);
+				if (!entity || entity->timeDependent())
+					return false;
+
+				info.entities.push_back(name);
+			}
+
+			groups.push_back(info);
+		}
+
+		return true;
+	}
+
+	/**
+	 * Copies the entities of one group of a checkpoint file
+	 *
+	 * @param base Position of the data of this file (indexed groups only)
+	 */
+	static bool copyGroup(NetcdfGroup &group, const GroupInfo &info, const std::vector<size_t> &partitions,
+			size_t base, NetcdfGroup &out)
+	{
+		std::vector<char> buf;
+		std::vector<double> min, max;
+
+		for (std::vector<std::string>::const_iterator i = info.entities.begin(); i != info.entities.end(); i++) {
+			Entity* entity = group.getEntity(i->c_str());
+			Entity* outEntity = out.getEntity(i->c_str());
+			if (!entity || !outEntity)
+				return false;
+
+			size_t elementSize = entity->numComponents() * entity->valueSize();
+
+			if (info.indexed) {
+				// Copy all data of this file at once
+				size_t size = group.dataSize();
+				buf.resize(std::max(size * elementSize, static_cast<size_t>(1)));
+				if (size > 0 && (!entity->getaRaw(0, size, &buf[0]) || !outEntity->putaRaw(base, size, &buf[0])))
+					return false;
+			} else {
+				for (size_t p = 0; p < partitions.size(); p++) {
+					size_t size = group.size(p);
+					if (size == 0)
+						continue;
+
+					buf.resize(size * elementSize);
+					if (!entity->getaRaw(group.start(p), size, &buf[0])
+							|| !outEntity->putaRaw(out.start(partitions[p]), size, &buf[0]))
+						return false;
+				}
+			}
+
+			if (entity->hasStatistics()) {
+				min.resize(entity->numComponents());
+				max.resize(entity->numComponents());
+				for (size_t p = 0; p < partitions.size(); p++) {
+					if (!entity->getStatistics(p, &min[0], &max[0])
+							|| !outEntity->putStatistics(partitions[p], &min[0], &max[0]))
+						return false;
+				}
+			}
+		}
+
+		return group.isValid() && out.isValid();
+	}
+
+	/**
+	 * @return The position of the data of a file in an indexed group
+	 */
+	static unsigned long dataBase(const std::vector<unsigned long> &sizes, size_t first, size_t file)
+	{
+		unsigned long base = 0;
+		for (size_t i = 0; i < file; i++)
+			base += sizes[first + i];
+		return base;
+	}
+
+	/**
+	 * @return True if all ranks were successful
+	 */
+	bool agree(bool success)
+	{
+		int s = success;
+#ifdef PARALLEL
+		MPI_Allreduce(MPI_IN_PLACE, &s, 1, MPI_INT, MPI_MIN, mpiComm());
+#endif // PARALLEL
+		return s != 0;
+	}
+};
+
+}
+
+#endif // PUML_CHECKPOINT_MERGER_H
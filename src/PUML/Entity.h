@@ -13,16 +13,32 @@
 #ifndef PUML_ENTITY_H
 #define PUML_ENTITY_H
 
+#ifdef PARALLEL
+#include <mpi.h>
+#endif // PARALLEL
+
+#include <algorithm>
 #include <limits>
+#include <map>
 #include <string>
+#include <utility>
+#include <vector>
 
+#include "PUML/Dimension.h"
+#include "PUML/IOCounters.h"
 #include "PUML/MPIElement.h"
+#include "PUML/PartitionRouter.h"
+#include "PUML/SharedBuffer.h"
 
 namespace PUML
 {
 
 class Entity : protected MPIElement
 {
+	friend class Group;
+	friend class Scanner;
+	template<typename T, size_t... UserDims> friend class TypedEntity;
+
 private:
 	/** Name of this entity */
 	std::string m_name;
@@ -39,6 +55,79 @@ private:
 	/** Pointer to the index entity */
 	Entity* m_index;
 
+	/** Entity that stores the minimum of each partition (or NULL) */
+	Entity* m_statMin;
+
+	/** Entity that stores the maximum of each partition (or NULL) */
+	Entity* m_statMax;
+
+	/** Cached minimum and maximum of all partitions (used for queries) */
+	std::vector<double> m_statCache;
+
+	/** I/O counters of this entity */
+	IOCounters m_counters;
+
+	/** Size of one value in the file (0 if not yet known) */
+	size_t m_valueSize;
+
+	/** True if the entity has a time dimension */
+	bool m_timeDependent;
+
+	/** Time step of the next access (time-dependent entities only) */
+	size_t m_step;
+
+	/** Forwards partition based accesses to a subfile (or NULL) */
+	PartitionRouter* m_router;
+
+	/** Name of the group (required for routing) */
+	std::string m_groupName;
+
+	/** Select collective or independent I/O for each partition access */
+	bool m_adaptive;
+
+	/** The current I/O mode of the variable */
+	bool m_ioCollective;
+
+	/**
+	 * Measured performance of both I/O modes for one class of accesses
+	 * (index 0: independent, 1: collective)
+	 */
+	struct AdaptiveStats
+	{
+		unsigned long calls[2];
+		double time[2];
+		double bytes[2];
+
+		AdaptiveStats()
+		{
+			for (int i = 0; i < 2; i++) {
+				calls[i] = 0;
+				time[i] = bytes[i] = 0;
+			}
+		}
+	};
+
+	/** Performance of all classes of accesses (adaptive mode only) */
+	std::map<int, AdaptiveStats> m_adaptiveStats;
+
+	/** Class of the last adaptive access (-1 if not measured) */
+	int m_adaptiveClass;
+
+	/** Bytes of the last adaptive access (all ranks) */
+	double m_adaptiveBytes;
+
+	/** Start of the current adaptive access on this rank */
+	double m_adaptiveStart;
+
+	/** Duration of the last adaptive access on this rank */
+	double m_adaptiveTime;
+
+	/** Number of calls per class before the faster mode is selected */
+	static const unsigned long ADAPTIVE_TRIALS = 2;
+
+	/** Interval (in calls per class) for trying the slower mode again */
+	static const unsigned long ADAPTIVE_RETRY = 16;
+
 	/**
 	 * Helper structure to sum up contiguous indices
 	 */
@@ -54,7 +143,10 @@ private:
 
 public:
 	Entity()
-		: m_collective(false), m_offset(0L), m_index(0L)
+		: m_collective(false), m_offset(0L), m_index(0L), m_statMin(0L), m_statMax(0L),
+		  m_valueSize(0), m_timeDependent(false), m_step(0), m_router(0L),
+		  m_adaptive(false), m_ioCollective(false), m_adaptiveClass(-1), m_adaptiveBytes(0),
+		  m_adaptiveStart(0), m_adaptiveTime(0)
 	{
 	}
 
@@ -62,7 +154,11 @@ public:
 			const std::vector<size_t> &offset, Entity* index, MPIElement &comm)
 		: MPIElement(comm),
 		  m_name(name), m_collective(false),
-		  m_dimSize(numUserDimensions+1), m_offset(&offset), m_index(index)
+		  m_dimSize(numUserDimensions+1), m_offset(&offset), m_index(index),
+		  m_statMin(0L), m_statMax(0L), m_valueSize(0), m_timeDependent(false), m_step(0),
+		  m_router(0L),
+		  m_adaptive(false), m_ioCollective(false), m_adaptiveClass(-1), m_adaptiveBytes(0),
+		  m_adaptiveStart(0), m_adaptiveTime(0)
 	{
 		for (size_t i = 0; i < numUserDimensions; i++) {
 			// Set the size of the user dimension, we need them later
@@ -75,7 +171,11 @@ public:
 	 */
 	Entity(const std::vector<size_t> &offset, Entity* index, MPIElement &comm)
 		: MPIElement(comm),
-		  m_collective(false), m_offset(&offset), m_index(index)
+		  m_collective(false), m_offset(&offset), m_index(index),
+		  m_statMin(0L), m_statMax(0L), m_valueSize(0), m_timeDependent(false), m_step(0),
+		  m_router(0L),
+		  m_adaptive(false), m_ioCollective(false), m_adaptiveClass(-1), m_adaptiveBytes(0),
+		  m_adaptiveStart(0), m_adaptiveTime(0)
 	{
 	}
 
@@ -89,9 +189,60 @@ public:
 	virtual bool setCollective(bool collective)
 	{
 		m_collective = collective;
+		m_ioCollective = collective;
+		if (!collective)
+			m_adaptive = false;
 		return true;
 	}
 
+	/**
+	 * Activate/Deactivate adaptive mode
+	 *
+	 * As in collective mode, all ranks have to call get() and put(). For each
+	 * call, the ranks agree on collective or independent I/O (one additional
+	 * small Allreduce). The mode depends on the class of the access (bytes per
+	 * contiguous range and number of ranks with data). Both modes are tried
+	 * for each class, afterwards the faster mode (average time per byte over all
+	 * ranks) is used. The slower mode is tried again from time to time.
+	 *
+	 * Only get() and put() with partitions adapt the mode, all other
+	 * functions use the mode of the last call. Time-dependent entities always
+	 * use collective mode. In the serial version this has no effect.
+	 */
+	virtual bool setAdaptive(bool adaptive)
+	{
+		if (adaptive && m_timeDependent)
+			return false;
+
+		if (!setCollective(adaptive))
+			return false;
+
+		m_adaptive = adaptive;
+		m_adaptiveStats.clear();
+		m_adaptiveClass = -1;
+		m_adaptiveTime = 0;
+
+		return true;
+	}
+
+	/**
+	 * @return True if the entity is in adaptive mode
+	 */
+	bool adaptive() const
+	{
+		return m_adaptive;
+	}
+
+	/**
+	 * @return True if the last get() or put() used collective I/O
+	 *
+	 * @see setAdaptive
+	 */
+	bool ioCollective() const
+	{
+		return m_ioCollective;
+	}
+
 	/**
 	 * Writes the values for one partition the file. Make sure that the size of the partition is already determined.
 	 *
@@ -102,54 +253,160 @@ public:
 	template<typename T>
 	bool put(size_t partition, size_t size, const T* values)
 	{
+		if (m_router) {
+			Entity* entity = route(partition);
+			return entity && entity->put(partition, size, values);
+		}
+
 		if (!isPartitionOffsetSet(partition))
 			return false;
 
-		if (!indexed())
-			return puta((*m_offset)[partition], size, values);
+		size_t n = numComponents();
+
+		if (!indexed()) {
+			if (m_adaptive) {
+				if (!selectMode(size * n * sizeof(T), 1))
+					return false;
+				if (!m_ioCollective && size == 0)
+					return putStatistics(partition, size, values);
+			}
+
+			if (!puta((*m_offset)[partition], size, values))
+				return false;
+			finishMode();
+
+			return putStatistics(partition, size, values);
+		}
 
 		// compute position and count of values
 		std::vector<IndexedRange> valuePos;
 		size_t accesses;
 		if (!getValuePos(partition, size, valuePos, accesses))
 			return false;
+		if (m_adaptive) {
+			if (!selectMode(size * n * sizeof(T), (size > 0 ? valuePos.size() : 0)))
+				return false;
+			if (!m_ioCollective) {
+				if (size == 0)
+					return putStatistics(partition, size, values);
+				// No padding required
+				accesses = valuePos.size();
+			}
+		}
 
-
+		if (!_beginBatch())
+			return false;
 		for (size_t i = 0; i < accesses; i++) {
 			// Due to collective I/O accesses might be larger than valuePos.size()
 			IndexedRange& v = valuePos[i % valuePos.size()];
-			if (!puta(v.pos, v.count, &values[v.localPos]))
+			if (i >= valuePos.size())
+				m_counters.paddingAccesses++;
+			if (!puta(v.pos, v.count, &values[v.localPos * n])) {
+				_endBatch();
 				return false;
+			}
 		}
+		if (!_endBatch())
+			return false;
+		finishMode();
 
-		return true;
+		return putStatistics(partition, size, values);
 	}
 
 	template<typename T>
 	bool get(size_t partition, size_t size, T* values)
 	{
+		if (m_router) {
+			Entity* entity = route(partition);
+			return entity && entity->get(partition, size, values);
+		}
+
 		if (!isPartitionOffsetSet(partition))
 			return false;
 
-		if (!indexed())
-			return geta((*m_offset)[partition], size, values);
+		size_t n = numComponents();
+
+		if (!indexed()) {
+			if (!m_adaptive)
+				return geta((*m_offset)[partition], size, values);
+
+			if (!selectMode(size * n * sizeof(T), 1))
+				return false;
+			if ((m_ioCollective || size > 0) && !geta((*m_offset)[partition], size, values))
+				return false;
+			finishMode();
+
+			return true;
+		}
 
 		// compute position and count of values
 		std::vector<IndexedRange> valuePos;
 		size_t accesses;
 		if (!getValuePos(partition, size, valuePos, accesses))
 			return false;
+		if (m_adaptive) {
+			if (!selectMode(size * n * sizeof(T), (size > 0 ? valuePos.size() : 0)))
+				return false;
+			if (!m_ioCollective) {
+				if (size == 0)
+					return true;
+				// No padding required
+				accesses = valuePos.size();
+			}
+		}
 
+		if (!_beginBatch())
+			return false;
 		for (size_t i = 0; i < accesses; i++) {
 			// Due to collective I/O accesses might be larger than valuePos.size()
 			IndexedRange& v = valuePos[i % valuePos.size()];
-			if (!geta(v.pos, v.count, &values[v.localPos]))
+			if (i >= valuePos.size())
+				m_counters.paddingAccesses++;
+			if (!geta(v.pos, v.count, &values[v.localPos * n])) {
+				_endBatch();
 				return false;
+			}
 		}
+		if (!_endBatch())
+			return false;
+		finishMode();
 
 		return true;
 	}
 
+	/**
+	 * Writes the values of one partition for a time step
+	 *
+	 * Only for time-dependent entities. Appending a new step extends the
+	 * time dimension; in the parallel version this requires collective mode.
+	 *
+	 * @see Group::createTimeEntity
+	 */
+	template<typename T>
+	bool put(size_t step, size_t partition, size_t size, const T* values)
+	{
+		if (!m_timeDependent)
+			return false;
+
+		m_step = step;
+		return put(partition, size, values);
+	}
+
+	/**
+	 * Reads the values of one partition for a time step
+	 *
+	 * @see put(size_t, size_t, size_t, const T*)
+	 */
+	template<typename T>
+	bool get(size_t step, size_t partition, size_t size, T* values)
+	{
+		if (!m_timeDependent)
+			return false;
+
+		m_step = step;
+		return get(partition, size, values);
+	}
+
 	/**
 	 * @return All values of a partition
 	 */
@@ -162,12 +419,274 @@ public:
 		return get(partition, partitionSize(partition), values);
 	}
 
+	/**
+	 * Reads the values of arbitrary elements
+	 *
+	 * The ids are sorted and consecutive ids are combined into a single access.
+	 * The values are returned in the order of the ids. For indexed groups the
+	 * ids are the positions in the file (the values of the index).
+	 *
+	 * With subfiles, the elements are read from the subfiles of their
+	 * partitions. Indexed groups are not supported with subfiles (the index
+	 * refers to the subfile).
+	 *
+	 * In collective mode all ranks have to call this function.
+	 *
+	 * @param ids The global ids of the elements (the position in the file)
+	 * @param count Number of ids
+	 * @param values Buffer for count elements
+	 */
+	template<typename T>
+	bool gather(const unsigned long* ids, size_t count, T* values)
+	{
+		return gatherRaw(ids, count, values);
+	}
+
+#ifdef PARALLEL
+	/**
+	 * Reads the values of arbitrary elements. Requests are sent to the rank
+	 * that owns the partition of the element (partition % number of ranks),
+	 * which reads all requested elements with few accesses.
+	 *
+	 * This is a collective function. For indexed groups and with subfiles the
+	 * values are read by the requesting rank.
+	 *
+	 * @see gather
+	 */
+	template<typename T>
+	bool gatherDistributed(const unsigned long* ids, size_t count, T* values)
+	{
+		if (indexed() || m_router)
+			return gather(ids, count, values);
+
+		std::vector<std::pair<unsigned long, size_t> > order(count);
+		for (size_t i = 0; i < count; i++)
+			order[i] = std::make_pair(ids[i], i);
+		std::sort(order.begin(), order.end());
+
+		// Find the owner of each element
+		std::vector<int> owner(count);
+		std::vector<int> sendCounts(mpiSize(), 0);
+		size_t partition = 0;
+		int success = 1;
+		for (size_t i = 0; i < count; i++) {
+			// Ids are sorted -> continue the search at the last partition
+			partition = std::upper_bound(m_offset->begin()+partition, m_offset->end(), order[i].first)
+				- m_offset->begin() - 1;
+			if (partition >= m_offset->size()-1) {
+				success = 0;
+				break;
+			}
+
+			owner[i] = partition % mpiSize();
+			sendCounts[owner[i]]++;
+		}
+
+		// All ranks have to fail, otherwise the exchange deadlocks
+		{
+			IOTimer timer(m_counters.mpiTime);
+			MPI_Allreduce(MPI_IN_PLACE, &success, 1, MPI_INT, MPI_MIN, mpiComm());
+		}
+		if (!success)
+			return false;
+
+		std::vector<int> sendDispls(mpiSize()+1, 0);
+		for (int i = 0; i < mpiSize(); i++)
+			sendDispls[i+1] = sendDispls[i] + sendCounts[i];
+
+		// Sort requests by owner
+		std::vector<unsigned long> sendIds(count);
+		std::vector<size_t> sendPos(count);
+		std::vector<int> pos(sendDispls.begin(), sendDispls.end()-1);
+		for (size_t i = 0; i < count; i++) {
+			sendIds[pos[owner[i]]] = order[i].first;
+			sendPos[pos[owner[i]]] = order[i].second;
+			pos[owner[i]]++;
+		}
+
+		double start = IOCounters::time();
+		std::vector<int> recvCounts(mpiSize());
+		MPI_Alltoall(&sendCounts[0], 1, MPI_INT, &recvCounts[0], 1, MPI_INT, mpiComm());
+		std::vector<int> recvDispls(mpiSize()+1, 0);
+		for (int i = 0; i < mpiSize(); i++)
+			recvDispls[i+1] = recvDispls[i] + recvCounts[i];
+
+		std::vector<unsigned long> recvIds(recvDispls.back());
+		MPI_Alltoallv(sendIds.empty() ? 0L : &sendIds[0], &sendCounts[0], &sendDispls[0], MPI_UNSIGNED_LONG,
+			recvIds.empty() ? 0L : &recvIds[0], &recvCounts[0], &recvDispls[0], MPI_UNSIGNED_LONG,
+			mpiComm());
+		m_counters.mpiTime += IOCounters::time() - start;
+
+		// Read the requested values
+		size_t n = numComponents();
+		std::vector<T> recvValues(recvIds.size() * n);
+		success = gather(recvIds.empty() ? 0L : &recvIds[0], recvIds.size(), recvValues.empty() ? 0L : &recvValues[0]);
+
+		// Send the values back (as bytes)
+		int bytes = n * sizeof(T);
+		for (int i = 0; i <= mpiSize(); i++) {
+			if (i < mpiSize()) {
+				sendCounts[i] *= bytes;
+				recvCounts[i] *= bytes;
+			}
+			sendDispls[i] *= bytes;
+			recvDispls[i] *= bytes;
+		}
+
+		std::vector<T> sendValues(count * n);
+		{
+			IOTimer timer(m_counters.mpiTime);
+			MPI_Alltoallv(recvValues.empty() ? 0L : &recvValues[0], &recvCounts[0], &recvDispls[0], MPI_BYTE,
+				sendValues.empty() ? 0L : &sendValues[0], &sendCounts[0], &sendDispls[0], MPI_BYTE,
+				mpiComm());
+		}
+
+		{
+			IOTimer timer(m_counters.mpiTime);
+			MPI_Allreduce(MPI_IN_PLACE, &success, 1, MPI_INT, MPI_MIN, mpiComm());
+		}
+		if (!success)
+			return false;
+
+		for (size_t i = 0; i < count; i++)
+			std::copy(&sendValues[i*n], &sendValues[i*n] + n, &values[sendPos[i]*n]);
+
+		return true;
+	}
+
+	/**
+	 * Reads the values of a partition once per node. Only the first rank
+	 * of each node reads the values into shared memory, all other ranks
+	 * on the node get a read-only pointer to the same memory.
+	 *
+	 * This is a collective function. All ranks on a node must request the
+	 * same partition.
+	 *
+	 * @param buffer The buffer will be (re)allocated
+	 */
+	template<typename T>
+	bool getShared(size_t partition, size_t size, SharedBuffer<T> &buffer)
+	{
+		if (m_router) {
+			Entity* entity = route(partition);
+			return entity && entity->getShared(partition, size, buffer);
+		}
+
+		if (!isPartitionOffsetSet(partition))
+			return false;
+
+		if (!indexed())
+			return getaShared((*m_offset)[partition], size, buffer);
+
+		if (!buffer.allocate(size * numComponents(), mpiComm()))
+			return false;
+
+		int success;
+		if (buffer.nodeMaster() && size > 0)
+			success = get(partition, size, buffer.writableData());
+		else
+			success = getNothing(partition);
+
+		return syncShared(success, buffer);
+	}
+
+	/**
+	 * @see getShared
+	 */
+	template<typename T>
+	bool getShared(size_t partition, SharedBuffer<T> &buffer)
+	{
+		if (!isPartitionSizeSet(partition))
+			return false;
+
+		return getShared(partition, partitionSize(partition), buffer);
+	}
+
+	/**
+	 * Get values at absolute position once per node
+	 *
+	 * @see getShared
+	 */
+	template<typename T>
+	bool getaShared(size_t start, size_t size, SharedBuffer<T> &buffer)
+	{
+		if (m_router)
+			// Not supported with subfiles
+			return false;
+
+		if (!buffer.allocate(size * numComponents(), mpiComm()))
+			return false;
+
+		int success = 1;
+		if (buffer.nodeMaster() && size > 0)
+			success = geta(start, size, buffer.writableData());
+		else if (m_collective) {
+			// Take part in the collective call
+			T dummy;
+			m_counters.paddingAccesses++;
+			success = geta(0, 0, &dummy);
+		}
+
+		return syncShared(success, buffer);
+	}
+#endif // PARALLEL
+
+	/**
+	 * Get values at absolute position without type conversion
+	 *
+	 * @param values Buffer for size * numComponents() values with valueSize() bytes
+	 */
+	bool getaRaw(size_t start, size_t size, void* values)
+	{
+		if (m_router)
+			// Not supported with subfiles
+			return false;
+
+		std::vector<size_t> s(m_dimSize.size(), 0);
+		s[0] = start;
+
+		// Set partition dimension for this call (not threadsafe)
+		m_dimSize[0] = size;
+
+		m_counters.getCalls++;
+		m_counters.getBytes += size * numComponents() * valueSize();
+		IOTimer timer(m_counters.ioTime);
+		return _geta(&s[0], &m_dimSize[0], values);
+	}
+
+	/**
+	 * Put values at absolute position without type conversion
+	 *
+	 * @param values size * numComponents() values with valueSize() bytes
+	 */
+	bool putaRaw(size_t start, size_t size, const void* values)
+	{
+		if (m_router)
+			// Not supported with subfiles
+			return false;
+
+		std::vector<size_t> s(m_dimSize.size(), 0);
+		s[0] = start;
+
+		// Set partition dimension for this call (not threadsafe)
+		m_dimSize[0] = size;
+
+		m_counters.putCalls++;
+		m_counters.putBytes += size * numComponents() * valueSize();
+		IOTimer timer(m_counters.ioTime);
+		return _puta(&s[0], &m_dimSize[0], values);
+	}
+
 	/**
 	 * Put values at absolute position
 	 */
 	template<typename T>
 	bool puta(size_t start, size_t size, const T* values)
 	{
+		if (m_router)
+			// Not supported with subfiles
+			return false;
+
 		// Use std::vector to avoid memory leaks
 		std::vector<size_t> s(m_dimSize.size(), 0);
 		s[0] = start;
@@ -175,6 +694,8 @@ public:
 		// Set partition dimension for this call (not threadsafe)
 		m_dimSize[0] = size;
 
+		countAccess<T>(true, &m_dimSize[0]);
+		IOTimer timer(m_counters.ioTime);
 		return __puta(&s[0], &m_dimSize[0], values);
 	}
 
@@ -184,6 +705,10 @@ public:
 	template<typename T>
 	bool geta(size_t start, size_t size, T* values)
 	{
+		if (m_router)
+			// Not supported with subfiles
+			return false;
+
 		// Use std::vector to avoid memory leaks
 		std::vector<size_t> s(m_dimSize.size(), 0);
 		s[0] = start;
@@ -191,14 +716,247 @@ public:
 		// Set partition dimension for this call (not threadsafe)
 		m_dimSize[0] = size;
 
+		countAccess<T>(false, &m_dimSize[0]);
+		IOTimer timer(m_counters.ioTime);
 		return _geta(&s[0], &m_dimSize[0], values);
 	}
 
+	/**
+	 * Put values at absolute position but only the first <code>numValues</code>
+	 * values of the last user dimension
+	 *
+	 * Used to store blocks of cells with less vertices than the maximum in mixed
+	 * cell groups.
+	 */
+	template<typename T>
+	bool putaPartial(size_t start, size_t size, size_t numValues, const T* values)
+	{
+		if (m_router)
+			// Not supported with subfiles
+			return false;
+
+		if (m_dimSize.size() < 2 || numValues > m_dimSize.back())
+			return false;
+
+		std::vector<size_t> s(m_dimSize.size(), 0);
+		s[0] = start;
+		std::vector<size_t> c(m_dimSize);
+		c[0] = size;
+		c.back() = numValues;
+
+		countAccess<T>(true, &c[0]);
+		IOTimer timer(m_counters.ioTime);
+		return __puta(&s[0], &c[0], values);
+	}
+
+	/**
+	 * Get values at absolute position but only the first <code>numValues</code>
+	 * values of the last user dimension
+	 *
+	 * @see putaPartial
+	 */
+	template<typename T>
+	bool getaPartial(size_t start, size_t size, size_t numValues, T* values)
+	{
+		if (m_router)
+			// Not supported with subfiles
+			return false;
+
+		if (m_dimSize.size() < 2 || numValues > m_dimSize.back())
+			return false;
+
+		std::vector<size_t> s(m_dimSize.size(), 0);
+		s[0] = start;
+		std::vector<size_t> c(m_dimSize);
+		c[0] = size;
+		c.back() = numValues;
+
+		countAccess<T>(false, &c[0]);
+		IOTimer timer(m_counters.ioTime);
+		return __geta(&s[0], &c[0], values);
+	}
+
 	const char* name() const
 	{
 		return m_name.c_str();
 	}
 
+	/**
+	 * @return True if the entity has a time dimension
+	 *
+	 * @see Group::createTimeEntity
+	 */
+	bool timeDependent() const
+	{
+		return m_timeDependent;
+	}
+
+	/**
+	 * @return True if minimum and maximum are stored for each partition
+	 *
+	 * @see Group::addStatistics
+	 */
+	bool hasStatistics() const
+	{
+		return m_statMin != 0L;
+	}
+
+	/**
+	 * @return The size of one value in the file (in bytes)
+	 */
+	size_t valueSize()
+	{
+		if (m_valueSize == 0)
+			m_valueSize = _valueSize();
+		return m_valueSize;
+	}
+
+	/**
+	 * @return The number of components of one element (product of all user dimensions)
+	 */
+	size_t numComponents() const
+	{
+		size_t n = 1;
+		for (size_t i = 1; i < m_dimSize.size(); i++)
+			n *= m_dimSize[i];
+		return n;
+	}
+
+	/**
+	 * Reads the minimum and maximum of each component in a partition. For
+	 * coordinate entities this is the bounding box of the partition.
+	 *
+	 * @param min Buffer for numComponents() values
+	 * @param max Buffer for numComponents() values
+	 */
+	bool getStatistics(size_t partition, double* min, double* max)
+	{
+		if (m_router) {
+			Entity* entity = route(partition);
+			return entity && entity->getStatistics(partition, min, max);
+		}
+
+		if (!hasStatistics())
+			return false;
+
+		if (!m_statMin->geta(partition, 1, min))
+			return false;
+
+		return m_statMax->geta(partition, 1, max);
+	}
+
+	/**
+	 * Writes the minimum and maximum of each component in a partition
+	 *
+	 * Entity::put updates the statistics automatically. This is only required
+	 * if the values are written without type information (e.g. with putaRaw).
+	 *
+	 * @param min numComponents() values
+	 * @param max numComponents() values
+	 */
+	bool putStatistics(size_t partition, const double* min, const double* max)
+	{
+		if (m_router) {
+			Entity* entity = route(partition);
+			return entity && entity->putStatistics(partition, min, max);
+		}
+
+		if (!hasStatistics())
+			return false;
+
+		if (!m_statMin->puta(partition, 1, min))
+			return false;
+		if (!m_statMax->puta(partition, 1, max))
+			return false;
+
+		// Invalidate cache
+		m_statCache.clear();
+
+		return true;
+	}
+
+	/**
+	 * Selects all partitions that may contain elements inside a box. Uses only
+	 * the stored statistics, no bulk data is read.
+	 *
+	 * A partition is selected if [min, max] of the partition intersects
+	 * [queryMin, queryMax] in all components. Use queryMin == queryMax
+	 * to find partitions that may contain a specific value.
+	 *
+	 * @param queryMin Lower bounds, numComponents() values
+	 * @param queryMax Upper bounds, numComponents() values
+	 * @param partitions The selected partitions in increasing order
+	 */
+	bool selectPartitions(const double* queryMin, const double* queryMax, std::vector<size_t> &partitions)
+	{
+		if (!hasStatistics())
+			return false;
+
+		size_t numPartitions = m_offset->size() - 1;
+		size_t n = numComponents();
+
+		if (m_statCache.size() != 2*numPartitions*n) {
+			m_statCache.resize(2*numPartitions*n);
+			if (!loadStatistics(numPartitions)) {
+				m_statCache.clear();
+				return false;
+			}
+		}
+
+		const double* min = &m_statCache[0];
+		const double* max = &m_statCache[numPartitions*n];
+
+		partitions.clear();
+		for (size_t i = 0; i < numPartitions; i++) {
+			bool intersects = true;
+			for (size_t j = 0; j < n; j++)
+				intersects &= (min[i*n+j] <= queryMax[j]) & (max[i*n+j] >= queryMin[j]);
+
+			if (intersects)
+				partitions.push_back(i);
+		}
+
+		return true;
+	}
+
+	/**
+	 * Set the entities that store minimum and maximum of each partition
+	 *
+	 * @internal
+	 */
+	void setStatistics(Entity* statMin, Entity* statMax)
+	{
+		m_statMin = statMin;
+		m_statMax = statMax;
+		m_statCache.clear();
+	}
+
+	/**
+	 * Forward all partition based accesses to another file
+	 *
+	 * @param group The name of the group of this entity
+	 *
+	 * @internal
+	 */
+	void setRouter(PartitionRouter* router, const char* group)
+	{
+		m_router = router;
+		m_groupName = group;
+	}
+
+	/**
+	 * @return The I/O counters of this entity (on this rank)
+	 */
+	const IOCounters& counters() const
+	{
+		return m_counters;
+	}
+
+	void resetCounters()
+	{
+		m_counters.reset();
+	}
+
 protected:
 	/**
 	 * @return The number of dimension of this entity
@@ -223,6 +981,25 @@ protected:
 		m_name = name;
 	}
 
+	void setTimeDependent()
+	{
+		m_timeDependent = true;
+	}
+
+	/**
+	 * @return The time step of the current access. All accesses without a
+	 *  step use the step of the last access.
+	 */
+	size_t step() const
+	{
+		return m_step;
+	}
+
+	/**
+	 * @return The size of one value in the file (in bytes)
+	 */
+	virtual size_t _valueSize() = 0;
+
 	virtual bool _puta(const size_t* start, const size_t* size, const void* values) = 0;
 	virtual bool _puta_schar(const size_t* start, const size_t* size, const signed char* values) = 0;
 	virtual bool _puta_uchar(const size_t* start, const size_t* size, const unsigned char* values) = 0;
@@ -249,6 +1026,33 @@ protected:
 	virtual bool _geta_longlong(const size_t* start, const size_t* size, long long* values) = 0;
 	virtual bool _geta_ulonglong(const size_t* start, const size_t* size, unsigned long long* values) = 0;
 
+	/**
+	 * Starts a batch of accesses. Backends with nonblocking I/O may defer
+	 * the completion of all accesses until the end of the batch; the buffers
+	 * must stay valid until then. Batches can be nested.
+	 */
+	virtual bool _beginBatch()
+	{
+		return true;
+	}
+
+	/**
+	 * Completes all accesses of the batch
+	 */
+	virtual bool _endBatch()
+	{
+		return true;
+	}
+
+	/**
+	 * Switches the I/O mode of the variable without changing the
+	 * semantics of the entity (used by the adaptive mode)
+	 */
+	virtual bool _setIOMode(bool collective)
+	{
+		return true;
+	}
+
 private:
 	bool isPartitionOffsetSet(size_t partition)
 	{
@@ -275,6 +1079,221 @@ private:
 		return m_index != 0L;
 	}
 
+	/**
+	 * The time step and the access mode are copied to the returned entity.
+	 *
+	 * @param partition The partition in this file, replaced by the partition in the returned entity
+	 * @return The entity that stores the partition
+	 */
+	Entity* route(size_t &partition)
+	{
+		Entity* entity = m_router->routeEntity(m_groupName.c_str(), name(), partition);
+		if (!entity)
+			return 0L;
+
+		entity->m_step = m_step;
+		if (entity->m_adaptive != m_adaptive && !entity->setAdaptive(m_adaptive))
+			return 0L;
+		if (entity->m_collective != m_collective && !entity->setCollective(m_collective))
+			return 0L;
+
+		return entity;
+	}
+
+	/**
+	 * Computes and writes the minimum and maximum of a partition
+	 */
+	template<typename T>
+	bool putStatistics(size_t partition, size_t size, const T* values)
+	{
+		if (!hasStatistics() || size == 0)
+			return true;
+
+		size_t n = numComponents();
+		std::vector<double> min(n);
+		std::vector<double> max(n);
+		for (size_t j = 0; j < n; j++)
+			min[j] = max[j] = values[j];
+
+		for (size_t i = 1; i < size; i++) {
+			for (size_t j = 0; j < n; j++) {
+				double v = values[i*n+j];
+				min[j] = std::min(min[j], v);
+				max[j] = std::max(max[j], v);
+			}
+		}
+
+		if (!m_statMin->puta(partition, 1, &min[0]))
+			return false;
+		if (!m_statMax->puta(partition, 1, &max[0]))
+			return false;
+
+		// Invalidate cache
+		m_statCache.clear();
+
+		return true;
+	}
+
+	/**
+	 * Reads the statistics of all partitions into the cache
+	 */
+	bool loadStatistics(size_t numPartitions)
+	{
+		size_t n = numComponents();
+
+		if (!m_router) {
+			if (!m_statMin->geta(0, numPartitions, &m_statCache[0]))
+				return false;
+			return m_statMax->geta(0, numPartitions, &m_statCache[numPartitions*n]);
+		}
+
+		// The statistics are stored in the subfiles
+		for (size_t i = 0; i < numPartitions; i++) {
+			if (!getStatistics(i, &m_statCache[i*n], &m_statCache[(numPartitions+i)*n]))
+				return false;
+		}
+
+		return true;
+	}
+
+	/**
+	 * Implementation of gather without type conversion
+	 *
+	 * @param values Buffer for count * numComponents() * valueSize() bytes
+	 */
+	bool gatherRaw(const unsigned long* ids, size_t count, void* values)
+	{
+		if (m_router)
+			return gatherRouted(ids, count, values);
+
+		std::vector<std::pair<unsigned long, size_t> > order(count);
+		for (size_t i = 0; i < count; i++)
+			order[i] = std::make_pair(ids[i], i);
+		std::sort(order.begin(), order.end());
+
+		// Find the consecutive ranges (duplicates are allowed)
+		std::vector<size_t> ranges;
+		for (size_t i = 0; i < count; i++) {
+			if (i == 0 || order[i].first > order[i-1].first+1)
+				ranges.push_back(i);
+		}
+		ranges.push_back(count);
+		unsigned long accesses = ranges.size()-1;
+
+#ifdef PARALLEL
+		if (m_collective) {
+			// Other ranks may require more accesses
+			IOTimer timer(m_counters.mpiTime);
+			MPI_Allreduce(MPI_IN_PLACE, &accesses, 1, MPI_UNSIGNED_LONG, MPI_MAX, mpiComm());
+		}
+#endif // PARALLEL
+
+		size_t n = numComponents() * valueSize();
+		char* v = static_cast<char*>(values);
+		std::vector<char> buf(std::max(n, static_cast<size_t>(1)));
+		bool success = true;
+
+		for (size_t r = 0; r < accesses; r++) {
+			if (r >= ranges.size()-1) {
+				// Take part in the collective access
+				m_counters.paddingAccesses++;
+				success = getaRaw(0, 0, &buf[0]) && success;
+				continue;
+			}
+
+			size_t i = ranges[r];
+			size_t j = ranges[r+1];
+			size_t start = order[i].first;
+			size_t size = order[j-1].first - start + 1;
+			buf.resize(size*n);
+			if (!getaRaw(start, size, &buf[0])) {
+				success = false;
+				continue;
+			}
+
+			for (size_t k = i; k < j; k++)
+				std::copy(&buf[(order[k].first-start)*n], &buf[(order[k].first-start)*n] + n,
+					&v[order[k].second*n]);
+		}
+
+		return success;
+	}
+
+	/**
+	 * Implementation of gatherRaw for files with subfiles. The ids are
+	 * grouped by partition and read from the subfiles.
+	 */
+	bool gatherRouted(const unsigned long* ids, size_t count, void* values)
+	{
+		if (indexed())
+			// The index refers to the subfile
+			return false;
+
+		std::vector<std::pair<unsigned long, size_t> > order(count);
+		for (size_t i = 0; i < count; i++)
+			order[i] = std::make_pair(ids[i], i);
+		std::sort(order.begin(), order.end());
+
+		size_t n = numComponents() * valueSize();
+		char* v = static_cast<char*>(values);
+
+		std::vector<unsigned long> subIds;
+		std::vector<char> buf;
+		size_t i = 0;
+		while (i < count) {
+			size_t partition = std::upper_bound(m_offset->begin(), m_offset->end(), order[i].first)
+				- m_offset->begin() - 1;
+			if (partition >= m_offset->size()-1)
+				return false;
+
+			size_t start = (*m_offset)[partition];
+			size_t end = (*m_offset)[partition+1];
+			size_t j = i;
+			while (j < count && order[j].first < end)
+				j++;
+
+			Entity* entity = route(partition);
+			if (!entity)
+				return false;
+
+			// Position of the elements in the subfile
+			subIds.resize(j-i);
+			for (size_t k = i; k < j; k++)
+				subIds[k-i] = order[k].first - start + (*entity->m_offset)[partition];
+			buf.resize((j-i)*n);
+			if (!entity->gatherRaw(&subIds[0], j-i, &buf[0]))
+				return false;
+
+			for (size_t k = i; k < j; k++)
+				std::copy(&buf[(k-i)*n], &buf[(k-i)*n] + n, &v[order[k].second*n]);
+
+			i = j;
+		}
+
+		return true;
+	}
+
+	/**
+	 * Counts a read or write access
+	 *
+	 * @param count Number of values in each dimension
+	 */
+	template<typename T>
+	void countAccess(bool put, const size_t* count)
+	{
+		unsigned long bytes = sizeof(T);
+		for (size_t i = 0; i < m_dimSize.size(); i++)
+			bytes *= count[i];
+
+		if (put) {
+			m_counters.putCalls++;
+			m_counters.putBytes += bytes;
+		} else {
+			m_counters.getCalls++;
+			m_counters.getBytes += bytes;
+		}
+	}
+
 	template<typename T>
 	bool __puta(const size_t* start, const size_t* size, const T* values)
 	{
@@ -287,17 +1306,143 @@ private:
 		return _geta(start, size, values);
 	}
 
+#ifdef PARALLEL
+	/**
+	 * Issues the same collective calls as get() for an indexed entity
+	 * but does not read any values
+	 */
+	bool getNothing(size_t partition)
+	{
+		// Zero-size accesses do not touch the buffer
+		double dummy;
+
+		// The index is always read in collective mode
+		m_index->m_counters.paddingAccesses++;
+		if (!m_index->geta(0, 0, &dummy))
+			return false;
+
+		unsigned long maxAccesses = 0;
+		if (m_collective) {
+			IOTimer timer(m_counters.mpiTime);
+			MPI_Allreduce(MPI_IN_PLACE, &maxAccesses, 1, MPI_UNSIGNED_LONG, MPI_MAX, mpiComm());
+		}
+
+		for (unsigned long i = 0; i < maxAccesses; i++) {
+			m_counters.paddingAccesses++;
+			if (!geta(0, 0, &dummy))
+				return false;
+		}
+
+		return true;
+	}
+
+	/**
+	 * Makes the values of the shared buffer visible and distributes the
+	 * result of the first rank on the node
+	 */
+	template<typename T>
+	bool syncShared(int success, SharedBuffer<T> &buffer)
+	{
+		IOTimer timer(m_counters.mpiTime);
+
+		buffer.sync();
+
+		MPI_Allreduce(MPI_IN_PLACE, &success, 1, MPI_INT, MPI_MIN, buffer.nodeComm());
+		return success != 0;
+	}
+#endif // PARALLEL
+
+	/**
+	 * Selects the I/O mode for a partition access in adaptive mode. Collective
+	 * function.
+	 *
+	 * @param bytes Number of bytes accessed by this rank
+	 * @param ranges Number of contiguous ranges accessed by this rank
+	 */
+	bool selectMode(size_t bytes, size_t ranges)
+	{
+#ifdef PARALLEL
+		double buf[4] = {static_cast<double>(bytes), static_cast<double>(ranges),
+			(bytes > 0 ? 1. : 0.), m_adaptiveTime};
+		{
+			IOTimer timer(m_counters.mpiTime);
+			MPI_Allreduce(MPI_IN_PLACE, buf, 4, MPI_DOUBLE, MPI_SUM, mpiComm());
+		}
+
+		// Learn from the previous access (the mode was not changed since then)
+		if (m_adaptiveClass >= 0) {
+			AdaptiveStats &stats = m_adaptiveStats[m_adaptiveClass];
+			int mode = (m_ioCollective ? 1 : 0);
+			stats.calls[mode]++;
+			stats.time[mode] += buf[3] / mpiSize();
+			stats.bytes[mode] += m_adaptiveBytes;
+		}
+
+		bool collective = false;
+		m_adaptiveClass = -1;
+		if (buf[0] > 0) {
+			// Class = (bytes per range, ranks with data)
+			m_adaptiveClass = log2(buf[0] / std::max(buf[1], 1.)) * 32 + log2(buf[2]);
+			m_adaptiveBytes = buf[0];
+
+			const AdaptiveStats &stats = m_adaptiveStats[m_adaptiveClass];
+			if (stats.calls[1] < ADAPTIVE_TRIALS)
+				collective = true;
+			else if (stats.calls[0] < ADAPTIVE_TRIALS)
+				collective = false;
+			else {
+				collective = (stats.time[1] * stats.bytes[0] <= stats.time[0] * stats.bytes[1]);
+				if ((stats.calls[0] + stats.calls[1]) % ADAPTIVE_RETRY == 0)
+					collective = !collective;
+			}
+		}
+
+		if (collective != m_ioCollective) {
+			if (!_setIOMode(collective))
+				return false;
+			m_ioCollective = collective;
+		}
+
+		m_adaptiveTime = 0;
+		m_adaptiveStart = IOCounters::time();
+#endif // PARALLEL
+
+		return true;
+	}
+
+	/**
+	 * Measures the time of an adaptive access
+	 */
+	void finishMode()
+	{
+		if (m_adaptive)
+			m_adaptiveTime = IOCounters::time() - m_adaptiveStart;
+	}
+
+	/**
+	 * @return floor(log2(value)) for value >= 1, 0 otherwise
+	 */
+	static int log2(double value)
+	{
+		int l = 0;
+		for (; value >= 2; value /= 2)
+			l++;
+		return l;
+	}
+
 	/**
 	 * @param accesses The number of accesses we need (may differ from valuePos.size())
 	 */
 	bool getValuePos(size_t partition, size_t size, std::vector<IndexedRange> &valuePos, size_t &accesses)
 	{
 		std::vector<unsigned long> index(size);
-		if (!m_index->get(partition, size, &index[0]))
+		if (!m_index->get(partition, size, (size > 0 ? &index[0] : 0L)))
 			return false;
 
-		IndexedRange range = {index[0], 1, 0};
-		valuePos.push_back(range);
+		if (size > 0) {
+			IndexedRange range = {index[0], 1, 0};
+			valuePos.push_back(range);
+		}
 		for (size_t i = 1; i < index.size(); i++) {
 			if (index[i] == valuePos.back().pos + valuePos.back().count)
 				valuePos.back().count++;
@@ -308,15 +1453,26 @@ private:
 			}
 		}
 
+		for (std::vector<IndexedRange>::const_iterator i = valuePos.begin(); i != valuePos.end(); i++)
+			m_counters.addRange(i->count);
+
 		// Get maximum number of access we need to get all data
 		unsigned long maxAccesses = valuePos.size();
 #ifdef PARALLEL
-		if (m_collective)
+		if (m_collective) {
+			IOTimer timer(m_counters.mpiTime);
 			MPI_Allreduce(MPI_IN_PLACE, &maxAccesses, 1, MPI_UNSIGNED_LONG, MPI_MAX, mpiComm());
+		}
 #endif // PARALLEL
 
 		accesses = maxAccesses;
 
+		if (valuePos.empty() && accesses > 0) {
+			// Empty partition, take part in the collective accesses without values
+			IndexedRange range = {0, 0, 0};
+			valuePos.push_back(range);
+		}
+
 		return true;
 	}
 };
@@ -17,14 +17,18 @@
 #include <mpi.h>
 #endif // PARALLEL
 
+#include <algorithm>
 #include <limits>
+#include <map>
 #include <string>
 #include <vector>
 
 #include "PUML/CellType.h"
 #include "PUML/Dimension.h"
 #include "PUML/Entity.h"
+#include "PUML/IOCounters.h"
 #include "PUML/MPIElement.h"
+#include "PUML/PartitionRouter.h"
 #include "PUML/Type.h"
 
 namespace PUML
@@ -51,14 +55,35 @@ private:
 	/** Entity the index variable */
 	Entity* m_entityIndex;
 
+	/**
+	 * Entity of the type offset variable (only in mixed cell groups)
+	 * Contains for each partition the start of each cell type block
+	 */
+	Entity* m_entityTypeOffset;
+
+	/** Partition of the cached type offsets */
+	size_t m_typeOffsetPartition;
+
+	/** Cached type offsets of one partition */
+	std::vector<unsigned long> m_typeOffset;
+
+	/** I/O counters of the group (without the entities) */
+	IOCounters m_counters;
+
+	/** Forwards partition based accesses to a subfile (or NULL) */
+	PartitionRouter* m_router;
+
 public:
 	Group()
-		: m_entityIndex(0L)
+		: m_entityIndex(0L), m_entityTypeOffset(0L),
+		  m_typeOffsetPartition(std::numeric_limits<size_t>::max()), m_router(0L)
 	{
 	}
 
 	Group(const char* name, size_t numPartitions, MPIElement &comm)
-		: MPIElement(comm), m_name(name), m_offset(numPartitions+1), m_entityIndex(0L)
+		: MPIElement(comm), m_name(name), m_offset(numPartitions+1), m_entityIndex(0L),
+		  m_entityTypeOffset(0L), m_typeOffsetPartition(std::numeric_limits<size_t>::max()),
+		  m_router(0L)
 	{
 		m_offset[0] = 0;
 		for (size_t i = 1; i < m_offset.size(); i++)
@@ -70,7 +95,8 @@ public:
 	 * Name and offsets must be set later
 	 */
 	Group(MPIElement &comm)
-		: MPIElement(comm), m_entityIndex(0L)
+		: MPIElement(comm), m_entityIndex(0L), m_entityTypeOffset(0L),
+		  m_typeOffsetPartition(std::numeric_limits<size_t>::max()), m_router(0L)
 	{
 	}
 
@@ -114,6 +140,34 @@ public:
 		return createEntity(name, type, 0, 0L);
 	}
 
+	/**
+	 * Create a new time-dependent entity in this group
+	 *
+	 * The entity has an additional (unlimited) time dimension in front of the
+	 * partition dimension. Offsets and the index of the group are shared by
+	 * all time steps. Use Entity::put(step, partition, ...) to append a step.
+	 * Time-dependent entities are created in collective mode and cannot have
+	 * statistics.
+	 *
+	 * @see Entity::put
+	 */
+	virtual Entity* createTimeEntity(const char* name, const Type &type, size_t numDimensions, Dimension* dimensions) = 0;
+
+	/**
+	 * @overload
+	 *
+	 * Creates a one dimensional time-dependent entity.
+	 */
+	Entity* createTimeEntity(const char* name, const Type &type)
+	{
+		return createTimeEntity(name, type, 0, 0L);
+	}
+
+	/**
+	 * @return The number of time steps in this group
+	 */
+	virtual size_t numSteps() = 0;
+
 	/**
 	 * Create to reference the vertices of a cell. Should only be used in cell groups.
 	 *
@@ -125,21 +179,72 @@ public:
 	 */
 	Entity* createVertexEntity(CellType cellType)
 	{
-		int numVertices;
+		Dimension &dim = createDimension("vertex", numVertices(cellType));
+		return createEntity("vertex", Type::Int64, 1, &dim);
+	}
 
-		switch (cellType)
-		{
-		case TETRAHEDRON:
-			numVertices = 4;
-			break;
-		}
+	/**
+	 * @overload
+	 *
+	 * @ingroup HighLevelApi
+	 */
+	template<CellType Type>
+	Entity* createVertexEntity()
+	{
+		return createVertexEntity(Type);
+	}
 
-		Dimension &dim = createDimension("vertex", numVertices);
+	/**
+	 * Create the vertex entity for a cell group with different cell types
+	 *
+	 * Cells of a partition must be sorted by their type. The vertex dimension
+	 * has the size of the largest cell type; blocks of smaller cells only use the
+	 * first vertices. The start of each block is stored in a per partition type
+	 * offset table.
+	 *
+	 * @param numCellTypes Number of cell types in <code>cellTypes</code>
+	 * @param cellTypes All cell types that appear in this group
+	 *
+	 * @see setTypeSizes
+	 *
+	 * @ingroup HighLevelApi
+	 */
+	Entity* createMixedVertexEntity(size_t numCellTypes, const CellType* cellTypes)
+	{
+		unsigned int maxVertices = 0;
+		for (size_t i = 0; i < numCellTypes; i++)
+			maxVertices = std::max(maxVertices, numVertices(cellTypes[i]));
+		if (maxVertices == 0)
+			return 0L;
+
+		m_entityTypeOffset = _addTypeOffset();
+		if (!m_entityTypeOffset)
+			return 0L;
+
+		Dimension &dim = createDimension("vertex", maxVertices);
 		return createEntity("vertex", Type::Int64, 1, &dim);
 	}
 
 	virtual Entity* getEntity(const char* name) = 0;
 
+	/**
+	 * Store the minimum and maximum of each component for each partition of
+	 * an entity. The values are updated by Entity::put and can be used to select
+	 * partitions without reading the data.
+	 *
+	 * Must be called during the definition phase.
+	 *
+	 * @see Entity::selectPartitions
+	 */
+	bool addStatistics(const char* name)
+	{
+		Entity* entity = getEntity(name);
+		if (!entity || entity->timeDependent())
+			return false;
+
+		return _addStatistics(*entity);
+	}
+
 	/**
 	 * Sets the size of a partition
 	 *
@@ -158,7 +263,10 @@ public:
 		std::vector<unsigned long> buf(2*mpiSize());
 		buf[2*mpiRank()] = partition;
 		buf[2*mpiRank()+1] = size;
-		MPI_Allgather(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, &buf[0], 2, MPI_UNSIGNED_LONG, mpiComm());
+		{
+			IOTimer timer(m_counters.mpiTime);
+			MPI_Allgather(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, &buf[0], 2, MPI_UNSIGNED_LONG, mpiComm());
+		}
 
 		for (int i = 0; i < mpiSize(); i++) {
 			if (buf[i*2] < basePartition)
@@ -193,7 +301,41 @@ public:
 			m_offset[basePartition+1] = m_offset[basePartition] + size;
 #endif // PARALLEL
 
-		return setOffset(partition+1);
+		{
+			IOTimer timer(m_counters.ioTime);
+			if (!setOffset(partition+1))
+				return false;
+		}
+
+		if (m_router) {
+			// Set the size in the subfile as well
+			Group* group = m_router->routeGroup(name(), partition);
+			return group && group->setSize(partition, size);
+		}
+
+		return true;
+	}
+
+	/**
+	 * Sets the size of all partitions at once
+	 *
+	 * Can be used instead of setSize if the sizes of all partitions are known
+	 * on all ranks. In the parallel version this is a collective function and
+	 * all ranks must pass the same sizes.
+	 *
+	 * @param sizes The size of each partition (numPartitions() values)
+	 */
+	bool setSizes(const unsigned long* sizes)
+	{
+		if (m_router)
+			// Not supported with subfiles
+			return false;
+
+		for (size_t i = 0; i < numPartitions(); i++)
+			m_offset[i+1] = m_offset[i] + sizes[i];
+
+		IOTimer timer(m_counters.ioTime);
+		return setOffsets();
 	}
 
 	/**
@@ -204,15 +346,246 @@ public:
 		return m_offset[partition+1] - m_offset[partition];
 	}
 
+	/**
+	 * @return The position of the first element of a partition in the file
+	 *  (in the index for indexed groups)
+	 */
+	size_t start(size_t partition)
+	{
+		return m_offset[partition];
+	}
+
+	/**
+	 * Sets the number of cells of each type in a mixed cell group
+	 *
+	 * Must be called after the size of the partition is set.
+	 *
+	 * @param sizes Number of cells for each type (an array with NUM_CELL_TYPES elements)
+	 */
+	bool setTypeSizes(size_t partition, const size_t* sizes)
+	{
+		if (m_entityTypeOffset == 0L)
+			return false;
+
+		std::vector<unsigned long> typeOffset(NUM_CELL_TYPES+1);
+		typeOffset[0] = 0;
+		for (unsigned int i = 0; i < NUM_CELL_TYPES; i++)
+			typeOffset[i+1] = typeOffset[i] + sizes[i];
+
+		if (typeOffset.back() != size(partition))
+			return false;
+
+		if (!m_entityTypeOffset->puta(partition, 1, &typeOffset[0]))
+			return false;
+
+		m_typeOffsetPartition = partition;
+		m_typeOffset.swap(typeOffset);
+
+		return true;
+	}
+
+	/**
+	 * @return The number of cells of a specific type in a partition
+	 *  (only in mixed cell groups)
+	 */
+	template<CellType Type>
+	size_t numCells(size_t partition)
+	{
+		if (!loadTypeOffset(partition))
+			return 0;
+
+		return m_typeOffset[Type+1] - m_typeOffset[Type];
+	}
+
+	/**
+	 * Writes the vertices of all cells of one type in a partition
+	 *
+	 * @param vertices The vertices, CellTraits<Type>::NUM_VERTICES per cell
+	 *
+	 * @see setTypeSizes
+	 */
+	template<CellType Type, typename T>
+	bool putCells(size_t partition, const T* vertices)
+	{
+		Entity* entity = getEntity("vertex");
+		if (!entity || !loadTypeOffset(partition))
+			return false;
+
+		size_t size = m_typeOffset[Type+1] - m_typeOffset[Type];
+		if (size == 0)
+			return true;
+
+		return entity->putaPartial(m_offset[partition] + m_typeOffset[Type], size,
+				CellTraits<Type>::NUM_VERTICES, vertices);
+	}
+
+	/**
+	 * Reads the vertices of all cells of one type in a partition
+	 *
+	 * @param vertices Buffer for CellTraits<Type>::NUM_VERTICES * numCells<Type>(partition) values
+	 */
+	template<CellType Type, typename T>
+	bool getCells(size_t partition, T* vertices)
+	{
+		Entity* entity = getEntity("vertex");
+		if (!entity || !loadTypeOffset(partition))
+			return false;
+
+		size_t size = m_typeOffset[Type+1] - m_typeOffset[Type];
+		if (size == 0)
+			return true;
+
+		return entity->getaPartial(m_offset[partition] + m_typeOffset[Type], size,
+				CellTraits<Type>::NUM_VERTICES, vertices);
+	}
+
 	bool putIndex(size_t partition, size_t size, const unsigned long* values)
 	{
 		if (m_entityIndex == 0L)
 			// Not an indexed group -> do nothing
 			return false;
 
+		if (m_router) {
+			Group* group = m_router->routeGroup(name(), partition);
+			return group && group->putIndex(partition, size, values);
+		}
+
 		return m_entityIndex->put(partition, size, values);
 	}
 
+	/**
+	 * Reads the index of a partition
+	 *
+	 * For groups without an index the identity (the position of the elements
+	 * in the file) is returned. In the parallel version this is a collective
+	 * function for indexed groups.
+	 *
+	 * With subfiles, the index of indexed groups refers to the subfile.
+	 */
+	bool getIndex(size_t partition, size_t size, unsigned long* values)
+	{
+		if (m_entityIndex == 0L) {
+			for (size_t i = 0; i < size; i++)
+				values[i] = m_offset[partition] + i;
+			return true;
+		}
+
+		if (m_router) {
+			Group* group = m_router->routeGroup(name(), partition);
+			return group && group->getIndex(partition, size, values);
+		}
+
+		return m_entityIndex->get(partition, size, values);
+	}
+
+	/**
+	 * Reads all elements of a partition for several entities at once
+	 *
+	 * The access plan (the contiguous ranges of the index in indexed groups)
+	 * is computed once and the entities are read back to back for each range.
+	 * In the parallel version the number of accesses is agreed on once for
+	 * all entities.
+	 *
+	 * Values are copied without type conversion, the buffers must have the
+	 * type of the entity in the file.
+	 *
+	 * In the parallel version this is a collective function if the group is
+	 * indexed or one of the entities is in collective mode. All ranks must
+	 * pass the same entities.
+	 *
+	 * @param values Maps the name of each entity to a buffer for size(partition) elements
+	 */
+	bool getRow(size_t partition, const std::map<std::string, void*> &values)
+	{
+		return accessRow(partition, values, false);
+	}
+
+	/**
+	 * Writes all elements of a partition for several entities at once
+	 *
+	 * Entities with statistics are not supported (use Entity::put instead).
+	 *
+	 * @see getRow
+	 */
+	bool putRow(size_t partition, const std::map<std::string, const void*> &values)
+	{
+		return accessRow(partition, values, true);
+	}
+
+	/**
+	 * @return True if this is a cell group with different cell types
+	 */
+	bool mixed() const
+	{
+		return m_entityTypeOffset != 0L;
+	}
+
+	/**
+	 * @return True if the group has an index
+	 */
+	bool indexed() const
+	{
+		return m_entityIndex != 0L;
+	}
+
+	size_t numPartitions() const
+	{
+		return m_offset.size()-1;
+	}
+
+	/**
+	 * Collects all entities of this group that are loaded or created,
+	 * including internal entities (e.g. the index)
+	 */
+	void loadedEntities(std::vector<Entity*> &entities)
+	{
+		entities.clear();
+		_loadedEntities(entities);
+	}
+
+	/**
+	 * @return The I/O counters of this group and all its entities (on this rank)
+	 */
+	IOCounters counters()
+	{
+		IOCounters counters = m_counters;
+
+		std::vector<Entity*> entities;
+		loadedEntities(entities);
+		for (std::vector<Entity*>::const_iterator i = entities.begin(); i != entities.end(); i++)
+			counters += (*i)->counters();
+
+		return counters;
+	}
+
+	/**
+	 * @return The I/O counters of this group without the entities (e.g. for setSize)
+	 */
+	const IOCounters& groupCounters() const
+	{
+		return m_counters;
+	}
+
+	void resetCounters()
+	{
+		m_counters.reset();
+
+		std::vector<Entity*> entities;
+		loadedEntities(entities);
+		for (std::vector<Entity*>::const_iterator i = entities.begin(); i != entities.end(); i++)
+			(*i)->resetCounters();
+	}
+
+	/**
+	 * Forward all partition based accesses to another file
+	 *
+	 * @internal
+	 */
+	void setRouter(PartitionRouter* router)
+	{
+		m_router = router;
+	}
+
 	/**
 	 * Adds an index to this group
 	 * Cannot be done in the constructor because of wrong values for m_parent for the indexed entity
@@ -226,14 +599,14 @@ public:
 	}
 
 protected:
-	size_t numPartitions() const
+	const std::vector<size_t>& offset() const
 	{
-		return m_offset.size()-1;
+		return m_offset;
 	}
 
-	const std::vector<size_t>& offset() const
+	PartitionRouter* router()
 	{
-		return m_offset;
+		return m_router;
 	}
 
 	std::vector<size_t>& offset()
@@ -246,12 +619,27 @@ protected:
 	 */
 	virtual bool setOffset(size_t partition) = 0;
 
+	/**
+	 * Write the offsets of all partitions to file
+	 */
+	virtual bool setOffsets() = 0;
+
 	virtual Entity* _addIndex(size_t index) = 0;
 
-	bool indexed() const
-	{
-		return m_entityIndex != 0L;
-	}
+	/**
+	 * Add the type offset variable for mixed cell groups
+	 */
+	virtual Entity* _addTypeOffset() = 0;
+
+	/**
+	 * Add the variables for the statistics of an entity
+	 */
+	virtual bool _addStatistics(Entity &entity) = 0;
+
+	/**
+	 * Add all loaded entities to the list
+	 */
+	virtual void _loadedEntities(std::vector<Entity*> &entities) = 0;
 
 	/**
 	 * Set the index entity loaded from file
@@ -261,11 +649,151 @@ protected:
 		m_entityIndex = entityIndex;
 	}
 
+	/**
+	 * Set the type offset entity loaded from file
+	 */
+	void setEntityTypeOffset(Entity* entityTypeOffset)
+	{
+		m_entityTypeOffset = entityTypeOffset;
+	}
+
 	void setName(const char* name)
 	{
 		m_name = name;
 	}
 
+private:
+	/**
+	 * Loads the type offsets of a partition into the cache
+	 */
+	bool loadTypeOffset(size_t partition)
+	{
+		if (m_entityTypeOffset == 0L)
+			return false;
+
+		if (m_typeOffsetPartition == partition)
+			return true;
+
+		m_typeOffset.resize(NUM_CELL_TYPES+1);
+		if (!m_entityTypeOffset->geta(partition, 1, &m_typeOffset[0]))
+			return false;
+
+		m_typeOffsetPartition = partition;
+		return true;
+	}
+
+	/**
+	 * Implementation of getRow and putRow
+	 */
+	template<typename V>
+	bool accessRow(size_t partition, const std::map<std::string, V> &values, bool put)
+	{
+		if (m_router) {
+			Group* group = m_router->routeGroup(name(), partition);
+			return group && group->accessRow(partition, values, put);
+		}
+
+		if (m_offset[partition] == std::numeric_limits<size_t>::max()
+				|| m_offset[partition+1] == std::numeric_limits<size_t>::max())
+			return false;
+
+		std::vector<Entity*> entities;
+		std::vector<V> buffers;
+		std::vector<size_t> elementSize;
+		bool collective = false;
+		for (typename std::map<std::string, V>::const_iterator i = values.begin(); i != values.end(); i++) {
+			Entity* entity = getEntity(i->first.c_str());
+			if (!entity || (put && entity->hasStatistics()))
+				return false;
+
+			entities.push_back(entity);
+			buffers.push_back(i->second);
+			elementSize.push_back(entity->numComponents() * entity->valueSize());
+			collective |= entity->m_collective;
+		}
+
+		size_t size = this->size(partition);
+
+		// Compute the access plan
+		std::vector<Entity::IndexedRange> ranges;
+		if (indexed()) {
+			std::vector<unsigned long> index(std::max(size, static_cast<size_t>(1)));
+			if (!m_entityIndex->get(partition, size, &index[0]))
+				return false;
+
+			for (size_t i = 0; i < size; i++) {
+				if (!ranges.empty() && index[i] == ranges.back().pos + ranges.back().count)
+					ranges.back().count++;
+				else {
+					Entity::IndexedRange range = {index[i], 1, i};
+					ranges.push_back(range);
+				}
+			}
+
+			for (std::vector<Entity*>::const_iterator e = entities.begin(); e != entities.end(); e++) {
+				for (std::vector<Entity::IndexedRange>::const_iterator i = ranges.begin(); i != ranges.end(); i++)
+					(*e)->m_counters.addRange(i->count);
+			}
+		} else {
+			// One access, even for empty partitions (required for collective I/O)
+			Entity::IndexedRange range = {m_offset[partition], size, 0};
+			ranges.push_back(range);
+		}
+
+		unsigned long accesses = ranges.size();
+#ifdef PARALLEL
+		if (indexed() && collective) {
+			IOTimer timer(m_counters.mpiTime);
+			MPI_Allreduce(MPI_IN_PLACE, &accesses, 1, MPI_UNSIGNED_LONG, MPI_MAX, mpiComm());
+		}
+#endif // PARALLEL
+
+		if (entities.empty())
+			return true;
+
+		// All accesses of the row form one batch (the entities share the file)
+		if (!entities[0]->_beginBatch())
+			return false;
+
+		// Zero-size accesses do not touch the buffer
+		char dummy = 0;
+		bool success = true;
+		for (unsigned long i = 0; i < accesses && success; i++) {
+			for (size_t j = 0; j < entities.size() && success; j++) {
+				if (i < ranges.size()) {
+					success = rowAccess(*entities[j], ranges[i].pos, ranges[i].count,
+						rowBuffer(buffers[j], ranges[i].localPos * elementSize[j]));
+				} else if (entities[j]->m_collective) {
+					// Other ranks may require more accesses
+					entities[j]->m_counters.paddingAccesses++;
+					success = rowAccess(*entities[j], 0, 0, static_cast<V>(&dummy));
+				}
+			}
+		}
+
+		return entities[0]->_endBatch() && success;
+	}
+
+	static void* rowBuffer(void* values, size_t offset)
+	{
+		return static_cast<char*>(values) + offset;
+	}
+
+	static const void* rowBuffer(const void* values, size_t offset)
+	{
+		return static_cast<const char*>(values) + offset;
+	}
+
+	static bool rowAccess(Entity &entity, size_t start, size_t size, void* values)
+	{
+		return entity.getaRaw(start, size, values);
+	}
+
+	static bool rowAccess(Entity &entity, size_t start, size_t size, const void* values)
+	{
+		return entity.putaRaw(start, size, values);
+	}
+
 public:
 	static const size_t UNLIMITED;
 
@@ -273,9 +801,15 @@ protected:
 	static const char* DIM_PARTITION;
 	static const char* DIM_SIZE;
 	static const char* DIM_INDEXSIZE;
+	static const char* DIM_CELLTYPE;
+	static const char* DIM_TIME;
 
 	static const char* VAR_OFFSET;
+	static const char* VAR_TOTALSIZE;
 	static const char* VAR_INDEX;
+	static const char* VAR_TYPEOFFSET;
+	static const char* VAR_MIN_SUFFIX;
+	static const char* VAR_MAX_SUFFIX;
 };
 
 }
@@ -0,0 +1,707 @@
+/**
+ * @file
+ *  This file is part of PUML
+ *
+ *  For conditions of distribution and use, please see the copyright
+ *  notice in the file 'COPYING' at the root directory of this package
+ *  and the copyright notice at https://github.com/TUM-I5/PUML
+ *
+ * @copyright 2013 Technische Universitaet Muenchen
+ * @author Sebastian Rettenberger <rettenbs@in.tum.de>
+ */
+
+#ifndef PUML_HALO_H
+#define PUML_HALO_H
+
+#ifdef PARALLEL
+#include <mpi.h>
+#endif // PARALLEL
+
+#include <algorithm>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "PUML/Entity.h"
+#include "PUML/Group.h"
+
+namespace PUML
+{
+
+/**
+ * Computes the halo (ghost layer) of one partition
+ *
+ * Cells of two partitions are neighbors if they share a vertex. Vertices are
+ * identified by the index of the vertex group (the position in the file).
+ * The halo of depth <code>d</code> received from a partition contains the cells
+ * of this partition that are reachable within <code>d</code> layers from the
+ * shared vertices. The send lists are computed the same way from the local
+ * partition, so send and receive lists of two partitions match.
+ *
+ * Cells reference vertices by their position in the partition of the vertex
+ * group with the same partition id.
+ *
+ * In the parallel version, each rank builds the halos of its own partitions and
+ * only reads these partitions. The shared vertices are found with a distributed
+ * directory of the vertex ids and the ghost cells are sent by the rank that
+ * builds the neighbor partition. All partitions of the file have to be built
+ * in the same call, otherwise the neighbors cannot be found.
+ *
+ * In the serial version, the bounding boxes of the partitions (the statistics
+ * of a coordinate entity) are required. Only partitions with overlapping
+ * bounding boxes are read.
+ *
+ * The send/receive counts and displacements (in cells) are ordered by
+ * neighbor partition and can directly be used with
+ * <code>MPI_Neighbor_alltoallv</code> if each rank owns one partition.
+ */
+class Halo
+{
+private:
+	/** The group that contains the cells */
+	Group &m_cellGroup;
+
+	/** The group that contains the vertices */
+	Group &m_vertexGroup;
+
+	/**
+	 * Coordinate entity with statistics (serial version only). Used to skip
+	 * partitions that cannot be neighbors.
+	 */
+	Entity* m_coordinates;
+
+	/** Number of vertices in the local partition */
+	size_t m_numVertices;
+
+	/** Number of vertices per cell */
+	size_t m_numCellVertices;
+
+	/** Neighbor partitions */
+	std::vector<unsigned long> m_neighbors;
+
+	std::vector<int> m_sendCounts;
+	std::vector<int> m_sendDispls;
+	/** Local cells that should be sent, ordered by neighbor */
+	std::vector<unsigned long> m_sendCells;
+
+	std::vector<int> m_recvCounts;
+	std::vector<int> m_recvDispls;
+	/** Ghost cells (the position in the owner partition), ordered by neighbor */
+	std::vector<unsigned long> m_ghostCells;
+
+	/**
+	 * The vertices of the ghost cells. Local vertices have the local id, ghost vertices
+	 * have the id <code>numVertices() + position in ghostVertices()</code>.
+	 */
+	std::vector<unsigned long> m_ghostCellVertices;
+
+	/** Global ids (position in the file) of the ghost vertices (sorted) */
+	std::vector<unsigned long> m_ghostVertices;
+
+	/** Sorted global ids of the local partition -> local id */
+	std::vector<std::pair<unsigned long, unsigned long> > m_localVertices;
+
+public:
+	/**
+	 * @param coordinates Coordinate entity of the vertex group with statistics.
+	 *  Required in the serial version, ignored in the parallel version.
+	 */
+	Halo(Group &cellGroup, Group &vertexGroup, Entity* coordinates = 0L)
+		: m_cellGroup(cellGroup), m_vertexGroup(vertexGroup), m_coordinates(coordinates),
+		  m_numVertices(0), m_numCellVertices(0)
+	{
+	}
+
+	/**
+	 * Computes the halo of a partition
+	 *
+	 * In the parallel version this is a collective function and each rank
+	 * has to build a different partition. Use the list version if the file
+	 * has more partitions than ranks.
+	 */
+	bool build(size_t partition, unsigned int depth = 1
+#ifdef PARALLEL
+			, MPI_Comm comm = MPI_COMM_WORLD
+#endif // PARALLEL
+		)
+	{
+#ifdef PARALLEL
+		return exchange(m_cellGroup, m_vertexGroup, 1, &partition, this, depth, comm);
+#else // PARALLEL
+		Entity* vertexEntity = m_cellGroup.getEntity("vertex");
+		if (!vertexEntity)
+			return false;
+
+		std::vector<unsigned long> localIndex;
+		std::vector<long> localCells;
+		if (!readLocal(*vertexEntity, partition, localIndex, localCells))
+			return false;
+
+		// Global vertex ids of the ghost cells
+		std::vector<unsigned long> neighborGlobalVertices;
+		if (!readNeighbors(partition, depth, *vertexEntity, localCells, neighborGlobalVertices))
+			return false;
+
+		numberGhostVertices(neighborGlobalVertices);
+
+		return true;
+#endif // PARALLEL
+	}
+
+	/**
+	 * Computes the halos of a list of partitions
+	 *
+	 * In the parallel version this is a collective function. Each partition
+	 * of the file must be listed on exactly one rank, the number of
+	 * partitions may differ between the ranks.
+	 *
+	 * @param coordinates See the constructor
+	 * @param halos Will contain one halo for each partition in the list
+	 */
+	static bool build(Group &cellGroup, Group &vertexGroup, Entity* coordinates,
+			size_t numPartitions, const size_t* partitions, std::vector<Halo> &halos, unsigned int depth = 1
+#ifdef PARALLEL
+			, MPI_Comm comm = MPI_COMM_WORLD
+#endif // PARALLEL
+		)
+	{
+		halos.clear();
+		halos.reserve(numPartitions);
+		for (size_t i = 0; i < numPartitions; i++)
+			halos.push_back(Halo(cellGroup, vertexGroup, coordinates));
+
+#ifdef PARALLEL
+		return exchange(cellGroup, vertexGroup, numPartitions, partitions,
+			(halos.empty() ? 0L : &halos[0]), depth, comm);
+#else // PARALLEL
+		for (size_t i = 0; i < numPartitions; i++) {
+			if (!halos[i].build(partitions[i], depth))
+				return false;
+		}
+
+		return true;
+#endif // PARALLEL
+	}
+
+	/**
+	 * Reads the values of all ghost vertices. Consecutive vertices are
+	 * read with one access.
+	 *
+	 * @param entity An entity of the vertex group
+	 * @param values Buffer for <code>ghostVertices().size()</code> elements
+	 *
+	 * @see Entity::gather
+	 */
+	template<typename T>
+	bool getGhostVertices(Entity &entity, T* values)
+	{
+		if (m_ghostVertices.empty()) {
+			// Take part in collective accesses
+			T dummy;
+			return entity.gather(0L, 0, &dummy);
+		}
+
+		return entity.gather(&m_ghostVertices[0], m_ghostVertices.size(), values);
+	}
+
+	size_t numVertices() const
+	{
+		return m_numVertices;
+	}
+
+	const std::vector<unsigned long>& neighbors() const
+	{
+		return m_neighbors;
+	}
+
+	const std::vector<int>& sendCounts() const
+	{
+		return m_sendCounts;
+	}
+
+	const std::vector<int>& sendDispls() const
+	{
+		return m_sendDispls;
+	}
+
+	const std::vector<unsigned long>& sendCells() const
+	{
+		return m_sendCells;
+	}
+
+	const std::vector<int>& recvCounts() const
+	{
+		return m_recvCounts;
+	}
+
+	const std::vector<int>& recvDispls() const
+	{
+		return m_recvDispls;
+	}
+
+	const std::vector<unsigned long>& ghostCells() const
+	{
+		return m_ghostCells;
+	}
+
+	const std::vector<unsigned long>& ghostCellVertices() const
+	{
+		return m_ghostCellVertices;
+	}
+
+	const std::vector<unsigned long>& ghostVertices() const
+	{
+		return m_ghostVertices;
+	}
+
+private:
+#ifdef PARALLEL
+	/**
+	 * Finds the neighbors with a distributed directory of the vertex ids and
+	 * exchanges the ghost cells with them
+	 *
+	 * @param halos One halo for each partition in the list
+	 */
+	static bool exchange(Group &cellGroup, Group &vertexGroup, size_t numPartitions, const size_t* partitions,
+			Halo* halos, unsigned int depth, MPI_Comm comm)
+	{
+		Entity* vertexEntity = cellGroup.getEntity("vertex");
+		if (!vertexEntity)
+			return false;
+		size_t numCellVertices = vertexEntity->numComponents();
+
+		int size;
+		MPI_Comm_size(comm, &size);
+
+		// Read the local partitions (the same number of collective reads on all ranks)
+		unsigned long maxPartitions = numPartitions;
+		MPI_Allreduce(MPI_IN_PLACE, &maxPartitions, 1, MPI_UNSIGNED_LONG, MPI_MAX, comm);
+
+		int success = 1;
+		std::vector<std::vector<unsigned long> > localIndex(numPartitions);
+		std::vector<std::vector<long> > localCells(numPartitions);
+		for (size_t i = 0; i < maxPartitions; i++) {
+			if (i < numPartitions) {
+				if (!halos[i].readLocal(*vertexEntity, partitions[i], localIndex[i], localCells[i]))
+					success = 0;
+			} else if (!readEmpty(vertexGroup, *vertexEntity))
+				success = 0;
+		}
+
+		MPI_Allreduce(MPI_IN_PLACE, &success, 1, MPI_INT, MPI_MIN, comm);
+		if (!success)
+			return false;
+
+		// Partitions of all ranks
+		int count = numPartitions;
+		std::vector<int> counts(size);
+		MPI_Allgather(&count, 1, MPI_INT, &counts[0], 1, MPI_INT, comm);
+		std::vector<int> displs(size+1, 0);
+		for (int i = 0; i < size; i++)
+			displs[i+1] = displs[i] + counts[i];
+
+		std::vector<unsigned long> local(partitions, partitions+numPartitions);
+		std::vector<unsigned long> all(displs.back());
+		MPI_Allgatherv((local.empty() ? 0L : &local[0]), count, MPI_UNSIGNED_LONG,
+			(all.empty() ? 0L : &all[0]), &counts[0], &displs[0], MPI_UNSIGNED_LONG, comm);
+
+		// Each partition of the file has to be built by exactly one rank,
+		// otherwise the neighbors cannot be found
+		if (all.size() != cellGroup.numPartitions())
+			return false;
+		std::vector<int> owner(all.size(), -1);
+		for (int i = 0; i < size; i++) {
+			for (int j = displs[i]; j < displs[i+1]; j++) {
+				if (all[j] >= owner.size() || owner[all[j]] >= 0)
+					return false;
+				owner[all[j]] = i;
+			}
+		}
+
+		// Send the vertex ids to the directory (rank id % size)
+		std::vector<std::vector<unsigned long> > requests(size);
+		for (size_t i = 0; i < numPartitions; i++) {
+			for (std::vector<unsigned long>::const_iterator v = localIndex[i].begin(); v != localIndex[i].end(); v++) {
+				requests[*v % size].push_back(*v);
+				requests[*v % size].push_back(partitions[i]);
+			}
+		}
+		std::vector<unsigned long> recvIds;
+		alltoallv(requests, recvIds, comm);
+
+		// Vertices used by more than one partition
+		std::vector<std::pair<unsigned long, unsigned long> > directory(recvIds.size() / 2);
+		for (size_t i = 0; i < directory.size(); i++)
+			directory[i] = std::make_pair(recvIds[i*2], recvIds[i*2+1]);
+		std::sort(directory.begin(), directory.end());
+
+		std::vector<std::vector<unsigned long> > replies(size);
+		for (size_t i = 0; i < directory.size(); ) {
+			size_t j = i+1;
+			while (j < directory.size() && directory[j].first == directory[i].first)
+				j++;
+
+			// Each partition gets (vertex id, partition, other partition) for all other partitions
+			for (size_t a = i; a < j; a++) {
+				for (size_t b = i; b < j; b++) {
+					if (directory[a].second == directory[b].second)
+						continue;
+					std::vector<unsigned long> &reply = replies[owner[directory[a].second]];
+					reply.push_back(directory[a].first);
+					reply.push_back(directory[a].second);
+					reply.push_back(directory[b].second);
+				}
+			}
+
+			i = j;
+		}
+		std::vector<unsigned long> shared;
+		alltoallv(replies, shared, comm);
+
+		// Shared vertices of each local partition by neighbor partition
+		std::map<unsigned long, size_t> localPos;
+		for (size_t i = 0; i < numPartitions; i++)
+			localPos[partitions[i]] = i;
+		std::vector<std::map<unsigned long, std::vector<char> > > localShared(numPartitions);
+		for (size_t i = 0; i < shared.size(); i += 3) {
+			Halo &halo = halos[localPos[shared[i+1]]];
+			std::vector<char> &marked = localShared[localPos[shared[i+1]]][shared[i+2]];
+			if (marked.empty())
+				marked.resize(halo.m_numVertices, 0);
+			marked[halo.findLocal(shared[i])->second] = 1;
+		}
+
+		// Send lists: the target and the source partition, the position of the cell
+		// and its global vertex ids
+		std::vector<std::vector<unsigned long> > sends(size);
+		for (size_t i = 0; i < numPartitions; i++) {
+			Halo &halo = halos[i];
+
+			// Neighbors are ordered by partition
+			for (std::map<unsigned long, std::vector<char> >::iterator n = localShared[i].begin();
+					n != localShared[i].end(); n++) {
+				std::vector<unsigned long> cells;
+				halo.layers(localCells[i], n->second, depth, cells);
+
+				halo.m_neighbors.push_back(n->first);
+				halo.m_sendDispls.push_back(halo.m_sendCells.size());
+				halo.m_sendCounts.push_back(cells.size());
+				halo.m_sendCells.insert(halo.m_sendCells.end(), cells.begin(), cells.end());
+
+				std::vector<unsigned long> &send = sends[owner[n->first]];
+				for (std::vector<unsigned long>::const_iterator c = cells.begin(); c != cells.end(); c++) {
+					send.push_back(n->first);
+					send.push_back(partitions[i]);
+					send.push_back(*c);
+					for (size_t j = 0; j < numCellVertices; j++)
+						send.push_back(localIndex[i][localCells[i][*c*numCellVertices+j]]);
+				}
+			}
+		}
+
+		// The send lists of the neighbors are the ghost cells
+		std::vector<unsigned long> ghosts;
+		alltoallv(sends, ghosts, comm);
+
+		size_t recordSize = numCellVertices + 3;
+		std::map<std::pair<unsigned long, unsigned long>, std::vector<size_t> > received;
+		for (size_t i = 0; i < ghosts.size() / recordSize; i++)
+			received[std::make_pair(ghosts[i*recordSize], ghosts[i*recordSize+1])].push_back(i);
+
+		for (size_t i = 0; i < numPartitions; i++) {
+			Halo &halo = halos[i];
+
+			// Global vertex ids of the ghost cells
+			std::vector<unsigned long> neighborGlobalVertices;
+			for (std::vector<unsigned long>::const_iterator n = halo.m_neighbors.begin();
+					n != halo.m_neighbors.end(); n++) {
+				const std::vector<size_t> &records = received[std::make_pair(partitions[i], *n)];
+
+				halo.m_recvDispls.push_back(halo.m_ghostCells.size());
+				halo.m_recvCounts.push_back(records.size());
+				for (std::vector<size_t>::const_iterator r = records.begin(); r != records.end(); r++) {
+					const unsigned long* ghost = &ghosts[*r*recordSize];
+					halo.m_ghostCells.push_back(ghost[2]);
+					neighborGlobalVertices.insert(neighborGlobalVertices.end(), ghost+3, ghost+3+numCellVertices);
+				}
+			}
+
+			halo.numberGhostVertices(neighborGlobalVertices);
+		}
+
+		return true;
+	}
+
+	/**
+	 * Takes part in the (collective) reads of readIndex and readCells
+	 * without reading a partition
+	 */
+	static bool readEmpty(Group &vertexGroup, Entity &vertexEntity)
+	{
+		unsigned long dummyIndex;
+		long dummyCell;
+		bool indexRead = vertexGroup.getIndex(0, 0, &dummyIndex);
+		bool cellsRead = vertexEntity.get(0, 0, &dummyCell);
+
+		return indexRead && cellsRead;
+	}
+
+	/**
+	 * Sends a list of values to each rank
+	 */
+	static void alltoallv(const std::vector<std::vector<unsigned long> > &send,
+			std::vector<unsigned long> &recv, MPI_Comm comm)
+	{
+		int size = send.size();
+
+		std::vector<int> sendCounts(size), sendDispls(size+1, 0);
+		for (int i = 0; i < size; i++) {
+			sendCounts[i] = send[i].size();
+			sendDispls[i+1] = sendDispls[i] + sendCounts[i];
+		}
+		std::vector<unsigned long> sendBuf;
+		sendBuf.reserve(sendDispls.back());
+		for (int i = 0; i < size; i++)
+			sendBuf.insert(sendBuf.end(), send[i].begin(), send[i].end());
+
+		std::vector<int> recvCounts(size), recvDispls(size+1, 0);
+		MPI_Alltoall(&sendCounts[0], 1, MPI_INT, &recvCounts[0], 1, MPI_INT, comm);
+		for (int i = 0; i < size; i++)
+			recvDispls[i+1] = recvDispls[i] + recvCounts[i];
+
+		recv.resize(recvDispls.back());
+		MPI_Alltoallv((sendBuf.empty() ? 0L : &sendBuf[0]), &sendCounts[0], &sendDispls[0], MPI_UNSIGNED_LONG,
+			(recv.empty() ? 0L : &recv[0]), &recvCounts[0], &recvDispls[0], MPI_UNSIGNED_LONG, comm);
+	}
+#else // PARALLEL
+	/**
+	 * Reads the index and the cells of all partitions with overlapping
+	 * bounding boxes and computes the send and receive lists
+	 *
+	 * @param neighborGlobalVertices The global vertex ids of the ghost cells
+	 */
+	bool readNeighbors(size_t partition, unsigned int depth, Entity &vertexEntity,
+			const std::vector<long> &localCells, std::vector<unsigned long> &neighborGlobalVertices)
+	{
+		std::vector<size_t> candidates;
+		if (!selectCandidates(partition, candidates))
+			return false;
+
+		for (std::vector<size_t>::const_iterator n = candidates.begin(); n != candidates.end(); n++) {
+			std::vector<unsigned long> neighborIndex;
+			if (!readIndex(*n, neighborIndex))
+				return false;
+
+			// Shared vertices in both numberings
+			std::vector<char> neighborShared(neighborIndex.size(), 0);
+			std::vector<char> localShared(m_numVertices, 0);
+			bool shared = false;
+			for (size_t i = 0; i < neighborIndex.size(); i++) {
+				const std::pair<unsigned long, unsigned long>* local = findLocal(neighborIndex[i]);
+				if (local) {
+					neighborShared[i] = 1;
+					localShared[local->second] = 1;
+					shared = true;
+				}
+			}
+			if (!shared)
+				continue;
+
+			std::vector<long> neighborCells;
+			if (!readCells(vertexEntity, *n, neighborCells))
+				return false;
+
+			m_neighbors.push_back(*n);
+
+			// Receive
+			std::vector<unsigned long> ghosts;
+			layers(neighborCells, neighborShared, depth, ghosts);
+			m_recvDispls.push_back(m_ghostCells.size());
+			m_recvCounts.push_back(ghosts.size());
+			m_ghostCells.insert(m_ghostCells.end(), ghosts.begin(), ghosts.end());
+			for (std::vector<unsigned long>::const_iterator i = ghosts.begin(); i != ghosts.end(); i++) {
+				for (size_t j = 0; j < m_numCellVertices; j++)
+					neighborGlobalVertices.push_back(neighborIndex[neighborCells[*i*m_numCellVertices+j]]);
+			}
+
+			// Send
+			std::vector<unsigned long> sends;
+			layers(localCells, localShared, depth, sends);
+			m_sendDispls.push_back(m_sendCells.size());
+			m_sendCounts.push_back(sends.size());
+			m_sendCells.insert(m_sendCells.end(), sends.begin(), sends.end());
+		}
+
+		return true;
+	}
+
+	/**
+	 * Selects all partitions with a bounding box that overlaps the bounding
+	 * box of the partition
+	 */
+	bool selectCandidates(size_t partition, std::vector<size_t> &candidates)
+	{
+		candidates.clear();
+
+		if (!m_coordinates || !m_coordinates->hasStatistics())
+			// Without bounding boxes, all partitions would be read
+			return false;
+
+		size_t n = m_coordinates->numComponents();
+		std::vector<double> min(n);
+		std::vector<double> max(n);
+		if (!m_coordinates->getStatistics(partition, &min[0], &max[0]))
+			return false;
+
+		std::vector<size_t> selected;
+		if (!m_coordinates->selectPartitions(&min[0], &max[0], selected))
+			return false;
+
+		for (std::vector<size_t>::const_iterator i = selected.begin(); i != selected.end(); i++) {
+			if (*i != partition)
+				candidates.push_back(*i);
+		}
+
+		return true;
+	}
+#endif // PARALLEL
+
+	/**
+	 * Resets the halo and reads the index and the cells of the local partition.
+	 * Both reads are always done, they may be collective.
+	 */
+	bool readLocal(Entity &vertexEntity, size_t partition, std::vector<unsigned long> &localIndex,
+			std::vector<long> &localCells)
+	{
+		m_neighbors.clear();
+		m_sendCounts.clear(); m_sendDispls.clear(); m_sendCells.clear();
+		m_recvCounts.clear(); m_recvDispls.clear(); m_ghostCells.clear();
+		m_ghostCellVertices.clear(); m_ghostVertices.clear();
+		m_localVertices.clear();
+
+		m_numCellVertices = vertexEntity.numComponents();
+
+		bool indexRead = readIndex(partition, localIndex);
+		bool cellsRead = readCells(vertexEntity, partition, localCells);
+		m_numVertices = localIndex.size();
+
+		m_localVertices.resize(m_numVertices);
+		for (size_t i = 0; i < m_numVertices; i++)
+			m_localVertices[i] = std::make_pair(localIndex[i], i);
+		std::sort(m_localVertices.begin(), m_localVertices.end());
+
+		return indexRead && cellsRead;
+	}
+
+	/**
+	 * Finds the ghost vertices and renumbers the vertices of the ghost cells
+	 *
+	 * @param neighborGlobalVertices The global vertex ids of the ghost cells
+	 */
+	void numberGhostVertices(const std::vector<unsigned long> &neighborGlobalVertices)
+	{
+		// Ghost vertices
+		for (std::vector<unsigned long>::const_iterator i = neighborGlobalVertices.begin();
+				i != neighborGlobalVertices.end(); i++) {
+			if (!findLocal(*i))
+				m_ghostVertices.push_back(*i);
+		}
+		std::sort(m_ghostVertices.begin(), m_ghostVertices.end());
+		m_ghostVertices.erase(std::unique(m_ghostVertices.begin(), m_ghostVertices.end()),
+			m_ghostVertices.end());
+
+		// Renumber the vertices of the ghost cells
+		m_ghostCellVertices.resize(neighborGlobalVertices.size());
+		for (size_t i = 0; i < neighborGlobalVertices.size(); i++) {
+			const std::pair<unsigned long, unsigned long>* local = findLocal(neighborGlobalVertices[i]);
+			if (local)
+				m_ghostCellVertices[i] = local->second;
+			else
+				m_ghostCellVertices[i] = m_numVertices
+					+ (std::lower_bound(m_ghostVertices.begin(), m_ghostVertices.end(), neighborGlobalVertices[i])
+						- m_ghostVertices.begin());
+		}
+	}
+
+	/**
+	 * Reads the index of a partition. Empty partitions take part in the
+	 * (collective) read as well.
+	 */
+	bool readIndex(size_t partition, std::vector<unsigned long> &index)
+	{
+		index.resize(m_vertexGroup.size(partition));
+
+		unsigned long dummy;
+		return m_vertexGroup.getIndex(partition, index.size(), (index.empty() ? &dummy : &index[0]));
+	}
+
+	/**
+	 * Reads the cells of a partition. Empty partitions take part in the
+	 * (collective) read as well.
+	 */
+	bool readCells(Entity &vertexEntity, size_t partition, std::vector<long> &cells)
+	{
+		size_t size = m_cellGroup.size(partition);
+		cells.resize(size * m_numCellVertices);
+
+		long dummy;
+		return vertexEntity.get(partition, size, (cells.empty() ? &dummy : &cells[0]));
+	}
+
+	/**
+	 * Finds all cells within a number of layers of marked vertices
+	 *
+	 * @param marked Marked vertices (will be modified)
+	 * @param selected The selected cells (sorted)
+	 */
+	void layers(const std::vector<long> &cells, std::vector<char> &marked, unsigned int depth,
+			std::vector<unsigned long> &selected) const
+	{
+		size_t numCells = cells.size() / m_numCellVertices;
+		std::vector<char> isSelected(numCells, 0);
+
+		for (unsigned int d = 0; d < depth; d++) {
+			std::vector<unsigned long> layer;
+			for (size_t i = 0; i < numCells; i++) {
+				if (isSelected[i])
+					continue;
+
+				for (size_t j = 0; j < m_numCellVertices; j++) {
+					if (marked[cells[i*m_numCellVertices+j]]) {
+						layer.push_back(i);
+						break;
+					}
+				}
+			}
+
+			for (std::vector<unsigned long>::const_iterator i = layer.begin(); i != layer.end(); i++) {
+				isSelected[*i] = 1;
+				for (size_t j = 0; j < m_numCellVertices; j++)
+					marked[cells[*i*m_numCellVertices+j]] = 1;
+			}
+		}
+
+		selected.clear();
+		for (size_t i = 0; i < numCells; i++) {
+			if (isSelected[i])
+				selected.push_back(i);
+		}
+	}
+
+	/**
+	 * @return The local id of a vertex or NULL if the vertex is not in the local partition
+	 */
+	const std::pair<unsigned long, unsigned long>* findLocal(unsigned long global) const
+	{
+		std::vector<std::pair<unsigned long, unsigned long> >::const_iterator it
+			= std::lower_bound(m_localVertices.begin(), m_localVertices.end(), std::make_pair(global, 0ul));
+		if (it != m_localVertices.end() && it->first == global)
+			return &(*it);
+
+		return 0L;
+	}
+};
+
+}
+
+#endif // PUML_HALO_H
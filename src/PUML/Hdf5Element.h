@@ -0,0 +1,252 @@
+/**
+ * @file
+ *  This file is part of PUML
+ *
+ *  For conditions of distribution and use, please see the copyright
+ *  notice in the file 'COPYING' at the root directory of this package
+ *  and the copyright notice at https://github.com/TUM-I5/PUML
+ *
+ * @copyright 2013 Technische Universitaet Muenchen
+ * @author Sebastian Rettenberger <rettenbs@in.tum.de>
+ */
+
+#ifndef PUML_HDF5_ELEMENT_H
+#define PUML_HDF5_ELEMENT_H
+
+#include <string>
+#include <vector>
+
+#include <hdf5.h>
+
+namespace PUML
+{
+
+/**
+ * Contains basic functionality to handle a HDF5 element (file, group, dataset, ...)
+ *
+ * Same as NetcdfElement but for the HDF5 library. The file element owns all
+ * HDF5 handles (they are closed with the file) and collects the elements
+ * with pending accesses of the current batch.
+ */
+class Hdf5Element
+{
+private:
+	/** HDF5 identifier */
+	hid_t m_identifier;
+
+	/** Parent element */
+	Hdf5Element* m_parent;
+
+	/** The first HDF5 error (or 0 if no error occurred) */
+	long long m_error;
+
+	/** Open handles (top most element only) */
+	std::vector<hid_t> m_handles;
+
+	/** Number of open batches (top most element only) */
+	unsigned int m_batchDepth;
+
+	/** Elements with pending accesses (top most element only) */
+	std::vector<Hdf5Element*> m_batch;
+
+	/** Dataset transfer properties for independent/collective accesses (top most element only) */
+	hid_t m_transfer[2];
+
+public:
+	Hdf5Element(Hdf5Element* parent = 0L)
+		: m_identifier(-1), m_parent(parent), m_error(0), m_batchDepth(0)
+	{
+		m_transfer[0] = m_transfer[1] = H5P_DEFAULT;
+	}
+
+	Hdf5Element(hid_t identifier, Hdf5Element* parent = 0L)
+		: m_identifier(identifier), m_parent(parent), m_error(0), m_batchDepth(0)
+	{
+		m_transfer[0] = m_transfer[1] = H5P_DEFAULT;
+	}
+
+	virtual ~Hdf5Element()
+	{
+	}
+
+	/**
+	 * @return The HDF5 identifier
+	 *
+	 * @ingroup LowLevelApi
+	 */
+	hid_t identifier() const
+	{
+		return m_identifier;
+	}
+
+	/**
+	 * @return True if no error occurred, false otherwise
+	 */
+	bool isValid() const
+	{
+		if (m_parent)
+			return m_parent->isValid();
+
+		return m_error >= 0;
+	}
+
+	/**
+	 * @return The message for the error
+	 */
+	std::string errorMsg() const
+	{
+		if (m_parent)
+			return m_parent->errorMsg();
+
+		if (m_error >= 0)
+			return "No error";
+		return "HDF5 error (see the HDF5 error stack)";
+	}
+
+protected:
+	void setIdentifier(hid_t identifier)
+	{
+		m_identifier = identifier;
+	}
+
+	/**
+	 * Returns the identifier of the parent if a parent exists
+	 *
+	 * @return The HDF5 identifier of the parent element
+	 */
+	hid_t parentIdentifier() const
+	{
+		if (m_parent)
+			return m_parent->m_identifier;
+
+		return m_identifier;
+	}
+
+	/**
+	 * Checks if result contains an error and saves the error state
+	 *
+	 * @return True result is an error false otherwise
+	 */
+	bool checkError(long long result)
+	{
+		if (m_parent)
+			// Propagate error to the parent element
+			return m_parent->checkError(result);
+
+		if (m_error >= 0)
+			// An error occurred early -> ignore this error
+			m_error = result;
+
+		return result < 0;
+	}
+
+	/**
+	 * Closes the handle with the file
+	 *
+	 * @return The handle
+	 */
+	hid_t addHandle(hid_t handle)
+	{
+		if (m_parent)
+			return m_parent->addHandle(handle);
+
+		if (handle >= 0)
+			m_handles.push_back(handle);
+		return handle;
+	}
+
+	/**
+	 * Closes all handles added with addHandle
+	 */
+	void closeHandles()
+	{
+		for (std::vector<hid_t>::const_iterator i = m_handles.begin(); i != m_handles.end(); i++)
+			H5Idec_ref(*i);
+		m_handles.clear();
+		m_batch.clear();
+		m_batchDepth = 0;
+	}
+
+	void setTransfer(hid_t independent, hid_t collective)
+	{
+		m_transfer[0] = independent;
+		m_transfer[1] = collective;
+	}
+
+	/**
+	 * @return The dataset transfer properties
+	 */
+	hid_t transfer(bool collective) const
+	{
+		if (m_parent)
+			return m_parent->transfer(collective);
+
+		return m_transfer[collective ? 1 : 0];
+	}
+
+	/**
+	 * @return True if a batch is open
+	 */
+	bool inBatch() const
+	{
+		if (m_parent)
+			return m_parent->inBatch();
+
+		return m_batchDepth > 0;
+	}
+
+	void beginBatch()
+	{
+		if (m_parent) {
+			m_parent->beginBatch();
+			return;
+		}
+
+		m_batchDepth++;
+	}
+
+	/**
+	 * Ends a batch. The outermost batch flushes all elements in the order
+	 * of their first access.
+	 */
+	bool endBatch()
+	{
+		if (m_parent)
+			return m_parent->endBatch();
+
+		if (m_batchDepth == 0 || --m_batchDepth > 0)
+			return true;
+
+		bool success = true;
+		for (std::vector<Hdf5Element*>::const_iterator i = m_batch.begin(); i != m_batch.end(); i++)
+			success = (*i)->flushBatch() && success;
+		m_batch.clear();
+
+		return success;
+	}
+
+	/**
+	 * Flushes the element at the end of the batch
+	 */
+	void addToBatch(Hdf5Element* element)
+	{
+		if (m_parent) {
+			m_parent->addToBatch(element);
+			return;
+		}
+
+		m_batch.push_back(element);
+	}
+
+	/**
+	 * Executes all pending accesses of the batch
+	 */
+	virtual bool flushBatch()
+	{
+		return true;
+	}
+};
+
+}
+
+#endif // PUML_HDF5_ELEMENT_H
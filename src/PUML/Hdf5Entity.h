@@ -0,0 +1,512 @@
+/**
+ * @file
+ *  This file is part of PUML
+ *
+ *  For conditions of distribution and use, please see the copyright
+ *  notice in the file 'COPYING' at the root directory of this package
+ *  and the copyright notice at https://github.com/TUM-I5/PUML
+ *
+ * @copyright 2013 Technische Universitaet Muenchen
+ * @author Sebastian Rettenberger <rettenbs@in.tum.de>
+ */
+
+#ifndef PUML_HDF5_ENTITY_H
+#define PUML_HDF5_ENTITY_H
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include <hdf5.h>
+#include <hdf5_hl.h>
+
+#include "PUML/Dimension.h"
+#include "PUML/Entity.h"
+#include "PUML/Hdf5Element.h"
+#include "PUML/Type.h"
+
+namespace PUML
+{
+
+/**
+ * An entity stored as HDF5 dataset
+ *
+ * The dataset is attached to the dimension scales of its dimensions (as in
+ * netCDF-4 files). Accesses of a batch (e.g. all ranges of an indexed
+ * partition in Entity::get/put) are combined into one union of hyperslabs
+ * and executed with a single H5Dread/H5Dwrite. The ranges of a batch must
+ * not overlap (duplicates are ignored).
+ */
+class Hdf5Entity : public Entity, public Hdf5Element
+{
+private:
+	/** An access of the current batch */
+	struct Access
+	{
+		std::vector<hsize_t> start;
+		std::vector<hsize_t> count;
+		/** Number of values */
+		size_t size;
+		char* values;
+
+		bool operator<(const Access &other) const
+		{
+			return start[0] < other.start[0];
+		}
+
+		bool operator==(const Access &other) const
+		{
+			return start == other.start && count == other.count;
+		}
+	};
+
+	/** The type of the dataset */
+	hid_t m_type;
+
+	/** The dimension scales (created entities only) */
+	std::vector<hid_t> m_dims;
+
+	/** Use collective transfers */
+	bool m_collectiveIO;
+
+	/** True if the entity is part of the current batch */
+	bool m_inBatch;
+
+	/** Memory type of the pending accesses */
+	hid_t m_batchType;
+
+	/** True if the pending accesses are writes */
+	bool m_batchPut;
+
+	/** The pending accesses */
+	std::vector<Access> m_batch;
+
+public:
+	Hdf5Entity()
+		: m_type(-1), m_collectiveIO(false), m_inBatch(false), m_batchType(-1), m_batchPut(false)
+	{
+	}
+
+	/**
+	 * @param dimSize The dimension scale of the group that contains the size
+	 */
+	Hdf5Entity(const char* name, const Type &type, hid_t dimSize,
+			size_t numUserDimensions, const Dimension* userDimensions,
+			const std::vector<size_t> &offset, Hdf5Entity* index,
+			Hdf5Element &group, MPIElement &comm)
+		: Entity(name, numUserDimensions, userDimensions, offset, index, comm), Hdf5Element(&group),
+		  m_type(-1), m_collectiveIO(false), m_inBatch(false), m_batchType(-1), m_batchPut(false)
+	{
+		m_dims.push_back(dimSize);
+		for (size_t i = 0; i < numUserDimensions; i++)
+			m_dims.push_back(userDimensions[i].identifier());
+
+		std::vector<hsize_t> extent;
+		for (std::vector<hid_t>::const_iterator i = m_dims.begin(); i != m_dims.end(); i++)
+			extent.push_back(dimLength(*i));
+
+		hid_t space = H5Screate_simple(extent.size(), &extent[0], 0L);
+		hid_t properties = H5Pcreate(H5P_DATASET_CREATE);
+		H5Pset_fill_time(properties, H5D_FILL_TIME_NEVER);
+		hid_t dataset = addHandle(H5Dcreate2(parentIdentifier(), name, type2h5(type), space,
+			H5P_DEFAULT, properties, H5P_DEFAULT));
+		H5Pclose(properties);
+		H5Sclose(space);
+		if (checkError(dataset))
+			return;
+		setIdentifier(dataset);
+
+		for (size_t i = 0; i < m_dims.size(); i++) {
+			if (checkError(H5DSattach_scale(dataset, m_dims[i], i)))
+				return;
+		}
+
+		m_type = addHandle(H5Dget_type(dataset));
+		checkError(m_type);
+	}
+
+	/**
+	 * Constructor to load an entity from a HDF5 file
+	 *
+	 * @param dataset The dataset (closed with the file)
+	 */
+	Hdf5Entity(const char* name, hid_t dataset, const std::vector<size_t> &offset, Hdf5Entity* index,
+			Hdf5Element &group, MPIElement &comm)
+		: Entity(offset, index, comm), Hdf5Element(dataset, &group),
+		  m_type(-1), m_collectiveIO(false), m_inBatch(false), m_batchType(-1), m_batchPut(false)
+	{
+		setName(name);
+
+		m_type = addHandle(H5Dget_type(dataset));
+		if (checkError(m_type))
+			return;
+
+		// Learn about the dimension size
+		hid_t space = H5Dget_space(dataset);
+		if (checkError(space))
+			return;
+		int numDims = H5Sget_simple_extent_ndims(space);
+		std::vector<hsize_t> extent(std::max(numDims, 1));
+		H5Sget_simple_extent_dims(space, &extent[0], 0L);
+		H5Sclose(space);
+		if (checkError(numDims))
+			return;
+
+		dimSize().resize(numDims);
+		for (int i = 1; i < numDims; i++) // Skip pum dimension
+			dimSize()[i] = extent[i];
+	}
+
+#ifdef PARALLEL
+	/**
+	 * Overriding this function is only done in the parallel version
+	 */
+	bool setCollective(bool collective)
+	{
+		if (!Entity::setCollective(collective))
+			return false;
+
+		m_collectiveIO = collective;
+		return true;
+	}
+#endif // PARALLEL
+
+	/**
+	 * @return The dimension scales of the dataset (empty for loaded entities)
+	 *
+	 * @internal
+	 */
+	const std::vector<hid_t>& dimensions() const
+	{
+		return m_dims;
+	}
+
+	/**
+	 * @return The length of a dimension scale
+	 *
+	 * @internal
+	 */
+	static hsize_t dimLength(hid_t dim)
+	{
+		hid_t space = H5Dget_space(dim);
+		if (space < 0)
+			return 0;
+
+		hsize_t length = 0;
+		if (H5Sget_simple_extent_ndims(space) == 1)
+			H5Sget_simple_extent_dims(space, &length, 0L);
+		H5Sclose(space);
+
+		return length;
+	}
+
+protected:
+#ifdef PARALLEL
+	bool _setIOMode(bool collective)
+	{
+		m_collectiveIO = collective;
+		return true;
+	}
+#endif // PARALLEL
+
+	size_t _valueSize()
+	{
+		return H5Tget_size(m_type);
+	}
+
+	bool _beginBatch()
+	{
+		beginBatch();
+		return true;
+	}
+
+	bool _endBatch()
+	{
+		return endBatch();
+	}
+
+	bool flushBatch()
+	{
+		m_inBatch = false;
+
+		// Ranges in file order, padding accesses repeat ranges
+		std::stable_sort(m_batch.begin(), m_batch.end());
+		m_batch.erase(std::unique(m_batch.begin(), m_batch.end()), m_batch.end());
+
+		bool overlap = false;
+		size_t size = 0;
+		for (size_t i = 0; i < m_batch.size(); i++) {
+			if (i > 0 && m_batch[i-1].start[0] + m_batch[i-1].count[0] > m_batch[i].start[0])
+				overlap = true;
+			size += m_batch[i].size;
+		}
+		if (overlap) {
+			// Take part in collective transfers but do not transfer anything
+			checkError(-1);
+			m_batch.clear();
+			size = 0;
+		}
+
+		hid_t fileSpace = H5Dget_space(identifier());
+		if (checkError(fileSpace))
+			return false;
+
+		if (m_batch.empty())
+			H5Sselect_none(fileSpace);
+		for (size_t i = 0; i < m_batch.size(); i++)
+			H5Sselect_hyperslab(fileSpace, (i == 0 ? H5S_SELECT_SET : H5S_SELECT_OR),
+				&m_batch[i].start[0], 0L, &m_batch[i].count[0], 0L);
+
+		hsize_t memSize = std::max(size, static_cast<size_t>(1));
+		hid_t memSpace = H5Screate_simple(1, &memSize, 0L);
+		if (size == 0)
+			H5Sselect_none(memSpace);
+
+		// Values of the selection in file order
+		size_t typeSize = H5Tget_size(m_batchType);
+		std::vector<char> buffer(memSize * typeSize);
+
+		herr_t err;
+		if (m_batchPut) {
+			char* b = &buffer[0];
+			for (std::vector<Access>::const_iterator i = m_batch.begin(); i != m_batch.end(); i++) {
+				memcpy(b, i->values, i->size * typeSize);
+				b += i->size * typeSize;
+			}
+
+			err = H5Dwrite(identifier(), m_batchType, memSpace, fileSpace, transfer(m_collectiveIO), &buffer[0]);
+		} else {
+			err = H5Dread(identifier(), m_batchType, memSpace, fileSpace, transfer(m_collectiveIO), &buffer[0]);
+
+			const char* b = &buffer[0];
+			for (std::vector<Access>::const_iterator i = m_batch.begin(); i != m_batch.end(); i++) {
+				memcpy(i->values, b, i->size * typeSize);
+				b += i->size * typeSize;
+			}
+		}
+
+		H5Sclose(memSpace);
+		H5Sclose(fileSpace);
+		m_batch.clear();
+
+		return !checkError(err) && !overlap;
+	}
+
+	bool _puta(const size_t* start, const size_t* size, const void* values)
+	{
+		return access(start, size, values, m_type, true);
+	}
+
+	bool _puta_schar(const size_t* start, const size_t* size, const signed char* values)
+	{
+		return access(start, size, values, H5T_NATIVE_SCHAR, true);
+	}
+
+	bool _puta_uchar(const size_t* start, const size_t* size, const unsigned char* values)
+	{
+		return access(start, size, values, H5T_NATIVE_UCHAR, true);
+	}
+
+	bool _puta_short(const size_t* start, const size_t* size, const short* values)
+	{
+		return access(start, size, values, H5T_NATIVE_SHORT, true);
+	}
+
+	bool _puta_int(const size_t* start, const size_t* size, const int* values)
+	{
+		return access(start, size, values, H5T_NATIVE_INT, true);
+	}
+
+	bool _puta_long(const size_t* start, const size_t* size, const long* values)
+	{
+		return access(start, size, values, H5T_NATIVE_LONG, true);
+	}
+
+	bool _puta_float(const size_t* start, const size_t* size, const float* values)
+	{
+		return access(start, size, values, H5T_NATIVE_FLOAT, true);
+	}
+
+	bool _puta_double(const size_t* start, const size_t* size, const double* values)
+	{
+		return access(start, size, values, H5T_NATIVE_DOUBLE, true);
+	}
+
+	bool _puta_ushort(const size_t* start, const size_t* size, const unsigned short* values)
+	{
+		return access(start, size, values, H5T_NATIVE_USHORT, true);
+	}
+
+	bool _puta_uint(const size_t* start, const size_t* size, const unsigned int* values)
+	{
+		return access(start, size, values, H5T_NATIVE_UINT, true);
+	}
+
+	bool _puta_longlong(const size_t* start, const size_t* size, const long long* values)
+	{
+		return access(start, size, values, H5T_NATIVE_LLONG, true);
+	}
+
+	bool _puta_ulonglong(const size_t* start, const size_t* size, const unsigned long long* values)
+	{
+		return access(start, size, values, H5T_NATIVE_ULLONG, true);
+	}
+
+	bool _geta(const size_t* start, const size_t* size, void* values)
+	{
+		return access(start, size, values, m_type, false);
+	}
+
+	bool _geta_schar(const size_t* start, const size_t* size, signed char* values)
+	{
+		return access(start, size, values, H5T_NATIVE_SCHAR, false);
+	}
+
+	bool _geta_uchar(const size_t* start, const size_t* size, unsigned char* values)
+	{
+		return access(start, size, values, H5T_NATIVE_UCHAR, false);
+	}
+
+	bool _geta_short(const size_t* start, const size_t* size, short* values)
+	{
+		return access(start, size, values, H5T_NATIVE_SHORT, false);
+	}
+
+	bool _geta_int(const size_t* start, const size_t* size, int* values)
+	{
+		return access(start, size, values, H5T_NATIVE_INT, false);
+	}
+
+	bool _geta_long(const size_t* start, const size_t* size, long* values)
+	{
+		return access(start, size, values, H5T_NATIVE_LONG, false);
+	}
+
+	bool _geta_float(const size_t* start, const size_t* size, float* values)
+	{
+		return access(start, size, values, H5T_NATIVE_FLOAT, false);
+	}
+
+	bool _geta_double(const size_t* start, const size_t* size, double* values)
+	{
+		return access(start, size, values, H5T_NATIVE_DOUBLE, false);
+	}
+
+	bool _geta_ushort(const size_t* start, const size_t* size, unsigned short* values)
+	{
+		return access(start, size, values, H5T_NATIVE_USHORT, false);
+	}
+
+	bool _geta_uint(const size_t* start, const size_t* size, unsigned int* values)
+	{
+		return access(start, size, values, H5T_NATIVE_UINT, false);
+	}
+
+	bool _geta_longlong(const size_t* start, const size_t* size, long long* values)
+	{
+		return access(start, size, values, H5T_NATIVE_LLONG, false);
+	}
+
+	bool _geta_ulonglong(const size_t* start, const size_t* size, unsigned long long* values)
+	{
+		return access(start, size, values, H5T_NATIVE_ULLONG, false);
+	}
+
+private:
+	/**
+	 * Reads or writes a hyperslab or adds it to the current batch
+	 *
+	 * @param memType The HDF5 type of the values
+	 */
+	bool access(const size_t* start, const size_t* count, const void* values, hid_t memType, bool put)
+	{
+		Access a;
+		a.start.assign(start, start+numDims());
+		a.count.assign(count, count+numDims());
+		a.size = 1;
+		for (std::vector<hsize_t>::const_iterator i = a.count.begin(); i != a.count.end(); i++)
+			a.size *= *i;
+		a.values = static_cast<char*>(const_cast<void*>(values));
+
+		if (inBatch()) {
+			if (m_inBatch && (memType != m_batchType || put != m_batchPut)) {
+				// Different kind of access, flush the previous accesses
+				if (!flushBatch())
+					return false;
+			}
+
+			if (!m_inBatch) {
+				// All ranks register the entity (even without data) to take part
+				// in collective transfers
+				addToBatch(this);
+				m_inBatch = true;
+				m_batchType = memType;
+				m_batchPut = put;
+			}
+
+			if (a.size > 0)
+				m_batch.push_back(a);
+			return true;
+		}
+
+		hid_t fileSpace = H5Dget_space(identifier());
+		if (checkError(fileSpace))
+			return false;
+		hsize_t memSize = std::max(a.size, static_cast<size_t>(1));
+		hid_t memSpace = H5Screate_simple(1, &memSize, 0L);
+		if (a.size > 0)
+			H5Sselect_hyperslab(fileSpace, H5S_SELECT_SET, &a.start[0], 0L, &a.count[0], 0L);
+		else {
+			H5Sselect_none(fileSpace);
+			H5Sselect_none(memSpace);
+		}
+
+		herr_t err;
+		if (put)
+			err = H5Dwrite(identifier(), memType, memSpace, fileSpace, transfer(m_collectiveIO), values);
+		else
+			err = H5Dread(identifier(), memType, memSpace, fileSpace, transfer(m_collectiveIO), a.values);
+
+		H5Sclose(memSpace);
+		H5Sclose(fileSpace);
+
+		return !checkError(err);
+	}
+
+	/**
+	 * @return The HDF5 identifier for this type
+	 */
+	static hid_t type2h5(const Type &type)
+	{
+		switch (type.baseType()) {
+		case Type::CHAR:
+			return H5T_C_S1;
+		case Type::BYTE:
+			return H5T_NATIVE_SCHAR;
+		case Type::SHORT:
+			return H5T_NATIVE_SHORT;
+		case Type::INT:
+			return H5T_NATIVE_INT;
+		case Type::INT64:
+			return H5T_NATIVE_LLONG;
+		case Type::FLOAT:
+			return H5T_NATIVE_FLOAT;
+		case Type::DOUBLE:
+			return H5T_NATIVE_DOUBLE;
+		case Type::UBYTE:
+			return H5T_NATIVE_UCHAR;
+		case Type::USHORT:
+			return H5T_NATIVE_USHORT;
+		case Type::UINT:
+			return H5T_NATIVE_UINT;
+		case Type::UINT64:
+			return H5T_NATIVE_ULLONG;
+		default:
+			return type.identifier();
+		}
+	}
+};
+
+}
+
+#endif // PUML_HDF5_ENTITY_H
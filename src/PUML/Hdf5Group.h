@@ -0,0 +1,441 @@
+/**
+ * @file
+ *  This file is part of PUML
+ *
+ *  For conditions of distribution and use, please see the copyright
+ *  notice in the file 'COPYING' at the root directory of this package
+ *  and the copyright notice at https://github.com/TUM-I5/PUML
+ *
+ * @copyright 2013 Technische Universitaet Muenchen
+ * @author Sebastian Rettenberger <rettenbs@in.tum.de>
+ */
+
+#ifndef PUML_HDF5_GROUP_H
+#define PUML_HDF5_GROUP_H
+
+#include <algorithm>
+#include <cstdio>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <hdf5.h>
+#include <hdf5_hl.h>
+
+#include "PUML/Dimension.h"
+#include "PUML/Group.h"
+#include "PUML/Hdf5Element.h"
+#include "PUML/Hdf5Entity.h"
+
+namespace PUML
+{
+
+/**
+ * A group stored as HDF5 group
+ *
+ * Uses the same layout as NetcdfGroup: dimensions are dimension scales
+ * (as created by netCDF-4) and entities are datasets attached to them.
+ * Time-dependent entities are not supported.
+ */
+class Hdf5Group : public Group, public Hdf5Element
+{
+private:
+	/** Dimension scale for the partitions */
+	hid_t m_dimPartition;
+
+	/** Dimension scale for the size */
+	hid_t m_dimSize;
+
+	/** Dimension scale for the index size */
+	hid_t m_dimIndexSize;
+
+	/** User defined dimensions (std::list does not move the elements) */
+	std::list<Dimension> m_dimensions;
+
+	/** The offset dataset */
+	hid_t m_varOffset;
+
+	/** index variable */
+	Hdf5Entity m_entityIndex;
+
+	/** type offset variable (mixed cell groups only) */
+	Hdf5Entity m_entityTypeOffset;
+
+	/** Entities in this group */
+	std::map<std::string, Hdf5Entity> m_entities;
+
+	/** Minimum/maximum variables of entities (accessed by the variable name) */
+	std::map<std::string, Hdf5Entity> m_statistics;
+
+public:
+	Hdf5Group()
+		: m_dimPartition(-1), m_dimSize(-1), m_dimIndexSize(-1), m_varOffset(-1)
+	{
+	}
+
+	/**
+	 * @param size The total size of this group (must be known)
+	 */
+	Hdf5Group(const char* name, size_t numPartitions, Hdf5Element &pum, MPIElement &comm, size_t size)
+		: Group(name, numPartitions, comm), Hdf5Element(&pum),
+		  m_dimPartition(-1), m_dimSize(-1), m_dimIndexSize(-1), m_varOffset(-1)
+	{
+		hid_t group = addHandle(H5Gcreate2(pum.identifier(), name, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT));
+		if (checkError(group))
+			return;
+		setIdentifier(group);
+
+		m_dimPartition = createScale(DIM_PARTITION, numPartitions);
+		m_dimSize = createScale(DIM_SIZE, size);
+		if (!isValid())
+			return;
+
+		Hdf5Entity offset(VAR_OFFSET, Type::UINT64, m_dimPartition, 0, 0L, this->offset(), 0L, *this, *this);
+		m_varOffset = offset.identifier();
+	}
+
+	/**
+	 * Constructor to load a group from the HDF5 file (collective)
+	 */
+	Hdf5Group(const char* name, Hdf5Element &pum, MPIElement &comm)
+		: Group(comm), Hdf5Element(&pum),
+		  m_dimPartition(-1), m_dimSize(-1), m_dimIndexSize(-1), m_varOffset(-1)
+	{
+		setName(name);
+
+		hid_t group = addHandle(H5Gopen2(pum.identifier(), name, H5P_DEFAULT));
+		if (checkError(group))
+			return;
+		setIdentifier(group);
+
+		m_dimPartition = open(DIM_PARTITION);
+		m_dimSize = open(DIM_SIZE);
+		m_varOffset = open(VAR_OFFSET);
+		if (!isValid())
+			return;
+
+		// The partitions of indexed groups are stored in the index dimension
+		hid_t dimTotal = m_dimSize;
+		if (H5Lexists(identifier(), DIM_INDEXSIZE, H5P_DEFAULT) > 0) {
+			m_dimIndexSize = open(DIM_INDEXSIZE);
+			dimTotal = m_dimIndexSize;
+		}
+
+		// Read offsets
+		std::vector<unsigned long long> o(Hdf5Entity::dimLength(m_dimPartition)+1);
+		if (checkError(H5Dread(m_varOffset, H5T_NATIVE_ULLONG, H5S_ALL, H5S_ALL, transfer(true), &o[0])))
+			return;
+		o.back() = Hdf5Entity::dimLength(dimTotal);
+
+		offset().assign(o.begin(), o.end());
+	}
+
+	Dimension& createDimension(const char* name, size_t size)
+	{
+		m_dimensions.push_back(Dimension(createScale(name, size), name, size));
+
+		return m_dimensions.back();
+	}
+
+	Hdf5Entity* createEntity(const char* name, const Type &type, size_t numDimensions, Dimension* dimensions)
+	{
+		Hdf5Entity entity = Hdf5Entity(name, type, m_dimSize, numDimensions, dimensions,
+				offset(), (indexed() ? &m_entityIndex : 0L), *this, *this);
+		if (!entity.isValid())
+			return 0L;
+
+		m_entities[name] = entity;
+
+		return &m_entities[name];
+	}
+
+	/**
+	 * @overload
+	 */
+	Hdf5Entity* createEntity(const char* name, const Type &type, std::vector<Dimension> &dimensions)
+	{
+		return createEntity(name, type, dimensions.size(), &dimensions[0]);
+	}
+
+	/**
+	 * @overload
+	 */
+	Hdf5Entity* createEntity(const char* name, const Type &type)
+	{
+		return createEntity(name, type, 0, 0L);
+	}
+
+	/**
+	 * Not supported
+	 */
+	Hdf5Entity* createTimeEntity(const char* name, const Type &type, size_t numDimensions, Dimension* dimensions)
+	{
+		return 0L;
+	}
+
+	size_t numSteps()
+	{
+		return 0;
+	}
+
+	/**
+	 * @return The number of elements stored in the file. For indexed groups
+	 *  this is the size of the data, not the size of the index.
+	 */
+	size_t dataSize()
+	{
+		return Hdf5Entity::dimLength(m_dimSize);
+	}
+
+	/**
+	 * Entities of groups loaded from a file are loaded on the first call
+	 */
+	Hdf5Entity* getEntity(const char* name)
+	{
+		std::map<std::string, Hdf5Entity>::iterator it = m_entities.find(name);
+		if (it != m_entities.end())
+			return &it->second;
+
+		return loadEntity(name);
+	}
+
+	/**
+	 * Loads the index and the type offsets from the HDF5 file. Other
+	 * entities are loaded on demand.
+	 * We can't do this in the constructor because this results in wrong values for m_parent
+	 *
+	 * @internal
+	 */
+	bool loadEntities()
+	{
+		// Get index if exists
+		if (m_dimIndexSize >= 0) {
+			hid_t index = open(VAR_INDEX);
+			if (index < 0)
+				return false;
+
+			m_entityIndex = Hdf5Entity(VAR_INDEX, index, offset(), 0L, *this, *this);
+
+			setEntityIndex(&m_entityIndex);
+		}
+
+		// Get type offsets if exist
+		if (H5Lexists(identifier(), VAR_TYPEOFFSET, H5P_DEFAULT) > 0) {
+			hid_t typeOffset = open(VAR_TYPEOFFSET);
+			if (typeOffset < 0)
+				return false;
+
+			m_entityTypeOffset = Hdf5Entity(VAR_TYPEOFFSET, typeOffset, offset(), 0L, *this, *this);
+
+			setEntityTypeOffset(&m_entityTypeOffset);
+		}
+
+		return isValid();
+	}
+
+protected:
+	bool setOffset(size_t partition)
+	{
+		if (partition >= numPartitions())
+			// The last partition sets the offset for the first one
+			partition = 0;
+
+		hsize_t start = partition;
+		hsize_t count = 1;
+		unsigned long long o = offset()[partition];
+
+		return writeOffsets(start, count, &o);
+	}
+
+	bool setOffsets()
+	{
+		// The first rank writes all offsets
+		std::vector<unsigned long long> o(offset().begin(), offset().end()-1);
+
+		return writeOffsets(0, (mpiRank() == 0 ? numPartitions() : 0), &o[0]);
+	}
+
+	Hdf5Entity* _addIndex(size_t indexSize)
+	{
+		m_dimIndexSize = createScale(DIM_INDEXSIZE, indexSize);
+		if (!isValid())
+			return 0L;
+
+		m_entityIndex = Hdf5Entity(VAR_INDEX, Type::UINT64, m_dimIndexSize, 0, 0L, offset(), 0L, *this, *this);
+
+		return &m_entityIndex;
+	}
+
+	bool _addStatistics(Entity &entity)
+	{
+		Hdf5Entity &h5Entity = static_cast<Hdf5Entity&>(entity);
+
+		// Use the same user dimensions as the entity
+		const std::vector<hid_t> &dimIds = h5Entity.dimensions();
+		if (dimIds.empty())
+			return false;
+
+		std::vector<Dimension> dims;
+		for (size_t i = 1; i < dimIds.size(); i++) // Skip the size dimension
+			dims.push_back(Dimension(dimIds[i], "", Hdf5Entity::dimLength(dimIds[i])));
+
+		std::string minName = statisticsName(entity.name(), VAR_MIN_SUFFIX);
+		std::string maxName = statisticsName(entity.name(), VAR_MAX_SUFFIX);
+		m_statistics[minName] = Hdf5Entity(minName.c_str(), Type::DOUBLE, m_dimPartition,
+				dims.size(), (dims.empty() ? 0L : &dims[0]), offset(), 0L, *this, *this);
+		m_statistics[maxName] = Hdf5Entity(maxName.c_str(), Type::DOUBLE, m_dimPartition,
+				dims.size(), (dims.empty() ? 0L : &dims[0]), offset(), 0L, *this, *this);
+		if (!isValid())
+			return false;
+
+		entity.setStatistics(&m_statistics[minName], &m_statistics[maxName]);
+
+		return true;
+	}
+
+	void _loadedEntities(std::vector<Entity*> &entities)
+	{
+		if (indexed())
+			entities.push_back(&m_entityIndex);
+		if (mixed())
+			entities.push_back(&m_entityTypeOffset);
+
+		for (std::map<std::string, Hdf5Entity>::iterator i = m_entities.begin();
+				i != m_entities.end(); i++)
+			entities.push_back(&i->second);
+		for (std::map<std::string, Hdf5Entity>::iterator i = m_statistics.begin();
+				i != m_statistics.end(); i++)
+			entities.push_back(&i->second);
+	}
+
+	Hdf5Entity* _addTypeOffset()
+	{
+		Dimension &dim = createDimension(DIM_CELLTYPE, NUM_CELL_TYPES+1);
+		if (!isValid())
+			return 0L;
+
+		m_entityTypeOffset = Hdf5Entity(VAR_TYPEOFFSET, Type::UINT64, m_dimPartition, 1, &dim,
+				offset(), 0L, *this, *this);
+
+		return &m_entityTypeOffset;
+	}
+
+private:
+	/**
+	 * Creates a dimension without a variable (same as netCDF-4)
+	 *
+	 * @return The dimension scale
+	 */
+	hid_t createScale(const char* name, size_t size)
+	{
+		hsize_t length = size;
+		hid_t space = H5Screate_simple(1, &length, 0L);
+		hid_t properties = H5Pcreate(H5P_DATASET_CREATE);
+		H5Pset_fill_time(properties, H5D_FILL_TIME_NEVER);
+		hid_t scale = addHandle(H5Dcreate2(identifier(), name, H5T_IEEE_F32BE, space,
+			H5P_DEFAULT, properties, H5P_DEFAULT));
+		H5Pclose(properties);
+		H5Sclose(space);
+		if (checkError(scale))
+			return -1;
+
+		// NAME of netCDF-4 dimension scales without a variable
+		char scaleName[80];
+		sprintf(scaleName, "This is a netCDF dimension but not a netCDF variable.%10d", static_cast<int>(size));
+		if (checkError(H5DSset_scale(scale, scaleName)))
+			return -1;
+
+		return scale;
+	}
+
+	/**
+	 * Opens a dataset of the group
+	 */
+	hid_t open(const char* name)
+	{
+		hid_t dataset = addHandle(H5Dopen2(identifier(), name, H5P_DEFAULT));
+		checkError(dataset);
+		return dataset;
+	}
+
+	/**
+	 * Writes a range of the offset variable (collective)
+	 */
+	bool writeOffsets(hsize_t start, hsize_t count, const unsigned long long* offsets)
+	{
+		hid_t fileSpace = H5Dget_space(m_varOffset);
+		if (checkError(fileSpace))
+			return false;
+		hsize_t memSize = std::max(count, static_cast<hsize_t>(1));
+		hid_t memSpace = H5Screate_simple(1, &memSize, 0L);
+		if (count > 0)
+			H5Sselect_hyperslab(fileSpace, H5S_SELECT_SET, &start, 0L, &count, 0L);
+		else {
+			H5Sselect_none(fileSpace);
+			H5Sselect_none(memSpace);
+		}
+
+		herr_t err = H5Dwrite(m_varOffset, H5T_NATIVE_ULLONG, memSpace, fileSpace, transfer(true), offsets);
+		H5Sclose(memSpace);
+		H5Sclose(fileSpace);
+
+		return !checkError(err);
+	}
+
+	/**
+	 * Loads an entity from the HDF5 file
+	 *
+	 * @return The entity or NULL if the entity does not exist
+	 */
+	Hdf5Entity* loadEntity(const char* name)
+	{
+		if (name[0] == '_')
+			// Internal variable
+			return 0L;
+
+		if (H5Lexists(identifier(), name, H5P_DEFAULT) <= 0)
+			return 0L;
+
+		hid_t dataset = open(name);
+		if (dataset < 0)
+			return 0L;
+
+		if (H5Lexists(identifier(), DIM_TIME, H5P_DEFAULT) > 0) {
+			// Time-dependent entities are not supported
+			hid_t time = open(DIM_TIME);
+			if (time < 0 || H5DSis_attached(dataset, time, 0) != 0)
+				return 0L;
+		}
+
+		Hdf5Entity &entity = m_entities[name];
+		entity = Hdf5Entity(name, dataset, offset(), (indexed() ? &m_entityIndex : 0L), *this, *this);
+
+		// Load statistics if available
+		std::string minName = statisticsName(name, VAR_MIN_SUFFIX);
+		std::string maxName = statisticsName(name, VAR_MAX_SUFFIX);
+		if (H5Lexists(identifier(), minName.c_str(), H5P_DEFAULT) > 0
+				&& H5Lexists(identifier(), maxName.c_str(), H5P_DEFAULT) > 0) {
+			m_statistics[minName] = Hdf5Entity(minName.c_str(), open(minName.c_str()), offset(), 0L, *this, *this);
+			m_statistics[maxName] = Hdf5Entity(maxName.c_str(), open(maxName.c_str()), offset(), 0L, *this, *this);
+			entity.setStatistics(&m_statistics[minName], &m_statistics[maxName]);
+		}
+
+		if (!isValid())
+			return 0L;
+
+		return &entity;
+	}
+
+	/**
+	 * @return The name of the variable that stores the minimum/maximum of an entity
+	 */
+	static std::string statisticsName(const std::string &name, const char* suffix)
+	{
+		return "_" + name + suffix;
+	}
+};
+
+}
+
+#endif // PUML_HDF5_GROUP_H
@@ -0,0 +1,493 @@
+/**
+ * @file
+ *  This file is part of PUML
+ *
+ *  For conditions of distribution and use, please see the copyright
+ *  notice in the file 'COPYING' at the root directory of this package
+ *  and the copyright notice at https://github.com/TUM-I5/PUML
+ *
+ * @copyright 2013 Technische Universitaet Muenchen
+ * @author Sebastian Rettenberger <rettenbs@in.tum.de>
+ */
+
+#ifndef PUML_HDF5_PUM_H
+#define PUML_HDF5_PUM_H
+
+#ifdef PARALLEL
+#include <mpi.h>
+#endif // PARALLEL
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <hdf5.h>
+
+#include "PUML/Hdf5Element.h"
+#include "PUML/Hdf5Group.h"
+#include "PUML/Pum.h"
+
+namespace PUML
+{
+
+/**
+ * A PUM file accessed directly with HDF5
+ *
+ * Reads and writes the same layout as NetcdfPum, files can be read with
+ * both classes. Compared to NetcdfPum:
+ * - Accesses of a batch (all ranges of an indexed partition in
+ *  Entity::get/put, all entities in Group::getRow/putRow) are one
+ *  H5Dread/H5Dwrite per entity with a union of hyperslabs.
+ * - In the parallel version, metadata is read and written collectively.
+ * - Paged file space aggregation can be enabled with setPageSize, the
+ *  metadata cache can be configured with setMetadataCache.
+ * - The sizes of all groups must be known in advance (use the size
+ *  parameter of createGroup or Pum::planSize).
+ * - Time-dependent entities, subfiles and checkpoint files are not supported.
+ */
+class Hdf5Pum : public Pum, public Hdf5Element
+{
+private:
+	/** Groups in this file */
+	std::map<std::string, Hdf5Group> m_groups;
+
+	/** Page size for the file space (0 to disable paging) */
+	size_t m_pageSize;
+
+	/** Initial size of the metadata cache (0 for the HDF5 default) */
+	size_t m_metadataCacheSize;
+
+	/** Allow evictions from the metadata cache */
+	bool m_metadataEvictions;
+
+#ifdef PARALLEL
+	/** Collective metadata operations */
+	bool m_collectiveMetadata;
+#endif // PARALLEL
+
+public:
+	Hdf5Pum()
+		: m_pageSize(0), m_metadataCacheSize(0), m_metadataEvictions(true)
+#ifdef PARALLEL
+		  , m_collectiveMetadata(true)
+#endif // PARALLEL
+	{
+	}
+
+	virtual ~Hdf5Pum()
+	{
+		closeFile();
+	}
+
+	bool open(const char* path)
+	{
+		hid_t access = fileAccess();
+		bool success = openFile(path, access);
+		H5Pclose(access);
+
+		return success;
+	}
+
+#ifdef PARALLEL
+	/**
+	 * Overridden to work around overload/subclass issues
+	 */
+	bool open(const char* path, MPI_Comm comm, MPI_Info info = MPI_INFO_NULL)
+	{
+		return Pum::open(path, comm, info);
+	}
+#endif // PARALLEL
+
+	/**
+	 * Enables paged aggregation of the file space for the next create
+	 *
+	 * Small metadata and raw data allocations are aggregated into pages of
+	 * this size (requires HDF5 1.10).
+	 *
+	 * @param pageSize The page size in bytes or 0 to disable paging
+	 */
+	void setPageSize(size_t pageSize)
+	{
+		m_pageSize = pageSize;
+	}
+
+	/**
+	 * Configures the metadata cache for the next create or open
+	 *
+	 * A large cache without evictions keeps all metadata in memory until the
+	 * file is flushed (Pum::checkpoint) or closed. This avoids metadata writes
+	 * during write-heavy phases, but the cache grows with the metadata.
+	 *
+	 * @param size The initial size of the cache in bytes or 0 for the HDF5 default
+	 * @param evictions False to disable evictions and automatic resizing
+	 */
+	void setMetadataCache(size_t size, bool evictions = true)
+	{
+		m_metadataCacheSize = size;
+		m_metadataEvictions = evictions;
+	}
+
+#ifdef PARALLEL
+	/**
+	 * Enable/disable collective metadata reads and writes for the next
+	 * parallel create or open (enabled by default)
+	 *
+	 * If enabled, all metadata operations (e.g. createGroup, getGroup,
+	 * Group::getEntity) must be called collectively.
+	 */
+	void setCollectiveMetadata(bool collectiveMetadata)
+	{
+		m_collectiveMetadata = collectiveMetadata;
+	}
+#endif // PARALLEL
+
+	/**
+	 * In the parallel version this is a collective function.
+	 *
+	 * @param size The total size of the group (required if no partition sizes
+	 *  are declared with Pum::planSize)
+	 */
+	Hdf5Group* createGroup(const char* name, size_t size = Group::UNLIMITED)
+	{
+		return static_cast<Hdf5Group*>(Pum::createGroup(name, size));
+	}
+
+	/**
+	 * @copydoc createGroup
+	 *
+	 * @param indexSize The total size of the index (required if no partition
+	 *  sizes are declared with Pum::planSize)
+	 */
+	Hdf5Group* createGroupIndexed(const char* name, size_t size = Group::UNLIMITED, size_t indexSize = Group::UNLIMITED)
+	{
+		return static_cast<Hdf5Group*>(Pum::createGroupIndexed(name, size, indexSize));
+	}
+
+	/**
+	 * Groups of opened files are loaded on the first call. In the parallel
+	 * version the first call for each group is collective.
+	 */
+	Hdf5Group* getGroup(const char* name)
+	{
+		std::map<std::string, Hdf5Group>::iterator it = m_groups.find(name);
+		if (it != m_groups.end())
+			return &it->second;
+
+		return loadGroup(name);
+	}
+
+	bool endDefinition()
+	{
+		if (!Pum::endDefinition())
+			return false;
+
+		return writePlannedSizes();
+	}
+
+	bool close()
+	{
+		// Close the file in any case, the first error is kept
+		bool success = closeCounters();
+		return closeFile() && success;
+	}
+
+protected:
+	bool _create(const char* path)
+	{
+		hid_t access = fileAccess();
+		bool success = createFile(path, access);
+		H5Pclose(access);
+
+		return success;
+	}
+
+	/**
+	 * Defines the dimensions and the offsets of a group
+	 */
+	Hdf5Group* _createGroup(const char* name, size_t size, bool indexed, size_t indexSize, bool planned)
+	{
+		if (size == Group::UNLIMITED)
+			// The size must be known in advance
+			return 0L;
+		if (indexed && indexSize == Group::UNLIMITED)
+			return 0L;
+
+		Hdf5Group group = Hdf5Group(name, numPartitions(), *this, *this, size);
+		if (!group.isValid())
+			return 0L;
+
+		m_groups[name] = group;
+
+		if (indexed) {
+			m_groups[name].addIndex(indexSize);
+			if (!isValid())
+				return 0L;
+		}
+
+		return &m_groups[name];
+	}
+
+	/**
+	 * In the parallel version, the metadata cache is flushed collectively
+	 */
+	bool _flush()
+	{
+		return !checkError(H5Fflush(identifier(), H5F_SCOPE_GLOBAL));
+	}
+
+#ifdef PARALLEL
+	bool _create(const char* path, MPI_Comm comm, MPI_Info info = MPI_INFO_NULL)
+	{
+		hid_t access = parallelAccess(comm, info);
+		bool success = createFile(path, access);
+		H5Pclose(access);
+
+		if (!success)
+			return false;
+
+		initTransfer();
+		return true;
+	}
+
+	bool _open(const char* path, MPI_Comm comm, MPI_Info info = MPI_INFO_NULL)
+	{
+		hid_t access = parallelAccess(comm, info);
+		bool success = openFile(path, access);
+		H5Pclose(access);
+
+		if (!success)
+			return false;
+
+		initTransfer();
+		return true;
+	}
+#endif // PARALLEL
+
+	void _loadedGroups(std::vector<Group*> &groups)
+	{
+		for (std::map<std::string, Hdf5Group>::iterator i = m_groups.begin();
+				i != m_groups.end(); i++)
+			groups.push_back(&i->second);
+	}
+
+private:
+	bool createFile(const char* path, hid_t access)
+	{
+		closeFile();
+
+		hid_t creation = H5Pcreate(H5P_FILE_CREATE);
+		if (m_pageSize > 0) {
+			H5Pset_file_space_strategy(creation, H5F_FSPACE_STRATEGY_PAGE, 0, 1);
+			H5Pset_file_space_page_size(creation, m_pageSize);
+		}
+		hid_t file = H5Fcreate(path, H5F_ACC_TRUNC, creation, access);
+		H5Pclose(creation);
+		if (checkError(file))
+			return false;
+		setIdentifier(file);
+
+		return initFile();
+	}
+
+	bool openFile(const char* path, hid_t access)
+	{
+		closeFile();
+
+		hid_t file = H5Fopen(path, H5F_ACC_RDONLY, access);
+		if (checkError(file))
+			return false;
+		setIdentifier(file);
+
+		return loadFile();
+	}
+
+	/**
+	 * Closes all handles and the file
+	 */
+	bool closeFile()
+	{
+		m_groups.clear();
+
+		if (identifier() < 0)
+			return true;
+
+		closeHandles();
+		herr_t err = H5Fclose(identifier());
+		setIdentifier(-1);
+
+		return !checkError(err);
+	}
+
+	/**
+	 * @return File access properties with the metadata cache configuration
+	 */
+	hid_t fileAccess()
+	{
+		hid_t access = H5Pcreate(H5P_FILE_ACCESS);
+		if (m_metadataCacheSize == 0 && m_metadataEvictions)
+			return access;
+
+		H5AC_cache_config_t config;
+		config.version = H5AC__CURR_CACHE_CONFIG_VERSION;
+		H5Pget_mdc_config(access, &config);
+
+		if (m_metadataCacheSize > 0) {
+			config.set_initial_size = true;
+			config.initial_size = m_metadataCacheSize;
+			config.min_size = std::min(config.min_size, m_metadataCacheSize);
+			config.max_size = std::max(config.max_size, m_metadataCacheSize);
+		}
+		if (!m_metadataEvictions) {
+			config.evictions_enabled = false;
+			config.incr_mode = H5C_incr__off;
+			config.flash_incr_mode = H5C_flash_incr__off;
+			config.decr_mode = H5C_decr__off;
+		}
+
+		H5Pset_mdc_config(access, &config);
+
+		return access;
+	}
+
+#ifdef PARALLEL
+	/**
+	 * @return File access properties for MPI-IO
+	 */
+	hid_t parallelAccess(MPI_Comm comm, MPI_Info info)
+	{
+		hid_t access = fileAccess();
+		H5Pset_fapl_mpio(access, comm, info);
+		if (m_collectiveMetadata) {
+			H5Pset_all_coll_metadata_ops(access, 1);
+			H5Pset_coll_metadata_write(access, 1);
+		}
+
+		return access;
+	}
+
+	/**
+	 * Creates the independent and collective transfer properties
+	 */
+	void initTransfer()
+	{
+		hid_t independent = addHandle(H5Pcreate(H5P_DATASET_XFER));
+		H5Pset_dxpl_mpio(independent, H5FD_MPIO_INDEPENDENT);
+		hid_t collective = addHandle(H5Pcreate(H5P_DATASET_XFER));
+		H5Pset_dxpl_mpio(collective, H5FD_MPIO_COLLECTIVE);
+
+		setTransfer(independent, collective);
+	}
+#endif // PARALLEL
+
+	/**
+	 * Initialize a new HDF5 pum file (same attributes as netCDF-4)
+	 */
+	bool initFile()
+	{
+		setTransfer(H5P_DEFAULT, H5P_DEFAULT);
+
+		// Fixed length string
+		hid_t text = H5Tcopy(H5T_C_S1);
+		H5Tset_size(text, CONVENTIONS.size());
+		bool success = putAttribute(ATT_CONVENTIONS, text, CONVENTIONS.c_str());
+		H5Tclose(text);
+
+		unsigned long long np = numPartitions();
+		return success
+			&& putAttribute(ATT_FILE_VERSION, H5T_NATIVE_INT, &FILE_VERSION)
+			&& putAttribute(ATT_NUM_PARTITIONS, H5T_NATIVE_ULLONG, &np);
+	}
+
+	/**
+	 * Check HDF5 pum file
+	 */
+	bool loadFile()
+	{
+		setTransfer(H5P_DEFAULT, H5P_DEFAULT);
+
+		hid_t attribute = H5Aopen(identifier(), ATT_CONVENTIONS, H5P_DEFAULT);
+		if (checkError(attribute))
+			return false;
+		hid_t type = H5Aget_type(attribute);
+		std::vector<char> conventions(H5Aget_storage_size(attribute)+1); // Use std::vector to avoid memory leaks
+		herr_t err = H5Aread(attribute, type, &conventions[0]);
+		H5Tclose(type);
+		H5Aclose(attribute);
+		if (checkError(err))
+			return false;
+		if (CONVENTIONS.compare(&conventions[0]) != 0)
+			return false;
+
+		int fileVersion;
+		if (!getAttribute(ATT_FILE_VERSION, H5T_NATIVE_INT, &fileVersion))
+			return false;
+		if (fileVersion != FILE_VERSION)
+			// Currently only one version is supported
+			return false;
+
+		// Number of partitions
+		unsigned long long np;
+		if (!getAttribute(ATT_NUM_PARTITIONS, H5T_NATIVE_ULLONG, &np))
+			return false;
+		setNumPartitions(np);
+
+		return true;
+	}
+
+	/**
+	 * Writes a scalar attribute of the file
+	 */
+	bool putAttribute(const char* name, hid_t type, const void* value)
+	{
+		hid_t space = H5Screate(H5S_SCALAR);
+		hid_t attribute = H5Acreate2(identifier(), name, type, space, H5P_DEFAULT, H5P_DEFAULT);
+		H5Sclose(space);
+		if (checkError(attribute))
+			return false;
+
+		herr_t err = H5Awrite(attribute, type, value);
+		H5Aclose(attribute);
+
+		return !checkError(err);
+	}
+
+	/**
+	 * Reads a scalar attribute of the file
+	 */
+	bool getAttribute(const char* name, hid_t type, void* value)
+	{
+		hid_t attribute = H5Aopen(identifier(), name, H5P_DEFAULT);
+		if (checkError(attribute))
+			return false;
+
+		herr_t err = H5Aread(attribute, type, value);
+		H5Aclose(attribute);
+
+		return !checkError(err);
+	}
+
+	/**
+	 * Loads a group from the file
+	 *
+	 * @return The group or NULL if the group does not exist
+	 */
+	Hdf5Group* loadGroup(const char* name)
+	{
+		if (H5Lexists(identifier(), name, H5P_DEFAULT) <= 0)
+			return 0L;
+
+		Hdf5Group &group = m_groups[name];
+		group = Hdf5Group(name, *this, *this);
+		if (!group.isValid() || !group.loadEntities()) {
+			m_groups.erase(name);
+			return 0L;
+		}
+
+		return &group;
+	}
+};
+
+}
+
+#endif // PUML_HDF5_PUM_H
@@ -0,0 +1,166 @@
+/**
+ * @file
+ *  This file is part of PUML
+ *
+ *  For conditions of distribution and use, please see the copyright
+ *  notice in the file 'COPYING' at the root directory of this package
+ *  and the copyright notice at https://github.com/TUM-I5/PUML
+ *
+ * @copyright 2013 Technische Universitaet Muenchen
+ * @author Sebastian Rettenberger <rettenbs@in.tum.de>
+ */
+
+#ifndef PUML_IO_COUNTERS_H
+#define PUML_IO_COUNTERS_H
+
+#ifdef PARALLEL
+#include <mpi.h>
+#else // PARALLEL
+#include <sys/time.h>
+#endif // PARALLEL
+
+#include <cstddef>
+
+namespace PUML
+{
+
+/**
+ * I/O counters of an entity, a group or a file
+ *
+ * @see Entity::counters
+ */
+struct IOCounters
+{
+	/** Number of buckets in the range histogram */
+	static const unsigned int NUM_RANGE_BUCKETS = 16;
+
+	/** Number of values returned by toArray */
+	static const unsigned int NUM_VALUES = 7 + NUM_RANGE_BUCKETS;
+
+	/** Number of read accesses */
+	unsigned long getCalls;
+
+	/** Number of write accesses */
+	unsigned long putCalls;
+
+	/** Number of bytes read */
+	unsigned long getBytes;
+
+	/** Number of bytes written */
+	unsigned long putBytes;
+
+	/** Number of zero-size accesses required for collective I/O */
+	unsigned long paddingAccesses;
+
+	/**
+	 * Number of contiguous ranges of indexed accesses by length.
+	 * Bucket i counts ranges with 2^i <= length < 2^(i+1), the last bucket
+	 * contains all larger ranges.
+	 */
+	unsigned long ranges[NUM_RANGE_BUCKETS];
+
+	/** Time spent in netCDF calls (in seconds) */
+	double ioTime;
+
+	/** Time spent in MPI collectives (in seconds) */
+	double mpiTime;
+
+	IOCounters()
+	{
+		reset();
+	}
+
+	void reset()
+	{
+		getCalls = putCalls = 0;
+		getBytes = putBytes = 0;
+		paddingAccesses = 0;
+		for (unsigned int i = 0; i < NUM_RANGE_BUCKETS; i++)
+			ranges[i] = 0;
+		ioTime = mpiTime = 0;
+	}
+
+	void addRange(size_t length)
+	{
+		unsigned int bucket = 0;
+		while (length > 1 && bucket < NUM_RANGE_BUCKETS-1) {
+			length >>= 1;
+			bucket++;
+		}
+
+		ranges[bucket]++;
+	}
+
+	IOCounters& operator+=(const IOCounters &other)
+	{
+		getCalls += other.getCalls;
+		putCalls += other.putCalls;
+		getBytes += other.getBytes;
+		putBytes += other.putBytes;
+		paddingAccesses += other.paddingAccesses;
+		for (unsigned int i = 0; i < NUM_RANGE_BUCKETS; i++)
+			ranges[i] += other.ranges[i];
+		ioTime += other.ioTime;
+		mpiTime += other.mpiTime;
+
+		return *this;
+	}
+
+	/**
+	 * Converts all counters to doubles (in the order of the member variables)
+	 *
+	 * @param values Buffer for NUM_VALUES values
+	 */
+	void toArray(double* values) const
+	{
+		values[0] = getCalls;
+		values[1] = putCalls;
+		values[2] = getBytes;
+		values[3] = putBytes;
+		values[4] = paddingAccesses;
+		for (unsigned int i = 0; i < NUM_RANGE_BUCKETS; i++)
+			values[5+i] = ranges[i];
+		values[5+NUM_RANGE_BUCKETS] = ioTime;
+		values[6+NUM_RANGE_BUCKETS] = mpiTime;
+	}
+
+	/**
+	 * @return The current wall clock time in seconds
+	 */
+	static double time()
+	{
+#ifdef PARALLEL
+		return MPI_Wtime();
+#else // PARALLEL
+		struct timeval tv;
+		gettimeofday(&tv, 0L);
+		return tv.tv_sec + tv.tv_usec * 1.e-6;
+#endif // PARALLEL
+	}
+};
+
+/**
+ * Adds the time between construction and destruction to a counter
+ */
+class IOTimer
+{
+private:
+	double &m_time;
+
+	double m_start;
+
+public:
+	IOTimer(double &time)
+		: m_time(time), m_start(IOCounters::time())
+	{
+	}
+
+	~IOTimer()
+	{
+		m_time += IOCounters::time() - m_start;
+	}
+};
+
+}
+
+#endif // PUML_IO_COUNTERS_H
@@ -0,0 +1,552 @@
+/**
+ * @file
+ *  This file is part of PUML
+ *
+ *  For conditions of distribution and use, please see the copyright
+ *  notice in the file 'COPYING' at the root directory of this package
+ *  and the copyright notice at https://github.com/TUM-I5/PUML
+ *
+ * @copyright 2013 Technische Universitaet Muenchen
+ * @author Sebastian Rettenberger <rettenbs@in.tum.de>
+ */
+
+#ifndef PUML_MPIIO_ELEMENT_H
+#define PUML_MPIIO_ELEMENT_H
+
+#include <algorithm>
+#include <cstring>
+#include <list>
+#include <string>
+#include <vector>
+
+#include <mpi.h>
+
+namespace PUML
+{
+
+/**
+ * Contains basic functionality to handle an element (file, group, entity)
+ * of a PUM file stored with plain MPI-IO
+ *
+ * The file element collects the contiguous blocks of all accesses of a
+ * batch. At the end of the batch, the blocks are sorted by their position in
+ * the file and transferred with one file view (a derived datatype) and one
+ * collective read or write.
+ *
+ * Writes can be deferred (see deferWrites): the values are copied and
+ * written by a nonblocking collective write started with beginFlush and
+ * completed with endFlush.
+ */
+class MpiioElement
+{
+private:
+	/**
+	 * A contiguous access
+	 */
+	struct Block
+	{
+		/** Position in the file (in bytes) */
+		MPI_Offset position;
+		/** Position in memory */
+		char* memory;
+		/** Number of bytes */
+		size_t size;
+
+		bool operator<(const Block &other) const
+		{
+			return position < other.position;
+		}
+	};
+
+	/**
+	 * Converts values after they have been read
+	 */
+	struct Conversion
+	{
+		void (*convert)(int type, const void* src, size_t n, void* dst);
+		int type;
+		const void* src;
+		size_t n;
+		void* dst;
+	};
+
+	/**
+	 * Accesses that are transferred together
+	 */
+	struct Transfer
+	{
+		/** -1 no access yet, 0 reads, 1 writes */
+		int kind;
+		std::vector<Block> blocks;
+		/** Buffers owned by the transfer (std::list does not move the elements) */
+		std::list<std::vector<char> > buffers;
+		std::vector<Conversion> conversions;
+
+		Transfer()
+			: kind(-1)
+		{
+		}
+
+		void clear()
+		{
+			kind = -1;
+			blocks.clear();
+			buffers.clear();
+			conversions.clear();
+		}
+	};
+
+	/** MPI file handle */
+	MPI_File m_file;
+
+	/** Parent element */
+	MpiioElement* m_parent;
+
+	/** MPI error (or MPI_SUCCESS if no error occurred) */
+	int m_mpiError;
+
+	/** Number of open batches (top most element only) */
+	unsigned int m_batchDepth;
+
+	/** Accesses of the current batch (top most element only) */
+	Transfer m_batch;
+
+	/** True if writes are deferred (top most element only) */
+	bool m_deferWrites;
+
+	/** True if any writes were deferred, consistent on all ranks (top most element only) */
+	bool m_deferredPending;
+
+	/** Deferred writes (top most element only) */
+	Transfer m_deferred;
+
+	/** Writes of the nonblocking collective write (top most element only) */
+	Transfer m_flushing;
+
+	/** Request of the nonblocking collective write (top most element only) */
+	MPI_Request m_request;
+
+	/** Maximum size of one block (the block lengths of MPI datatypes are int) */
+	static const size_t MAX_BLOCK_SIZE = 1ul << 30;
+
+public:
+	MpiioElement(MpiioElement* parent = 0L)
+		: m_file(MPI_FILE_NULL), m_parent(parent), m_mpiError(MPI_SUCCESS), m_batchDepth(0),
+		  m_deferWrites(false), m_deferredPending(false), m_request(MPI_REQUEST_NULL)
+	{
+	}
+
+	virtual ~MpiioElement()
+	{
+	}
+
+	/**
+	 * @return The MPI file handle
+	 *
+	 * @ingroup LowLevelApi
+	 */
+	MPI_File identifier() const
+	{
+		if (m_parent)
+			return m_parent->identifier();
+
+		return m_file;
+	}
+
+	/**
+	 * @return True if no error occurred, false otherwise
+	 */
+	bool isValid() const
+	{
+		if (m_parent)
+			return m_parent->isValid();
+
+		return m_mpiError == MPI_SUCCESS;
+	}
+
+	/**
+	 * @return The message for the error
+	 */
+	std::string errorMsg() const
+	{
+		if (m_parent)
+			return m_parent->errorMsg();
+
+		char msg[MPI_MAX_ERROR_STRING];
+		int len;
+		if (MPI_Error_string(m_mpiError, msg, &len) != MPI_SUCCESS)
+			return "Unknown MPI error";
+		return std::string(msg, len);
+	}
+
+protected:
+	void setIdentifier(MPI_File file)
+	{
+		m_file = file;
+	}
+
+	/**
+	 * Checks if result contains an error and saves the error state
+	 *
+	 * @return True result is an error false otherwise
+	 */
+	bool checkError(int result)
+	{
+		if (m_parent)
+			// Propagate error to the parent element
+			return m_parent->checkError(result);
+
+		if (m_mpiError == MPI_SUCCESS)
+			// An error occurred early -> ignore this error
+			m_mpiError = result;
+
+		return result != MPI_SUCCESS;
+	}
+
+	/**
+	 * Starts a batch of accesses for the whole file
+	 */
+	void beginBatch()
+	{
+		if (m_parent) {
+			m_parent->beginBatch();
+			return;
+		}
+
+		m_batchDepth++;
+	}
+
+	/**
+	 * Ends a batch. The outermost batch transfers all accesses (collectively)
+	 * unless the writes are deferred.
+	 */
+	bool endBatch()
+	{
+		if (m_parent)
+			return m_parent->endBatch();
+
+		if (m_batchDepth == 0 || --m_batchDepth > 0)
+			return true;
+
+		if (m_batch.kind < 0 || (m_batch.kind == 1 && m_deferWrites)) {
+			// Nothing to transfer now (deferred writes are already copied)
+			m_batch.clear();
+			return true;
+		}
+
+		bool success = execute(m_batch);
+		m_batch.clear();
+
+		return success;
+	}
+
+	/**
+	 * Adds a contiguous access to the current batch. Must be called on all
+	 * ranks for every access of a collective operation, even if
+	 * <code>size</code> is 0.
+	 *
+	 * @param position The position in the file (in bytes)
+	 * @param size The number of bytes
+	 */
+	bool access(bool put, MPI_Offset position, size_t size, const void* values)
+	{
+		if (m_parent)
+			return m_parent->access(put, position, size, values);
+
+		bool defer = put && m_deferWrites;
+		Transfer &transfer = (defer ? m_deferred : m_batch);
+		if (!defer && m_batch.kind >= 0 && m_batch.kind != put)
+			// Reads and writes cannot be mixed
+			return !checkError(MPI_ERR_ARG);
+		transfer.kind = put;
+		m_batch.kind = put;
+		if (defer)
+			m_deferredPending = true;
+
+		if (size == 0)
+			return true;
+
+		char* memory = const_cast<char*>(static_cast<const char*>(values));
+		if (defer) {
+			// Copy the values, the buffer may be reused before the flush
+			transfer.buffers.push_back(std::vector<char>(memory, memory+size));
+			memory = &transfer.buffers.back()[0];
+		}
+
+		for (size_t i = 0; i < size; i += MAX_BLOCK_SIZE) {
+			Block block = {position + static_cast<MPI_Offset>(i), memory + i, std::min(size - i, static_cast<size_t>(MAX_BLOCK_SIZE))};
+			transfer.blocks.push_back(block);
+		}
+
+		return true;
+	}
+
+	/**
+	 * @return A buffer that stays valid until the end of the current batch
+	 */
+	void* stage(size_t size)
+	{
+		if (m_parent)
+			return m_parent->stage(size);
+
+		m_batch.buffers.push_back(std::vector<char>(std::max(size, static_cast<size_t>(1))));
+		return &m_batch.buffers.back()[0];
+	}
+
+	/**
+	 * Converts values after the current batch has been read
+	 */
+	void convertAfterRead(void (*convert)(int, const void*, size_t, void*), int type,
+			const void* src, size_t n, void* dst)
+	{
+		if (m_parent) {
+			m_parent->convertAfterRead(convert, type, src, n, dst);
+			return;
+		}
+
+		Conversion conversion = {convert, type, src, n, dst};
+		m_batch.conversions.push_back(conversion);
+	}
+
+	/**
+	 * Defers all following writes until beginFlush
+	 *
+	 * This is a collective function.
+	 */
+	void deferWrites()
+	{
+		if (m_parent) {
+			m_parent->deferWrites();
+			return;
+		}
+
+		m_deferWrites = true;
+	}
+
+	/**
+	 * Starts writing the deferred values with a nonblocking collective write.
+	 * Writes are no longer deferred.
+	 *
+	 * This is a collective function.
+	 */
+	bool beginFlush()
+	{
+		if (m_parent)
+			return m_parent->beginFlush();
+
+		m_deferWrites = false;
+
+		if (!endFlush())
+			return false;
+
+		if (!m_deferredPending)
+			return true;
+
+		std::swap(m_deferred, m_flushing);
+		m_deferred.clear();
+		m_deferredPending = false;
+
+		return start(m_flushing, &m_request);
+	}
+
+	/**
+	 * Waits until the nonblocking write started with beginFlush is complete
+	 */
+	bool endFlush()
+	{
+		if (m_parent)
+			return m_parent->endFlush();
+
+		if (m_request == MPI_REQUEST_NULL)
+			return true;
+
+		bool success = !checkError(MPI_Wait(&m_request, MPI_STATUS_IGNORE));
+		m_flushing.clear();
+
+		return success;
+	}
+
+	/**
+	 * Writes all deferred values and waits for the completion
+	 *
+	 * This is a collective function.
+	 */
+	bool flush()
+	{
+		return beginFlush() && endFlush();
+	}
+
+	/**
+	 * Forgets all pending accesses (e.g. if the file is closed)
+	 */
+	void resetBatches()
+	{
+		m_batchDepth = 0;
+		m_batch.clear();
+		m_deferWrites = false;
+		m_deferredPending = false;
+		m_deferred.clear();
+		m_flushing.clear();
+		m_request = MPI_REQUEST_NULL;
+	}
+
+	/**
+	 * Appends a value to a header
+	 */
+	static void putHeader(std::vector<char> &header, unsigned long long value)
+	{
+		const char* v = reinterpret_cast<const char*>(&value);
+		header.insert(header.end(), v, v+sizeof(value));
+	}
+
+	/**
+	 * @overload
+	 */
+	static void putHeader(std::vector<char> &header, const std::string &value)
+	{
+		putHeader(header, value.size());
+		header.insert(header.end(), value.begin(), value.end());
+	}
+
+	/**
+	 * Reads a value from a header
+	 *
+	 * @param pos The current position, moved behind the value
+	 * @param end The end of the header
+	 * @return False if the header is too short
+	 */
+	static bool getHeader(const char* &pos, const char* end, unsigned long long &value)
+	{
+		if (end - pos < static_cast<long>(sizeof(value)))
+			return false;
+
+		memcpy(&value, pos, sizeof(value));
+		pos += sizeof(value);
+		return true;
+	}
+
+	/**
+	 * @overload
+	 */
+	static bool getHeader(const char* &pos, const char* end, std::string &value)
+	{
+		unsigned long long size;
+		if (!getHeader(pos, end, size) || static_cast<unsigned long long>(end - pos) < size)
+			return false;
+
+		value.assign(pos, size);
+		pos += size;
+		return true;
+	}
+
+private:
+	/**
+	 * Transfers the accesses with a blocking collective read or write
+	 */
+	bool execute(Transfer &transfer)
+	{
+		if (!endFlush())
+			return false;
+
+		if (transfer.kind == 0 && m_deferredPending) {
+			// Values we read might still be deferred
+			std::swap(m_deferred, m_flushing);
+			m_deferred.clear();
+			m_deferredPending = false;
+
+			bool success = start(m_flushing, 0L);
+			m_flushing.clear();
+			if (!success)
+				return false;
+		}
+
+		if (!start(transfer, 0L))
+			return false;
+
+		for (std::vector<Conversion>::const_iterator i = transfer.conversions.begin();
+				i != transfer.conversions.end(); i++)
+			i->convert(i->type, i->src, i->n, i->dst);
+
+		return true;
+	}
+
+	/**
+	 * Sets the file view and starts the collective read or write
+	 *
+	 * @param request The request for a nonblocking write or NULL for a
+	 *  blocking access
+	 */
+	bool start(Transfer &transfer, MPI_Request* request)
+	{
+		std::vector<Block> &blocks = transfer.blocks;
+
+		// The displacements of a file view must be monotonically nondecreasing
+		std::stable_sort(blocks.begin(), blocks.end());
+
+		// Merge blocks that are contiguous in the file and in memory
+		std::vector<int> lengths;
+		std::vector<MPI_Aint> fileDispl;
+		std::vector<MPI_Aint> memDispl;
+		for (size_t i = 0; i < blocks.size(); i++) {
+			if (!lengths.empty()) {
+				const Block &prev = blocks[i-1];
+				if (blocks[i].position < prev.position + static_cast<MPI_Offset>(prev.size))
+					// Overlapping accesses
+					return !checkError(MPI_ERR_ARG);
+
+				if (blocks[i].position == fileDispl.back() + lengths.back()
+						&& blocks[i].memory == prev.memory + prev.size
+						&& lengths.back() + blocks[i].size <= MAX_BLOCK_SIZE) {
+					lengths.back() += blocks[i].size;
+					continue;
+				}
+			}
+
+			MPI_Aint address;
+			if (checkError(MPI_Get_address(blocks[i].memory, &address)))
+				return false;
+
+			lengths.push_back(blocks[i].size);
+			fileDispl.push_back(blocks[i].position);
+			memDispl.push_back(address);
+		}
+
+		MPI_Datatype fileType = MPI_BYTE;
+		MPI_Datatype memType = MPI_BYTE;
+		int count = 0;
+		if (!lengths.empty()) {
+			if (checkError(MPI_Type_create_hindexed(lengths.size(), &lengths[0], &fileDispl[0], MPI_BYTE, &fileType)))
+				return false;
+			if (checkError(MPI_Type_commit(&fileType)))
+				return false;
+			if (checkError(MPI_Type_create_hindexed(lengths.size(), &lengths[0], &memDispl[0], MPI_BYTE, &memType)))
+				return false;
+			if (checkError(MPI_Type_commit(&memType)))
+				return false;
+			count = 1;
+		}
+
+		int err = MPI_File_set_view(m_file, 0, MPI_BYTE, fileType, "native", MPI_INFO_NULL);
+		if (err == MPI_SUCCESS) {
+			if (transfer.kind == 1) {
+				if (request)
+					err = MPI_File_iwrite_all(m_file, MPI_BOTTOM, count, memType, request);
+				else
+					err = MPI_File_write_all(m_file, MPI_BOTTOM, count, memType, MPI_STATUS_IGNORE);
+			} else
+				err = MPI_File_read_all(m_file, MPI_BOTTOM, count, memType, MPI_STATUS_IGNORE);
+		}
+
+		if (count > 0) {
+			// Types of pending nonblocking operations can be freed
+			MPI_Type_free(&fileType);
+			MPI_Type_free(&memType);
+		}
+
+		return !checkError(err);
+	}
+};
+
+}
+
+#endif // PUML_MPIIO_ELEMENT_H
@@ -0,0 +1,542 @@
+/**
+ * @file
+ *  This file is part of PUML
+ *
+ *  For conditions of distribution and use, please see the copyright
+ *  notice in the file 'COPYING' at the root directory of this package
+ *  and the copyright notice at https://github.com/TUM-I5/PUML
+ *
+ * @copyright 2013 Technische Universitaet Muenchen
+ * @author Sebastian Rettenberger <rettenbs@in.tum.de>
+ */
+
+#ifndef PUML_MPIIO_ENTITY_H
+#define PUML_MPIIO_ENTITY_H
+
+#include <string>
+#include <vector>
+
+#include <mpi.h>
+
+#include "PUML/Dimension.h"
+#include "PUML/Entity.h"
+#include "PUML/MpiioElement.h"
+#include "PUML/Type.h"
+
+namespace PUML
+{
+
+/**
+ * An entity stored with MPI-IO
+ *
+ * The values are stored contiguously in native byte order at a fixed
+ * position in the file (assigned by MpiioPum::endDefinition). Each
+ * hyperslab access is split into contiguous blocks and added to the
+ * batch of the file. Values are converted if the type of the buffer
+ * differs from the type of the entity. Entities are always collective,
+ * the adaptive mode is not supported.
+ */
+class MpiioEntity : public Entity, public MpiioElement
+{
+private:
+	/** Type of the values */
+	Type::BaseType m_type;
+
+	/** Size of the first dimension */
+	size_t m_length;
+
+	/** Position of the first value in the file */
+	MPI_Offset m_position;
+
+public:
+	MpiioEntity()
+		: m_type(Type::CUSTOM), m_length(0), m_position(0)
+	{
+	}
+
+	/**
+	 * @param length The size of the first dimension (size of the group,
+	 *  index or number of partitions)
+	 */
+	MpiioEntity(const char* name, const Type &type, size_t length,
+			size_t numUserDimensions, const Dimension* userDimensions,
+			const std::vector<size_t> &offset, MpiioEntity* index,
+			MpiioElement &group, MPIElement &comm)
+		: Entity(name, numUserDimensions, userDimensions, offset, index, comm), MpiioElement(&group),
+		  m_type(type.baseType()), m_length(length), m_position(0)
+	{
+		Entity::setCollective(true);
+
+		if (m_type == Type::CUSTOM)
+			// Only primitive types are supported
+			checkError(MPI_ERR_TYPE);
+	}
+
+	/**
+	 * Constructor to load an entity from the header
+	 *
+	 * @param pos The current position in the header (moved behind the entity)
+	 */
+	MpiioEntity(const char* &pos, const char* end, const std::vector<size_t> &offset, MpiioEntity* index,
+			MpiioElement &group, MPIElement &comm)
+		: Entity(offset, index, comm), MpiioElement(&group),
+		  m_type(Type::CUSTOM), m_length(0), m_position(0)
+	{
+		Entity::setCollective(true);
+
+		std::string name;
+		unsigned long long type, length, numUserDimensions, position;
+		if (!getHeader(pos, end, name) || !getHeader(pos, end, type) || !getHeader(pos, end, length)
+				|| !getHeader(pos, end, numUserDimensions)) {
+			checkError(MPI_ERR_FILE);
+			return;
+		}
+		setName(name.c_str());
+		m_type = static_cast<Type::BaseType>(type);
+		m_length = length;
+
+		dimSize().resize(numUserDimensions+1);
+		for (size_t i = 1; i <= numUserDimensions; i++) {
+			unsigned long long dim;
+			if (!getHeader(pos, end, dim)) {
+				checkError(MPI_ERR_FILE);
+				return;
+			}
+			dimSize()[i] = dim;
+		}
+
+		if (!getHeader(pos, end, position) || m_type >= Type::CUSTOM) {
+			checkError(MPI_ERR_FILE);
+			return;
+		}
+		m_position = position;
+	}
+
+	/**
+	 * Only collective mode is supported
+	 */
+	bool setCollective(bool collective)
+	{
+		return collective;
+	}
+
+	/**
+	 * The adaptive mode is not supported
+	 */
+	bool setAdaptive(bool adaptive)
+	{
+		return !adaptive;
+	}
+
+	/**
+	 * @return The user dimensions
+	 */
+	std::vector<Dimension> dimensions() const
+	{
+		std::vector<Dimension> dims;
+		for (size_t i = 1; i < dimSize().size(); i++)
+			dims.push_back(Dimension(i-1, "", dimSize()[i]));
+		return dims;
+	}
+
+	/**
+	 * Appends the description of this entity to the header
+	 *
+	 * @internal
+	 */
+	void describe(std::vector<char> &header)
+	{
+		putHeader(header, name());
+		putHeader(header, m_type);
+		putHeader(header, m_length);
+		putHeader(header, dimSize().size()-1);
+		for (size_t i = 1; i < dimSize().size(); i++)
+			putHeader(header, dimSize()[i]);
+		putHeader(header, m_position);
+	}
+
+	/**
+	 * Assigns the position in the file
+	 *
+	 * @param position The next free position in the file, moved behind the entity
+	 * @param alignment Alignment of the first value
+	 *
+	 * @internal
+	 */
+	void layout(MPI_Offset &position, size_t alignment)
+	{
+		position = (position + alignment - 1) / alignment * alignment;
+		m_position = position;
+		position += m_length * numComponents() * valueSize();
+	}
+
+	/**
+	 * @return The name of an entity in the header
+	 *
+	 * @internal
+	 */
+	static std::string peekName(const char* pos, const char* end)
+	{
+		std::string name;
+		getHeader(pos, end, name);
+		return name;
+	}
+
+protected:
+	size_t _valueSize()
+	{
+		return typeSize(m_type);
+	}
+
+	bool _beginBatch()
+	{
+		beginBatch();
+		return true;
+	}
+
+	bool _endBatch()
+	{
+		return endBatch();
+	}
+
+	bool _puta(const size_t* start, const size_t* size, const void* values)
+	{
+		return hyperslab(true, start, size, values);
+	}
+
+	bool _puta_schar(const size_t* start, const size_t* size, const signed char* values)
+	{
+		return putTyped(Type::BYTE, start, size, values);
+	}
+
+	bool _puta_uchar(const size_t* start, const size_t* size, const unsigned char* values)
+	{
+		return putTyped(Type::UBYTE, start, size, values);
+	}
+
+	bool _puta_short(const size_t* start, const size_t* size, const short* values)
+	{
+		return putTyped(Type::SHORT, start, size, values);
+	}
+
+	bool _puta_int(const size_t* start, const size_t* size, const int* values)
+	{
+		return putTyped(Type::INT, start, size, values);
+	}
+
+	bool _puta_long(const size_t* start, const size_t* size, const long* values)
+	{
+		return putTyped(sizeof(long) == 8 ? Type::INT64 : Type::INT, start, size, values);
+	}
+
+	bool _puta_float(const size_t* start, const size_t* size, const float* values)
+	{
+		return putTyped(Type::FLOAT, start, size, values);
+	}
+
+	bool _puta_double(const size_t* start, const size_t* size, const double* values)
+	{
+		return putTyped(Type::DOUBLE, start, size, values);
+	}
+
+	bool _puta_ushort(const size_t* start, const size_t* size, const unsigned short* values)
+	{
+		return putTyped(Type::USHORT, start, size, values);
+	}
+
+	bool _puta_uint(const size_t* start, const size_t* size, const unsigned int* values)
+	{
+		return putTyped(Type::UINT, start, size, values);
+	}
+
+	bool _puta_longlong(const size_t* start, const size_t* size, const long long* values)
+	{
+		return putTyped(Type::INT64, start, size, values);
+	}
+
+	bool _puta_ulonglong(const size_t* start, const size_t* size, const unsigned long long* values)
+	{
+		return putTyped(Type::UINT64, start, size, values);
+	}
+
+	bool _geta(const size_t* start, const size_t* size, void* values)
+	{
+		return hyperslab(false, start, size, values);
+	}
+
+	bool _geta_schar(const size_t* start, const size_t* size, signed char* values)
+	{
+		return getTyped(Type::BYTE, start, size, values);
+	}
+
+	bool _geta_uchar(const size_t* start, const size_t* size, unsigned char* values)
+	{
+		return getTyped(Type::UBYTE, start, size, values);
+	}
+
+	bool _geta_short(const size_t* start, const size_t* size, short* values)
+	{
+		return getTyped(Type::SHORT, start, size, values);
+	}
+
+	bool _geta_int(const size_t* start, const size_t* size, int* values)
+	{
+		return getTyped(Type::INT, start, size, values);
+	}
+
+	bool _geta_long(const size_t* start, const size_t* size, long* values)
+	{
+		return getTyped(sizeof(long) == 8 ? Type::INT64 : Type::INT, start, size, values);
+	}
+
+	bool _geta_float(const size_t* start, const size_t* size, float* values)
+	{
+		return getTyped(Type::FLOAT, start, size, values);
+	}
+
+	bool _geta_double(const size_t* start, const size_t* size, double* values)
+	{
+		return getTyped(Type::DOUBLE, start, size, values);
+	}
+
+	bool _geta_ushort(const size_t* start, const size_t* size, unsigned short* values)
+	{
+		return getTyped(Type::USHORT, start, size, values);
+	}
+
+	bool _geta_uint(const size_t* start, const size_t* size, unsigned int* values)
+	{
+		return getTyped(Type::UINT, start, size, values);
+	}
+
+	bool _geta_longlong(const size_t* start, const size_t* size, long long* values)
+	{
+		return getTyped(Type::INT64, start, size, values);
+	}
+
+	bool _geta_ulonglong(const size_t* start, const size_t* size, unsigned long long* values)
+	{
+		return getTyped(Type::UINT64, start, size, values);
+	}
+
+private:
+	/**
+	 * @return The number of values in a hyperslab
+	 */
+	size_t numValues(const size_t* size) const
+	{
+		size_t n = 1;
+		for (size_t i = 0; i < dimSize().size(); i++)
+			n *= size[i];
+		return n;
+	}
+
+	/**
+	 * @return True if values of the type can be transferred without conversion
+	 */
+	bool sameType(Type::BaseType type) const
+	{
+		if (m_type == type)
+			return true;
+
+		// Characters are stored as bytes
+		return (m_type == Type::CHAR && type == Type::BYTE) || (m_type == Type::BYTE && type == Type::CHAR);
+	}
+
+	template<typename T>
+	bool putTyped(Type::BaseType type, const size_t* start, const size_t* size, const T* values)
+	{
+		if (sameType(type))
+			return hyperslab(true, start, size, values);
+
+		size_t n = numValues(size);
+		beginBatch();
+		void* buffer = stage(n * valueSize());
+		toFile(values, n, m_type, buffer);
+		bool success = hyperslab(true, start, size, buffer);
+		return endBatch() && success;
+	}
+
+	template<typename T>
+	bool getTyped(Type::BaseType type, const size_t* start, const size_t* size, T* values)
+	{
+		if (sameType(type))
+			return hyperslab(false, start, size, values);
+
+		size_t n = numValues(size);
+		beginBatch();
+		void* buffer = stage(n * valueSize());
+		convertAfterRead(&fromFile<T>, m_type, buffer, n, values);
+		bool success = hyperslab(false, start, size, buffer);
+		return endBatch() && success;
+	}
+
+	/**
+	 * Adds the contiguous blocks of a hyperslab to the batch
+	 */
+	bool hyperslab(bool put, const size_t* start, const size_t* size, const void* values)
+	{
+		const size_t numDims = dimSize().size();
+		std::vector<size_t> dims(dimSize());
+		dims[0] = m_length;
+
+		// Find the last dimension that is not accessed completely
+		// All following dimensions are contiguous in each block
+		size_t last = numDims - 1;
+		while (last > 0 && start[last] == 0 && size[last] == dims[last])
+			last--;
+
+		size_t blockValues = size[last];
+		for (size_t i = last+1; i < numDims; i++)
+			blockValues *= dims[i];
+		size_t blockSize = blockValues * valueSize();
+
+		size_t numBlocks = 1;
+		for (size_t i = 0; i < last; i++)
+			numBlocks *= size[i];
+		if (numBlocks == 0 || blockSize == 0) {
+			// Empty accesses are required for collective I/O
+			numBlocks = 1;
+			blockSize = 0;
+		}
+
+		beginBatch();
+
+		const char* memory = static_cast<const char*>(values);
+		std::vector<size_t> pos(start, start+last+1);
+		bool success = true;
+		for (size_t b = 0; b < numBlocks && success; b++) {
+			// Linear position of the block
+			size_t linear = 0;
+			for (size_t i = 0; i < numDims; i++)
+				linear = linear * dims[i] + (i <= last ? pos[i] : 0);
+
+			success = access(put, m_position + static_cast<MPI_Offset>(linear * valueSize()),
+					blockSize, memory + b * blockSize);
+
+			// Next block (in row major order)
+			for (size_t i = last; i-- > 0; ) {
+				if (++pos[i] < start[i] + size[i])
+					break;
+				pos[i] = start[i];
+			}
+		}
+
+		return endBatch() && success;
+	}
+
+	/**
+	 * @return The size of one value of the type in bytes
+	 */
+	static size_t typeSize(Type::BaseType type)
+	{
+		switch (type) {
+		case Type::CHAR:
+		case Type::BYTE:
+		case Type::UBYTE:
+			return 1;
+		case Type::SHORT:
+		case Type::USHORT:
+			return 2;
+		case Type::INT:
+		case Type::UINT:
+		case Type::FLOAT:
+			return 4;
+		default:
+			return 8;
+		}
+	}
+
+	template<typename S, typename D>
+	static void convert(const S* src, size_t n, D* dst)
+	{
+		for (size_t i = 0; i < n; i++)
+			dst[i] = static_cast<D>(src[i]);
+	}
+
+	/**
+	 * Converts values to the type of the entity
+	 */
+	template<typename T>
+	static void toFile(const T* src, size_t n, Type::BaseType type, void* dst)
+	{
+		switch (type) {
+		case Type::CHAR:
+		case Type::BYTE:
+			convert(src, n, static_cast<signed char*>(dst));
+			break;
+		case Type::UBYTE:
+			convert(src, n, static_cast<unsigned char*>(dst));
+			break;
+		case Type::SHORT:
+			convert(src, n, static_cast<short*>(dst));
+			break;
+		case Type::USHORT:
+			convert(src, n, static_cast<unsigned short*>(dst));
+			break;
+		case Type::INT:
+			convert(src, n, static_cast<int*>(dst));
+			break;
+		case Type::UINT:
+			convert(src, n, static_cast<unsigned int*>(dst));
+			break;
+		case Type::INT64:
+			convert(src, n, static_cast<long long*>(dst));
+			break;
+		case Type::UINT64:
+			convert(src, n, static_cast<unsigned long long*>(dst));
+			break;
+		case Type::FLOAT:
+			convert(src, n, static_cast<float*>(dst));
+			break;
+		default:
+			convert(src, n, static_cast<double*>(dst));
+		}
+	}
+
+	/**
+	 * Converts values from the type of the entity
+	 */
+	template<typename T>
+	static void fromFile(int type, const void* src, size_t n, void* dst)
+	{
+		T* d = static_cast<T*>(dst);
+
+		switch (type) {
+		case Type::CHAR:
+		case Type::BYTE:
+			convert(static_cast<const signed char*>(src), n, d);
+			break;
+		case Type::UBYTE:
+			convert(static_cast<const unsigned char*>(src), n, d);
+			break;
+		case Type::SHORT:
+			convert(static_cast<const short*>(src), n, d);
+			break;
+		case Type::USHORT:
+			convert(static_cast<const unsigned short*>(src), n, d);
+			break;
+		case Type::INT:
+			convert(static_cast<const int*>(src), n, d);
+			break;
+		case Type::UINT:
+			convert(static_cast<const unsigned int*>(src), n, d);
+			break;
+		case Type::INT64:
+			convert(static_cast<const long long*>(src), n, d);
+			break;
+		case Type::UINT64:
+			convert(static_cast<const unsigned long long*>(src), n, d);
+			break;
+		case Type::FLOAT:
+			convert(static_cast<const float*>(src), n, d);
+			break;
+		default:
+			convert(static_cast<const double*>(src), n, d);
+		}
+	}
+};
+
+}
+
+#endif // PUML_MPIIO_ENTITY_H
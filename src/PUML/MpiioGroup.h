@@ -0,0 +1,383 @@
+/**
+ * @file
+ *  This file is part of PUML
+ *
+ *  For conditions of distribution and use, please see the copyright
+ *  notice in the file 'COPYING' at the root directory of this package
+ *  and the copyright notice at https://github.com/TUM-I5/PUML
+ *
+ * @copyright 2013 Technische Universitaet Muenchen
+ * @author Sebastian Rettenberger <rettenbs@in.tum.de>
+ */
+
+#ifndef PUML_MPIIO_GROUP_H
+#define PUML_MPIIO_GROUP_H
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <mpi.h>
+
+#include "PUML/Dimension.h"
+#include "PUML/Group.h"
+#include "PUML/MpiioElement.h"
+#include "PUML/MpiioEntity.h"
+
+namespace PUML
+{
+
+/**
+ * A group stored with MPI-IO
+ *
+ * The group is described in the header of the file (sizes and all
+ * entities). The offsets are stored directly behind the header, the values
+ * of the entities are stored in the data section. Time-dependent entities
+ * are not supported.
+ */
+class MpiioGroup : public Group, public MpiioElement
+{
+private:
+	/** Total size of the group */
+	size_t m_size;
+
+	/** Total size of the index (or Group::UNLIMITED if not indexed) */
+	size_t m_indexSize;
+
+	/** User defined dimensions (std::list does not move the elements) */
+	std::list<Dimension> m_dimensions;
+
+	/** Position of the offsets in the file */
+	MPI_Offset m_offsetPosition;
+
+	/** The description of the entities (loaded groups only, parsed by loadEntities) */
+	std::vector<char> m_description;
+
+	/** Number of entities in the description */
+	size_t m_numDescribed;
+
+	/** index variable */
+	MpiioEntity m_entityIndex;
+
+	/** type offset variable (mixed cell groups only) */
+	MpiioEntity m_entityTypeOffset;
+
+	/** Entities in this group */
+	std::map<std::string, MpiioEntity> m_entities;
+
+	/** Minimum/maximum variables of entities (accessed by the variable name) */
+	std::map<std::string, MpiioEntity> m_statistics;
+
+public:
+	MpiioGroup()
+		: m_size(0), m_indexSize(UNLIMITED), m_offsetPosition(0), m_numDescribed(0)
+	{
+	}
+
+	/**
+	 * @param size The total size of this group (must be known)
+	 */
+	MpiioGroup(const char* name, size_t numPartitions, MpiioElement &pum, MPIElement &comm, size_t size)
+		: Group(name, numPartitions, comm), MpiioElement(&pum),
+		  m_size(size), m_indexSize(UNLIMITED), m_offsetPosition(0), m_numDescribed(0)
+	{
+	}
+
+	/**
+	 * Constructor to load a group from the header
+	 *
+	 * @param pos The current position in the header (moved behind the group)
+	 */
+	MpiioGroup(const char* &pos, const char* end, size_t numPartitions, MpiioElement &pum, MPIElement &comm)
+		: Group(comm), MpiioElement(&pum),
+		  m_size(0), m_indexSize(UNLIMITED), m_offsetPosition(0), m_numDescribed(0)
+	{
+		offset().resize(numPartitions+1);
+
+		std::string name;
+		unsigned long long size, indexed, indexSize, offsetPosition, numEntities;
+		if (!getHeader(pos, end, name) || !getHeader(pos, end, size) || !getHeader(pos, end, indexed)
+				|| !getHeader(pos, end, indexSize) || !getHeader(pos, end, offsetPosition)
+				|| !getHeader(pos, end, numEntities)) {
+			checkError(MPI_ERR_FILE);
+			return;
+		}
+		setName(name.c_str());
+		m_size = size;
+		if (indexed)
+			m_indexSize = indexSize;
+		m_offsetPosition = offsetPosition;
+
+		// Keep the entities for loadEntities
+		const char* start = pos;
+		for (unsigned long long i = 0; i < numEntities; i++) {
+			MpiioEntity entity(pos, end, offset(), 0L, *this, *this);
+			if (!entity.isValid())
+				return;
+		}
+		m_description.assign(start, pos);
+		m_numDescribed = numEntities;
+	}
+
+	Dimension& createDimension(const char* name, size_t size)
+	{
+		m_dimensions.push_back(Dimension(m_dimensions.size(), name, size));
+
+		return m_dimensions.back();
+	}
+
+	MpiioEntity* createEntity(const char* name, const Type &type, size_t numDimensions, Dimension* dimensions)
+	{
+		if (name[0] == '_')
+			// Reserved for internal variables
+			return 0L;
+
+		MpiioEntity entity = MpiioEntity(name, type, m_size, numDimensions, dimensions,
+				offset(), (indexed() ? &m_entityIndex : 0L), *this, *this);
+		if (!entity.isValid())
+			return 0L;
+
+		m_entities[name] = entity;
+
+		return &m_entities[name];
+	}
+
+	/**
+	 * @overload
+	 */
+	MpiioEntity* createEntity(const char* name, const Type &type, std::vector<Dimension> &dimensions)
+	{
+		return createEntity(name, type, dimensions.size(), &dimensions[0]);
+	}
+
+	/**
+	 * @overload
+	 */
+	MpiioEntity* createEntity(const char* name, const Type &type)
+	{
+		return createEntity(name, type, 0, 0L);
+	}
+
+	/**
+	 * Not supported (all entities have a fixed size)
+	 */
+	MpiioEntity* createTimeEntity(const char* name, const Type &type, size_t numDimensions, Dimension* dimensions)
+	{
+		return 0L;
+	}
+
+	size_t numSteps()
+	{
+		return 0;
+	}
+
+	/**
+	 * @return The number of elements stored in the file. For indexed groups
+	 *  this is the size of the data, not the size of the index.
+	 */
+	size_t dataSize()
+	{
+		return m_size;
+	}
+
+	/**
+	 * All entities are loaded with the group
+	 */
+	MpiioEntity* getEntity(const char* name)
+	{
+		std::map<std::string, MpiioEntity>::iterator it = m_entities.find(name);
+		if (it != m_entities.end())
+			return &it->second;
+
+		return 0L;
+	}
+
+	/**
+	 * Loads all entities from the description and reads the offsets
+	 * (collective).
+	 * We can't do this in the constructor because this results in wrong values for m_parent
+	 *
+	 * @internal
+	 */
+	bool loadEntities()
+	{
+		if (m_indexSize != UNLIMITED)
+			setEntityIndex(&m_entityIndex);
+
+		const char* pos = m_description.empty() ? 0L : &m_description[0];
+		const char* end = pos + m_description.size();
+		for (size_t i = 0; i < m_numDescribed; i++) {
+			std::string name = MpiioEntity::peekName(pos, end);
+			bool internal = (name[0] == '_');
+			MpiioEntity entity(pos, end, offset(), (internal || !indexed() ? 0L : &m_entityIndex), *this, *this);
+			if (!entity.isValid())
+				return false;
+
+			if (name == VAR_INDEX)
+				m_entityIndex = entity;
+			else if (name == VAR_TYPEOFFSET) {
+				m_entityTypeOffset = entity;
+				setEntityTypeOffset(&m_entityTypeOffset);
+			} else if (internal)
+				m_statistics[name] = entity;
+			else
+				m_entities[name] = entity;
+		}
+		m_description.clear();
+
+		// Connect the statistics
+		for (std::map<std::string, MpiioEntity>::iterator i = m_entities.begin(); i != m_entities.end(); i++) {
+			std::map<std::string, MpiioEntity>::iterator min = m_statistics.find(statisticsName(i->first, VAR_MIN_SUFFIX));
+			std::map<std::string, MpiioEntity>::iterator max = m_statistics.find(statisticsName(i->first, VAR_MAX_SUFFIX));
+			if (min != m_statistics.end() && max != m_statistics.end())
+				i->second.setStatistics(&min->second, &max->second);
+		}
+
+		// Read offsets
+		size_t numPartitions = offset().size() - 1;
+		std::vector<unsigned long long> o(numPartitions+1);
+		beginBatch();
+		bool success = access(false, m_offsetPosition, numPartitions * sizeof(unsigned long long), &o[0]);
+		if (!endBatch() || !success)
+			return false;
+		o.back() = (indexed() ? m_indexSize : m_size);
+
+		offset().assign(o.begin(), o.end());
+
+		return true;
+	}
+
+	/**
+	 * Appends the description of this group and all entities to the header
+	 *
+	 * @internal
+	 */
+	void describe(std::vector<char> &header)
+	{
+		std::vector<Entity*> entities;
+		_loadedEntities(entities);
+
+		putHeader(header, name());
+		putHeader(header, m_size);
+		putHeader(header, indexed());
+		putHeader(header, (indexed() ? m_indexSize : 0));
+		putHeader(header, m_offsetPosition);
+		putHeader(header, entities.size());
+		for (std::vector<Entity*>::const_iterator i = entities.begin(); i != entities.end(); i++)
+			static_cast<MpiioEntity*>(*i)->describe(header);
+	}
+
+	/**
+	 * Assigns the positions of the offsets or the entities
+	 *
+	 * @param position The next free position in the file, moved behind the group
+	 * @param alignment Alignment of each entity
+	 *
+	 * @internal
+	 */
+	void layout(MPI_Offset &position, size_t alignment, bool offsets)
+	{
+		if (offsets) {
+			position = (position + alignment - 1) / alignment * alignment;
+			m_offsetPosition = position;
+			position += (offset().size() - 1) * sizeof(unsigned long long);
+			return;
+		}
+
+		std::vector<Entity*> entities;
+		_loadedEntities(entities);
+		for (std::vector<Entity*>::const_iterator i = entities.begin(); i != entities.end(); i++)
+			static_cast<MpiioEntity*>(*i)->layout(position, alignment);
+	}
+
+protected:
+	bool setOffset(size_t partition)
+	{
+		if (partition >= numPartitions())
+			// The last partition sets the offset for the first one
+			partition = 0;
+
+		unsigned long long o = offset()[partition];
+
+		beginBatch();
+		bool success = access(true, m_offsetPosition + partition * sizeof(o), sizeof(o), &o);
+		return endBatch() && success;
+	}
+
+	bool setOffsets()
+	{
+		// The first rank writes all offsets
+		std::vector<unsigned long long> o(offset().begin(), offset().end()-1);
+
+		beginBatch();
+		bool success = access(true, m_offsetPosition, (mpiRank() == 0 ? o.size() * sizeof(o[0]) : 0), &o[0]);
+		return endBatch() && success;
+	}
+
+	MpiioEntity* _addIndex(size_t indexSize)
+	{
+		m_indexSize = indexSize;
+		m_entityIndex = MpiioEntity(VAR_INDEX, Type::UINT64, indexSize, 0, 0L,
+				offset(), 0L, *this, *this);
+
+		return &m_entityIndex;
+	}
+
+	bool _addStatistics(Entity &entity)
+	{
+		// Use the same user dimensions as the entity
+		std::vector<Dimension> dims = static_cast<MpiioEntity&>(entity).dimensions();
+
+		std::string minName = statisticsName(entity.name(), VAR_MIN_SUFFIX);
+		std::string maxName = statisticsName(entity.name(), VAR_MAX_SUFFIX);
+		m_statistics[minName] = MpiioEntity(minName.c_str(), Type::DOUBLE, numPartitions(),
+				dims.size(), (dims.empty() ? 0L : &dims[0]), offset(), 0L, *this, *this);
+		m_statistics[maxName] = MpiioEntity(maxName.c_str(), Type::DOUBLE, numPartitions(),
+				dims.size(), (dims.empty() ? 0L : &dims[0]), offset(), 0L, *this, *this);
+		if (!isValid())
+			return false;
+
+		entity.setStatistics(&m_statistics[minName], &m_statistics[maxName]);
+
+		return true;
+	}
+
+	void _loadedEntities(std::vector<Entity*> &entities)
+	{
+		if (indexed())
+			entities.push_back(&m_entityIndex);
+		if (mixed())
+			entities.push_back(&m_entityTypeOffset);
+
+		for (std::map<std::string, MpiioEntity>::iterator i = m_entities.begin();
+				i != m_entities.end(); i++)
+			entities.push_back(&i->second);
+		for (std::map<std::string, MpiioEntity>::iterator i = m_statistics.begin();
+				i != m_statistics.end(); i++)
+			entities.push_back(&i->second);
+	}
+
+	MpiioEntity* _addTypeOffset()
+	{
+		Dimension &dim = createDimension(DIM_CELLTYPE, NUM_CELL_TYPES+1);
+
+		m_entityTypeOffset = MpiioEntity(VAR_TYPEOFFSET, Type::UINT64, numPartitions(), 1, &dim,
+				offset(), 0L, *this, *this);
+
+		return &m_entityTypeOffset;
+	}
+
+private:
+	/**
+	 * @return The name of the variable that stores the minimum/maximum of an entity
+	 */
+	static std::string statisticsName(const std::string &name, const char* suffix)
+	{
+		return "_" + name + suffix;
+	}
+};
+
+}
+
+#endif // PUML_MPIIO_GROUP_H
@@ -0,0 +1,404 @@
+/**
+ * @file
+ *  This file is part of PUML
+ *
+ *  For conditions of distribution and use, please see the copyright
+ *  notice in the file 'COPYING' at the root directory of this package
+ *  and the copyright notice at https://github.com/TUM-I5/PUML
+ *
+ * @copyright 2013 Technische Universitaet Muenchen
+ * @author Sebastian Rettenberger <rettenbs@in.tum.de>
+ */
+
+#ifndef PUML_MPIIO_PUM_H
+#define PUML_MPIIO_PUM_H
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <mpi.h>
+
+#include "PUML/MpiioElement.h"
+#include "PUML/MpiioGroup.h"
+#include "PUML/Pum.h"
+
+namespace PUML
+{
+
+/**
+ * A PUM file stored with plain MPI-IO
+ *
+ * Requires the parallel version. The file starts with a small header that
+ * contains the schema (groups, entities and their positions in the file),
+ * followed by the offsets of all groups and the values of the entities
+ * (native byte order, each entity aligned, see setAlignment).
+ *
+ * Compared to NetcdfPum:
+ * - The sizes of all groups must be known in advance (use the size
+ *  parameter of createGroup or Pum::planSize). The header is written by
+ *  endDefinition.
+ * - Time-dependent entities, subfiles and checkpoint files are not supported.
+ * - All entities are collective. All accesses of a batch (e.g. all ranges
+ *  of an indexed partition in Entity::get/put or all entities in
+ *  Group::getRow/putRow) are transferred with one file view and one
+ *  collective read or write.
+ * - Writes can be deferred and flushed with a nonblocking collective write
+ *  (see deferWrites, beginFlush and endFlush).
+ */
+class MpiioPum : public Pum, public MpiioElement
+{
+private:
+	/** Groups in this file */
+	std::map<std::string, MpiioGroup> m_groups;
+
+	/** Alignment of the entities in the file */
+	size_t m_alignment;
+
+	/** True until the header is written */
+	bool m_defining;
+
+public:
+	MpiioPum()
+		: m_alignment(4096), m_defining(false)
+	{
+	}
+
+	virtual ~MpiioPum()
+	{
+		closeFile();
+	}
+
+	/**
+	 * Opens the file with MPI_COMM_SELF
+	 */
+	bool open(const char* path)
+	{
+		setMPIComm(MPI_COMM_SELF);
+		return _open(path, MPI_COMM_SELF);
+	}
+
+	/**
+	 * Overridden to work around overload/subclass issues
+	 */
+	bool open(const char* path, MPI_Comm comm, MPI_Info info = MPI_INFO_NULL)
+	{
+		return Pum::open(path, comm, info);
+	}
+
+	/**
+	 * Sets the alignment of the entities in files created afterwards
+	 * (e.g. the stripe size of the file system)
+	 */
+	void setAlignment(size_t alignment)
+	{
+		m_alignment = std::max(alignment, static_cast<size_t>(1));
+	}
+
+	/**
+	 * This is a collective function.
+	 *
+	 * @param size The total size of the group (required if no partition sizes
+	 *  are declared with Pum::planSize)
+	 */
+	MpiioGroup* createGroup(const char* name, size_t size = Group::UNLIMITED)
+	{
+		return static_cast<MpiioGroup*>(Pum::createGroup(name, size));
+	}
+
+	/**
+	 * @copydoc createGroup
+	 *
+	 * @param indexSize The total size of the index (required if no partition
+	 *  sizes are declared with Pum::planSize)
+	 */
+	MpiioGroup* createGroupIndexed(const char* name, size_t size = Group::UNLIMITED, size_t indexSize = Group::UNLIMITED)
+	{
+		return static_cast<MpiioGroup*>(Pum::createGroupIndexed(name, size, indexSize));
+	}
+
+	/**
+	 * All groups are loaded when the file is opened
+	 */
+	MpiioGroup* getGroup(const char* name)
+	{
+		std::map<std::string, MpiioGroup>::iterator it = m_groups.find(name);
+		if (it != m_groups.end())
+			return &it->second;
+
+		return 0L;
+	}
+
+	/**
+	 * Computes the positions of all entities and writes the header
+	 *
+	 * This is a collective function.
+	 */
+	bool endDefinition()
+	{
+		if (!Pum::endDefinition())
+			return false;
+
+		if (!m_defining)
+			return true;
+		m_defining = false;
+
+		// Compute the layout (the size of the header does not depend on the positions)
+		std::vector<char> header;
+		describe(header);
+
+		MPI_Offset position = header.size();
+		for (std::map<std::string, MpiioGroup>::iterator i = m_groups.begin(); i != m_groups.end(); i++)
+			i->second.layout(position, sizeof(unsigned long long), true);
+		for (std::map<std::string, MpiioGroup>::iterator i = m_groups.begin(); i != m_groups.end(); i++)
+			i->second.layout(position, m_alignment, false);
+
+		header.clear();
+		describe(header);
+
+		if (checkError(MPI_File_set_view(identifier(), 0, MPI_BYTE, MPI_BYTE, "native", MPI_INFO_NULL)))
+			return false;
+		if (checkError(MPI_File_write_at_all(identifier(), 0, &header[0], (mpiRank() == 0 ? header.size() : 0),
+				MPI_BYTE, MPI_STATUS_IGNORE)))
+			return false;
+		if (checkError(MPI_File_set_size(identifier(), position)))
+			return false;
+
+		return writePlannedSizes();
+	}
+
+	/**
+	 * Defers all following writes. The values are copied, the buffers can
+	 * be reused immediately.
+	 *
+	 * This is a collective function.
+	 *
+	 * @see beginFlush
+	 */
+	void deferWrites()
+	{
+		MpiioElement::deferWrites();
+	}
+
+	/**
+	 * Starts writing all deferred values with a nonblocking collective
+	 * write and stops deferring writes. Computations can overlap with the
+	 * write until endFlush is called.
+	 *
+	 * This is a collective function.
+	 */
+	bool beginFlush()
+	{
+		return MpiioElement::beginFlush();
+	}
+
+	/**
+	 * Waits for the write started by beginFlush
+	 */
+	bool endFlush()
+	{
+		return MpiioElement::endFlush();
+	}
+
+	bool close()
+	{
+		// Close the file in any case, the first error is kept
+		bool success = closeCounters();
+		success = endDefinition() && success;
+		success = flush() && success;
+
+		return closeFile() && success;
+	}
+
+protected:
+	/**
+	 * Creates the file with MPI_COMM_SELF
+	 */
+	bool _create(const char* path)
+	{
+		setMPIComm(MPI_COMM_SELF);
+		return _create(path, MPI_COMM_SELF);
+	}
+
+	/**
+	 * Defines a group
+	 */
+	MpiioGroup* _createGroup(const char* name, size_t size, bool indexed, size_t indexSize, bool planned)
+	{
+		if (size == Group::UNLIMITED || !m_defining)
+			// The size must be known in advance
+			return 0L;
+		if (indexed && indexSize == Group::UNLIMITED)
+			return 0L;
+
+		MpiioGroup group = MpiioGroup(name, numPartitions(), *this, *this, size);
+		if (!group.isValid())
+			return 0L;
+
+		m_groups[name] = group;
+
+		if (indexed) {
+			m_groups[name].addIndex(indexSize);
+			if (!isValid())
+				return 0L;
+		}
+
+		return &m_groups[name];
+	}
+
+	/**
+	 * Writes all deferred values (stops deferring writes, see beginFlush)
+	 * and synchronizes the file
+	 */
+	bool _flush()
+	{
+		if (m_defining)
+			// Nothing written yet
+			return true;
+
+		if (!flush())
+			return false;
+
+		return !checkError(MPI_File_sync(identifier()));
+	}
+
+	bool _create(const char* path, MPI_Comm comm, MPI_Info info = MPI_INFO_NULL)
+	{
+		closeFile();
+
+		MPI_File file;
+		if (checkError(MPI_File_open(comm, const_cast<char*>(path), MPI_MODE_CREATE | MPI_MODE_RDWR, info, &file)))
+			return false;
+		setIdentifier(file);
+
+		// Remove the old content
+		if (checkError(MPI_File_set_size(file, 0)))
+			return false;
+
+		m_defining = true;
+
+		return true;
+	}
+
+	bool _open(const char* path, MPI_Comm comm, MPI_Info info = MPI_INFO_NULL)
+	{
+		closeFile();
+
+		MPI_File file;
+		if (checkError(MPI_File_open(comm, const_cast<char*>(path), MPI_MODE_RDONLY, info, &file)))
+			return false;
+		setIdentifier(file);
+
+		return loadFile();
+	}
+
+	void _loadedGroups(std::vector<Group*> &groups)
+	{
+		for (std::map<std::string, MpiioGroup>::iterator i = m_groups.begin();
+				i != m_groups.end(); i++)
+			groups.push_back(&i->second);
+	}
+
+private:
+	/**
+	 * Closes the file without writing deferred values
+	 */
+	bool closeFile()
+	{
+		endFlush();
+
+		m_groups.clear();
+		m_defining = false;
+		resetBatches();
+
+		MPI_File file = identifier();
+		if (file == MPI_FILE_NULL)
+			return true;
+
+		setIdentifier(MPI_FILE_NULL);
+		return !checkError(MPI_File_close(&file));
+	}
+
+	/**
+	 * Writes the header of the file
+	 */
+	void describe(std::vector<char> &header)
+	{
+		header.insert(header.end(), magic(), magic()+MAGIC_SIZE);
+		putHeader(header, 0ull); // Size of the header
+		putHeader(header, CONVENTIONS);
+		putHeader(header, FILE_VERSION);
+		putHeader(header, numPartitions());
+		putHeader(header, m_groups.size());
+		for (std::map<std::string, MpiioGroup>::iterator i = m_groups.begin(); i != m_groups.end(); i++)
+			i->second.describe(header);
+
+		unsigned long long size = header.size();
+		memcpy(&header[MAGIC_SIZE], &size, sizeof(size));
+	}
+
+	/**
+	 * Reads the header of the file and loads all groups
+	 */
+	bool loadFile()
+	{
+		char prefix[MAGIC_SIZE + sizeof(unsigned long long)];
+		if (checkError(MPI_File_read_at_all(identifier(), 0, prefix, sizeof(prefix), MPI_BYTE, MPI_STATUS_IGNORE)))
+			return false;
+		if (memcmp(prefix, magic(), MAGIC_SIZE) != 0)
+			return !checkError(MPI_ERR_FILE);
+
+		unsigned long long size;
+		memcpy(&size, &prefix[MAGIC_SIZE], sizeof(size));
+		if (size < sizeof(prefix))
+			return !checkError(MPI_ERR_FILE);
+
+		std::vector<char> header(size);
+		if (checkError(MPI_File_read_at_all(identifier(), 0, &header[0], size, MPI_BYTE, MPI_STATUS_IGNORE)))
+			return false;
+
+		const char* pos = &header[sizeof(prefix)];
+		const char* end = &header[0] + header.size();
+
+		std::string conventions;
+		unsigned long long fileVersion, np, numGroups;
+		if (!getHeader(pos, end, conventions) || !getHeader(pos, end, fileVersion)
+				|| !getHeader(pos, end, np) || !getHeader(pos, end, numGroups))
+			return !checkError(MPI_ERR_FILE);
+		if (conventions != CONVENTIONS)
+			return false;
+		if (fileVersion != static_cast<unsigned long long>(FILE_VERSION))
+			// Currently only one version is supported
+			return false;
+		setNumPartitions(np);
+
+		for (unsigned long long i = 0; i < numGroups; i++) {
+			MpiioGroup group(pos, end, np, *this, *this);
+			if (!group.isValid())
+				return false;
+
+			MpiioGroup &g = m_groups[group.name()];
+			g = group;
+			if (!g.loadEntities())
+				return false;
+		}
+
+		return true;
+	}
+
+	/**
+	 * @return The identification of MPI-IO pum files
+	 */
+	static const char* magic()
+	{
+		return "PUMLMPIO";
+	}
+
+	static const size_t MAGIC_SIZE = 8;
+};
+
+}
+
+#endif // PUML_MPIIO_PUM_H
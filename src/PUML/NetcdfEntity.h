@@ -13,6 +13,7 @@
 #ifndef PUML_NETCDF_ENTITY_H
 #define PUML_NETCDF_ENTITY_H
 
+#include <algorithm>
 #include <vector>
 
 #ifdef PARALLEL
@@ -30,6 +31,15 @@ namespace PUML
 
 class NetcdfEntity : public Entity, public NetcdfElement
 {
+	template<typename T, size_t... UserDims> friend class TypedEntity;
+
+private:
+	/** Start of the current access including the time dimension */
+	std::vector<size_t> m_timeStart;
+
+	/** Count of the current access including the time dimension */
+	std::vector<size_t> m_timeCount;
+
 public:
 	NetcdfEntity()
 	{
@@ -37,20 +47,25 @@ public:
 
 	/**
 	 * @param dimSize The netCDF dimension of the group that contains the size
+	 * @param dimTime The netCDF time dimension for time-dependent entities (or -1)
 	 */
 	NetcdfEntity(const char* name, const Type &type, int dimSize,
 			size_t numUserDimensions, const Dimension* userDimensions,
 			const std::vector<size_t> &offset, NetcdfEntity* index,
-			NetcdfElement &group, MPIElement &comm)
+			NetcdfElement &group, MPIElement &comm, int dimTime = -1)
 		: Entity(name, numUserDimensions, userDimensions, offset, index, comm), NetcdfElement(&group)
 	{
 		int ncVar;
 
 		// Use std::vector to avoid memory leaks
-		std::vector<int> dims(numUserDimensions+1);
-		dims[0] = dimSize;
+		std::vector<int> dims;
+		if (dimTime >= 0) {
+			dims.push_back(dimTime);
+			initTime();
+		}
+		dims.push_back(dimSize);
 		for (size_t i = 0; i < numUserDimensions; i++)
-			dims[i+1] = userDimensions[i].identifier();
+			dims.push_back(userDimensions[i].identifier());
 
 		if (checkError(nc_def_var(parentIdentifier(), name, type2nc(type), dims.size(), &dims[0], &ncVar)))
 			return;
@@ -60,8 +75,11 @@ public:
 
 	/**
 	 * Constructor to load an entity from a nc file
+	 *
+	 * @param dimTime The netCDF time dimension of the group (or -1)
 	 */
-	NetcdfEntity(int ncId, const std::vector<size_t> &offset, NetcdfEntity* index, NetcdfElement &group, MPIElement &comm)
+	NetcdfEntity(int ncId, const std::vector<size_t> &offset, NetcdfEntity* index, NetcdfElement &group, MPIElement &comm,
+			int dimTime = -1)
 		: Entity(offset, index, comm), NetcdfElement(ncId, &group)
 	{
 		char name[NC_MAX_NAME+1];
@@ -78,9 +96,16 @@ public:
 		if (checkError(nc_inq_vardimid(parentIdentifier(), identifier(), &dims[0])))
 			return;
 
-		dimSize().resize(numDims);
-		for (int i = 1; i < numDims; i++) { // Skip pum dimension
-			if (checkError(nc_inq_dimlen(parentIdentifier(), dims[i], &dimSize()[i])))
+		// Skip the time dimension
+		size_t first = 0;
+		if (dimTime >= 0 && dims[0] == dimTime) {
+			first = 1;
+			initTime();
+		}
+
+		dimSize().resize(numDims-first);
+		for (int i = 1; i < numDims-static_cast<int>(first); i++) { // Skip pum dimension
+			if (checkError(nc_inq_dimlen(parentIdentifier(), dims[i+first], &dimSize()[i])))
 				return;
 		}
 	}
@@ -102,127 +127,184 @@ public:
 #endif // PARALLEL
 
 protected:
+#ifdef PARALLEL
+	bool _setIOMode(bool collective)
+	{
+		return !checkError(nc_var_par_access(parentIdentifier(), identifier(),
+			(collective ? NC_COLLECTIVE : NC_INDEPENDENT)));
+	}
+#endif // PARALLEL
+
+	size_t _valueSize()
+	{
+		nc_type type;
+		if (checkError(nc_inq_vartype(parentIdentifier(), identifier(), &type)))
+			return 0;
+
+		size_t size;
+		if (checkError(nc_inq_type(parentIdentifier(), type, 0L, &size)))
+			return 0;
+
+		return size;
+	}
+
 	bool _puta(const size_t* start, const size_t* size, const void* values)
 	{
-		return !checkError(nc_put_vara(parentIdentifier(), identifier(), start, size, values));
+		return !checkError(nc_put_vara(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values));
 	}
 
 	bool _puta_schar(const size_t* start, const size_t* size, const signed char* values)
 	{
-		return !checkError(nc_put_vara_schar(parentIdentifier(), identifier(), start, size, values));
+		return !checkError(nc_put_vara_schar(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values));
 	}
 
 	bool _puta_uchar(const size_t* start, const size_t* size, const unsigned char* values)
 	{
-		return !checkError(nc_put_vara_uchar(parentIdentifier(), identifier(), start, size, values));
+		return !checkError(nc_put_vara_uchar(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values));
 	}
 
 	bool _puta_short(const size_t* start, const size_t* size, const short* values)
 	{
-		return !checkError(nc_put_vara_short(parentIdentifier(), identifier(), start, size, values));
+		return !checkError(nc_put_vara_short(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values));
 	}
 
 	bool _puta_int(const size_t* start, const size_t* size, const int* values)
 	{
-		return !checkError(nc_put_vara_int(parentIdentifier(), identifier(), start, size, values));
+		return !checkError(nc_put_vara_int(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values));
 	}
 
 	bool _puta_long(const size_t* start, const size_t* size, const long* values)
 	{
-		return !checkError(nc_put_vara_long(parentIdentifier(), identifier(), start, size, values));
+		return !checkError(nc_put_vara_long(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values));
 	}
 
 	bool _puta_float(const size_t* start, const size_t* size, const float* values)
 	{
-		return !checkError(nc_put_vara_float(parentIdentifier(), identifier(), start, size, values));
+		return !checkError(nc_put_vara_float(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values));
 	}
 
 	bool _puta_double(const size_t* start, const size_t* size, const double* values)
 	{
-		return !checkError(nc_put_vara_double(parentIdentifier(), identifier(), start, size, values));
+		return !checkError(nc_put_vara_double(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values));
 	}
 
 	bool _puta_ushort(const size_t* start, const size_t* size, const unsigned short* values)
 	{
-		return !checkError(nc_put_vara_ushort(parentIdentifier(), identifier(), start, size, values));
+		return !checkError(nc_put_vara_ushort(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values));
 	}
 
 	bool _puta_uint(const size_t* start, const size_t* size, const unsigned int* values)
 	{
-		return !checkError(nc_put_vara_uint(parentIdentifier(), identifier(), start, size, values));
+		return !checkError(nc_put_vara_uint(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values));
 	}
 
 	bool _puta_longlong(const size_t* start, const size_t* size, const long long* values)
 	{
-		return !checkError(nc_put_vara_longlong(parentIdentifier(), identifier(), start, size, values));
+		return !checkError(nc_put_vara_longlong(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values));
 	}
 
 	bool _puta_ulonglong(const size_t* start, const size_t* size, const unsigned long long* values)
 	{
-		return !checkError(nc_put_vara_ulonglong(parentIdentifier(), identifier(), start, size, values));
+		return !checkError(nc_put_vara_ulonglong(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values));
 	}
 
 	bool _geta(const size_t* start, const size_t* size, void* values)
 	{
-		return !checkError(nc_get_vara(parentIdentifier(), identifier(), start, size, values));
+		return !checkError(nc_get_vara(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values));
 	}
 
 	bool _geta_schar(const size_t* start, const size_t* size, signed char* values)
 	{
-		return !checkError(nc_get_vara_schar(parentIdentifier(), identifier(), start, size, values));
+		return !checkError(nc_get_vara_schar(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values));
 	}
 
 	bool _geta_uchar(const size_t* start, const size_t* size, unsigned char* values)
 	{
-		return !checkError(nc_get_vara_uchar(parentIdentifier(), identifier(), start, size, values));
+		return !checkError(nc_get_vara_uchar(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values));
 	}
 
 	bool _geta_short(const size_t* start, const size_t* size, short* values)
 	{
-		return !checkError(nc_get_vara_short(parentIdentifier(), identifier(), start, size, values));
+		return !checkError(nc_get_vara_short(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values));
 	}
 
 	bool _geta_int(const size_t* start, const size_t* size, int* values)
 	{
-		return !checkError(nc_get_vara_int(parentIdentifier(), identifier(), start, size, values));
+		return !checkError(nc_get_vara_int(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values));
 	}
 
 	bool _geta_long(const size_t* start, const size_t* size, long* values)
 	{
-		return !checkError(nc_get_vara_long(parentIdentifier(), identifier(), start, size, values));
+		return !checkError(nc_get_vara_long(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values));
 	}
 
 	bool _geta_float(const size_t* start, const size_t* size, float* values)
 	{
-		return !checkError(nc_get_vara_float(parentIdentifier(), identifier(), start, size, values));
+		return !checkError(nc_get_vara_float(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values));
 	}
 
 	bool _geta_double(const size_t* start, const size_t* size, double* values)
 	{
-		return !checkError(nc_get_vara_double(parentIdentifier(), identifier(), start, size, values));
+		return !checkError(nc_get_vara_double(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values));
 	}
 
 	bool _geta_ushort(const size_t* start, const size_t* size, unsigned short* values)
 	{
-		return !checkError(nc_get_vara_ushort(parentIdentifier(), identifier(), start, size, values));
+		return !checkError(nc_get_vara_ushort(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values));
 	}
 
 	bool _geta_uint(const size_t* start, const size_t* size, unsigned int* values)
 	{
-		return !checkError(nc_get_vara_uint(parentIdentifier(), identifier(), start, size, values));
+		return !checkError(nc_get_vara_uint(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values));
 	}
 
 	bool _geta_longlong(const size_t* start, const size_t* size, long long* values)
 	{
-		return !checkError(nc_get_vara_longlong(parentIdentifier(), identifier(), start, size, values));
+		return !checkError(nc_get_vara_longlong(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values));
 	}
 
 	bool _geta_ulonglong(const size_t* start, const size_t* size, unsigned long long* values)
 	{
-		return !checkError(nc_get_vara_ulonglong(parentIdentifier(), identifier(), start, size, values));
+		return !checkError(nc_get_vara_ulonglong(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values));
 	}
 
 private:
+	void initTime()
+	{
+		setTimeDependent();
+		m_timeStart.resize(1);
+		m_timeCount.assign(1, 1);
+	}
+
+	/**
+	 * @return The start of an access in the file (with the time step for
+	 *  time-dependent entities)
+	 */
+	const size_t* ncStart(const size_t* start)
+	{
+		if (!timeDependent())
+			return start;
+
+		m_timeStart.resize(numDims()+1);
+		m_timeStart[0] = step();
+		std::copy(start, start+numDims(), &m_timeStart[1]);
+		return &m_timeStart[0];
+	}
+
+	/**
+	 * @return The count of an access in the file (with one time step for
+	 *  time-dependent entities)
+	 */
+	const size_t* ncCount(const size_t* count)
+	{
+		if (!timeDependent())
+			return count;
+
+		m_timeCount.resize(numDims()+1);
+		std::copy(count, count+numDims(), &m_timeCount[1]);
+		return &m_timeCount[0];
+	}
+
 	/**
 	 * @return The nc identifier for this type
 	 */
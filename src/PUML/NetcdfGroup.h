@@ -13,7 +13,11 @@
 #ifndef PUML_NETCDF_GROUP_H
 #define PUML_NETCDF_GROUP_H
 
+#include <algorithm>
+#include <cstring>
 #include <map>
+#include <string>
+#include <vector>
 
 #include <netcdf.h>
 
@@ -39,21 +43,40 @@ private:
 	/** nc identifier for the index size dimension */
 	int m_ncDimIndexSize;
 
+	/** nc identifier for the time dimension (if time-dependent entities exist) */
+	int m_ncDimTime;
+
 	/** User defined dimensions */
 	std::vector<Dimension> m_dimensions;
 
 	/** nc identifier for the offset variable */
 	int m_ncVarOffset;
 
+	/** nc identifier for the total size variable (-1 if the total is the size dimension) */
+	int m_ncVarTotalSize;
+
 	/** index variable */
 	NetcdfEntity m_entityIndex;
 
+	/** type offset variable (mixed cell groups only) */
+	NetcdfEntity m_entityTypeOffset;
+
 	/** Entities in this group */
 	std::map<std::string, NetcdfEntity> m_entities;
 
+	/** Minimum/maximum variables of entities (accessed by the variable name) */
+	std::map<std::string, NetcdfEntity> m_statistics;
+
+	/** Write the offsets in flushOffsets instead of setOffset */
+	bool m_deferOffsets;
+
+	/** True if offsets were changed since the last flushOffsets */
+	bool m_offsetsChanged;
+
 public:
 	NetcdfGroup()
-		: m_ncDimPartition(-1), m_ncDimSize(-1), m_ncDimIndexSize(-1), m_ncVarOffset(-1)
+		: m_ncDimPartition(-1), m_ncDimSize(-1), m_ncDimIndexSize(-1), m_ncDimTime(-1), m_ncVarOffset(-1),
+		  m_ncVarTotalSize(-1), m_deferOffsets(false), m_offsetsChanged(false)
 	{
 	}
 
@@ -61,7 +84,8 @@ public:
 	 * @param size The total size of this group. Use NC_UNLIMITED if unknown
 	 */
 	NetcdfGroup(const char* name, size_t numPartitions, NetcdfElement &ncPum, MPIElement &comm, size_t size)
-		: Group(name, numPartitions, comm), NetcdfElement(&ncPum), m_ncDimIndexSize(-1)
+		: Group(name, numPartitions, comm), NetcdfElement(&ncPum), m_ncDimIndexSize(-1), m_ncDimTime(-1),
+		  m_ncVarTotalSize(-1), m_deferOffsets(false), m_offsetsChanged(false)
 	{
 		int ncGroup;
 		if (checkError(nc_def_grp(ncPum.identifier(), name, &ncGroup)))
@@ -87,10 +111,14 @@ public:
 	 * Constructor to load a group from the nc file
 	 *
 	 * @param ncId The netcdf identifier of the group
+	 * @param offsets Offsets of all partitions and the total size (if already
+	 *  known). If NULL the offsets are read from the file.
 	 */
-	NetcdfGroup(int ncId, NetcdfElement &ncPum, MPIElement &comm)
+	NetcdfGroup(int ncId, NetcdfElement &ncPum, MPIElement &comm,
+			const std::vector<unsigned long long>* offsets = 0L)
 		: Group(comm), NetcdfElement(ncId, &ncPum),
-		  m_ncDimIndexSize(-1)
+		  m_ncDimIndexSize(-1), m_ncDimTime(-1), m_ncVarTotalSize(-1),
+		  m_deferOffsets(false), m_offsetsChanged(false)
 	{
 		char name[NC_MAX_NAME+1];
 		if (checkError(nc_inq_grpname(identifier(), name)))
@@ -110,21 +138,74 @@ public:
 			return;
 #endif // PARALLEL
 
+		if (offsets) {
+			offset().assign(offsets->begin(), offsets->end());
+			return;
+		}
+
 		// Read offsets
 		size_t numPartitions;
 		if (checkError(nc_inq_dimlen(identifier(), m_ncDimPartition, &numPartitions)))
 			return;
 
-		std::vector<unsigned long long> o(numPartitions);
-		if (checkError(nc_get_var_ulonglong(identifier(), m_ncVarOffset, &o[0])))
+		std::vector<unsigned long long> o;
+		if (checkError(readOffsets(identifier(), numPartitions, o)))
 			return;
 
-		offset().resize(numPartitions+1);
-		for (size_t i = 0; i < numPartitions; i++)
-			offset()[i] = o[i];
+		offset().assign(o.begin(), o.end());
+	}
 
-		if (checkError(nc_inq_dimlen(identifier(), m_ncDimSize, &offset()[numPartitions])))
-			return;
+	/**
+	 * Reads the offsets and the total size of a group without loading the group
+	 *
+	 * @param independent Use independent access (if only one rank reads the offsets)
+	 * @return The netCDF error code
+	 *
+	 * @internal
+	 */
+	static int readOffsets(int ncGroup, size_t numPartitions, std::vector<unsigned long long> &offsets,
+			bool independent = false)
+	{
+		// The partitions of indexed groups are stored in the index dimension
+		int dimSize, varOffset;
+		int ncError = nc_inq_dimid(ncGroup, DIM_INDEXSIZE, &dimSize);
+		if (ncError == NC_EBADDIM)
+			ncError = nc_inq_dimid(ncGroup, DIM_SIZE, &dimSize);
+		if (ncError != NC_NOERR)
+			return ncError;
+		ncError = nc_inq_varid(ncGroup, VAR_OFFSET, &varOffset);
+		if (ncError != NC_NOERR)
+			return ncError;
+#ifdef PARALLEL
+		ncError = nc_var_par_access(ncGroup, varOffset, (independent ? NC_INDEPENDENT : NC_COLLECTIVE));
+		if (ncError != NC_NOERR)
+			return ncError;
+#endif // PARALLEL
+
+		offsets.resize(numPartitions+1);
+		ncError = nc_get_var_ulonglong(ncGroup, varOffset, &offsets[0]);
+		if (ncError != NC_NOERR)
+			return ncError;
+
+		int varTotalSize;
+		ncError = nc_inq_varid(ncGroup, VAR_TOTALSIZE, &varTotalSize);
+		if (ncError == NC_NOERR) {
+			// The size dimension does not contain the total
+#ifdef PARALLEL
+			ncError = nc_var_par_access(ncGroup, varTotalSize, (independent ? NC_INDEPENDENT : NC_COLLECTIVE));
+			if (ncError != NC_NOERR)
+				return ncError;
+#endif // PARALLEL
+			return nc_get_var_ulonglong(ncGroup, varTotalSize, &offsets.back());
+		}
+		if (ncError != NC_ENOTVAR)
+			return ncError;
+
+		size_t size;
+		ncError = nc_inq_dimlen(ncGroup, dimSize, &size);
+		offsets.back() = size;
+
+		return ncError;
 	}
 
 	Dimension& createDimension(const char* name, size_t size)
@@ -166,29 +247,246 @@ public:
 		return createEntity(name, type, 0, 0L);
 	}
 
-	NetcdfEntity* getEntity(const char* name)
+	/**
+	 * The entity is chunked with one time step and the average partition
+	 * size (if the size of the group is known) per chunk.
+	 */
+	NetcdfEntity* createTimeEntity(const char* name, const Type &type, size_t numDimensions, Dimension* dimensions)
 	{
-		if (m_entities.find(name) == m_entities.end())
+		if (m_ncDimTime < 0) {
+			if (checkError(nc_def_dim(identifier(), DIM_TIME, NC_UNLIMITED, &m_ncDimTime)))
+				return 0L;
+		}
+
+		NetcdfEntity entity = NetcdfEntity(name, type, m_ncDimSize, numDimensions, dimensions,
+				offset(), (indexed() ? &m_entityIndex : 0L), *this, *this, m_ncDimTime);
+		if (!entity.isValid())
+			return 0L;
+
+		// Chunk = one time step of an average partition
+		size_t size;
+		if (checkError(nc_inq_dimlen(identifier(), m_ncDimSize, &size)))
+			return 0L;
+		if (size > 0) {
+			std::vector<size_t> chunks;
+			chunks.push_back(1);
+			chunks.push_back(std::max((size + numPartitions() - 1) / numPartitions(), static_cast<size_t>(1)));
+			for (size_t i = 0; i < numDimensions; i++)
+				chunks.push_back(dimensions[i].size());
+			if (checkError(nc_def_var_chunking(identifier(), entity.identifier(), NC_CHUNKED, &chunks[0])))
+				return 0L;
+		}
+
+		m_entities[name] = entity;
+		if (!m_entities[name].setCollective(true))
 			return 0L;
 
-		return &m_entities.at(name);
+		return &m_entities[name];
+	}
+
+	size_t numSteps()
+	{
+		if (m_ncDimTime < 0)
+			return 0;
+
+		size_t steps;
+		if (checkError(nc_inq_dimlen(identifier(), m_ncDimTime, &steps)))
+			return 0;
+
+		return steps;
+	}
+
+	/**
+	 * @return The number of elements stored in the file. For indexed groups
+	 *  this is the size of the data, not the size of the index.
+	 */
+	size_t dataSize()
+	{
+		size_t size;
+		if (checkError(nc_inq_dimlen(identifier(), m_ncDimSize, &size)))
+			return 0;
+
+		return size;
+	}
+
+	/**
+	 * Defines the same user dimensions, entities and statistics as another
+	 * group. The file must be in define mode.
+	 *
+	 * @param source The group of another file, mixed groups are not supported
+	 */
+	bool copyDefinition(NetcdfGroup &source)
+	{
+		if (source.mixed())
+			return false;
+
+		int numVars;
+		if (checkError(nc_inq_varids(source.identifier(), &numVars, 0L)))
+			return false;
+		std::vector<int> varIds(numVars);
+		if (numVars > 0 && checkError(nc_inq_varids(source.identifier(), 0L, &varIds[0])))
+			return false;
+
+		std::map<std::string, Dimension> dims;
+		for (std::vector<int>::const_iterator i = varIds.begin(); i != varIds.end(); i++) {
+			char name[NC_MAX_NAME+1];
+			if (checkError(nc_inq_varname(source.identifier(), *i, name)))
+				return false;
+			if (source.isInternal(name))
+				continue;
+
+			NetcdfEntity* entity = source.getEntity(name);
+			if (!entity)
+				return false;
+
+			nc_type type;
+			int numDims;
+			if (checkError(nc_inq_vartype(source.identifier(), *i, &type))
+					|| checkError(nc_inq_varndims(source.identifier(), *i, &numDims)))
+				return false;
+			std::vector<int> dimIds(numDims);
+			if (checkError(nc_inq_vardimid(source.identifier(), *i, &dimIds[0])))
+				return false;
+
+			std::vector<Dimension> userDims;
+			for (int j = (entity->timeDependent() ? 2 : 1); j < numDims; j++) { // Skip the time and the size dimension
+				char dimName[NC_MAX_NAME+1];
+				size_t len;
+				if (checkError(nc_inq_dim(source.identifier(), dimIds[j], dimName, &len)))
+					return false;
+
+				std::map<std::string, Dimension>::iterator dim = dims.find(dimName);
+				if (dim == dims.end())
+					dim = dims.insert(std::make_pair(std::string(dimName), createDimension(dimName, len))).first;
+				userDims.push_back(dim->second);
+			}
+
+			Type t(static_cast<long>(type));
+			if (entity->timeDependent()) {
+				if (!createTimeEntity(name, t, userDims.size(), (userDims.empty() ? 0L : &userDims[0])))
+					return false;
+			} else {
+				if (!createEntity(name, t, userDims.size(), (userDims.empty() ? 0L : &userDims[0])))
+					return false;
+			}
+
+			if (entity->hasStatistics() && !addStatistics(name))
+				return false;
+		}
+
+		return isValid();
+	}
+
+	/**
+	 * Forwards all partition based accesses of the group and its entities
+	 *
+	 * @internal
+	 */
+	void setRouter(PartitionRouter* router)
+	{
+		Group::setRouter(router);
+
+		for (std::map<std::string, NetcdfEntity>::iterator i = m_entities.begin();
+				i != m_entities.end(); i++)
+			i->second.setRouter(router, name());
+	}
+
+	/**
+	 * Stores the total size of the group in a variable. Required if the size
+	 * dimension of the file does not contain the total size (e.g. for the
+	 * master file of subfiles). The file must be in define mode.
+	 *
+	 * @internal
+	 */
+	bool defineTotalSize()
+	{
+		if (checkError(nc_def_var(identifier(), VAR_TOTALSIZE, NC_UINT64, 0, 0L, &m_ncVarTotalSize)))
+			return false;
+#ifdef PARALLEL
+		if (checkError(nc_var_par_access(identifier(), m_ncVarTotalSize, NC_COLLECTIVE)))
+			return false;
+#endif // PARALLEL
+
+		return true;
+	}
+
+	/**
+	 * Writes the total size if defined with defineTotalSize. In the parallel
+	 * version this is a collective function.
+	 *
+	 * @internal
+	 */
+	bool writeTotalSize()
+	{
+		if (m_ncVarTotalSize < 0)
+			return true;
+
+		// All ranks know the same offsets and write the same value
+		unsigned long long size = offset().back();
+		return !checkError(nc_put_var_ulonglong(identifier(), m_ncVarTotalSize, &size));
+	}
+
+	/**
+	 * Entities of groups loaded from a file are loaded on the first call
+	 */
+	NetcdfEntity* getEntity(const char* name)
+	{
+		std::map<std::string, NetcdfEntity>::iterator it = m_entities.find(name);
+		if (it != m_entities.end())
+			return &it->second;
+
+		return loadEntity(name);
+	}
+
+	/**
+	 * Enable/disable deferred offsets. If enabled, Group::setSize only
+	 * updates the offsets in memory, they are written by flushOffsets.
+	 *
+	 * @internal
+	 */
+	void setDeferOffsets(bool deferOffsets)
+	{
+		m_deferOffsets = deferOffsets;
+	}
+
+	/**
+	 * Writes the offsets changed since the last call (all offsets in one
+	 * access). In the parallel version this is a collective function.
+	 *
+	 * @internal
+	 */
+	bool flushOffsets()
+	{
+		if (!m_offsetsChanged)
+			return true;
+		m_offsetsChanged = false;
+
+		return writeOffsets();
 	}
 
 	/**
-	 * Loads the entities from the netcdf file
+	 * Loads the index and the type offsets from the netcdf file. Other
+	 * entities are loaded on demand.
 	 * We can't do this in the constructor because this results in wrong values for m_parent
 	 *
 	 * @internal
 	 */
 	bool loadEntities()
 	{
+		// Get the time dimension if exists
+		int ncError = nc_inq_dimid(identifier(), DIM_TIME, &m_ncDimTime);
+		if (ncError == NC_EBADDIM)
+			m_ncDimTime = -1;
+		else if (checkError(ncError))
+			return false;
+
 		// Get index if exists
-		int indexId = -1;
-		int ncError = nc_inq_dimid(identifier(), DIM_INDEXSIZE, &m_ncDimIndexSize);
+		ncError = nc_inq_dimid(identifier(), DIM_INDEXSIZE, &m_ncDimIndexSize);
 		if (ncError != NC_EBADDIM) {
 			if (checkError(ncError))
 				return false;
 
+			int indexId;
 			if (checkError(nc_inq_varid(identifier(), VAR_INDEX, &indexId)))
 				return false;
 
@@ -197,31 +495,58 @@ public:
 			setEntityIndex(&m_entityIndex);
 		}
 
-		// Get other variables
-		int numVars;
-		if (checkError(nc_inq_varids(identifier(), &numVars, 0L)))
-			return false;
+		// Get type offsets if exist
+		int typeOffsetId;
+		ncError = nc_inq_varid(identifier(), VAR_TYPEOFFSET, &typeOffsetId);
+		if (ncError != NC_ENOTVAR) {
+			if (checkError(ncError))
+				return false;
 
-		std::vector<int> varIds(numVars);
-		if (checkError(nc_inq_varids(identifier(), 0L, &varIds[0])))
-			return false;
+			m_entityTypeOffset = NetcdfEntity(typeOffsetId, offset(), 0L, *this, *this);
 
-		for (std::vector<int>::const_iterator i = varIds.begin(); i != varIds.end(); i++) {
-			if (*i == m_ncVarOffset)
-				continue;
-			if (*i == indexId)
+			setEntityTypeOffset(&m_entityTypeOffset);
+		}
+
+		return true;
+	}
+
+	/**
+	 * @return True if the variable is used internally by the group
+	 *
+	 * @internal
+	 */
+	bool isInternal(const char* name)
+	{
+		if (strcmp(name, VAR_OFFSET) == 0 || strcmp(name, VAR_INDEX) == 0
+				|| strcmp(name, VAR_TYPEOFFSET) == 0 || strcmp(name, VAR_TOTALSIZE) == 0)
+			return true;
+
+		// Statistics of an existing entity
+		const char* suffixes[] = {VAR_MIN_SUFFIX, VAR_MAX_SUFFIX};
+		for (unsigned int i = 0; i < 2; i++) {
+			size_t nameLen = strlen(name);
+			size_t suffixLen = strlen(suffixes[i]);
+			if (name[0] != '_' || nameLen <= suffixLen+1
+					|| strcmp(name+nameLen-suffixLen, suffixes[i]) != 0)
 				continue;
 
-			NetcdfEntity entity = NetcdfEntity(*i, offset(), (indexed() ? &m_entityIndex : 0L), *this, *this);
-			m_entities[entity.name()] = entity;
+			std::string entityName(name+1, nameLen-suffixLen-1);
+			int varId;
+			if (nc_inq_varid(identifier(), entityName.c_str(), &varId) == NC_NOERR)
+				return true;
 		}
 
-		return true;
+		return false;
 	}
 
 protected:
 	bool setOffset(size_t partition)
 	{
+		if (m_deferOffsets) {
+			// Group::setSize is collective, all ranks know the same offsets
+			m_offsetsChanged = true;
+			return true;
+		}
 
 		if (partition >= numPartitions())
 			// The last partition sets the offset for the first one
@@ -235,6 +560,16 @@ protected:
 		return true;
 	}
 
+	bool setOffsets()
+	{
+		if (m_deferOffsets) {
+			m_offsetsChanged = true;
+			return true;
+		}
+
+		return writeOffsets();
+	}
+
 	NetcdfEntity* _addIndex(size_t indexSize)
 	{
 		if (checkError(nc_def_dim(identifier(), DIM_INDEXSIZE, indexSize, &m_ncDimIndexSize)))
@@ -244,6 +579,136 @@ protected:
 
 		return &m_entityIndex;
 	}
+
+	bool _addStatistics(Entity &entity)
+	{
+		NetcdfEntity &ncEntity = static_cast<NetcdfEntity&>(entity);
+
+		// Use the same user dimensions as the entity
+		int numDims;
+		if (checkError(nc_inq_varndims(identifier(), ncEntity.identifier(), &numDims)))
+			return false;
+		std::vector<int> dimIds(numDims);
+		if (checkError(nc_inq_vardimid(identifier(), ncEntity.identifier(), &dimIds[0])))
+			return false;
+
+		std::vector<Dimension> dims;
+		for (int i = 1; i < numDims; i++) { // Skip the size dimension
+			size_t len;
+			if (checkError(nc_inq_dimlen(identifier(), dimIds[i], &len)))
+				return false;
+			dims.push_back(Dimension(dimIds[i], "", len));
+		}
+
+		std::string minName = statisticsName(entity.name(), VAR_MIN_SUFFIX);
+		std::string maxName = statisticsName(entity.name(), VAR_MAX_SUFFIX);
+		m_statistics[minName] = NetcdfEntity(minName.c_str(), Type::DOUBLE, m_ncDimPartition,
+				dims.size(), (dims.empty() ? 0L : &dims[0]), offset(), 0L, *this, *this);
+		m_statistics[maxName] = NetcdfEntity(maxName.c_str(), Type::DOUBLE, m_ncDimPartition,
+				dims.size(), (dims.empty() ? 0L : &dims[0]), offset(), 0L, *this, *this);
+		if (!isValid())
+			return false;
+
+		entity.setStatistics(&m_statistics[minName], &m_statistics[maxName]);
+
+		return true;
+	}
+
+	void _loadedEntities(std::vector<Entity*> &entities)
+	{
+		if (indexed())
+			entities.push_back(&m_entityIndex);
+		if (mixed())
+			entities.push_back(&m_entityTypeOffset);
+
+		for (std::map<std::string, NetcdfEntity>::iterator i = m_entities.begin();
+				i != m_entities.end(); i++)
+			entities.push_back(&i->second);
+		for (std::map<std::string, NetcdfEntity>::iterator i = m_statistics.begin();
+				i != m_statistics.end(); i++)
+			entities.push_back(&i->second);
+	}
+
+	NetcdfEntity* _addTypeOffset()
+	{
+		Dimension &dim = createDimension(DIM_CELLTYPE, NUM_CELL_TYPES+1);
+		if (!isValid())
+			return 0L;
+
+		m_entityTypeOffset = NetcdfEntity(VAR_TYPEOFFSET, Type::UINT64, m_ncDimPartition, 1, &dim,
+				offset(), 0L, *this, *this);
+
+		return &m_entityTypeOffset;
+	}
+
+private:
+	/**
+	 * Writes the offsets of all partitions
+	 */
+	bool writeOffsets()
+	{
+		// The first rank writes all offsets (collective variable)
+		size_t start = 0;
+		size_t count = (mpiRank() == 0 ? numPartitions() : 0);
+		std::vector<unsigned long long> o(offset().begin(), offset().end()-1);
+
+		if (checkError(nc_put_vara_ulonglong(identifier(), m_ncVarOffset, &start, &count, &o[0])))
+			return false;
+
+		return true;
+	}
+
+	/**
+	 * Loads an entity from the netcdf file
+	 *
+	 * @return The entity or NULL if the entity does not exist
+	 */
+	NetcdfEntity* loadEntity(const char* name)
+	{
+		if (isInternal(name))
+			return 0L;
+
+		int varId;
+		if (nc_inq_varid(identifier(), name, &varId) != NC_NOERR)
+			return 0L;
+
+		NetcdfEntity entity(varId, offset(), (indexed() ? &m_entityIndex : 0L), *this, *this, m_ncDimTime);
+		if (router())
+			entity.setRouter(router(), this->name());
+
+		// Load statistics if available
+		std::string minName = statisticsName(name, VAR_MIN_SUFFIX);
+		std::string maxName = statisticsName(name, VAR_MAX_SUFFIX);
+		int minId, maxId;
+		bool hasStatistics = nc_inq_varid(identifier(), minName.c_str(), &minId) == NC_NOERR
+				&& nc_inq_varid(identifier(), maxName.c_str(), &maxId) == NC_NOERR;
+		NetcdfEntity min, max;
+		if (hasStatistics) {
+			min = NetcdfEntity(minId, offset(), 0L, *this, *this);
+			max = NetcdfEntity(maxId, offset(), 0L, *this, *this);
+		}
+
+		if (!isValid())
+			return 0L;
+
+		NetcdfEntity &stored = m_entities[name];
+		stored = entity;
+		if (hasStatistics) {
+			m_statistics[minName] = min;
+			m_statistics[maxName] = max;
+			stored.setStatistics(&m_statistics[minName], &m_statistics[maxName]);
+		}
+
+		return &stored;
+	}
+
+	/**
+	 * @return The name of the variable that stores the minimum/maximum of an entity
+	 */
+	static std::string statisticsName(const std::string &name, const char* suffix)
+	{
+		return "_" + name + suffix;
+	}
 };
 
 }
@@ -17,6 +17,12 @@
 #include <mpi.h>
 #endif // PARALLEL
 
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <string>
 #include <vector>
 
 #ifdef PARALLEL
@@ -28,34 +34,104 @@
 
 #include "PUML/NetcdfGroup.h"
 #include "PUML/NetcdfElement.h"
+#include "PUML/PartitionRouter.h"
 #include "PUML/Pum.h"
 
 namespace PUML
 {
 
-class NetcdfPum : public Pum, public NetcdfElement
+class NetcdfPum : public Pum, public NetcdfElement, public PartitionRouter
 {
 private:
 	/** Groups in this file */
 	std::map<std::string, NetcdfGroup> m_groups;
 
+#ifdef PARALLEL
+	/** Read the metadata on one rank and broadcast it */
+	bool m_broadcastMetadata;
+
+	/** Communicator of the subfile of this rank (create only) */
+	MPI_Comm m_subfileComm;
+#endif // PARALLEL
+
+	/** Offsets of all groups received from the root rank */
+	std::map<std::string, std::vector<unsigned long long> > m_offsets;
+
+	/** Number of subfiles for the next create */
+	size_t m_requestedSubfiles;
+
+	/** Number of subfiles (0 if the data is stored in this file) */
+	size_t m_numSubfiles;
+
+	/** Number of ranks that created the subfiles */
+	size_t m_subfileRanks;
+
+	/** The subfile of this rank (create only) */
+	size_t m_ownSubfile;
+
+	/** Path of this file, the subfiles are stored in <code>path.i</code> */
+	std::string m_path;
+
+	/** The subfiles (NULL if not opened) */
+	std::vector<NetcdfPum*> m_subfiles;
+
+	/** Keep the next file opened/created with the serial version in memory */
+	bool m_inMemory;
+
+	/** Write the offsets of created groups at checkpoint/close only */
+	bool m_deferOffsets;
+
 public:
 	NetcdfPum()
+		:
+#ifdef PARALLEL
+		  m_broadcastMetadata(false), m_subfileComm(MPI_COMM_NULL),
+#endif // PARALLEL
+		  m_requestedSubfiles(0), m_numSubfiles(0), m_subfileRanks(0),
+		  m_ownSubfile(std::numeric_limits<size_t>::max()),
+		  m_inMemory(false), m_deferOffsets(false)
 	{
 	}
 
 	virtual ~NetcdfPum()
 	{
 		nc_close(identifier());
+
+		for (std::vector<NetcdfPum*>::iterator i = m_subfiles.begin(); i != m_subfiles.end(); i++)
+			delete *i;
 	}
 
 	bool open(const char* path)
 	{
 		int ncFile;
 
-		if (checkError(nc_open(path, NC_NETCDF4, &ncFile)))
+		if (checkError(nc_open(path, NC_NETCDF4 | (m_inMemory ? NC_DISKLESS : 0), &ncFile)))
+				return false;
+		setIdentifier(ncFile);
+		m_path = path;
+
+		return loadFile();
+	}
+
+	/**
+	 * Opens a file that is already stored in memory (e.g. received from
+	 * another rank)
+	 *
+	 * The buffer is not copied and must not be modified or freed before the
+	 * file is closed. The file is read-only.
+	 *
+	 * @param path The name of the file (used for subfiles only)
+	 * @param buffer The content of the file
+	 * @param size The size of the buffer in bytes
+	 */
+	bool open(const char* path, void* buffer, size_t size)
+	{
+		int ncFile;
+
+		if (checkError(nc_open_mem(path, NC_NETCDF4, size, buffer, &ncFile)))
 				return false;
 		setIdentifier(ncFile);
+		m_path = path;
 
 		return loadFile();
 	}
@@ -70,34 +146,176 @@ public:
 	}
 #endif // PARALLEL
 
-	NetcdfGroup* createGroup(const char* name, size_t size = Group::UNLIMITED)
+#ifdef PARALLEL
+	/**
+	 * Enable/disable metadata broadcasting for parallel open.
+	 *
+	 * If enabled, only the first rank reads the attributes and the offsets of all
+	 * groups and broadcasts them to all other ranks. This avoids that all ranks
+	 * access the metadata at the same time. Must be called before open.
+	 */
+	void setBroadcastMetadata(bool broadcastMetadata)
 	{
-		if (size == Group::UNLIMITED)
-			size = NC_UNLIMITED;
+		m_broadcastMetadata = broadcastMetadata;
+	}
+#endif // PARALLEL
 
-		NetcdfGroup group = NetcdfGroup(name, numPartitions(), *this, *this, size);
-		if (!group.isValid())
-			return 0L;
+	/**
+	 * Enable/disable in-memory access for the serial open and create.
+	 *
+	 * If enabled, open reads the whole file into memory and all later accesses
+	 * are served from memory. A created file is kept in memory and written to
+	 * disk by close. The file must fit into the main memory. Does not affect the
+	 * parallel open/create and subfiles. Must be called before open/create.
+	 */
+	void setInMemory(bool inMemory)
+	{
+		m_inMemory = inMemory;
+	}
 
-		m_groups[name] = group;
+	/**
+	 * Enable/disable deferred offsets for groups created afterwards.
+	 *
+	 * If enabled, Group::setSize does not write the offset to the file. All
+	 * offsets of a group are written with one access by Pum::checkpoint and
+	 * close. Applies to the subfiles as well.
+	 */
+	void setDeferOffsets(bool deferOffsets)
+	{
+		m_deferOffsets = deferOffsets;
+	}
 
-		return &m_groups[name];
+	/**
+	 * Spread the data of the next parallel create over several files
+	 *
+	 * The file itself only contains the definitions and the offsets of all
+	 * partitions. The data is stored in <code>numSubfiles</code> subfiles
+	 * (<code>path.0</code>, <code>path.1</code>, ...). Each subfile is written by a
+	 * contiguous block of ranks with its own communicator.
+	 *
+	 * Partition p is stored in the subfile of rank <code>p % size</code> (where size
+	 * is the number of ranks that create the file). A rank can only write the
+	 * partitions of its own subfile. Readers can use any number of ranks, each
+	 * subfile is opened on the first access (with MPI_COMM_SELF).
+	 *
+	 * Entity::get/put, Entity::getStatistics, Group::setSize,
+	 * Group::getIndex/putIndex and Group::getRow/putRow are forwarded to the
+	 * subfile. Entity::gather, Entity::selectPartitions and Pum::scan read
+	 * from the subfiles of the partitions (gather does not support indexed
+	 * groups). Absolute access (e.g. Entity::geta) and TypedEntity fail. The
+	 * sizes of all groups are unlimited and mixed groups are not supported.
+	 *
+	 * @param numSubfiles Number of subfiles, at most one per rank. 0 or 1 disables
+	 *  subfiling.
+	 */
+	void setSubfiles(size_t numSubfiles)
+	{
+		m_requestedSubfiles = numSubfiles;
 	}
 
-	NetcdfGroup* createGroupIndexed(const char* name, size_t size = Group::UNLIMITED, size_t indexSize = Group::UNLIMITED)
+	/**
+	 * @return The number of subfiles or 0 if the data is stored in this file
+	 *
+	 * @see setSubfiles
+	 */
+	size_t numSubfiles() const
+	{
+		return m_numSubfiles;
+	}
+
+	/**
+	 * Creates a checkpoint file
+	 *
+	 * A checkpoint file contains only some partitions of a mesh and is written
+	 * without any communication (with MPI_COMM_SELF in the parallel version). Partition i of the checkpoint file is
+	 * partition <code>partitions[i]</code> of the mesh. Use
+	 * CheckpointMerger to combine the checkpoint files into a single file.
+	 *
+	 * @param partitions The partitions of the mesh stored in this file
+	 * @param numPartitions The number of partitions of the mesh
+	 */
+	bool createCheckpoint(const char* path, const std::vector<size_t> &partitions, size_t numPartitions)
+	{
+		if (partitions.empty())
+			return false;
+
+#ifdef PARALLEL
+		if (!create(path, partitions.size(), MPI_COMM_SELF))
+#else // PARALLEL
+		if (!create(path, partitions.size()))
+#endif // PARALLEL
+			return false;
+
+		std::vector<unsigned long long> p(partitions.begin(), partitions.end());
+		if (checkError(nc_put_att_ulonglong(identifier(), NC_GLOBAL, ATT_CHECKPOINT_PARTITIONS, NC_UINT64,
+				p.size(), &p[0])))
+			return false;
+		unsigned long long np = numPartitions;
+		if (checkError(nc_put_att_ulonglong(identifier(), NC_GLOBAL, ATT_CHECKPOINT_TOTAL, NC_UINT64, 1, &np)))
+			return false;
+
+		return true;
+	}
+
+	/**
+	 * Reads the partitions of a checkpoint file
+	 *
+	 * @param partitions The partitions of the mesh stored in this file
+	 * @param numPartitions The number of partitions of the mesh
+	 * @return False if this is not a checkpoint file
+	 *
+	 * @see createCheckpoint
+	 */
+	bool checkpointPartitions(std::vector<size_t> &partitions, size_t &numPartitions)
+	{
+		size_t len;
+		if (nc_inq_attlen(identifier(), NC_GLOBAL, ATT_CHECKPOINT_PARTITIONS, &len) != NC_NOERR
+				|| len != this->numPartitions())
+			return false;
+
+		std::vector<unsigned long long> p(len);
+		if (checkError(nc_get_att_ulonglong(identifier(), NC_GLOBAL, ATT_CHECKPOINT_PARTITIONS, &p[0])))
+			return false;
+		unsigned long long np;
+		if (checkError(nc_get_att_ulonglong(identifier(), NC_GLOBAL, ATT_CHECKPOINT_TOTAL, &np)))
+			return false;
+
+		partitions.assign(p.begin(), p.end());
+		numPartitions = np;
+
+		return true;
+	}
+
+	/**
+	 * In the parallel version this is a collective function.
+	 *
+	 * @see Pum::planSize
+	 */
+	NetcdfGroup* createGroup(const char* name, size_t size = Group::UNLIMITED)
 	{
-		if (indexSize == Group::UNLIMITED)
-			indexSize = NC_UNLIMITED;
+		return static_cast<NetcdfGroup*>(Pum::createGroup(name, size));
+	}
 
+	/**
+	 * @copydoc createGroup
+	 */
+	NetcdfGroup* createGroupIndexed(const char* name, size_t size = Group::UNLIMITED, size_t indexSize = Group::UNLIMITED)
+	{
 		return static_cast<NetcdfGroup*>(Pum::createGroupIndexed(name, size, indexSize));
 	}
 
+	/**
+	 * Groups of opened files are loaded on the first call. In the parallel
+	 * version the first call for each group is collective (the offsets are
+	 * read collectively).
+	 */
 	NetcdfGroup* getGroup(const char* name)
 	{
-		if (m_groups.find(name) == m_groups.end())
-			return 0L;
+		std::map<std::string, NetcdfGroup>::iterator it = m_groups.find(name);
+		if (it != m_groups.end())
+			return &it->second;
 
-		return &m_groups.at(name);
+		return loadGroup(name);
 	}
 
 	bool endDefinition()
@@ -105,15 +323,58 @@ public:
 		if (!Pum::endDefinition())
 			return false;
 
-		return !checkError(nc_enddef(identifier()));
+		if (m_numSubfiles > 0 && !defineSubfile())
+			return false;
+
+		if (checkError(nc_enddef(identifier())))
+			return false;
+
+		return writePlannedSizes();
 	}
 
 	bool close()
 	{
-		if (checkError(nc_close(identifier())))
-			return false;
+		bool success = true;
+		for (std::vector<NetcdfPum*>::iterator i = m_subfiles.begin(); i != m_subfiles.end(); i++) {
+			if (*i) {
+				success = (*i)->close() && success;
+				delete *i;
+			}
+		}
+		m_subfiles.clear();
+#ifdef PARALLEL
+		if (m_subfileComm != MPI_COMM_NULL)
+			MPI_Comm_free(&m_subfileComm);
+#endif // PARALLEL
 
-		return true;
+		// Close the file in any case, the first error is kept
+		success = closeCounters() && success;
+		success = flushOffsets() && success;
+		success = !checkError(nc_close(identifier())) && success;
+
+		return success;
+	}
+
+	Group* routeGroup(const char* group, size_t &partition)
+	{
+		NetcdfPum* subfile = routeSubfile(partition);
+		if (!subfile)
+			return 0L;
+
+		return subfile->getGroup(group);
+	}
+
+	Entity* routeEntity(const char* group, const char* entity, size_t &partition)
+	{
+		NetcdfPum* subfile = routeSubfile(partition);
+		if (!subfile)
+			return 0L;
+
+		NetcdfGroup* g = subfile->getGroup(group);
+		if (!g)
+			return 0L;
+
+		return g->getEntity(entity);
 	}
 
 protected:
@@ -121,13 +382,55 @@ protected:
 	{
 		int ncFile;
 
-		if (checkError(nc_create(path, NC_NETCDF4, &ncFile)))
+		if (checkError(nc_create(path, NC_NETCDF4 | (m_inMemory ? NC_DISKLESS | NC_PERSIST : 0), &ncFile)))
 			return false;
 		setIdentifier(ncFile);
 
 		return initFile();
 	}
 
+	/**
+	 * Creates the netCDF group
+	 */
+	NetcdfGroup* _createGroup(const char* name, size_t size, bool indexed, size_t indexSize, bool planned)
+	{
+		if (planned && m_numSubfiles > 0)
+			// The sizes of the subfiles are set with Group::setSize
+			return 0L;
+
+		if (size == Group::UNLIMITED || m_numSubfiles > 0)
+			// With subfiles, the size of a subfile is not known in advance
+			size = NC_UNLIMITED;
+
+		NetcdfGroup group = NetcdfGroup(name, numPartitions(), *this, *this, size);
+		if (!group.isValid())
+			return 0L;
+		group.setDeferOffsets(m_deferOffsets);
+
+		m_groups[name] = group;
+
+		if (indexed) {
+			if (indexSize == Group::UNLIMITED || m_numSubfiles > 0)
+				indexSize = NC_UNLIMITED;
+			m_groups[name].addIndex(indexSize);
+		}
+
+		return &m_groups[name];
+	}
+
+	bool _flush()
+	{
+		// Only the own subfile is written
+		if (m_ownSubfile < m_subfiles.size() && m_subfiles[m_ownSubfile]
+				&& !m_subfiles[m_ownSubfile]->_flush())
+			return false;
+
+		if (!flushOffsets())
+			return false;
+
+		return !checkError(nc_sync(identifier()));
+	}
+
 #ifdef PARALLEL
 	bool _create(const char* path, MPI_Comm comm, MPI_Info info = MPI_INFO_NULL)
 	{
@@ -137,7 +440,13 @@ protected:
 				return false;
 		setIdentifier(ncFile);
 
-		return initFile();
+		if (!initFile())
+			return false;
+
+		if (m_requestedSubfiles > 1 && mpiSize() > 1)
+			return createSubfiles(path, info);
+
+		return true;
 	}
 
 	bool _open(const char* path, MPI_Comm comm, MPI_Info info = MPI_INFO_NULL)
@@ -147,17 +456,45 @@ protected:
 		if (checkError(nc_open_par(path, NC_NETCDF4 | NC_MPIIO, comm, info, &ncFile)))
 				return false;
 		setIdentifier(ncFile);
+		m_path = path;
+
+		if (m_broadcastMetadata)
+			return broadcastFile();
 
 		return loadFile();
 	}
 #endif // PARALLEL
 
+	void _loadedGroups(std::vector<Group*> &groups)
+	{
+		for (std::map<std::string, NetcdfGroup>::iterator i = m_groups.begin();
+				i != m_groups.end(); i++)
+			groups.push_back(&i->second);
+	}
+
 private:
+	/**
+	 * Writes the deferred offsets and the total sizes (with subfiles) of all groups
+	 */
+	bool flushOffsets()
+	{
+		for (std::map<std::string, NetcdfGroup>::iterator i = m_groups.begin(); i != m_groups.end(); i++) {
+			if (!i->second.flushOffsets() || !i->second.writeTotalSize())
+				return false;
+		}
+
+		return true;
+	}
+
 	/**
 	 * Initialize a new nc pum file
 	 */
 	bool initFile()
 	{
+		m_groups.clear();
+		m_offsets.clear();
+		m_numSubfiles = 0;
+
 		if (checkError(nc_put_att_text(identifier(), NC_GLOBAL, ATT_CONVENTIONS, CONVENTIONS.size(), CONVENTIONS.c_str())))
 			return false;
 		if (checkError(nc_put_att_int(identifier(), NC_GLOBAL, ATT_FILE_VERSION, NC_INT, 1, &FILE_VERSION)))
@@ -197,24 +534,305 @@ private:
 			return false;
 		setNumPartitions(np);
 
-		// Get group ids
+		// Subfiles
+		m_numSubfiles = 0;
+		m_ownSubfile = std::numeric_limits<size_t>::max();
+		unsigned long long subfiles;
+		int ncError = nc_get_att_ulonglong(identifier(), NC_GLOBAL, ATT_SUBFILES, &subfiles);
+		if (ncError != NC_ENOTATT) {
+			if (checkError(ncError))
+				return false;
+
+			unsigned long long ranks;
+			if (checkError(nc_get_att_ulonglong(identifier(), NC_GLOBAL, ATT_SUBFILE_RANKS, &ranks)))
+				return false;
+
+			m_numSubfiles = subfiles;
+			m_subfileRanks = ranks;
+			m_subfiles.assign(m_numSubfiles, 0L);
+		}
+
+		// Groups are loaded on demand
+		m_groups.clear();
+		m_offsets.clear();
+
+		return true;
+	}
+
+#ifdef PARALLEL
+	/**
+	 * Creates the subfile of this rank
+	 */
+	bool createSubfiles(const char* path, MPI_Info info)
+	{
+		if (numPartitions() < static_cast<size_t>(mpiSize()))
+			// Each subfile requires at least one partition
+			return false;
+
+		m_numSubfiles = std::min(m_requestedSubfiles, static_cast<size_t>(mpiSize()));
+		m_subfileRanks = mpiSize();
+
+		unsigned long long subfiles = m_numSubfiles;
+		if (checkError(nc_put_att_ulonglong(identifier(), NC_GLOBAL, ATT_SUBFILES, NC_UINT64, 1, &subfiles)))
+			return false;
+		unsigned long long ranks = m_subfileRanks;
+		if (checkError(nc_put_att_ulonglong(identifier(), NC_GLOBAL, ATT_SUBFILE_RANKS, NC_UINT64, 1, &ranks)))
+			return false;
+
+		m_ownSubfile = subfileOfRank(mpiRank());
+		MPI_Comm_split(mpiComm(), m_ownSubfile, mpiRank(), &m_subfileComm);
+
+		m_subfiles.assign(m_numSubfiles, 0L);
+		m_subfiles[m_ownSubfile] = new NetcdfPum();
+		m_subfiles[m_ownSubfile]->setDeferOffsets(m_deferOffsets);
+
+		return m_subfiles[m_ownSubfile]->create(subfilePath(path, m_ownSubfile).c_str(),
+			subfilePartitions(m_ownSubfile), m_subfileComm, info);
+	}
+#endif // PARALLEL
+
+	/**
+	 * Copies the definitions of all groups to the subfile of this rank
+	 */
+	bool defineSubfile()
+	{
+		NetcdfPum* subfile = m_subfiles[m_ownSubfile];
+
+		for (std::map<std::string, NetcdfGroup>::iterator i = m_groups.begin(); i != m_groups.end(); i++) {
+			NetcdfGroup* group = (i->second.indexed()
+				? subfile->createGroupIndexed(i->first.c_str())
+				: subfile->createGroup(i->first.c_str()));
+			if (!group || !group->copyDefinition(i->second))
+				return false;
+
+			// The size dimension of this file is empty
+			if (!i->second.defineTotalSize())
+				return false;
+		}
+
+		if (!subfile->endDefinition())
+			return false;
+
+		for (std::map<std::string, NetcdfGroup>::iterator i = m_groups.begin(); i != m_groups.end(); i++)
+			i->second.setRouter(this);
+
+		return true;
+	}
+
+	/**
+	 * Finds the subfile of a partition. Opens the subfile if required.
+	 *
+	 * @param partition The partition in this file, replaced by the partition in the subfile
+	 * @return The subfile or NULL if the subfile is not accessible
+	 */
+	NetcdfPum* routeSubfile(size_t &partition)
+	{
+		if (partition >= numPartitions())
+			return 0L;
+
+		size_t owner = partition % m_subfileRanks;
+		size_t subfile = subfileOfRank(owner);
+		size_t first = firstRank(subfile);
+		partition = (partition / m_subfileRanks) * (firstRank(subfile+1) - first) + owner - first;
+
+		if (m_ownSubfile != std::numeric_limits<size_t>::max())
+			// Created: only the own subfile is accessible
+			return (subfile == m_ownSubfile ? m_subfiles[subfile] : 0L);
+
+		if (!m_subfiles[subfile]) {
+			NetcdfPum* pum = new NetcdfPum();
+#ifdef PARALLEL
+			bool success = pum->open(subfilePath(m_path.c_str(), subfile).c_str(), MPI_COMM_SELF);
+#else // PARALLEL
+			bool success = pum->open(subfilePath(m_path.c_str(), subfile).c_str());
+#endif // PARALLEL
+			if (!success || pum->numPartitions() != subfilePartitions(subfile)) {
+				delete pum;
+				return 0L;
+			}
+
+			m_subfiles[subfile] = pum;
+		}
+
+		return m_subfiles[subfile];
+	}
+
+	/**
+	 * @return The subfile that stores the partitions of a rank
+	 */
+	size_t subfileOfRank(size_t rank) const
+	{
+		return rank * m_numSubfiles / m_subfileRanks;
+	}
+
+	/**
+	 * @return The first rank of a subfile
+	 */
+	size_t firstRank(size_t subfile) const
+	{
+		return (subfile * m_subfileRanks + m_numSubfiles - 1) / m_numSubfiles;
+	}
+
+	/**
+	 * @return The number of partitions in a subfile
+	 */
+	size_t subfilePartitions(size_t subfile) const
+	{
+		size_t first = firstRank(subfile);
+		size_t last = firstRank(subfile+1);
+		size_t rest = numPartitions() % m_subfileRanks;
+
+		return (numPartitions() / m_subfileRanks) * (last - first)
+			+ (rest > first ? std::min(rest, last) - first : 0);
+	}
+
+	static std::string subfilePath(const char* path, size_t subfile)
+	{
+		std::ostringstream s;
+		s << path << '.' << subfile;
+		return s.str();
+	}
+
+#ifdef PARALLEL
+	/**
+	 * Loads the file on the first rank and broadcasts the metadata
+	 */
+	bool broadcastFile()
+	{
+		std::vector<char> buf;
+		if (mpiRank() == 0) {
+			if (!loadFile() || !packMetadata(buf))
+				buf.clear();
+		}
+
+		double start = IOCounters::time();
+		unsigned long size = buf.size();
+		MPI_Bcast(&size, 1, MPI_UNSIGNED_LONG, 0, mpiComm());
+		if (size > 0) {
+			buf.resize(size);
+			MPI_Bcast(&buf[0], size, MPI_CHAR, 0, mpiComm());
+		}
+		pumCounters().mpiTime += IOCounters::time() - start;
+
+		if (size == 0)
+			return false;
+
+		return unpackMetadata(buf);
+	}
+
+	/**
+	 * Packs the number of partitions and the offsets of all groups
+	 */
+	bool packMetadata(std::vector<char> &buf)
+	{
 		int numGrps;
 		if (checkError(nc_inq_grps(identifier(), &numGrps, 0L)))
 			return false;
 		std::vector<int> grpIds(numGrps);
-		if (checkError(nc_inq_grps(identifier(), 0L, &grpIds[0])))
+		if (numGrps > 0 && checkError(nc_inq_grps(identifier(), 0L, &grpIds[0])))
 			return false;
 
-		// Create the groups
+		pack(buf, static_cast<unsigned long long>(numPartitions()));
+		pack(buf, static_cast<unsigned long long>(m_numSubfiles));
+		pack(buf, static_cast<unsigned long long>(m_subfileRanks));
+		pack(buf, numGrps);
+
 		for (std::vector<int>::const_iterator i = grpIds.begin(); i != grpIds.end(); i++) {
-			NetcdfGroup group = NetcdfGroup(*i, *this, *this);
-			m_groups[group.name()] = group;
-			if (!m_groups[group.name()].loadEntities())
+			char name[NC_MAX_NAME+1];
+			if (checkError(nc_inq_grpname(*i, name)))
 				return false;
+
+			// Only this rank reads the offsets
+			std::vector<unsigned long long> offsets;
+			if (checkError(NetcdfGroup::readOffsets(*i, numPartitions(), offsets, true)))
+				return false;
+
+			size_t nameLen = strlen(name);
+			pack(buf, nameLen);
+			buf.insert(buf.end(), name, name+nameLen);
+			buf.insert(buf.end(), reinterpret_cast<char*>(&offsets[0]),
+				reinterpret_cast<char*>(&offsets[0] + offsets.size()));
 		}
 
 		return true;
 	}
+
+	bool unpackMetadata(const std::vector<char> &buf)
+	{
+		size_t pos = 0;
+
+		unsigned long long np;
+		unpack(buf, pos, np);
+		setNumPartitions(np);
+
+		unsigned long long subfiles, ranks;
+		unpack(buf, pos, subfiles);
+		unpack(buf, pos, ranks);
+		m_numSubfiles = subfiles;
+		m_subfileRanks = ranks;
+		m_ownSubfile = std::numeric_limits<size_t>::max();
+		m_subfiles.assign(m_numSubfiles, 0L);
+
+		int numGrps;
+		unpack(buf, pos, numGrps);
+
+		m_groups.clear();
+		m_offsets.clear();
+		for (int i = 0; i < numGrps; i++) {
+			size_t nameLen;
+			unpack(buf, pos, nameLen);
+			std::string name(&buf[pos], nameLen);
+			pos += nameLen;
+
+			std::vector<unsigned long long> &offsets = m_offsets[name];
+			offsets.resize(np+1);
+			memcpy(&offsets[0], &buf[pos], offsets.size() * sizeof(unsigned long long));
+			pos += offsets.size() * sizeof(unsigned long long);
+		}
+
+		return pos == buf.size();
+	}
+
+	template<typename T>
+	static void pack(std::vector<char> &buf, const T &value)
+	{
+		const char* v = reinterpret_cast<const char*>(&value);
+		buf.insert(buf.end(), v, v+sizeof(T));
+	}
+
+	template<typename T>
+	static void unpack(const std::vector<char> &buf, size_t &pos, T &value)
+	{
+		memcpy(&value, &buf[pos], sizeof(T));
+		pos += sizeof(T);
+	}
+#endif // PARALLEL
+
+	/**
+	 * Loads a group from the file
+	 *
+	 * @return The group or NULL if the group does not exist
+	 */
+	NetcdfGroup* loadGroup(const char* name)
+	{
+		int ncGroup;
+		if (nc_inq_grp_ncid(identifier(), name, &ncGroup) != NC_NOERR)
+			return 0L;
+
+		std::map<std::string, std::vector<unsigned long long> >::const_iterator offsets = m_offsets.find(name);
+
+		NetcdfGroup &group = m_groups[name];
+		group = NetcdfGroup(ncGroup, *this, *this, (offsets == m_offsets.end() ? 0L : &offsets->second));
+		if (!group.isValid() || !group.loadEntities()) {
+			m_groups.erase(name);
+			return 0L;
+		}
+
+		if (m_numSubfiles > 0)
+			group.setRouter(this);
+
+		return &group;
+	}
 };
 
 }
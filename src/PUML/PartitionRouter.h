@@ -0,0 +1,56 @@
+/**
+ * @file
+ *  This file is part of PUML
+ *
+ *  For conditions of distribution and use, please see the copyright
+ *  notice in the file 'COPYING' at the root directory of this package
+ *  and the copyright notice at https://github.com/TUM-I5/PUML
+ *
+ * @copyright 2013 Technische Universitaet Muenchen
+ * @author Sebastian Rettenberger <rettenbs@in.tum.de>
+ */
+
+#ifndef PUML_PARTITION_ROUTER_H
+#define PUML_PARTITION_ROUTER_H
+
+#include <cstddef>
+
+namespace PUML
+{
+
+class Entity;
+class Group;
+
+/**
+ * Maps the partitions of a file to the files that store them
+ *
+ * Used for subfiling: the groups and entities of the master file forward all
+ * partition based accesses to the group or entity of a subfile.
+ *
+ * @see NetcdfPum::setSubfiles
+ */
+class PartitionRouter
+{
+public:
+	virtual ~PartitionRouter()
+	{
+	}
+
+	/**
+	 * @param partition The partition in the master file. Replaced by the
+	 *  partition in the returned group.
+	 * @return The group that stores the partition or NULL
+	 */
+	virtual Group* routeGroup(const char* group, size_t &partition) = 0;
+
+	/**
+	 * @param partition The partition in the master file. Replaced by the
+	 *  partition in the returned entity.
+	 * @return The entity that stores the partition or NULL
+	 */
+	virtual Entity* routeEntity(const char* group, const char* entity, size_t &partition) = 0;
+};
+
+}
+
+#endif // PUML_PARTITION_ROUTER_H
@@ -0,0 +1,185 @@
+/**
+ * @file
+ *  This file is part of PUML
+ *
+ *  For conditions of distribution and use, please see the copyright
+ *  notice in the file 'COPYING' at the root directory of this package
+ *  and the copyright notice at https://github.com/TUM-I5/PUML
+ *
+ * @copyright 2013 Technische Universitaet Muenchen
+ * @author Sebastian Rettenberger <rettenbs@in.tum.de>
+ */
+
+#ifndef PUML_PNETCDF_ELEMENT_H
+#define PUML_PNETCDF_ELEMENT_H
+
+#include <string>
+
+#include <mpi.h>
+#include <pnetcdf.h>
+
+namespace PUML
+{
+
+/**
+ * Contains basic functionality to handle a PnetCDF element (file, group, variable, ...)
+ *
+ * Same as NetcdfElement but for the PnetCDF library. In addition the file
+ * element keeps track of the pending nonblocking requests.
+ */
+class PnetcdfElement
+{
+private:
+	/** PnetCDF identifier */
+	int m_ncIdentifier;
+
+	/** Parent element */
+	PnetcdfElement* m_parent;
+
+	/** PnetCDF error (or NC_NOERR if no error occurred) */
+	int m_ncError;
+
+	/** Number of open batches (top most element only) */
+	unsigned int m_batchDepth;
+
+public:
+	PnetcdfElement(PnetcdfElement* parent = 0L)
+		: m_ncIdentifier(-1), m_parent(parent), m_ncError(NC_NOERR), m_batchDepth(0)
+	{
+	}
+
+	PnetcdfElement(int identifier, PnetcdfElement* parent = 0L)
+		: m_ncIdentifier(identifier), m_parent(parent), m_ncError(NC_NOERR), m_batchDepth(0)
+	{
+	}
+
+	virtual ~PnetcdfElement()
+	{
+	}
+
+	/**
+	 * @return The PnetCDF identifier
+	 *
+	 * @ingroup LowLevelApi
+	 */
+	int identifier() const
+	{
+		return m_ncIdentifier;
+	}
+
+	/**
+	 * @return True if no error occurred, false otherwise
+	 */
+	bool isValid() const
+	{
+		if (m_parent)
+			return m_parent->isValid();
+
+		return m_ncError == NC_NOERR;
+	}
+
+	/**
+	 * @return The message for the error
+	 */
+	std::string errorMsg() const
+	{
+		if (m_parent)
+			return m_parent->errorMsg();
+
+		return ncmpi_strerror(m_ncError);
+	}
+
+protected:
+	void setIdentifier(int identifier)
+	{
+		m_ncIdentifier = identifier;
+	}
+
+	/**
+	 * Returns the identifier of the parent if a parent exists
+	 *
+	 * @return The PnetCDF identifier of the parent element
+	 */
+	int parentIdentifier() const
+	{
+		if (m_parent)
+			return m_parent->m_ncIdentifier;
+
+		return m_ncIdentifier;
+	}
+
+	/**
+	 * @return the PnetCDF identifier of the file (top most identifier)
+	 */
+	int fileIdentifier() const
+	{
+		if (m_parent)
+			return m_parent->fileIdentifier();
+
+		return m_ncIdentifier;
+	}
+
+	/**
+	 * Checks if result contains an error and saves the error state
+	 *
+	 * @return True result is an error false otherwise
+	 */
+	bool checkError(int result)
+	{
+		if (m_parent)
+			// Propagate error to the parent element
+			return m_parent->checkError(result);
+
+		if (m_ncError == NC_NOERR)
+			// An error occurred early -> ignore this error
+			m_ncError = result;
+
+		return result != NC_NOERR;
+	}
+
+	/**
+	 * Starts a batch of nonblocking requests for the whole file
+	 */
+	void beginBatch()
+	{
+		if (m_parent) {
+			m_parent->beginBatch();
+			return;
+		}
+
+		m_batchDepth++;
+	}
+
+	/**
+	 * Ends a batch. The outermost batch waits for all pending requests
+	 * (collectively).
+	 */
+	bool endBatch()
+	{
+		if (m_parent)
+			return m_parent->endBatch();
+
+		if (m_batchDepth == 0 || --m_batchDepth > 0)
+			return true;
+
+		return !checkError(ncmpi_wait_all(m_ncIdentifier, NC_REQ_ALL, 0L, 0L));
+	}
+
+	/**
+	 * Waits for all pending requests unless a batch is open
+	 */
+	bool complete()
+	{
+		if (m_parent)
+			return m_parent->complete();
+
+		if (m_batchDepth > 0)
+			return true;
+
+		return !checkError(ncmpi_wait_all(m_ncIdentifier, NC_REQ_ALL, 0L, 0L));
+	}
+};
+
+}
+
+#endif // PUML_PNETCDF_ELEMENT_H
@@ -0,0 +1,389 @@
+/**
+ * @file
+ *  This file is part of PUML
+ *
+ *  For conditions of distribution and use, please see the copyright
+ *  notice in the file 'COPYING' at the root directory of this package
+ *  and the copyright notice at https://github.com/TUM-I5/PUML
+ *
+ * @copyright 2013 Technische Universitaet Muenchen
+ * @author Sebastian Rettenberger <rettenbs@in.tum.de>
+ */
+
+#ifndef PUML_PNETCDF_ENTITY_H
+#define PUML_PNETCDF_ENTITY_H
+
+#include <string>
+#include <vector>
+
+#include <mpi.h>
+#include <pnetcdf.h>
+
+#include "PUML/Dimension.h"
+#include "PUML/Entity.h"
+#include "PUML/PnetcdfElement.h"
+#include "PUML/Type.h"
+
+namespace PUML
+{
+
+/**
+ * An entity stored with PnetCDF
+ *
+ * All accesses are posted as nonblocking requests. The requests are
+ * completed (collectively) after each access or at the end of a batch
+ * (e.g. all ranges of an indexed partition or all entities of a row).
+ * Entities are always collective, the adaptive mode is not supported.
+ */
+class PnetcdfEntity : public Entity, public PnetcdfElement
+{
+private:
+	/** Start of the current access */
+	std::vector<MPI_Offset> m_start;
+
+	/** Count of the current access */
+	std::vector<MPI_Offset> m_count;
+
+public:
+	PnetcdfEntity()
+	{
+	}
+
+	/**
+	 * @param prefix The prefix of all variables of the group
+	 * @param dimSize The PnetCDF dimension of the group that contains the size
+	 */
+	PnetcdfEntity(const std::string &prefix, const char* name, const Type &type, int dimSize,
+			size_t numUserDimensions, const Dimension* userDimensions,
+			const std::vector<size_t> &offset, PnetcdfEntity* index,
+			PnetcdfElement &group, MPIElement &comm)
+		: Entity(name, numUserDimensions, userDimensions, offset, index, comm), PnetcdfElement(&group)
+	{
+		Entity::setCollective(true);
+
+		int ncVar;
+
+		// Use std::vector to avoid memory leaks
+		std::vector<int> dims;
+		dims.push_back(dimSize);
+		for (size_t i = 0; i < numUserDimensions; i++)
+			dims.push_back(userDimensions[i].identifier());
+
+		if (checkError(ncmpi_def_var(parentIdentifier(), (prefix + name).c_str(), type2nc(type),
+				dims.size(), &dims[0], &ncVar)))
+			return;
+
+		setIdentifier(ncVar);
+	}
+
+	/**
+	 * Constructor to load an entity from a PnetCDF file
+	 *
+	 * @param prefix The prefix of all variables of the group
+	 */
+	PnetcdfEntity(const std::string &prefix, int ncId, const std::vector<size_t> &offset, PnetcdfEntity* index,
+			PnetcdfElement &group, MPIElement &comm)
+		: Entity(offset, index, comm), PnetcdfElement(ncId, &group)
+	{
+		Entity::setCollective(true);
+
+		char name[NC_MAX_NAME+1];
+		if (checkError(ncmpi_inq_varname(parentIdentifier(), identifier(), name)))
+			return;
+		setName(name + prefix.size());
+
+		// Learn about the dimension size
+		int numDims;
+		if (checkError(ncmpi_inq_varndims(parentIdentifier(), identifier(), &numDims)))
+			return;
+
+		std::vector<int> dims(numDims);
+		if (checkError(ncmpi_inq_vardimid(parentIdentifier(), identifier(), &dims[0])))
+			return;
+
+		dimSize().resize(numDims);
+		for (int i = 1; i < numDims; i++) { // Skip pum dimension
+			MPI_Offset len;
+			if (checkError(ncmpi_inq_dimlen(parentIdentifier(), dims[i], &len)))
+				return;
+			dimSize()[i] = len;
+		}
+	}
+
+	/**
+	 * Only collective mode is supported
+	 */
+	bool setCollective(bool collective)
+	{
+		return collective;
+	}
+
+	/**
+	 * The adaptive mode is not supported
+	 */
+	bool setAdaptive(bool adaptive)
+	{
+		return !adaptive;
+	}
+
+protected:
+	size_t _valueSize()
+	{
+		nc_type type;
+		if (checkError(ncmpi_inq_vartype(parentIdentifier(), identifier(), &type)))
+			return 0;
+
+		switch (type) {
+		case NC_BYTE:
+		case NC_CHAR:
+		case NC_UBYTE:
+			return 1;
+		case NC_SHORT:
+		case NC_USHORT:
+			return 2;
+		case NC_INT:
+		case NC_UINT:
+		case NC_FLOAT:
+			return 4;
+		default:
+			return 8;
+		}
+	}
+
+	bool _beginBatch()
+	{
+		beginBatch();
+		return true;
+	}
+
+	bool _endBatch()
+	{
+		return endBatch();
+	}
+
+	bool _puta(const size_t* start, const size_t* size, const void* values)
+	{
+		if (checkError(ncmpi_iput_vara(parentIdentifier(), identifier(), ncStart(start), ncCount(size),
+				values, -1, MPI_DATATYPE_NULL, 0L)))
+			return false;
+		return complete();
+	}
+
+	bool _puta_schar(const size_t* start, const size_t* size, const signed char* values)
+	{
+		if (checkError(ncmpi_iput_vara_schar(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values, 0L)))
+			return false;
+		return complete();
+	}
+
+	bool _puta_uchar(const size_t* start, const size_t* size, const unsigned char* values)
+	{
+		if (checkError(ncmpi_iput_vara_uchar(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values, 0L)))
+			return false;
+		return complete();
+	}
+
+	bool _puta_short(const size_t* start, const size_t* size, const short* values)
+	{
+		if (checkError(ncmpi_iput_vara_short(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values, 0L)))
+			return false;
+		return complete();
+	}
+
+	bool _puta_int(const size_t* start, const size_t* size, const int* values)
+	{
+		if (checkError(ncmpi_iput_vara_int(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values, 0L)))
+			return false;
+		return complete();
+	}
+
+	bool _puta_long(const size_t* start, const size_t* size, const long* values)
+	{
+		if (checkError(ncmpi_iput_vara_long(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values, 0L)))
+			return false;
+		return complete();
+	}
+
+	bool _puta_float(const size_t* start, const size_t* size, const float* values)
+	{
+		if (checkError(ncmpi_iput_vara_float(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values, 0L)))
+			return false;
+		return complete();
+	}
+
+	bool _puta_double(const size_t* start, const size_t* size, const double* values)
+	{
+		if (checkError(ncmpi_iput_vara_double(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values, 0L)))
+			return false;
+		return complete();
+	}
+
+	bool _puta_ushort(const size_t* start, const size_t* size, const unsigned short* values)
+	{
+		if (checkError(ncmpi_iput_vara_ushort(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values, 0L)))
+			return false;
+		return complete();
+	}
+
+	bool _puta_uint(const size_t* start, const size_t* size, const unsigned int* values)
+	{
+		if (checkError(ncmpi_iput_vara_uint(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values, 0L)))
+			return false;
+		return complete();
+	}
+
+	bool _puta_longlong(const size_t* start, const size_t* size, const long long* values)
+	{
+		if (checkError(ncmpi_iput_vara_longlong(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values, 0L)))
+			return false;
+		return complete();
+	}
+
+	bool _puta_ulonglong(const size_t* start, const size_t* size, const unsigned long long* values)
+	{
+		if (checkError(ncmpi_iput_vara_ulonglong(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values, 0L)))
+			return false;
+		return complete();
+	}
+
+	bool _geta(const size_t* start, const size_t* size, void* values)
+	{
+		if (checkError(ncmpi_iget_vara(parentIdentifier(), identifier(), ncStart(start), ncCount(size),
+				values, -1, MPI_DATATYPE_NULL, 0L)))
+			return false;
+		return complete();
+	}
+
+	bool _geta_schar(const size_t* start, const size_t* size, signed char* values)
+	{
+		if (checkError(ncmpi_iget_vara_schar(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values, 0L)))
+			return false;
+		return complete();
+	}
+
+	bool _geta_uchar(const size_t* start, const size_t* size, unsigned char* values)
+	{
+		if (checkError(ncmpi_iget_vara_uchar(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values, 0L)))
+			return false;
+		return complete();
+	}
+
+	bool _geta_short(const size_t* start, const size_t* size, short* values)
+	{
+		if (checkError(ncmpi_iget_vara_short(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values, 0L)))
+			return false;
+		return complete();
+	}
+
+	bool _geta_int(const size_t* start, const size_t* size, int* values)
+	{
+		if (checkError(ncmpi_iget_vara_int(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values, 0L)))
+			return false;
+		return complete();
+	}
+
+	bool _geta_long(const size_t* start, const size_t* size, long* values)
+	{
+		if (checkError(ncmpi_iget_vara_long(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values, 0L)))
+			return false;
+		return complete();
+	}
+
+	bool _geta_float(const size_t* start, const size_t* size, float* values)
+	{
+		if (checkError(ncmpi_iget_vara_float(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values, 0L)))
+			return false;
+		return complete();
+	}
+
+	bool _geta_double(const size_t* start, const size_t* size, double* values)
+	{
+		if (checkError(ncmpi_iget_vara_double(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values, 0L)))
+			return false;
+		return complete();
+	}
+
+	bool _geta_ushort(const size_t* start, const size_t* size, unsigned short* values)
+	{
+		if (checkError(ncmpi_iget_vara_ushort(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values, 0L)))
+			return false;
+		return complete();
+	}
+
+	bool _geta_uint(const size_t* start, const size_t* size, unsigned int* values)
+	{
+		if (checkError(ncmpi_iget_vara_uint(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values, 0L)))
+			return false;
+		return complete();
+	}
+
+	bool _geta_longlong(const size_t* start, const size_t* size, long long* values)
+	{
+		if (checkError(ncmpi_iget_vara_longlong(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values, 0L)))
+			return false;
+		return complete();
+	}
+
+	bool _geta_ulonglong(const size_t* start, const size_t* size, unsigned long long* values)
+	{
+		if (checkError(ncmpi_iget_vara_ulonglong(parentIdentifier(), identifier(), ncStart(start), ncCount(size), values, 0L)))
+			return false;
+		return complete();
+	}
+
+private:
+	/**
+	 * @return The start of an access as PnetCDF offsets
+	 */
+	const MPI_Offset* ncStart(const size_t* start)
+	{
+		m_start.assign(start, start+numDims());
+		return &m_start[0];
+	}
+
+	/**
+	 * @return The count of an access as PnetCDF offsets
+	 */
+	const MPI_Offset* ncCount(const size_t* count)
+	{
+		m_count.assign(count, count+numDims());
+		return &m_count[0];
+	}
+
+	/**
+	 * @return The PnetCDF identifier for this type
+	 */
+	static nc_type type2nc(const Type &type)
+	{
+		switch (type.baseType()) {
+		case Type::CHAR:
+			return NC_CHAR;
+		case Type::BYTE:
+			return NC_BYTE;
+		case Type::SHORT:
+			return NC_SHORT;
+		case Type::INT:
+			return NC_INT;
+		case Type::INT64:
+			return NC_INT64;
+		case Type::FLOAT:
+			return NC_FLOAT;
+		case Type::DOUBLE:
+			return NC_DOUBLE;
+		case Type::UBYTE:
+			return NC_UBYTE;
+		case Type::USHORT:
+			return NC_USHORT;
+		case Type::UINT:
+			return NC_UINT;
+		case Type::UINT64:
+			return NC_UINT64;
+		default:
+			return type.identifier();
+		}
+	}
+};
+
+}
+
+#endif // PUML_PNETCDF_ENTITY_H
@@ -0,0 +1,424 @@
+/**
+ * @file
+ *  This file is part of PUML
+ *
+ *  For conditions of distribution and use, please see the copyright
+ *  notice in the file 'COPYING' at the root directory of this package
+ *  and the copyright notice at https://github.com/TUM-I5/PUML
+ *
+ * @copyright 2013 Technische Universitaet Muenchen
+ * @author Sebastian Rettenberger <rettenbs@in.tum.de>
+ */
+
+#ifndef PUML_PNETCDF_GROUP_H
+#define PUML_PNETCDF_GROUP_H
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <mpi.h>
+#include <pnetcdf.h>
+
+#include "PUML/Dimension.h"
+#include "PUML/Group.h"
+#include "PUML/PnetcdfElement.h"
+#include "PUML/PnetcdfEntity.h"
+
+namespace PUML
+{
+
+/**
+ * A group stored with PnetCDF
+ *
+ * The classic formats have no groups: all dimensions and variables of the
+ * group are stored in the file with the prefix <code>name.</code>
+ * (e.g. <code>cell._size</code>, <code>cell.coords</code>). The identifier of
+ * the group is the identifier of the file. Time-dependent entities are
+ * not supported.
+ */
+class PnetcdfGroup : public Group, public PnetcdfElement
+{
+private:
+	/** Prefix of all dimensions and variables */
+	std::string m_prefix;
+
+	/** PnetCDF identifier for the partitions dimension */
+	int m_ncDimPartition;
+
+	/** PnetCDF identifier for the size dimension */
+	int m_ncDimSize;
+
+	/** PnetCDF identifier for the index size dimension */
+	int m_ncDimIndexSize;
+
+	/** User defined dimensions (std::list does not move the elements) */
+	std::list<Dimension> m_dimensions;
+
+	/** PnetCDF identifier for the offset variable */
+	int m_ncVarOffset;
+
+	/** index variable */
+	PnetcdfEntity m_entityIndex;
+
+	/** type offset variable (mixed cell groups only) */
+	PnetcdfEntity m_entityTypeOffset;
+
+	/** Entities in this group */
+	std::map<std::string, PnetcdfEntity> m_entities;
+
+	/** Minimum/maximum variables of entities (accessed by the variable name) */
+	std::map<std::string, PnetcdfEntity> m_statistics;
+
+public:
+	PnetcdfGroup()
+		: m_ncDimPartition(-1), m_ncDimSize(-1), m_ncDimIndexSize(-1), m_ncVarOffset(-1)
+	{
+	}
+
+	/**
+	 * @param size The total size of this group (must be known)
+	 */
+	PnetcdfGroup(const char* name, size_t numPartitions, PnetcdfElement &ncPum, MPIElement &comm, size_t size)
+		: Group(name, numPartitions, comm), PnetcdfElement(ncPum.identifier(), &ncPum),
+		  m_prefix(prefix(name)), m_ncDimIndexSize(-1)
+	{
+		if (checkError(ncmpi_def_dim(identifier(), (m_prefix + DIM_PARTITION).c_str(), numPartitions, &m_ncDimPartition)))
+			return;
+
+		if (checkError(ncmpi_def_dim(identifier(), (m_prefix + DIM_SIZE).c_str(), size, &m_ncDimSize)))
+			return;
+
+		if (checkError(ncmpi_def_var(identifier(), (m_prefix + VAR_OFFSET).c_str(), NC_UINT64, 1,
+				&m_ncDimPartition, &m_ncVarOffset)))
+			return;
+	}
+
+	/**
+	 * Constructor to load a group from the PnetCDF file (collective)
+	 */
+	PnetcdfGroup(const char* name, PnetcdfElement &ncPum, MPIElement &comm)
+		: Group(comm), PnetcdfElement(ncPum.identifier(), &ncPum),
+		  m_prefix(prefix(name)), m_ncDimIndexSize(-1)
+	{
+		setName(name);
+
+		if (checkError(ncmpi_inq_dimid(identifier(), (m_prefix + DIM_PARTITION).c_str(), &m_ncDimPartition)))
+			return;
+
+		if (checkError(ncmpi_inq_dimid(identifier(), (m_prefix + DIM_SIZE).c_str(), &m_ncDimSize)))
+			return;
+
+		if (checkError(ncmpi_inq_varid(identifier(), (m_prefix + VAR_OFFSET).c_str(), &m_ncVarOffset)))
+			return;
+
+		// The partitions of indexed groups are stored in the index dimension
+		int dimTotal = m_ncDimSize;
+		int ncError = ncmpi_inq_dimid(identifier(), (m_prefix + DIM_INDEXSIZE).c_str(), &m_ncDimIndexSize);
+		if (ncError == NC_NOERR)
+			dimTotal = m_ncDimIndexSize;
+		else if (ncError == NC_EBADDIM)
+			m_ncDimIndexSize = -1;
+		else if (checkError(ncError))
+			return;
+
+		// Read offsets
+		MPI_Offset numPartitions;
+		if (checkError(ncmpi_inq_dimlen(identifier(), m_ncDimPartition, &numPartitions)))
+			return;
+
+		std::vector<unsigned long long> o(numPartitions+1);
+		if (checkError(ncmpi_get_var_ulonglong_all(identifier(), m_ncVarOffset, &o[0])))
+			return;
+
+		MPI_Offset size;
+		if (checkError(ncmpi_inq_dimlen(identifier(), dimTotal, &size)))
+			return;
+		o.back() = size;
+
+		offset().assign(o.begin(), o.end());
+	}
+
+	Dimension& createDimension(const char* name, size_t size)
+	{
+		int dim;
+
+		checkError(ncmpi_def_dim(identifier(), (m_prefix + name).c_str(), size, &dim));
+
+		m_dimensions.push_back(Dimension(dim, name, size));
+
+		return m_dimensions.back();
+	}
+
+	PnetcdfEntity* createEntity(const char* name, const Type &type, size_t numDimensions, Dimension* dimensions)
+	{
+		PnetcdfEntity entity = PnetcdfEntity(m_prefix, name, type, m_ncDimSize, numDimensions, dimensions,
+				offset(), (indexed() ? &m_entityIndex : 0L), *this, *this);
+		if (!entity.isValid())
+			return 0L;
+
+		m_entities[name] = entity;
+
+		return &m_entities[name];
+	}
+
+	/**
+	 * @overload
+	 */
+	PnetcdfEntity* createEntity(const char* name, const Type &type, std::vector<Dimension> &dimensions)
+	{
+		return createEntity(name, type, dimensions.size(), &dimensions[0]);
+	}
+
+	/**
+	 * @overload
+	 */
+	PnetcdfEntity* createEntity(const char* name, const Type &type)
+	{
+		return createEntity(name, type, 0, 0L);
+	}
+
+	/**
+	 * Not supported (the classic formats have only one unlimited dimension)
+	 */
+	PnetcdfEntity* createTimeEntity(const char* name, const Type &type, size_t numDimensions, Dimension* dimensions)
+	{
+		return 0L;
+	}
+
+	size_t numSteps()
+	{
+		return 0;
+	}
+
+	/**
+	 * @return The number of elements stored in the file. For indexed groups
+	 *  this is the size of the data, not the size of the index.
+	 */
+	size_t dataSize()
+	{
+		MPI_Offset size;
+		if (checkError(ncmpi_inq_dimlen(identifier(), m_ncDimSize, &size)))
+			return 0;
+
+		return size;
+	}
+
+	/**
+	 * Entities of groups loaded from a file are loaded on the first call
+	 */
+	PnetcdfEntity* getEntity(const char* name)
+	{
+		std::map<std::string, PnetcdfEntity>::iterator it = m_entities.find(name);
+		if (it != m_entities.end())
+			return &it->second;
+
+		return loadEntity(name);
+	}
+
+	/**
+	 * Loads the index and the type offsets from the PnetCDF file. Other
+	 * entities are loaded on demand.
+	 * We can't do this in the constructor because this results in wrong values for m_parent
+	 *
+	 * @internal
+	 */
+	bool loadEntities()
+	{
+		// Get index if exists
+		if (m_ncDimIndexSize >= 0) {
+			int indexId;
+			if (checkError(ncmpi_inq_varid(identifier(), (m_prefix + VAR_INDEX).c_str(), &indexId)))
+				return false;
+
+			m_entityIndex = PnetcdfEntity(m_prefix, indexId, offset(), 0L, *this, *this);
+
+			setEntityIndex(&m_entityIndex);
+		}
+
+		// Get type offsets if exist
+		int typeOffsetId;
+		int ncError = ncmpi_inq_varid(identifier(), (m_prefix + VAR_TYPEOFFSET).c_str(), &typeOffsetId);
+		if (ncError != NC_ENOTVAR) {
+			if (checkError(ncError))
+				return false;
+
+			m_entityTypeOffset = PnetcdfEntity(m_prefix, typeOffsetId, offset(), 0L, *this, *this);
+
+			setEntityTypeOffset(&m_entityTypeOffset);
+		}
+
+		return true;
+	}
+
+	/**
+	 * @return True if the file contains the group
+	 *
+	 * @internal
+	 */
+	static bool exists(int ncFile, const char* name)
+	{
+		int dim;
+		return ncmpi_inq_dimid(ncFile, (prefix(name) + DIM_PARTITION).c_str(), &dim) == NC_NOERR;
+	}
+
+	/**
+	 * @return The prefix of the dimensions and variables of a group
+	 *
+	 * @internal
+	 */
+	static std::string prefix(const char* name)
+	{
+		return std::string(name) + '.';
+	}
+
+protected:
+	bool setOffset(size_t partition)
+	{
+		if (partition >= numPartitions())
+			// The last partition sets the offset for the first one
+			partition = 0;
+
+		MPI_Offset start = partition;
+		unsigned long long o = offset()[partition];
+
+		if (checkError(ncmpi_put_var1_ulonglong_all(identifier(), m_ncVarOffset, &start, &o)))
+			return false;
+
+		return true;
+	}
+
+	bool setOffsets()
+	{
+		// The first rank writes all offsets
+		MPI_Offset start = 0;
+		MPI_Offset count = (mpiRank() == 0 ? numPartitions() : 0);
+		std::vector<unsigned long long> o(offset().begin(), offset().end()-1);
+
+		if (checkError(ncmpi_put_vara_ulonglong_all(identifier(), m_ncVarOffset, &start, &count, &o[0])))
+			return false;
+
+		return true;
+	}
+
+	PnetcdfEntity* _addIndex(size_t indexSize)
+	{
+		if (checkError(ncmpi_def_dim(identifier(), (m_prefix + DIM_INDEXSIZE).c_str(), indexSize, &m_ncDimIndexSize)))
+			return 0L;
+
+		m_entityIndex = PnetcdfEntity(m_prefix, VAR_INDEX, Type::UINT64, m_ncDimIndexSize, 0, 0L,
+				offset(), 0L, *this, *this);
+
+		return &m_entityIndex;
+	}
+
+	bool _addStatistics(Entity &entity)
+	{
+		PnetcdfEntity &ncEntity = static_cast<PnetcdfEntity&>(entity);
+
+		// Use the same user dimensions as the entity
+		int numDims;
+		if (checkError(ncmpi_inq_varndims(identifier(), ncEntity.identifier(), &numDims)))
+			return false;
+		std::vector<int> dimIds(numDims);
+		if (checkError(ncmpi_inq_vardimid(identifier(), ncEntity.identifier(), &dimIds[0])))
+			return false;
+
+		std::vector<Dimension> dims;
+		for (int i = 1; i < numDims; i++) { // Skip the size dimension
+			MPI_Offset len;
+			if (checkError(ncmpi_inq_dimlen(identifier(), dimIds[i], &len)))
+				return false;
+			dims.push_back(Dimension(dimIds[i], "", len));
+		}
+
+		std::string minName = statisticsName(entity.name(), VAR_MIN_SUFFIX);
+		std::string maxName = statisticsName(entity.name(), VAR_MAX_SUFFIX);
+		m_statistics[minName] = PnetcdfEntity(m_prefix, minName.c_str(), Type::DOUBLE, m_ncDimPartition,
+				dims.size(), (dims.empty() ? 0L : &dims[0]), offset(), 0L, *this, *this);
+		m_statistics[maxName] = PnetcdfEntity(m_prefix, maxName.c_str(), Type::DOUBLE, m_ncDimPartition,
+				dims.size(), (dims.empty() ? 0L : &dims[0]), offset(), 0L, *this, *this);
+		if (!isValid())
+			return false;
+
+		entity.setStatistics(&m_statistics[minName], &m_statistics[maxName]);
+
+		return true;
+	}
+
+	void _loadedEntities(std::vector<Entity*> &entities)
+	{
+		if (indexed())
+			entities.push_back(&m_entityIndex);
+		if (mixed())
+			entities.push_back(&m_entityTypeOffset);
+
+		for (std::map<std::string, PnetcdfEntity>::iterator i = m_entities.begin();
+				i != m_entities.end(); i++)
+			entities.push_back(&i->second);
+		for (std::map<std::string, PnetcdfEntity>::iterator i = m_statistics.begin();
+				i != m_statistics.end(); i++)
+			entities.push_back(&i->second);
+	}
+
+	PnetcdfEntity* _addTypeOffset()
+	{
+		Dimension &dim = createDimension(DIM_CELLTYPE, NUM_CELL_TYPES+1);
+		if (!isValid())
+			return 0L;
+
+		m_entityTypeOffset = PnetcdfEntity(m_prefix, VAR_TYPEOFFSET, Type::UINT64, m_ncDimPartition, 1, &dim,
+				offset(), 0L, *this, *this);
+
+		return &m_entityTypeOffset;
+	}
+
+private:
+	/**
+	 * Loads an entity from the PnetCDF file
+	 *
+	 * @return The entity or NULL if the entity does not exist
+	 */
+	PnetcdfEntity* loadEntity(const char* name)
+	{
+		if (name[0] == '_')
+			// Internal variable
+			return 0L;
+
+		int varId;
+		if (ncmpi_inq_varid(identifier(), (m_prefix + name).c_str(), &varId) != NC_NOERR)
+			return 0L;
+
+		PnetcdfEntity &entity = m_entities[name];
+		entity = PnetcdfEntity(m_prefix, varId, offset(), (indexed() ? &m_entityIndex : 0L), *this, *this);
+
+		// Load statistics if available
+		std::string minName = statisticsName(name, VAR_MIN_SUFFIX);
+		std::string maxName = statisticsName(name, VAR_MAX_SUFFIX);
+		int minId, maxId;
+		if (ncmpi_inq_varid(identifier(), (m_prefix + minName).c_str(), &minId) == NC_NOERR
+				&& ncmpi_inq_varid(identifier(), (m_prefix + maxName).c_str(), &maxId) == NC_NOERR) {
+			m_statistics[minName] = PnetcdfEntity(m_prefix, minId, offset(), 0L, *this, *this);
+			m_statistics[maxName] = PnetcdfEntity(m_prefix, maxId, offset(), 0L, *this, *this);
+			entity.setStatistics(&m_statistics[minName], &m_statistics[maxName]);
+		}
+
+		if (!isValid())
+			return 0L;
+
+		return &entity;
+	}
+
+	/**
+	 * @return The name of the variable that stores the minimum/maximum of an entity
+	 */
+	static std::string statisticsName(const std::string &name, const char* suffix)
+	{
+		return "_" + name + suffix;
+	}
+};
+
+}
+
+#endif // PUML_PNETCDF_GROUP_H
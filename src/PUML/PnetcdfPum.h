@@ -0,0 +1,291 @@
+/**
+ * @file
+ *  This file is part of PUML
+ *
+ *  For conditions of distribution and use, please see the copyright
+ *  notice in the file 'COPYING' at the root directory of this package
+ *  and the copyright notice at https://github.com/TUM-I5/PUML
+ *
+ * @copyright 2013 Technische Universitaet Muenchen
+ * @author Sebastian Rettenberger <rettenbs@in.tum.de>
+ */
+
+#ifndef PUML_PNETCDF_PUM_H
+#define PUML_PNETCDF_PUM_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <mpi.h>
+#include <pnetcdf.h>
+
+#include "PUML/PnetcdfElement.h"
+#include "PUML/PnetcdfGroup.h"
+#include "PUML/Pum.h"
+
+namespace PUML
+{
+
+/**
+ * A PUM file stored with PnetCDF in the CDF-5 format
+ *
+ * Requires the parallel version. Compared to NetcdfPum:
+ * - Groups are stored as prefixed dimensions and variables (see PnetcdfGroup).
+ * - The sizes of all groups must be known in advance (use the size
+ *  parameter of createGroup or Pum::planSize), only one dimension of a
+ *  classic file can be unlimited.
+ * - Time-dependent entities, subfiles and checkpoint files are not supported.
+ * - All entities are collective. Accesses are nonblocking requests that
+ *  are completed together, e.g. all ranges of an indexed partition in
+ *  Entity::get/put or all entities in Group::getRow/putRow.
+ */
+class PnetcdfPum : public Pum, public PnetcdfElement
+{
+private:
+	/** Groups in this file */
+	std::map<std::string, PnetcdfGroup> m_groups;
+
+	/** True until the definition of a new file is finished */
+	bool m_defining;
+
+public:
+	PnetcdfPum()
+		: m_defining(false)
+	{
+	}
+
+	virtual ~PnetcdfPum()
+	{
+		ncmpi_close(identifier());
+	}
+
+	/**
+	 * Opens the file with MPI_COMM_SELF
+	 */
+	bool open(const char* path)
+	{
+		setMPIComm(MPI_COMM_SELF);
+		return _open(path, MPI_COMM_SELF);
+	}
+
+	/**
+	 * Overridden to work around overload/subclass issues
+	 */
+	bool open(const char* path, MPI_Comm comm, MPI_Info info = MPI_INFO_NULL)
+	{
+		return Pum::open(path, comm, info);
+	}
+
+	/**
+	 * This is a collective function.
+	 *
+	 * @param size The total size of the group (required if no partition sizes
+	 *  are declared with Pum::planSize)
+	 */
+	PnetcdfGroup* createGroup(const char* name, size_t size = Group::UNLIMITED)
+	{
+		return static_cast<PnetcdfGroup*>(Pum::createGroup(name, size));
+	}
+
+	/**
+	 * @copydoc createGroup
+	 *
+	 * @param indexSize The total size of the index (required if no partition
+	 *  sizes are declared with Pum::planSize)
+	 */
+	PnetcdfGroup* createGroupIndexed(const char* name, size_t size = Group::UNLIMITED, size_t indexSize = Group::UNLIMITED)
+	{
+		return static_cast<PnetcdfGroup*>(Pum::createGroupIndexed(name, size, indexSize));
+	}
+
+	/**
+	 * Groups of opened files are loaded on the first call. The first call
+	 * for each group is collective (the offsets are read collectively).
+	 */
+	PnetcdfGroup* getGroup(const char* name)
+	{
+		std::map<std::string, PnetcdfGroup>::iterator it = m_groups.find(name);
+		if (it != m_groups.end())
+			return &it->second;
+
+		return loadGroup(name);
+	}
+
+	bool endDefinition()
+	{
+		if (!Pum::endDefinition())
+			return false;
+
+		if (!m_defining)
+			return true;
+		m_defining = false;
+
+		if (checkError(ncmpi_enddef(identifier())))
+			return false;
+
+		return writePlannedSizes();
+	}
+
+	bool close()
+	{
+		// Close the file in any case, the first error is kept
+		bool success = closeCounters();
+		success = !checkError(ncmpi_close(identifier())) && success;
+
+		return success;
+	}
+
+protected:
+	/**
+	 * Creates the file with MPI_COMM_SELF
+	 */
+	bool _create(const char* path)
+	{
+		setMPIComm(MPI_COMM_SELF);
+		return _create(path, MPI_COMM_SELF);
+	}
+
+	/**
+	 * Defines the dimensions and the offsets of a group
+	 */
+	PnetcdfGroup* _createGroup(const char* name, size_t size, bool indexed, size_t indexSize, bool planned)
+	{
+		if (size == Group::UNLIMITED)
+			// The size must be known in advance
+			return 0L;
+		if (indexed && indexSize == Group::UNLIMITED)
+			return 0L;
+
+		PnetcdfGroup group = PnetcdfGroup(name, numPartitions(), *this, *this, size);
+		if (!group.isValid())
+			return 0L;
+
+		m_groups[name] = group;
+
+		if (indexed) {
+			m_groups[name].addIndex(indexSize);
+			if (!isValid())
+				return 0L;
+		}
+
+		return &m_groups[name];
+	}
+
+	bool _flush()
+	{
+		if (m_defining)
+			// Nothing written yet (ncmpi_sync fails in define mode)
+			return true;
+
+		return !checkError(ncmpi_sync(identifier()));
+	}
+
+	bool _create(const char* path, MPI_Comm comm, MPI_Info info = MPI_INFO_NULL)
+	{
+		int ncFile;
+
+		if (checkError(ncmpi_create(comm, path, NC_CLOBBER | NC_64BIT_DATA, info, &ncFile)))
+			return false;
+		setIdentifier(ncFile);
+
+		return initFile();
+	}
+
+	bool _open(const char* path, MPI_Comm comm, MPI_Info info = MPI_INFO_NULL)
+	{
+		int ncFile;
+
+		if (checkError(ncmpi_open(comm, path, NC_NOWRITE, info, &ncFile)))
+			return false;
+		setIdentifier(ncFile);
+		m_defining = false;
+
+		return loadFile();
+	}
+
+	void _loadedGroups(std::vector<Group*> &groups)
+	{
+		for (std::map<std::string, PnetcdfGroup>::iterator i = m_groups.begin();
+				i != m_groups.end(); i++)
+			groups.push_back(&i->second);
+	}
+
+private:
+	/**
+	 * Initialize a new PnetCDF pum file
+	 */
+	bool initFile()
+	{
+		m_groups.clear();
+		m_defining = true;
+
+		if (checkError(ncmpi_put_att_text(identifier(), NC_GLOBAL, ATT_CONVENTIONS, CONVENTIONS.size(), CONVENTIONS.c_str())))
+			return false;
+		if (checkError(ncmpi_put_att_int(identifier(), NC_GLOBAL, ATT_FILE_VERSION, NC_INT, 1, &FILE_VERSION)))
+			return false;
+		unsigned long long np = numPartitions();
+		if (checkError(ncmpi_put_att_ulonglong(identifier(), NC_GLOBAL, ATT_NUM_PARTITIONS, NC_UINT64, 1, &np)))
+			return false;
+
+		return true;
+	}
+
+	/**
+	 * Check PnetCDF pum file
+	 */
+	bool loadFile()
+	{
+		MPI_Offset len;
+		if (checkError(ncmpi_inq_attlen(identifier(), NC_GLOBAL, ATT_CONVENTIONS, &len)))
+			return false;
+
+		std::vector<char> conventions(len); // Use std::vector to avoid memory leaks
+		if (checkError(ncmpi_get_att_text(identifier(), NC_GLOBAL, ATT_CONVENTIONS, &conventions[0])))
+			return false;
+		if (CONVENTIONS.compare(0, std::string::npos, &conventions[0], len) != 0)
+			return false;
+
+		int fileVersion;
+		if (checkError(ncmpi_get_att_int(identifier(), NC_GLOBAL, ATT_FILE_VERSION, &fileVersion)))
+			return false;
+		if (fileVersion != FILE_VERSION)
+			// Currently only one version is supported
+			return false;
+
+		// Number of partitions
+		unsigned long long np;
+		if (checkError(ncmpi_get_att_ulonglong(identifier(), NC_GLOBAL, ATT_NUM_PARTITIONS, &np)))
+			return false;
+		setNumPartitions(np);
+
+		// Groups are loaded on demand
+		m_groups.clear();
+
+		return true;
+	}
+
+	/**
+	 * Loads a group from the file
+	 *
+	 * @return The group or NULL if the group does not exist
+	 */
+	PnetcdfGroup* loadGroup(const char* name)
+	{
+		if (!PnetcdfGroup::exists(identifier(), name))
+			return 0L;
+
+		PnetcdfGroup &group = m_groups[name];
+		group = PnetcdfGroup(name, *this, *this);
+		if (!group.isValid() || !group.loadEntities()) {
+			m_groups.erase(name);
+			return 0L;
+		}
+
+		return &group;
+	}
+};
+
+}
+
+#endif // PUML_PNETCDF_PUM_H
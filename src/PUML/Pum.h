@@ -17,12 +17,16 @@
 #include <mpi.h>
 #endif // PARALLEL
 
+#include <algorithm>
 #include <cstdlib>
+#include <fstream>
 #include <map>
 #include <string>
 #include <vector>
 
 #include "PUML/Group.h"
+#include "PUML/IOCounters.h"
+#include "PUML/Scanner.h"
 #include "PUML/MPIElement.h"
 
 namespace PUML
@@ -30,13 +34,50 @@ namespace PUML
 
 class Pum : protected MPIElement
 {
+public:
+	/**
+	 * When written data is synchronized with the file
+	 *
+	 * @see setFlushPolicy
+	 */
+	enum FlushPolicy {
+		/** Synchronize at every checkpoint */
+		FLUSH_CHECKPOINT,
+		/** Synchronize at a checkpoint if enough bytes were written since the last synchronization */
+		FLUSH_BYTES,
+		/** Synchronize only when the file is closed (checkpoint does nothing) */
+		FLUSH_CLOSE
+	};
+
 private:
 	/** Number of partitions */
 	size_t m_numPartitions;
 
+	/** I/O counters of the file (without the groups) */
+	IOCounters m_counters;
+
+	/** File for the I/O counters (written at close) */
+	std::string m_countersFile;
+
+	/** Partition sizes declared on this rank for groups not yet created */
+	std::map<std::string, std::vector<unsigned long> > m_plans;
+
+	/** Partition sizes of planned groups (offsets are written in endDefinition) */
+	std::map<std::string, std::vector<unsigned long> > m_plannedSizes;
+
+	/** Current flush policy */
+	FlushPolicy m_flushPolicy;
+
+	/** Number of bytes written between two synchronizations (FLUSH_BYTES only) */
+	unsigned long m_flushBytes;
+
+	/** Number of bytes written on this rank at the last synchronization */
+	unsigned long m_flushedBytes;
+
 public:
 	Pum()
-		: m_numPartitions(0)
+		: m_numPartitions(0), m_flushPolicy(FLUSH_CHECKPOINT),
+		  m_flushBytes(0), m_flushedBytes(0)
 	{
 	}
 
@@ -52,6 +93,9 @@ public:
 	bool create(const char* path, size_t numPartitions)
 	{
 		m_numPartitions = numPartitions;
+		m_plans.clear();
+		m_plannedSizes.clear();
+		m_flushedBytes = 0;
 		return _create(path);
 	}
 
@@ -65,6 +109,9 @@ public:
 	bool create(const char* path, size_t numPartitions, MPI_Comm comm, MPI_Info info = MPI_INFO_NULL)
 	{
 		m_numPartitions = numPartitions;
+		m_plans.clear();
+		m_plannedSizes.clear();
+		m_flushedBytes = 0;
 		setMPIComm(comm);
 		return _create(path, comm, info);
 	}
@@ -80,28 +127,56 @@ public:
 	}
 #endif // PARALLEL
 
+	/**
+	 * Declares the size of a partition before the group is created
+	 *
+	 * If any rank declared sizes for a group, the sizes of all ranks are
+	 * combined when the group is created (collectively). The group gets fixed
+	 * dimensions and the offsets are written with endDefinition(), Group::setSize
+	 * is not required. Partitions not declared on any rank are empty.
+	 *
+	 * For indexed groups the sizes are the sizes of the index, the size of
+	 * the data is still taken from createGroupIndexed.
+	 *
+	 * Must be called after create.
+	 *
+	 * @param group The name of the group
+	 */
+	void planSize(const char* group, size_t partition, size_t size)
+	{
+		std::vector<unsigned long> &sizes = m_plans[group];
+		if (sizes.empty())
+			sizes.resize(m_numPartitions);
+
+		if (partition < sizes.size())
+			sizes[partition] = size;
+	}
+
 	/**
 	 * Create a group in this file
 	 *
+	 * In the parallel version this is a collective function.
+	 *
 	 * @param size The total size (number of all elements in all partitions) of this group.
-	 *  Use Group::UNLIMITED if unknown
+	 *  Use Group::UNLIMITED if unknown. Ignored if the sizes of the partitions are
+	 *  declared with planSize.
 	 */
-	virtual Group* createGroup(const char* name, size_t size = Group::UNLIMITED) = 0;
+	virtual Group* createGroup(const char* name, size_t size = Group::UNLIMITED)
+	{
+		return createPlannedGroup(name, size, false, Group::UNLIMITED);
+	}
 
 	/**
 	 * Create an indexed group in this file
 	 *
+	 * @param indexSize The total size of the index. Ignored if the sizes of the
+	 *  partitions are declared with planSize.
+	 *
 	 * @see createGroup
 	 */
 	virtual Group* createGroupIndexed(const char* name, size_t size = Group::UNLIMITED, size_t indexSize = Group::UNLIMITED)
 	{
-		Group* group = createGroup(name, size);
-		if (!group)
-			return 0L;
-
-		group->addIndex(indexSize);
-
-		return group;
+		return createPlannedGroup(name, size, true, indexSize);
 	}
 
 	/**
@@ -126,6 +201,21 @@ public:
 
 	virtual Group* getGroup(const char* name) = 0;
 
+	/**
+	 * Creates a cursor that reads entities of one group in chunks
+	 *
+	 * @param entities The entities (all in the same group)
+	 * @param chunkBytes The memory budget for one chunk
+	 * @param partitions The partitions that should be read (all if empty)
+	 *
+	 * @see Scanner
+	 */
+	Scanner scan(const std::vector<Entity*> &entities, size_t chunkBytes,
+			const std::vector<size_t> &partitions = std::vector<size_t>())
+	{
+		return Scanner(entities, chunkBytes, partitions);
+	}
+
 	/**
 	 * End the definition phase. Groups and entities can only be added during the
 	 * definition phase
@@ -137,6 +227,72 @@ public:
 
 	virtual bool close() = 0;
 
+	/**
+	 * Sets when written data is synchronized with the file
+	 *
+	 * Data is synchronized by checkpoint (depending on the policy) and close.
+	 * The default policy is FLUSH_CHECKPOINT. Between two synchronizations the
+	 * backends may still write metadata on their own (see
+	 * NetcdfPum::setDeferOffsets and Hdf5Pum::setMetadataCache).
+	 *
+	 * @param bytes Minimum number of bytes written on any rank between two
+	 *  synchronizations (FLUSH_BYTES only)
+	 */
+	void setFlushPolicy(FlushPolicy policy, unsigned long bytes = 0)
+	{
+		m_flushPolicy = policy;
+		m_flushBytes = bytes;
+	}
+
+	/**
+	 * Synchronizes all written data with the file (depending on the flush
+	 * policy). Deferred writes (e.g. the offsets of NetcdfPum::setDeferOffsets)
+	 * are written as well.
+	 *
+	 * With FLUSH_BYTES, the check is cheap if not enough data was written. It
+	 * can be called frequently, e.g. after each partition.
+	 *
+	 * In the parallel version this is a collective function.
+	 *
+	 * @see setFlushPolicy
+	 */
+	bool checkpoint()
+	{
+		if (m_flushPolicy == FLUSH_CLOSE)
+			return true;
+
+		unsigned long written = counters().putBytes;
+		if (written < m_flushedBytes)
+			// Counters were reset
+			m_flushedBytes = 0;
+
+		if (m_flushPolicy == FLUSH_BYTES) {
+			int flush = (written - m_flushedBytes >= m_flushBytes);
+#ifdef PARALLEL
+			if (mpiSize() > 1) {
+				IOTimer timer(m_counters.mpiTime);
+				MPI_Allreduce(MPI_IN_PLACE, &flush, 1, MPI_INT, MPI_MAX, mpiComm());
+			}
+#endif // PARALLEL
+			if (!flush)
+				return true;
+		}
+
+		m_flushedBytes = written;
+
+		IOTimer timer(m_counters.ioTime);
+		return _flush();
+	}
+
+	/**
+	 * @return Number of bytes written on this rank at the last synchronization
+	 *  by checkpoint
+	 */
+	unsigned long flushedBytes() const
+	{
+		return m_flushedBytes;
+	}
+
 	/**
 	 * @return Number of partitions in this file
 	 */
@@ -145,18 +301,360 @@ public:
 		return m_numPartitions;
 	}
 
+	/**
+	 * @return The I/O counters of all loaded groups and entities (on this rank)
+	 */
+	IOCounters counters()
+	{
+		IOCounters counters = m_counters;
+
+		std::vector<Group*> groups;
+		_loadedGroups(groups);
+		for (std::vector<Group*>::const_iterator i = groups.begin(); i != groups.end(); i++)
+			counters += (*i)->counters();
+
+		return counters;
+	}
+
+	void resetCounters()
+	{
+		m_counters.reset();
+		m_flushedBytes = 0;
+
+		std::vector<Group*> groups;
+		_loadedGroups(groups);
+		for (std::vector<Group*>::const_iterator i = groups.begin(); i != groups.end(); i++)
+			(*i)->resetCounters();
+	}
+
+	/**
+	 * Write the I/O counters to a JSON file when the file is closed
+	 *
+	 * @param path The JSON file or NULL to disable
+	 *
+	 * @see writeCounters
+	 */
+	void setCountersFile(const char* path)
+	{
+		if (path)
+			m_countersFile = path;
+		else
+			m_countersFile.clear();
+	}
+
+	/**
+	 * Writes the I/O counters of the file, all groups and all entities as JSON.
+	 * The minimum, maximum and average over all ranks is stored for each counter.
+	 * Entities not loaded on a rank count as zero on this rank.
+	 *
+	 * The counters are named "total" (everything), "file" (without groups),
+	 * "<group>/" (without entities) and "<group>/<entity>".
+	 *
+	 * In the parallel version this is a collective function. The file is
+	 * written by the first rank.
+	 */
+	bool writeCounters(const char* path)
+	{
+		// Collect the counters of this rank
+		std::string names;
+		std::vector<double> values;
+		addCounters("total", counters(), names, values);
+		addCounters("file", m_counters, names, values);
+
+		std::vector<Group*> groups;
+		_loadedGroups(groups);
+		for (std::vector<Group*>::const_iterator i = groups.begin(); i != groups.end(); i++) {
+			std::string groupName = (*i)->name();
+			addCounters(groupName + "/", (*i)->groupCounters(), names, values);
+
+			std::vector<Entity*> entities;
+			(*i)->loadedEntities(entities);
+			for (std::vector<Entity*>::const_iterator j = entities.begin(); j != entities.end(); j++)
+				addCounters(groupName + "/" + (*j)->name(), (*j)->counters(), names, values);
+		}
+
+#ifdef PARALLEL
+		// Collect the counters of all ranks
+		int sizes[2] = {static_cast<int>(names.size()), static_cast<int>(values.size())};
+		std::vector<int> allSizes(2*mpiSize());
+		MPI_Gather(sizes, 2, MPI_INT, &allSizes[0], 2, MPI_INT, 0, mpiComm());
+
+		std::vector<int> nameCounts(mpiSize()), nameDispls(mpiSize()+1, 0);
+		std::vector<int> valueCounts(mpiSize()), valueDispls(mpiSize()+1, 0);
+		for (int i = 0; i < mpiSize(); i++) {
+			nameCounts[i] = allSizes[2*i];
+			nameDispls[i+1] = nameDispls[i] + nameCounts[i];
+			valueCounts[i] = allSizes[2*i+1];
+			valueDispls[i+1] = valueDispls[i] + valueCounts[i];
+		}
+
+		std::string allNames(mpiRank() == 0 ? nameDispls.back() : 0, '\0');
+		std::vector<double> allValues(mpiRank() == 0 ? valueDispls.back() : 0);
+		MPI_Gatherv(const_cast<char*>(names.data()), sizes[0], MPI_CHAR,
+			(allNames.empty() ? 0L : &allNames[0]), &nameCounts[0], &nameDispls[0], MPI_CHAR,
+			0, mpiComm());
+		MPI_Gatherv(&values[0], sizes[1], MPI_DOUBLE,
+			(allValues.empty() ? 0L : &allValues[0]), &valueCounts[0], &valueDispls[0], MPI_DOUBLE,
+			0, mpiComm());
+
+		int success = 1;
+		if (mpiRank() == 0)
+			success = writeCountersJson(path, allNames, allValues);
+
+		MPI_Bcast(&success, 1, MPI_INT, 0, mpiComm());
+		return success != 0;
+#else // PARALLEL
+		return writeCountersJson(path, names, values);
+#endif // PARALLEL
+	}
+
 protected:
 	void setNumPartitions(size_t numPartitions)
 	{
 		m_numPartitions = numPartitions;
 	}
 
+	/**
+	 * Writes the offsets of all planned groups. Must be called by the
+	 * backends in endDefinition when the offsets can be written.
+	 */
+	bool writePlannedSizes()
+	{
+		for (std::map<std::string, std::vector<unsigned long> >::const_iterator i = m_plannedSizes.begin();
+				i != m_plannedSizes.end(); i++) {
+			Group* group = getGroup(i->first.c_str());
+			if (!group || !group->setSizes(&i->second[0]))
+				return false;
+		}
+		m_plannedSizes.clear();
+
+		return true;
+	}
+
+	/**
+	 * @return The I/O counters of the file (without the groups)
+	 */
+	IOCounters& pumCounters()
+	{
+		return m_counters;
+	}
+
+	/**
+	 * Writes the I/O counters if a file was set
+	 *
+	 * @see setCountersFile
+	 */
+	bool closeCounters()
+	{
+		if (m_countersFile.empty())
+			return true;
+
+		return writeCounters(m_countersFile.c_str());
+	}
+
+	/**
+	 * Add all loaded groups to the list
+	 */
+	virtual void _loadedGroups(std::vector<Group*> &groups) = 0;
+
 	virtual bool _create(const char* path) = 0;
+
+	/**
+	 * Creates a group in the backend
+	 *
+	 * @param indexed True for indexed groups
+	 * @param indexSize The size of the index (indexed groups only)
+	 * @param planned True if the partition sizes are declared with planSize
+	 *  (the offsets are written by writePlannedSizes)
+	 */
+	virtual Group* _createGroup(const char* name, size_t size, bool indexed, size_t indexSize, bool planned) = 0;
+
+	/**
+	 * Writes all deferred values and synchronizes the file
+	 */
+	virtual bool _flush() = 0;
+
 #ifdef PARALLEL
 	virtual bool _create(const char* path, MPI_Comm comm, MPI_Info info = MPI_INFO_NULL) = 0;
 	virtual bool _open(const char* path, MPI_Comm comm, MPI_Info info = MPI_INFO_NULL) = 0;
 #endif // PARALLEL
 
+private:
+	/**
+	 * Creates a group with _createGroup. If the partition sizes are declared
+	 * with planSize, the size (or the index size) is the total planned size.
+	 * In the parallel version this is a collective function.
+	 */
+	Group* createPlannedGroup(const char* name, size_t size, bool indexed, size_t indexSize)
+	{
+		std::vector<unsigned long> sizes;
+		if (reducePlan(name, sizes)) {
+			if (indexed)
+				indexSize = planTotal(sizes);
+			else
+				size = planTotal(sizes);
+		}
+
+		Group* group = _createGroup(name, size, indexed, indexSize, !sizes.empty());
+		if (!group)
+			return 0L;
+
+		if (!sizes.empty())
+			m_plannedSizes[name].swap(sizes);
+
+		return group;
+	}
+
+	/**
+	 * Combines the partition sizes declared on all ranks for a group.
+	 * In the parallel version this is a collective function.
+	 *
+	 * @param sizes The sizes of all partitions
+	 * @return False if no rank declared sizes for this group
+	 *
+	 * @see planSize
+	 */
+	bool reducePlan(const char* group, std::vector<unsigned long> &sizes)
+	{
+		std::map<std::string, std::vector<unsigned long> >::iterator it = m_plans.find(group);
+		int planned = (it != m_plans.end());
+#ifdef PARALLEL
+		if (mpiSize() > 1) {
+			IOTimer timer(m_counters.mpiTime);
+			MPI_Allreduce(MPI_IN_PLACE, &planned, 1, MPI_INT, MPI_MAX, mpiComm());
+		}
+#endif // PARALLEL
+		if (!planned)
+			return false;
+
+		if (it != m_plans.end()) {
+			sizes.swap(it->second);
+			m_plans.erase(it);
+		} else
+			sizes.assign(m_numPartitions, 0);
+
+#ifdef PARALLEL
+		if (mpiSize() > 1 && !sizes.empty()) {
+			// Each partition is declared by one rank, the others have 0
+			IOTimer timer(m_counters.mpiTime);
+			MPI_Allreduce(MPI_IN_PLACE, &sizes[0], sizes.size(), MPI_UNSIGNED_LONG, MPI_MAX, mpiComm());
+		}
+#endif // PARALLEL
+
+		return true;
+	}
+
+	static size_t planTotal(const std::vector<unsigned long> &sizes)
+	{
+		size_t total = 0;
+		for (std::vector<unsigned long>::const_iterator i = sizes.begin(); i != sizes.end(); i++)
+			total += *i;
+		return total;
+	}
+
+	/**
+	 * Appends the name (null terminated) and the values of counters
+	 */
+	static void addCounters(const std::string &name, const IOCounters &counters,
+			std::string &names, std::vector<double> &values)
+	{
+		names.append(name);
+		names.push_back('\0');
+
+		values.resize(values.size() + IOCounters::NUM_VALUES);
+		counters.toArray(&values[values.size() - IOCounters::NUM_VALUES]);
+	}
+
+	/**
+	 * Computes minimum, maximum and average of all counters and writes them
+	 *
+	 * @param names The names of all counters (of all ranks)
+	 * @param values The values of all counters (of all ranks)
+	 */
+	bool writeCountersJson(const char* path, const std::string &names, const std::vector<double> &values)
+	{
+		const unsigned int n = IOCounters::NUM_VALUES;
+
+		// Minimum, maximum, sum and number of ranks for each name
+		std::map<std::string, std::vector<double> > aggregated;
+		size_t pos = 0;
+		for (size_t i = 0; pos < names.size(); i++) {
+			std::string name(&names[pos]);
+			pos += name.size() + 1;
+
+			std::vector<double> &a = aggregated[name];
+			if (a.empty()) {
+				a.resize(3*n+1);
+				std::copy(&values[i*n], &values[i*n]+n, a.begin());
+				std::copy(&values[i*n], &values[i*n]+n, a.begin()+n);
+			} else {
+				for (unsigned int j = 0; j < n; j++) {
+					a[j] = std::min(a[j], values[i*n+j]);
+					a[n+j] = std::max(a[n+j], values[i*n+j]);
+				}
+			}
+			for (unsigned int j = 0; j < n; j++)
+				a[2*n+j] += values[i*n+j];
+			a[3*n]++;
+		}
+
+		std::ofstream out(path);
+		if (!out)
+			return false;
+
+		static const char* scalarNames[] = {"getCalls", "putCalls", "getBytes", "putBytes", "paddingAccesses"};
+		static const char* timeNames[] = {"ioTime", "mpiTime"};
+		const unsigned int numScalars = sizeof(scalarNames) / sizeof(scalarNames[0]);
+
+		out.precision(12);
+		out << "{\n\t\"ranks\": " << mpiSize() << ",\n\t\"counters\": {";
+		for (std::map<std::string, std::vector<double> >::iterator i = aggregated.begin();
+				i != aggregated.end(); i++) {
+			std::vector<double> &a = i->second;
+
+			// Entities not loaded on all ranks
+			if (a[3*n] < mpiSize()) {
+				for (unsigned int j = 0; j < n; j++)
+					a[j] = std::min(a[j], 0.);
+			}
+
+			out << (i == aggregated.begin() ? "" : ",") << "\n\t\t\"" << i->first << "\": {";
+			for (unsigned int j = 0; j < n; j++) {
+				const char* name;
+				if (j < numScalars)
+					name = scalarNames[j];
+				else if (j < numScalars + IOCounters::NUM_RANGE_BUCKETS) {
+					// Write the histogram as arrays
+					if (j != numScalars)
+						continue;
+					name = "ranges";
+				} else
+					name = timeNames[j - numScalars - IOCounters::NUM_RANGE_BUCKETS];
+
+				out << (j == 0 ? "" : ",") << "\n\t\t\t\"" << name << "\": {";
+				static const char* aggNames[] = {"min", "max", "avg"};
+				for (unsigned int k = 0; k < 3; k++) {
+					out << (k == 0 ? "" : ", ") << "\"" << aggNames[k] << "\": ";
+
+					double scale = (k == 2 ? 1. / mpiSize() : 1.);
+					if (j < numScalars || j >= numScalars + IOCounters::NUM_RANGE_BUCKETS)
+						out << a[k*n+j] * scale;
+					else {
+						out << '[';
+						for (unsigned int l = 0; l < IOCounters::NUM_RANGE_BUCKETS; l++)
+							out << (l == 0 ? "" : ", ") << a[k*n+j+l] * scale;
+						out << ']';
+					}
+				}
+				out << '}';
+			}
+			out << "\n\t\t}";
+		}
+		out << "\n\t}\n}\n";
+
+		return out.good();
+	}
+
 protected:
 	static const std::string CONVENTIONS;
 	static const int FILE_VERSION;
@@ -164,6 +662,10 @@ protected:
 	static const char* ATT_CONVENTIONS;
 	static const char* ATT_FILE_VERSION;
 	static const char* ATT_NUM_PARTITIONS;
+	static const char* ATT_CHECKPOINT_PARTITIONS;
+	static const char* ATT_CHECKPOINT_TOTAL;
+	static const char* ATT_SUBFILES;
+	static const char* ATT_SUBFILE_RANKS;
 };
 
 }
@@ -0,0 +1,302 @@
+/**
+ * @file
+ *  This file is part of PUML
+ *
+ *  For conditions of distribution and use, please see the copyright
+ *  notice in the file 'COPYING' at the root directory of this package
+ *  and the copyright notice at https://github.com/TUM-I5/PUML
+ *
+ * @copyright 2013 Technische Universitaet Muenchen
+ * @author Sebastian Rettenberger <rettenbs@in.tum.de>
+ */
+
+#ifndef PUML_SCANNER_H
+#define PUML_SCANNER_H
+
+#ifdef PARALLEL
+#include <mpi.h>
+#endif // PARALLEL
+
+#include <algorithm>
+#include <vector>
+
+#include "PUML/Entity.h"
+
+namespace PUML
+{
+
+/**
+ * Reads several entities of one group in chunks
+ *
+ * The partitions are read in file order. Each chunk contains the same
+ * elements of all entities and never spans two partitions. The size of a
+ * chunk is chosen such that all buffers fit into the memory budget.
+ *
+ * For indexed groups only one chunk of the index is read at a time.
+ * The values of a chunk are read with Entity::gather which combines
+ * consecutive elements.
+ *
+ * In the parallel version, next() is a collective function if one of the
+ * entities is in collective mode or the group is indexed. In this case all
+ * ranks have to call next() until it returns false (next() returns false on
+ * all ranks at the same time). Ranks without more data get empty chunks.
+ * A rank with an error also continues with empty chunks, check failed()
+ * after the last chunk.
+ *
+ * With subfiles, each chunk is read from the subfile of its partition and
+ * the index of indexed groups refers to the subfile.
+ *
+ * @see Pum::scan
+ */
+class Scanner
+{
+private:
+	/** The entities */
+	std::vector<Entity*> m_entities;
+
+	/** The partitions that are read */
+	std::vector<size_t> m_partitions;
+
+	/** Number of elements per chunk */
+	size_t m_chunkSize;
+
+	/** Next partition (position in m_partitions) */
+	size_t m_nextPartition;
+
+	/** Start of the next chunk in the partition */
+	size_t m_nextStart;
+
+	/** Use collective calls */
+	bool m_collective;
+
+	/** An error occurred */
+	bool m_failed;
+
+	/** Partition of the current chunk */
+	size_t m_partition;
+
+	/** Start of the current chunk in the partition */
+	size_t m_start;
+
+	/** Number of elements in the current chunk */
+	size_t m_size;
+
+	/** Position of the elements in the file (index for indexed groups) */
+	std::vector<unsigned long> m_ids;
+
+	/** Values of the current chunk for each entity */
+	std::vector<std::vector<char> > m_values;
+
+public:
+	Scanner()
+		: m_chunkSize(0), m_nextPartition(0), m_nextStart(0), m_collective(false),
+		  m_failed(true), m_partition(0), m_start(0), m_size(0)
+	{
+	}
+
+	/**
+	 * @param entities The entities, all entities must be in the same group
+	 * @param chunkBytes Memory budget for one chunk (in bytes)
+	 * @param partitions The partitions that should be read (in increasing order).
+	 *  If empty, all partitions are read.
+	 */
+	Scanner(const std::vector<Entity*> &entities, size_t chunkBytes,
+			const std::vector<size_t> &partitions = std::vector<size_t>())
+		: m_entities(entities), m_partitions(partitions), m_chunkSize(0),
+		  m_nextPartition(0), m_nextStart(0), m_collective(false),
+		  m_failed(false), m_partition(0), m_start(0), m_size(0)
+	{
+		if (m_entities.empty()) {
+			m_failed = true;
+			return;
+		}
+
+		Entity* first = m_entities[0];
+		size_t rowBytes = sizeof(unsigned long);
+		for (std::vector<Entity*>::const_iterator i = m_entities.begin(); i != m_entities.end(); i++) {
+			if ((*i)->m_offset != first->m_offset || (*i)->m_index != first->m_index) {
+				// Not in the same group
+				m_failed = true;
+				return;
+			}
+
+			rowBytes += (*i)->numComponents() * (*i)->valueSize();
+			m_collective |= (*i)->m_collective;
+		}
+
+		// The index is always read collectively
+		m_collective |= first->indexed();
+
+		// Temporary buffers in Entity::gather require the same amount of memory
+		if (first->indexed())
+			rowBytes *= 2;
+
+		m_chunkSize = std::max(chunkBytes / rowBytes, static_cast<size_t>(1));
+
+		if (m_partitions.empty()) {
+			for (size_t i = 0; i < first->m_offset->size()-1; i++)
+				m_partitions.push_back(i);
+		}
+
+		// Chunks that are skipped still return valid buffers
+		m_values.assign(m_entities.size(), std::vector<char>(1));
+	}
+
+	/**
+	 * Reads the next chunk
+	 *
+	 * @return False if all chunks are read or an error occurred
+	 */
+	bool next()
+	{
+		if (m_chunkSize == 0 || (m_failed && !m_collective))
+			return false;
+
+		Entity* first = m_entities[0];
+
+		// Find the next non-empty chunk
+		while (m_nextPartition < m_partitions.size()
+				&& m_nextStart >= first->partitionSize(m_partitions[m_nextPartition])) {
+			m_nextPartition++;
+			m_nextStart = 0;
+		}
+
+		int more = (m_nextPartition < m_partitions.size() && !m_failed);
+#ifdef PARALLEL
+		if (m_collective)
+			MPI_Allreduce(MPI_IN_PLACE, &more, 1, MPI_INT, MPI_MAX, first->mpiComm());
+#endif // PARALLEL
+		if (!more)
+			return false;
+
+		if (m_nextPartition < m_partitions.size() && !m_failed) {
+			m_partition = m_partitions[m_nextPartition];
+			m_start = m_nextStart;
+			m_size = std::min(m_chunkSize, first->partitionSize(m_partition) - m_start);
+		} else {
+			// Only take part in the collective calls
+			m_partition = 0;
+			m_start = 0;
+			m_size = 0;
+		}
+		m_nextStart += m_size;
+
+		if (!read()) {
+			m_failed = true;
+			m_size = 0;
+		}
+
+		return m_collective || !m_failed;
+	}
+
+	/**
+	 * @return True if an error occurred
+	 */
+	bool failed() const
+	{
+		return m_failed;
+	}
+
+	/**
+	 * @return The partition of the current chunk
+	 */
+	size_t partition() const
+	{
+		return m_partition;
+	}
+
+	/**
+	 * @return The position of the first element of the current chunk in the partition
+	 */
+	size_t start() const
+	{
+		return m_start;
+	}
+
+	/**
+	 * @return The number of elements in the current chunk
+	 */
+	size_t size() const
+	{
+		return m_size;
+	}
+
+	/**
+	 * @return The positions of the elements in the file (the index for indexed groups)
+	 */
+	const unsigned long* ids() const
+	{
+		return &m_ids[0];
+	}
+
+	/**
+	 * @return The values of an entity in the current chunk. The type must
+	 *  match the type in the file.
+	 */
+	template<typename T>
+	const T* values(size_t entity) const
+	{
+		return reinterpret_cast<const T*>(&m_values[entity][0]);
+	}
+
+private:
+	/**
+	 * Reads the current chunk of all entities
+	 */
+	bool read()
+	{
+		Entity* first = m_entities[0];
+
+		// Position of the chunk in this file and in the file that stores the partition
+		size_t position = (*first->m_offset)[m_partition] + m_start;
+		size_t offset = position;
+
+		m_ids.resize(std::max(m_size, static_cast<size_t>(1)));
+		if (first->m_router) {
+			if (m_size == 0)
+				// Subfiles are read without collective calls
+				return true;
+
+			size_t partition = m_partition;
+			first = first->route(partition);
+			if (!first)
+				return false;
+			offset = (*first->m_offset)[partition] + m_start;
+		}
+
+		if (first->indexed()) {
+			if (!first->m_index->getaRaw(offset, m_size, &m_ids[0]))
+				return false;
+		} else {
+			for (size_t i = 0; i < m_size; i++)
+				m_ids[i] = position + i;
+		}
+
+		for (size_t i = 0; i < m_entities.size(); i++) {
+			Entity* entity = m_entities[i];
+			if (entity->m_router) {
+				size_t partition = m_partition;
+				entity = entity->route(partition);
+				if (!entity)
+					return false;
+			}
+			m_values[i].resize(std::max(m_size * entity->numComponents() * entity->valueSize(),
+				static_cast<size_t>(1)));
+
+			if (first->indexed()) {
+				if (!entity->gatherRaw(&m_ids[0], m_size, &m_values[i][0]))
+					return false;
+			} else {
+				if ((m_size > 0 || entity->m_collective)
+						&& !entity->getaRaw(offset, m_size, &m_values[i][0]))
+					return false;
+			}
+		}
+
+		return true;
+	}
+};
+
+}
+
+#endif // PUML_SCANNER_H
@@ -0,0 +1,175 @@
+/**
+ * @file
+ *  This file is part of PUML
+ *
+ *  For conditions of distribution and use, please see the copyright
+ *  notice in the file 'COPYING' at the root directory of this package
+ *  and the copyright notice at https://github.com/TUM-I5/PUML
+ *
+ * @copyright 2013 Technische Universitaet Muenchen
+ * @author Sebastian Rettenberger <rettenbs@in.tum.de>
+ */
+
+#ifndef PUML_SHARED_BUFFER_H
+#define PUML_SHARED_BUFFER_H
+
+#ifdef PARALLEL
+
+#include <mpi.h>
+
+#include <cstddef>
+
+namespace PUML
+{
+
+/**
+ * A buffer that exists only once on each (shared memory) node
+ *
+ * The buffer is allocated by the first rank of the node with
+ * MPI_Win_allocate_shared. All other ranks on the node get a pointer
+ * to the same memory.
+ *
+ * @see Entity::getShared
+ */
+template<typename T>
+class SharedBuffer
+{
+private:
+	/** Communicator of all ranks on this node */
+	MPI_Comm m_nodeComm;
+
+	/** The shared memory window */
+	MPI_Win m_win;
+
+	/** Pointer to the memory of the first rank of the node */
+	T* m_data;
+
+	/** Number of values in the buffer */
+	size_t m_size;
+
+public:
+	SharedBuffer()
+		: m_nodeComm(MPI_COMM_NULL), m_win(MPI_WIN_NULL),
+		  m_data(0L), m_size(0)
+	{
+	}
+
+	virtual ~SharedBuffer()
+	{
+		free();
+	}
+
+	/**
+	 * Allocates the buffer. The size of the first rank of each node is used,
+	 * other ranks may pass any value.
+	 *
+	 * This is a collective function.
+	 *
+	 * @param size Number of values
+	 * @param comm All ranks that share the buffer (ranks are grouped by node)
+	 */
+	bool allocate(size_t size, MPI_Comm comm)
+	{
+		free();
+
+		if (MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &m_nodeComm) != MPI_SUCCESS)
+			return false;
+
+		int rank;
+		MPI_Comm_rank(m_nodeComm, &rank);
+
+		void* data;
+		if (MPI_Win_allocate_shared((rank == 0 ? size * sizeof(T) : 0), sizeof(T),
+				MPI_INFO_NULL, m_nodeComm, &data, &m_win) != MPI_SUCCESS)
+			return false;
+
+		// Get the memory of the first rank
+		MPI_Aint bytes;
+		int dispUnit;
+		MPI_Win_shared_query(m_win, 0, &bytes, &dispUnit, &data);
+		m_data = static_cast<T*>(data);
+		m_size = bytes / sizeof(T);
+
+		// Start the first epoch
+		MPI_Win_fence(0, m_win);
+
+		return true;
+	}
+
+	/**
+	 * Makes the values written by the first rank visible on all ranks of the node
+	 *
+	 * This is a collective function (on the node).
+	 */
+	void sync()
+	{
+		MPI_Win_fence(0, m_win);
+	}
+
+	/**
+	 * Frees the buffer
+	 *
+	 * This is a collective function (on the node).
+	 */
+	void free()
+	{
+		if (m_win != MPI_WIN_NULL)
+			MPI_Win_free(&m_win);
+		if (m_nodeComm != MPI_COMM_NULL)
+			MPI_Comm_free(&m_nodeComm);
+
+		m_data = 0L;
+		m_size = 0;
+	}
+
+	/**
+	 * @return True if this rank writes the buffer
+	 */
+	bool nodeMaster() const
+	{
+		int rank;
+		MPI_Comm_rank(m_nodeComm, &rank);
+		return rank == 0;
+	}
+
+	MPI_Comm nodeComm() const
+	{
+		return m_nodeComm;
+	}
+
+	size_t size() const
+	{
+		return m_size;
+	}
+
+	const T* data() const
+	{
+		return m_data;
+	}
+
+	const T& operator[](size_t i) const
+	{
+		return m_data[i];
+	}
+
+	/**
+	 * @return Writable pointer (only for the first rank of the node)
+	 *
+	 * @internal
+	 */
+	T* writableData()
+	{
+		return m_data;
+	}
+
+private:
+	// Windows cannot be copied
+	SharedBuffer(const SharedBuffer&);
+	SharedBuffer& operator=(const SharedBuffer&);
+};
+
+}
+
+#endif // PARALLEL
+
+#endif // PUML_SHARED_BUFFER_H
@@ -0,0 +1,592 @@
+/**
+ * @file
+ *  This file is part of PUML
+ *
+ *  For conditions of distribution and use, please see the copyright
+ *  notice in the file 'COPYING' at the root directory of this package
+ *  and the copyright notice at https://github.com/TUM-I5/PUML
+ *
+ * @copyright 2013 Technische Universitaet Muenchen
+ * @author Sebastian Rettenberger <rettenbs@in.tum.de>
+ */
+
+#ifndef PUML_TET_BVH_H
+#define PUML_TET_BVH_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "PUML/CellType.h"
+#include "PUML/Dimension.h"
+#include "PUML/Entity.h"
+#include "PUML/Group.h"
+#include "PUML/Pum.h"
+#include "PUML/Type.h"
+
+namespace PUML
+{
+
+/**
+ * Bounding volume hierarchy over the tetrahedra of one partition
+ *
+ * The hierarchy is stored as a packed array of nodes with four children
+ * each. The bounding boxes of the children are stored as structure of arrays,
+ * so one point is tested against all four boxes with a fixed length loop
+ * that the compiler can vectorize. The coordinates of the tetrahedra are
+ * stored in leaf order to keep the exact tests cache friendly.
+ *
+ * Cells reference vertices by their position in the partition of the vertex
+ * group with the same partition id.
+ */
+class TetBvh
+{
+public:
+	/** Number of children per node */
+	static const unsigned int WIDTH = 4;
+
+	/** Maximum number of cells in a leaf */
+	static const unsigned int LEAF_SIZE = 4;
+
+	/** Maximum depth of the hierarchy (the median split never exceeds it) */
+	static const unsigned int MAX_DEPTH = 64;
+
+	struct Node
+	{
+		/** Boxes of the children: [dimension][child] */
+		double min[3][WIDTH];
+		double max[3][WIDTH];
+		/**
+		 * Index of the child node (>= 0) or position of the first cell
+		 * of a leaf (~position) in the cell order
+		 */
+		long child[WIDTH];
+		/** Number of cells in a leaf (or 0 for internal nodes and empty children) */
+		long count[WIDTH];
+	};
+
+private:
+	static const unsigned int NUM_VERTICES = CellTraits<TETRAHEDRON>::NUM_VERTICES;
+
+	/** Number of values of a node when stored in the file */
+	static const unsigned int NODE_BOX_SIZE = 6*WIDTH;
+	static const unsigned int NODE_LINK_SIZE = 2*WIDTH;
+
+	/** The nodes, root first */
+	std::vector<Node> m_nodes;
+
+	/** The cell ids in leaf order */
+	std::vector<unsigned long> m_order;
+
+	/** Coordinates of all cells in leaf order (12 values per cell) */
+	std::vector<double> m_coords;
+
+public:
+	/**
+	 * Build the hierarchy
+	 *
+	 * @param cells The vertices of the cells, 4 per cell
+	 * @param coords The coordinates of the vertices, 3 per vertex
+	 */
+	template<typename T>
+	bool build(size_t numCells, const T* cells, size_t numVertices, const double* coords)
+	{
+		m_nodes.clear();
+
+		// Bounding box and center of each cell
+		std::vector<double> boxes(6*numCells);
+		std::vector<double> centers(3*numCells);
+		for (size_t i = 0; i < numCells; i++) {
+			for (unsigned int k = 0; k < 3; k++) {
+				boxes[i*6+k] = std::numeric_limits<double>::max();
+				boxes[i*6+3+k] = -std::numeric_limits<double>::max();
+			}
+
+			for (unsigned int j = 0; j < NUM_VERTICES; j++) {
+				size_t v = static_cast<size_t>(cells[i*NUM_VERTICES+j]);
+				if (v >= numVertices)
+					return false;
+
+				for (unsigned int k = 0; k < 3; k++) {
+					boxes[i*6+k] = std::min(boxes[i*6+k], coords[v*3+k]);
+					boxes[i*6+3+k] = std::max(boxes[i*6+3+k], coords[v*3+k]);
+				}
+			}
+
+			for (unsigned int k = 0; k < 3; k++)
+				centers[i*3+k] = 0.5 * (boxes[i*6+k] + boxes[i*6+3+k]);
+		}
+
+		m_order.resize(numCells);
+		for (size_t i = 0; i < numCells; i++)
+			m_order[i] = i;
+
+		// The root is always an internal node
+		m_nodes.push_back(Node());
+		if (numCells <= LEAF_SIZE) {
+			initNode(m_nodes[0]);
+			if (numCells > 0)
+				setLeaf(m_nodes[0], 0, 0, numCells, boxes);
+		} else
+			buildNode(0, 0, numCells, boxes, centers);
+
+		return setCoords(cells, coords);
+	}
+
+	/**
+	 * @return The cell that contains the point or -1 if no cell contains the point
+	 *
+	 * @param tolerance Relative tolerance for points on faces
+	 */
+	long locate(const double* point, double tolerance = 1e-12) const
+	{
+		if (m_order.empty())
+			return -1;
+
+		// Each level leaves at most WIDTH-1 siblings on the stack
+		long stack[(WIDTH-1)*MAX_DEPTH + 1];
+		unsigned int top = 0;
+		stack[top++] = 0;
+
+		while (top > 0) {
+			const Node &node = m_nodes[stack[--top]];
+
+			// Test all children at once
+			int hit[WIDTH];
+			for (unsigned int i = 0; i < WIDTH; i++) {
+				hit[i] = (point[0] >= node.min[0][i]) & (point[0] <= node.max[0][i])
+						& (point[1] >= node.min[1][i]) & (point[1] <= node.max[1][i])
+						& (point[2] >= node.min[2][i]) & (point[2] <= node.max[2][i]);
+			}
+
+			for (unsigned int i = 0; i < WIDTH; i++) {
+				if (!hit[i])
+					continue;
+
+				if (node.count[i] == 0) {
+					stack[top++] = node.child[i];
+					continue;
+				}
+
+				size_t first = ~node.child[i];
+				for (long j = 0; j < node.count[i]; j++) {
+					if (contains(first+j, point, tolerance))
+						return m_order[first+j];
+				}
+			}
+		}
+
+		return -1;
+	}
+
+	/**
+	 * Locate multiple points
+	 *
+	 * @param cells The cell for each point (-1 if not found)
+	 */
+	void locate(size_t numPoints, const double* points, long* cells, double tolerance = 1e-12) const
+	{
+		for (size_t i = 0; i < numPoints; i++)
+			cells[i] = locate(&points[i*3], tolerance);
+	}
+
+	size_t numNodes() const
+	{
+		return m_nodes.size();
+	}
+
+	/**
+	 * Create the groups to store the hierarchy of all partitions in a file.
+	 * Must be called during the definition phase.
+	 */
+	static bool createGroups(Pum &pum)
+	{
+		Group* nodeGroup = pum.createGroup(GROUP_NODE);
+		if (!nodeGroup)
+			return false;
+		Dimension &boxDim = nodeGroup->createDimension(DIM_BOX, NODE_BOX_SIZE);
+		if (!nodeGroup->createEntity(ENTITY_BOX, Type::Double, 1, &boxDim))
+			return false;
+		Dimension &linkDim = nodeGroup->createDimension(DIM_LINK, NODE_LINK_SIZE);
+		if (!nodeGroup->createEntity(ENTITY_LINK, Type::Int64, 1, &linkDim))
+			return false;
+
+		Group* orderGroup = pum.createGroup(GROUP_ORDER);
+		if (!orderGroup)
+			return false;
+		if (!orderGroup->createEntity(ENTITY_ORDER, Type::UINT64))
+			return false;
+
+		return true;
+	}
+
+	/**
+	 * Stores the hierarchy of a partition
+	 *
+	 * Sets the size of the partition in both groups. In the parallel version
+	 * this is a collective function.
+	 *
+	 * @see createGroups
+	 */
+	bool put(Pum &pum, size_t partition) const
+	{
+		Group* nodeGroup = pum.getGroup(GROUP_NODE);
+		Group* orderGroup = pum.getGroup(GROUP_ORDER);
+		if (!nodeGroup || !orderGroup)
+			return false;
+
+		Entity* boxEntity = nodeGroup->getEntity(ENTITY_BOX);
+		Entity* linkEntity = nodeGroup->getEntity(ENTITY_LINK);
+		Entity* orderEntity = orderGroup->getEntity(ENTITY_ORDER);
+		if (!boxEntity || !linkEntity || !orderEntity)
+			return false;
+
+		if (!nodeGroup->setSize(partition, m_nodes.size()))
+			return false;
+		if (!orderGroup->setSize(partition, m_order.size()))
+			return false;
+
+		std::vector<double> boxes(m_nodes.size() * NODE_BOX_SIZE);
+		std::vector<long> links(m_nodes.size() * NODE_LINK_SIZE);
+		for (size_t i = 0; i < m_nodes.size(); i++) {
+			std::copy(&m_nodes[i].min[0][0], &m_nodes[i].min[0][0] + 3*WIDTH, &boxes[i*NODE_BOX_SIZE]);
+			std::copy(&m_nodes[i].max[0][0], &m_nodes[i].max[0][0] + 3*WIDTH, &boxes[i*NODE_BOX_SIZE + 3*WIDTH]);
+			std::copy(m_nodes[i].child, m_nodes[i].child + WIDTH, &links[i*NODE_LINK_SIZE]);
+			std::copy(m_nodes[i].count, m_nodes[i].count + WIDTH, &links[i*NODE_LINK_SIZE + WIDTH]);
+		}
+
+		if (!boxEntity->put(partition, m_nodes.size(), &boxes[0]))
+			return false;
+		if (!linkEntity->put(partition, m_nodes.size(), &links[0]))
+			return false;
+		if (m_order.empty())
+			return true;
+
+		return orderEntity->put(partition, m_order.size(), &m_order[0]);
+	}
+
+	/**
+	 * Loads the hierarchy of a partition instead of building it
+	 *
+	 * Cells and coordinates are required for the exact tests.
+	 */
+	template<typename T>
+	bool get(Pum &pum, size_t partition, size_t numCells, const T* cells, size_t numVertices, const double* coords)
+	{
+		Group* nodeGroup = pum.getGroup(GROUP_NODE);
+		Group* orderGroup = pum.getGroup(GROUP_ORDER);
+		if (!nodeGroup || !orderGroup)
+			return false;
+
+		Entity* boxEntity = nodeGroup->getEntity(ENTITY_BOX);
+		Entity* linkEntity = nodeGroup->getEntity(ENTITY_LINK);
+		Entity* orderEntity = orderGroup->getEntity(ENTITY_ORDER);
+		if (!boxEntity || !linkEntity || !orderEntity)
+			return false;
+
+		size_t numNodes = nodeGroup->size(partition);
+		if (numNodes == 0 || orderGroup->size(partition) != numCells)
+			return false;
+
+		std::vector<double> boxes(numNodes * NODE_BOX_SIZE);
+		std::vector<long> links(numNodes * NODE_LINK_SIZE);
+		if (!boxEntity->get(partition, numNodes, &boxes[0]))
+			return false;
+		if (!linkEntity->get(partition, numNodes, &links[0]))
+			return false;
+
+		m_order.resize(numCells);
+		if (numCells > 0 && !orderEntity->get(partition, numCells, &m_order[0]))
+			return false;
+		for (size_t i = 0; i < numCells; i++) {
+			if (m_order[i] >= numCells)
+				return false;
+		}
+
+		m_nodes.resize(numNodes);
+		for (size_t i = 0; i < numNodes; i++) {
+			std::copy(&boxes[i*NODE_BOX_SIZE], &boxes[i*NODE_BOX_SIZE] + 3*WIDTH, &m_nodes[i].min[0][0]);
+			std::copy(&boxes[i*NODE_BOX_SIZE + 3*WIDTH], &boxes[i*NODE_BOX_SIZE] + 6*WIDTH, &m_nodes[i].max[0][0]);
+			std::copy(&links[i*NODE_LINK_SIZE], &links[i*NODE_LINK_SIZE] + WIDTH, m_nodes[i].child);
+			std::copy(&links[i*NODE_LINK_SIZE + WIDTH], &links[i*NODE_LINK_SIZE] + 2*WIDTH, m_nodes[i].count);
+		}
+		if (!checkNodes(numCells))
+			return false;
+
+		for (size_t i = 0; i < numCells; i++) {
+			for (unsigned int j = 0; j < NUM_VERTICES; j++) {
+				if (static_cast<size_t>(cells[i*NUM_VERTICES+j]) >= numVertices)
+					return false;
+			}
+		}
+
+		return setCoords(cells, coords);
+	}
+
+	/**
+	 * Finds the partitions that may contain the points
+	 *
+	 * Uses the bounding boxes stored with the coordinate entity, no bulk
+	 * data is read.
+	 *
+	 * @param coordinates The coordinate entity of the vertex group with statistics
+	 * @param queries The points for each partition
+	 *
+	 * @see Group::addStatistics
+	 */
+	static bool selectPartitions(Entity &coordinates, size_t numPoints, const double* points,
+			std::vector<std::vector<size_t> > &queries)
+	{
+		if (!coordinates.hasStatistics() || coordinates.numComponents() != 3)
+			return false;
+
+		std::vector<size_t> partitions;
+		for (size_t i = 0; i < numPoints; i++) {
+			if (!coordinates.selectPartitions(&points[i*3], &points[i*3], partitions))
+				return false;
+
+			for (std::vector<size_t>::const_iterator p = partitions.begin(); p != partitions.end(); p++) {
+				if (*p >= queries.size())
+					queries.resize(*p+1);
+				queries[*p].push_back(i);
+			}
+		}
+
+		return true;
+	}
+
+private:
+	/**
+	 * Checks the links of loaded nodes, so <code>locate</code> stays within
+	 * the nodes, the cells and the stack
+	 */
+	bool checkNodes(size_t numCells) const
+	{
+		// Children are always stored after their parent
+		std::vector<unsigned int> depth(m_nodes.size(), 0);
+		for (size_t i = 0; i < m_nodes.size(); i++) {
+			const Node &node = m_nodes[i];
+			for (unsigned int j = 0; j < WIDTH; j++) {
+				if (node.count[j] < 0 || node.count[j] > static_cast<long>(LEAF_SIZE))
+					return false;
+
+				if (node.count[j] > 0) {
+					// Leaf
+					if (node.child[j] >= 0 || ~node.child[j] + node.count[j] > static_cast<long>(numCells))
+						return false;
+				} else if (node.child[j] != 0) {
+					// Internal node
+					if (node.child[j] <= static_cast<long>(i) || node.child[j] >= static_cast<long>(m_nodes.size()))
+						return false;
+					depth[node.child[j]] = std::max(depth[node.child[j]], depth[i]+1);
+					if (depth[node.child[j]] >= MAX_DEPTH)
+						return false;
+				} else {
+					// Empty child, must never be hit
+					if (node.min[0][j] <= node.max[0][j] && node.min[1][j] <= node.max[1][j]
+							&& node.min[2][j] <= node.max[2][j])
+						return false;
+				}
+			}
+		}
+
+		return true;
+	}
+
+	static void initNode(Node &node)
+	{
+		for (unsigned int i = 0; i < WIDTH; i++) {
+			for (unsigned int k = 0; k < 3; k++) {
+				// Empty box, never hit
+				node.min[k][i] = std::numeric_limits<double>::max();
+				node.max[k][i] = -std::numeric_limits<double>::max();
+			}
+			node.child[i] = 0;
+			node.count[i] = 0;
+		}
+	}
+
+	/**
+	 * Set the box of a child to the union of the cell boxes in [begin, end)
+	 */
+	void setBox(Node &node, unsigned int child, size_t begin, size_t end, const std::vector<double> &boxes) const
+	{
+		for (size_t i = begin; i < end; i++) {
+			for (unsigned int k = 0; k < 3; k++) {
+				node.min[k][child] = std::min(node.min[k][child], boxes[m_order[i]*6+k]);
+				node.max[k][child] = std::max(node.max[k][child], boxes[m_order[i]*6+3+k]);
+			}
+		}
+	}
+
+	void setLeaf(Node &node, unsigned int child, size_t begin, size_t end, const std::vector<double> &boxes) const
+	{
+		setBox(node, child, begin, end, boxes);
+		node.child[child] = ~static_cast<long>(begin);
+		node.count[child] = end - begin;
+	}
+
+	/**
+	 * Sorts the cells in [begin, end) around the median of the longest axis
+	 *
+	 * @return The position of the median
+	 */
+	size_t split(size_t begin, size_t end, const std::vector<double> &centers)
+	{
+		double min[3], max[3];
+		for (unsigned int k = 0; k < 3; k++) {
+			min[k] = std::numeric_limits<double>::max();
+			max[k] = -std::numeric_limits<double>::max();
+		}
+		for (size_t i = begin; i < end; i++) {
+			for (unsigned int k = 0; k < 3; k++) {
+				min[k] = std::min(min[k], centers[m_order[i]*3+k]);
+				max[k] = std::max(max[k], centers[m_order[i]*3+k]);
+			}
+		}
+
+		unsigned int axis = 0;
+		for (unsigned int k = 1; k < 3; k++) {
+			if (max[k]-min[k] > max[axis]-min[axis])
+				axis = k;
+		}
+
+		size_t mid = begin + (end-begin)/2;
+		std::nth_element(m_order.begin()+begin, m_order.begin()+mid, m_order.begin()+end,
+				CenterCompare(centers, axis));
+
+		return mid;
+	}
+
+	/**
+	 * Builds the node with index <code>index</code> for the cells [begin, end)
+	 */
+	void buildNode(size_t index, size_t begin, size_t end,
+			const std::vector<double> &boxes, const std::vector<double> &centers)
+	{
+		// Split into 4 ranges
+		size_t bounds[WIDTH+1];
+		bounds[0] = begin;
+		bounds[4] = end;
+		bounds[2] = split(begin, end, centers);
+		bounds[1] = split(begin, bounds[2], centers);
+		bounds[3] = split(bounds[2], end, centers);
+
+		Node node;
+		initNode(node);
+
+		for (unsigned int i = 0; i < WIDTH; i++) {
+			if (bounds[i] == bounds[i+1])
+				continue;
+
+			if (bounds[i+1] - bounds[i] <= LEAF_SIZE) {
+				setLeaf(node, i, bounds[i], bounds[i+1], boxes);
+			} else {
+				setBox(node, i, bounds[i], bounds[i+1], boxes);
+				node.child[i] = m_nodes.size();
+				m_nodes.push_back(Node());
+			}
+		}
+
+		m_nodes[index] = node;
+
+		// Build the children depth first (after the node is complete since m_nodes may be reallocated)
+		for (unsigned int i = 0; i < WIDTH; i++) {
+			if (node.count[i] == 0 && bounds[i] != bounds[i+1])
+				buildNode(node.child[i], bounds[i], bounds[i+1], boxes, centers);
+		}
+	}
+
+	/**
+	 * Copies the coordinates of the cells in leaf order
+	 */
+	template<typename T>
+	bool setCoords(const T* cells, const double* coords)
+	{
+		m_coords.resize(m_order.size() * NUM_VERTICES * 3);
+		for (size_t i = 0; i < m_order.size(); i++) {
+			for (unsigned int j = 0; j < NUM_VERTICES; j++) {
+				size_t v = static_cast<size_t>(cells[m_order[i]*NUM_VERTICES+j]);
+				for (unsigned int k = 0; k < 3; k++)
+					m_coords[(i*NUM_VERTICES+j)*3+k] = coords[v*3+k];
+			}
+		}
+
+		return true;
+	}
+
+	/**
+	 * @return 6 times the signed volume of the tetrahedron (a, b, c, d)
+	 */
+	static double orient(const double* a, const double* b, const double* c, const double* d)
+	{
+		double ax = b[0]-a[0]; double ay = b[1]-a[1]; double az = b[2]-a[2];
+		double bx = c[0]-a[0]; double by = c[1]-a[1]; double bz = c[2]-a[2];
+		double cx = d[0]-a[0]; double cy = d[1]-a[1]; double cz = d[2]-a[2];
+
+		return ax*(by*cz - bz*cy) - ay*(bx*cz - bz*cx) + az*(bx*cy - by*cx);
+	}
+
+	/**
+	 * @param pos The position of the cell in leaf order
+	 */
+	bool contains(size_t pos, const double* point, double tolerance) const
+	{
+		const double* v0 = &m_coords[pos*NUM_VERTICES*3];
+		const double* v1 = v0 + 3;
+		const double* v2 = v0 + 6;
+		const double* v3 = v0 + 9;
+
+		double volume = orient(v0, v1, v2, v3);
+		if (volume == 0)
+			return false;
+
+		// Barycentric coordinates (scaled by the volume)
+		double eps = -tolerance * std::abs(volume);
+		double sign = (volume > 0 ? 1. : -1.);
+
+		return orient(point, v1, v2, v3) * sign >= eps
+			&& orient(v0, point, v2, v3) * sign >= eps
+			&& orient(v0, v1, point, v3) * sign >= eps
+			&& orient(v0, v1, v2, point) * sign >= eps;
+	}
+
+private:
+	/**
+	 * Compares cells by the center on one axis
+	 */
+	class CenterCompare
+	{
+	private:
+		const std::vector<double> &m_centers;
+		unsigned int m_axis;
+
+	public:
+		CenterCompare(const std::vector<double> &centers, unsigned int axis)
+			: m_centers(centers), m_axis(axis)
+		{
+		}
+
+		bool operator()(unsigned long a, unsigned long b) const
+		{
+			return m_centers[a*3+m_axis] < m_centers[b*3+m_axis];
+		}
+	};
+
+public:
+	static const char* GROUP_NODE;
+	static const char* GROUP_ORDER;
+
+private:
+	static const char* DIM_BOX;
+	static const char* DIM_LINK;
+
+	static const char* ENTITY_BOX;
+	static const char* ENTITY_LINK;
+	static const char* ENTITY_ORDER;
+};
+
+}
+
+#endif // PUML_TET_BVH_H
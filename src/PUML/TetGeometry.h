@@ -0,0 +1,485 @@
+/**
+ * @file
+ *  This file is part of PUML
+ *
+ *  For conditions of distribution and use, please see the copyright
+ *  notice in the file 'COPYING' at the root directory of this package
+ *  and the copyright notice at https://github.com/TUM-I5/PUML
+ *
+ * @copyright 2013 Technische Universitaet Muenchen
+ * @author Sebastian Rettenberger <rettenbs@in.tum.de>
+ */
+
+#ifndef PUML_TET_GEOMETRY_H
+#define PUML_TET_GEOMETRY_H
+
+#ifdef PARALLEL
+#include <mpi.h>
+#endif // PARALLEL
+
+#include <cmath>
+#include <vector>
+
+#include "PUML/CellType.h"
+#include "PUML/Dimension.h"
+#include "PUML/Entity.h"
+#include "PUML/Group.h"
+#include "PUML/Type.h"
+
+namespace PUML
+{
+
+/**
+ * Geometry and quality of the tetrahedra in one partition
+ *
+ * Vertex coordinates are gathered into a structure of arrays layout
+ * (one array per coordinate and cell vertex) before the kernels run. All
+ * kernels are branch free loops over the cells and can be vectorized by the
+ * compiler.
+ *
+ * Cells reference vertices by their position in the partition of the vertex
+ * group with the same partition id.
+ */
+class TetGeometry
+{
+public:
+	/**
+	 * Values that should be computed (can be combined)
+	 */
+	enum Option
+	{
+		VOLUME = 1,
+		CENTROID = 2,
+		JACOBIAN = 4,
+		QUALITY = 8,
+		ALL = VOLUME | CENTROID | JACOBIAN | QUALITY
+	};
+
+	/**
+	 * Result of the validation of one partition
+	 */
+	struct Report
+	{
+		/** Number of cells with negative volume */
+		unsigned long inverted;
+		/** Number of cells with (almost) zero volume */
+		unsigned long degenerate;
+	};
+
+private:
+	static const unsigned int NUM_VERTICES = CellTraits<TETRAHEDRON>::NUM_VERTICES;
+
+	/** Number of cells */
+	size_t m_numCells;
+
+	/** Computed values */
+	int m_options;
+
+	/** Coordinates: [dimension][vertex][cell] */
+	std::vector<double> m_coords;
+
+	/** Volume of each cell */
+	std::vector<double> m_volume;
+
+	/** Centroids: [dimension][cell] */
+	std::vector<double> m_centroid;
+
+	/** Jacobians: [row*3+column][cell] */
+	std::vector<double> m_jacobian;
+
+	/** Quality of each cell (1 for the regular tetrahedron, <= 0 for inverted cells) */
+	std::vector<double> m_quality;
+
+public:
+	TetGeometry()
+		: m_numCells(0), m_options(0)
+	{
+	}
+
+	/**
+	 * Compute the geometry of tetrahedra
+	 *
+	 * @param cells The vertices of the cells, 4 per cell
+	 * @param coords The coordinates of the vertices, 3 per vertex
+	 * @param options Values that should be computed (see Option)
+	 */
+	template<typename T>
+	bool compute(size_t numCells, const T* cells, size_t numVertices, const double* coords, int options = ALL)
+	{
+		m_numCells = numCells;
+		m_options = options;
+
+		// Gather coordinates
+		m_coords.resize(3 * NUM_VERTICES * numCells);
+		for (size_t i = 0; i < numCells; i++) {
+			for (unsigned int j = 0; j < NUM_VERTICES; j++) {
+				size_t v = static_cast<size_t>(cells[i*NUM_VERTICES+j]);
+				if (v >= numVertices)
+					return false;
+
+				for (unsigned int k = 0; k < 3; k++)
+					m_coords[(k*NUM_VERTICES + j)*numCells + i] = coords[v*3+k];
+			}
+		}
+
+		if (options & (VOLUME | QUALITY)) {
+			m_volume.resize(numCells);
+			computeVolume();
+		}
+		if (options & CENTROID) {
+			m_centroid.resize(3*numCells);
+			computeCentroid();
+		}
+		if (options & JACOBIAN) {
+			m_jacobian.resize(9*numCells);
+			computeJacobian();
+		}
+		if (options & QUALITY) {
+			m_quality.resize(numCells);
+			computeQuality();
+		}
+
+		return true;
+	}
+
+	/**
+	 * Read cells and coordinates of a partition and compute the geometry
+	 *
+	 * In mixed cell groups only the tetrahedra are loaded. In the parallel version
+	 * this is a collective function if the vertex group is indexed.
+	 *
+	 * @param coordinates Name of the coordinate entity in the vertex group
+	 */
+	bool load(Group &cellGroup, Group &vertexGroup, const char* coordinates, size_t partition, int options = ALL)
+	{
+		Entity* coordEntity = vertexGroup.getEntity(coordinates);
+		if (!coordEntity)
+			return false;
+
+		Entity* vertexEntity = 0L;
+		if (!cellGroup.mixed()) {
+			vertexEntity = cellGroup.getEntity("vertex");
+			if (!vertexEntity)
+				return false;
+		}
+
+		// Read the coordinates even if the cells fail, the read may be collective
+		bool success = true;
+		std::vector<long> cells;
+		if (cellGroup.mixed()) {
+			cells.resize(cellGroup.numCells<TETRAHEDRON>(partition) * NUM_VERTICES);
+			if (!cells.empty() && !cellGroup.getCells<TETRAHEDRON>(partition, &cells[0]))
+				success = false;
+		} else {
+			cells.resize(cellGroup.size(partition) * NUM_VERTICES);
+			if (!cells.empty() && !vertexEntity->get(partition, &cells[0]))
+				success = false;
+		}
+
+		size_t numVertices = vertexGroup.size(partition);
+		std::vector<double> coords(numVertices * 3);
+		if (!coordEntity->get(partition, numVertices, (coords.empty() ? 0L : &coords[0])))
+			success = false;
+		if (!success)
+			return false;
+
+		return compute(cells.size() / NUM_VERTICES, (cells.empty() ? 0L : &cells[0]),
+				numVertices, (coords.empty() ? 0L : &coords[0]), options);
+	}
+
+	/**
+	 * Count inverted and degenerate cells
+	 *
+	 * Requires the QUALITY option.
+	 *
+	 * @param tolerance Cells with a quality smaller than this are degenerate
+	 */
+	bool validate(Report &report, double tolerance = 1e-8) const
+	{
+		if (!(m_options & QUALITY))
+			return false;
+
+		unsigned long inverted = 0;
+		unsigned long degenerate = 0;
+		for (size_t i = 0; i < m_numCells; i++) {
+			inverted += (m_quality[i] < -tolerance);
+			degenerate += (std::abs(m_quality[i]) <= tolerance);
+		}
+
+		report.inverted = inverted;
+		report.degenerate = degenerate;
+
+		return true;
+	}
+
+	size_t numCells() const
+	{
+		return m_numCells;
+	}
+
+	const double* volume() const
+	{
+		return &m_volume[0];
+	}
+
+	/**
+	 * @return The component of all centroids
+	 */
+	const double* centroid(unsigned int dim) const
+	{
+		return &m_centroid[dim*m_numCells];
+	}
+
+	/**
+	 * @return The entry of all jacobians
+	 */
+	const double* jacobian(unsigned int row, unsigned int column) const
+	{
+		return &m_jacobian[(row*3+column)*m_numCells];
+	}
+
+	const double* quality() const
+	{
+		return &m_quality[0];
+	}
+
+	/**
+	 * Create entities to store the geometry in a cell group. Must be called
+	 * in the definition phase.
+	 *
+	 * @param options The values that should be stored
+	 */
+	static bool createEntities(Group &cellGroup, int options = VOLUME | CENTROID | QUALITY)
+	{
+		if (options & VOLUME) {
+			if (!cellGroup.createEntity(ENTITY_VOLUME, Type::Double))
+				return false;
+		}
+		if (options & CENTROID) {
+			Dimension &dim = cellGroup.createDimension(DIM_CENTROID, 3);
+			if (!cellGroup.createEntity(ENTITY_CENTROID, Type::Double, 1, &dim))
+				return false;
+		}
+		if (options & JACOBIAN) {
+			Dimension &dim = cellGroup.createDimension(DIM_JACOBIAN, 9);
+			if (!cellGroup.createEntity(ENTITY_JACOBIAN, Type::Double, 1, &dim))
+				return false;
+		}
+		if (options & QUALITY) {
+			if (!cellGroup.createEntity(ENTITY_QUALITY, Type::Double))
+				return false;
+		}
+
+		return true;
+	}
+
+	/**
+	 * Store the computed values in the entities of a cell group
+	 *
+	 * Only values with an existing entity are stored. Not supported for mixed
+	 * cell groups.
+	 *
+	 * @see createEntities
+	 */
+	bool put(Group &cellGroup, size_t partition) const
+	{
+		if (cellGroup.mixed() || cellGroup.size(partition) != m_numCells)
+			return false;
+
+		Entity* entity = cellGroup.getEntity(ENTITY_VOLUME);
+		if (entity && (m_options & (VOLUME | QUALITY))) {
+			if (!entity->put(partition, m_numCells, &m_volume[0]))
+				return false;
+		}
+
+		entity = cellGroup.getEntity(ENTITY_CENTROID);
+		if (entity && (m_options & CENTROID)) {
+			std::vector<double> buf;
+			soa2aos(m_centroid, 3, buf);
+			if (!entity->put(partition, m_numCells, &buf[0]))
+				return false;
+		}
+
+		entity = cellGroup.getEntity(ENTITY_JACOBIAN);
+		if (entity && (m_options & JACOBIAN)) {
+			std::vector<double> buf;
+			soa2aos(m_jacobian, 9, buf);
+			if (!entity->put(partition, m_numCells, &buf[0]))
+				return false;
+		}
+
+		entity = cellGroup.getEntity(ENTITY_QUALITY);
+		if (entity && (m_options & QUALITY)) {
+			if (!entity->put(partition, m_numCells, &m_quality[0]))
+				return false;
+		}
+
+		return true;
+	}
+
+	/**
+	 * Validate a list of partitions
+	 *
+	 * In the parallel version this is a collective function. Each partition
+	 * must be listed on exactly one rank and all ranks must list the same
+	 * number of partitions. The reports of all partitions are available on
+	 * all ranks.
+	 *
+	 * @param reports Will contain one report for each partition in the file
+	 */
+	static bool validate(Group &cellGroup, Group &vertexGroup, const char* coordinates,
+			size_t numPartitions, const size_t* partitions, std::vector<Report> &reports,
+#ifdef PARALLEL
+			MPI_Comm comm,
+#endif // PARALLEL
+			double tolerance = 1e-8)
+	{
+		// Use two arrays with unsigned long for the reduction
+		std::vector<unsigned long> counts(2*cellGroup.numPartitions(), 0);
+
+		TetGeometry geometry;
+		int success = 1;
+		for (size_t i = 0; i < numPartitions; i++) {
+			Report report;
+			success = geometry.load(cellGroup, vertexGroup, coordinates, partitions[i], QUALITY)
+					&& geometry.validate(report, tolerance);
+
+#ifdef PARALLEL
+			// All ranks have to stop, otherwise the reads of the next partition deadlock
+			MPI_Allreduce(MPI_IN_PLACE, &success, 1, MPI_INT, MPI_MIN, comm);
+#endif // PARALLEL
+			if (!success)
+				break;
+
+			counts[2*partitions[i]] = report.inverted;
+			counts[2*partitions[i]+1] = report.degenerate;
+		}
+
+#ifdef PARALLEL
+		MPI_Allreduce(MPI_IN_PLACE, &counts[0], counts.size(), MPI_UNSIGNED_LONG, MPI_SUM, comm);
+#endif // PARALLEL
+
+		reports.resize(cellGroup.numPartitions());
+		for (size_t i = 0; i < reports.size(); i++) {
+			reports[i].inverted = counts[2*i];
+			reports[i].degenerate = counts[2*i+1];
+		}
+
+		return success != 0;
+	}
+
+private:
+	/**
+	 * @return Pointer to the coordinates of a vertex
+	 */
+	const double* coord(unsigned int dim, unsigned int vertex) const
+	{
+		return &m_coords[(dim*NUM_VERTICES + vertex)*m_numCells];
+	}
+
+	void computeVolume()
+	{
+		const double* x0 = coord(0, 0); const double* y0 = coord(1, 0); const double* z0 = coord(2, 0);
+		const double* x1 = coord(0, 1); const double* y1 = coord(1, 1); const double* z1 = coord(2, 1);
+		const double* x2 = coord(0, 2); const double* y2 = coord(1, 2); const double* z2 = coord(2, 2);
+		const double* x3 = coord(0, 3); const double* y3 = coord(1, 3); const double* z3 = coord(2, 3);
+		double* volume = &m_volume[0];
+
+		for (size_t i = 0; i < m_numCells; i++) {
+			double ax = x1[i]-x0[i]; double ay = y1[i]-y0[i]; double az = z1[i]-z0[i];
+			double bx = x2[i]-x0[i]; double by = y2[i]-y0[i]; double bz = z2[i]-z0[i];
+			double cx = x3[i]-x0[i]; double cy = y3[i]-y0[i]; double cz = z3[i]-z0[i];
+
+			volume[i] = (ax*(by*cz - bz*cy) - ay*(bx*cz - bz*cx) + az*(bx*cy - by*cx)) * (1./6.);
+		}
+	}
+
+	void computeCentroid()
+	{
+		for (unsigned int d = 0; d < 3; d++) {
+			const double* c0 = coord(d, 0);
+			const double* c1 = coord(d, 1);
+			const double* c2 = coord(d, 2);
+			const double* c3 = coord(d, 3);
+			double* centroid = &m_centroid[d*m_numCells];
+
+			for (size_t i = 0; i < m_numCells; i++)
+				centroid[i] = (c0[i] + c1[i] + c2[i] + c3[i]) * 0.25;
+		}
+	}
+
+	void computeJacobian()
+	{
+		// J[row][column] = x_{column+1}[row] - x_0[row]
+		for (unsigned int r = 0; r < 3; r++) {
+			const double* c0 = coord(r, 0);
+			for (unsigned int c = 0; c < 3; c++) {
+				const double* c1 = coord(r, c+1);
+				double* jacobian = &m_jacobian[(r*3+c)*m_numCells];
+
+				for (size_t i = 0; i < m_numCells; i++)
+					jacobian[i] = c1[i] - c0[i];
+			}
+		}
+	}
+
+	/**
+	 * Computes the volume-length quality measure
+	 * q = 6 * sqrt(2) * V / l_rms^3
+	 * Requires the volume
+	 */
+	void computeQuality()
+	{
+		std::vector<double> lengthSq(m_numCells, 0.);
+		double* l = &lengthSq[0];
+
+		// Sum of the squared length of all 6 edges
+		for (unsigned int v0 = 0; v0 < NUM_VERTICES; v0++) {
+			for (unsigned int v1 = v0+1; v1 < NUM_VERTICES; v1++) {
+				for (unsigned int d = 0; d < 3; d++) {
+					const double* c0 = coord(d, v0);
+					const double* c1 = coord(d, v1);
+
+					for (size_t i = 0; i < m_numCells; i++)
+						l[i] += (c1[i]-c0[i]) * (c1[i]-c0[i]);
+				}
+			}
+		}
+
+		const double* volume = &m_volume[0];
+		double* quality = &m_quality[0];
+		const double scale = 6. * std::sqrt(2.);
+		for (size_t i = 0; i < m_numCells; i++) {
+			double lrms = std::sqrt(l[i] * (1./6.));
+			double lrms3 = lrms * lrms * lrms;
+			// Avoid division by zero for collapsed cells
+			quality[i] = (lrms3 > 0 ? scale * volume[i] / lrms3 : 0.);
+		}
+	}
+
+	/**
+	 * Converts a SoA array to AoS
+	 */
+	void soa2aos(const std::vector<double> &soa, unsigned int numComponents, std::vector<double> &aos) const
+	{
+		aos.resize(soa.size());
+		for (unsigned int j = 0; j < numComponents; j++) {
+			for (size_t i = 0; i < m_numCells; i++)
+				aos[i*numComponents+j] = soa[j*m_numCells+i];
+		}
+	}
+
+public:
+	static const char* ENTITY_VOLUME;
+	static const char* ENTITY_CENTROID;
+	static const char* ENTITY_JACOBIAN;
+	static const char* ENTITY_QUALITY;
+
+private:
+	static const char* DIM_CENTROID;
+	static const char* DIM_JACOBIAN;
+};
+
+}
+
+#endif // PUML_TET_GEOMETRY_H
@@ -0,0 +1,237 @@
+/**
+ * @file
+ *  This file is part of PUML
+ *
+ *  For conditions of distribution and use, please see the copyright
+ *  notice in the file 'COPYING' at the root directory of this package
+ *  and the copyright notice at https://github.com/TUM-I5/PUML
+ *
+ * @copyright 2013 Technische Universitaet Muenchen
+ * @author Sebastian Rettenberger <rettenbs@in.tum.de>
+ */
+
+#ifndef PUML_TYPED_ENTITY_H
+#define PUML_TYPED_ENTITY_H
+
+#ifdef PARALLEL
+#include <netcdf_par.h>
+#endif // PARALLEL
+#include <netcdf.h>
+
+#include <cstddef>
+#include <vector>
+
+#include "PUML/Entity.h"
+#include "PUML/NetcdfEntity.h"
+
+namespace PUML
+{
+
+/**
+ * Maps C++ types to netCDF types and access functions
+ */
+template<typename T>
+struct NetcdfTraits;
+
+#define PUML_NETCDF_TRAITS(T, NC_TYPE, SUFFIX) \
+	template<> \
+	struct NetcdfTraits<T> \
+	{ \
+		static const nc_type TYPE = NC_TYPE; \
+		static int get(int ncId, int varId, const size_t* start, const size_t* count, T* values) \
+		{ return nc_get_vara_##SUFFIX(ncId, varId, start, count, values); } \
+		static int put(int ncId, int varId, const size_t* start, const size_t* count, const T* values) \
+		{ return nc_put_vara_##SUFFIX(ncId, varId, start, count, values); } \
+	};
+
+PUML_NETCDF_TRAITS(signed char, NC_BYTE, schar)
+PUML_NETCDF_TRAITS(unsigned char, NC_UBYTE, uchar)
+PUML_NETCDF_TRAITS(short, NC_SHORT, short)
+PUML_NETCDF_TRAITS(unsigned short, NC_USHORT, ushort)
+PUML_NETCDF_TRAITS(int, NC_INT, int)
+PUML_NETCDF_TRAITS(unsigned int, NC_UINT, uint)
+PUML_NETCDF_TRAITS(long, NC_INT64, long)
+PUML_NETCDF_TRAITS(long long, NC_INT64, longlong)
+PUML_NETCDF_TRAITS(unsigned long long, NC_UINT64, ulonglong)
+PUML_NETCDF_TRAITS(float, NC_FLOAT, float)
+PUML_NETCDF_TRAITS(double, NC_DOUBLE, double)
+
+#undef PUML_NETCDF_TRAITS
+
+template<>
+struct NetcdfTraits<unsigned long>
+{
+	static_assert(sizeof(unsigned long) == sizeof(unsigned long long), "unsigned long must have 64 bit");
+
+	static const nc_type TYPE = NC_UINT64;
+	static int get(int ncId, int varId, const size_t* start, const size_t* count, unsigned long* values)
+	{ return nc_get_vara_ulonglong(ncId, varId, start, count, reinterpret_cast<unsigned long long*>(values)); }
+	static int put(int ncId, int varId, const size_t* start, const size_t* count, const unsigned long* values)
+	{ return nc_put_vara_ulonglong(ncId, varId, start, count, reinterpret_cast<const unsigned long long*>(values)); }
+};
+
+/**
+ * Product of the user dimensions
+ */
+template<size_t... Dims>
+struct DimProduct;
+
+template<>
+struct DimProduct<>
+{
+	static const size_t VALUE = 1;
+};
+
+template<size_t Dim, size_t... Dims>
+struct DimProduct<Dim, Dims...>
+{
+	static const size_t VALUE = Dim * DimProduct<Dims...>::VALUE;
+};
+
+/**
+ * A typed handle for an entity with fixed user dimensions
+ *
+ * The type and the dimensions are checked once in bind(). Afterwards all
+ * accesses call netCDF directly without virtual functions or temporary
+ * extent vectors. The type <code>T</code> must match the type in the file.
+ *
+ * Only entities of groups without an index and without a time dimension
+ * are supported. Files with subfiles are not supported. Accesses are counted in the I/O counters of the entity
+ * but not timed.
+ *
+ * Example: <code>TypedEntity<double, 3> coords; coords.bind(entity);</code>
+ */
+template<typename T, size_t... UserDims>
+class TypedEntity
+{
+public:
+	/** Number of values per element */
+	static const size_t NUM_COMPONENTS = DimProduct<UserDims...>::VALUE;
+
+	/** Number of dimensions (including the partition dimension) */
+	static const size_t NUM_DIMS = sizeof...(UserDims) + 1;
+
+private:
+	/** The entity */
+	NetcdfEntity* m_entity;
+
+	/** netCDF identifier of the group */
+	int m_ncGroup;
+
+	/** netCDF identifier of the variable */
+	int m_ncVar;
+
+	/** Start of the next access */
+	size_t m_start[NUM_DIMS];
+
+	/** Count of the next access */
+	size_t m_count[NUM_DIMS];
+
+public:
+	TypedEntity()
+		: m_entity(0L), m_ncGroup(-1), m_ncVar(-1)
+	{
+		const size_t dims[NUM_DIMS] = {0, UserDims...};
+		for (size_t i = 0; i < NUM_DIMS; i++) {
+			m_start[i] = 0;
+			m_count[i] = dims[i];
+		}
+	}
+
+	/**
+	 * Binds the handle to an entity
+	 *
+	 * @return False if type or dimensions do not match, the entity is indexed
+	 *  or stored in subfiles
+	 */
+	bool bind(Entity* entity)
+	{
+		m_entity = 0L;
+
+		NetcdfEntity* ncEntity = dynamic_cast<NetcdfEntity*>(entity);
+		if (!ncEntity || ncEntity->indexed() || ncEntity->timeDependent() || ncEntity->m_router)
+			return false;
+
+		if (ncEntity->dimSize().size() != NUM_DIMS)
+			return false;
+		for (size_t i = 1; i < NUM_DIMS; i++) {
+			if (ncEntity->dimSize()[i] != m_count[i])
+				return false;
+		}
+
+		nc_type type;
+		if (ncEntity->checkError(nc_inq_vartype(ncEntity->parentIdentifier(), ncEntity->identifier(), &type)))
+			return false;
+		if (type != NetcdfTraits<T>::TYPE)
+			return false;
+
+		m_entity = ncEntity;
+		m_ncGroup = ncEntity->parentIdentifier();
+		m_ncVar = ncEntity->identifier();
+		return true;
+	}
+
+	/**
+	 * @return True if the handle is bound to an entity
+	 */
+	bool bound() const
+	{
+		return m_entity != 0L;
+	}
+
+	/**
+	 * Get values at absolute position
+	 *
+	 * @param values Buffer for size * NUM_COMPONENTS values
+	 */
+	bool geta(size_t start, size_t size, T* values)
+	{
+		m_start[0] = start;
+		m_count[0] = size;
+
+		m_entity->m_counters.getCalls++;
+		m_entity->m_counters.getBytes += size * NUM_COMPONENTS * sizeof(T);
+
+		return !m_entity->checkError(NetcdfTraits<T>::get(m_ncGroup, m_ncVar, m_start, m_count, values));
+	}
+
+	/**
+	 * Put values at absolute position
+	 *
+	 * @param values size * NUM_COMPONENTS values
+	 */
+	bool puta(size_t start, size_t size, const T* values)
+	{
+		m_start[0] = start;
+		m_count[0] = size;
+
+		m_entity->m_counters.putCalls++;
+		m_entity->m_counters.putBytes += size * NUM_COMPONENTS * sizeof(T);
+
+		return !m_entity->checkError(NetcdfTraits<T>::put(m_ncGroup, m_ncVar, m_start, m_count, values));
+	}
+
+	/**
+	 * Reads elements of a partition
+	 *
+	 * @param start The first element in the partition
+	 */
+	bool get(size_t partition, size_t start, size_t size, T* values)
+	{
+		return geta((*m_entity->m_offset)[partition] + start, size, values);
+	}
+
+	/**
+	 * Writes elements of a partition. Statistics of the entity are not updated.
+	 *
+	 * @param start The first element in the partition
+	 */
+	bool put(size_t partition, size_t start, size_t size, const T* values)
+	{
+		return puta((*m_entity->m_offset)[partition] + start, size, values);
+	}
+};
+
+}
+
+#endif // PUML_TYPED_ENTITY_H
@@ -18,3 +18,7 @@ const int PUML::Pum::FILE_VERSION = 1;
 const char* PUML::Pum::ATT_CONVENTIONS = "Conventions";
 const char* PUML::Pum::ATT_FILE_VERSION = "Version";
 const char* PUML::Pum::ATT_NUM_PARTITIONS = "Partitions";
+const char* PUML::Pum::ATT_CHECKPOINT_PARTITIONS = "CheckpointPartitions";
+const char* PUML::Pum::ATT_CHECKPOINT_TOTAL = "CheckpointTotalPartitions";
+const char* PUML::Pum::ATT_SUBFILES = "Subfiles";
+const char* PUML::Pum::ATT_SUBFILE_RANKS = "SubfileRanks";
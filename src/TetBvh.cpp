@@ -0,0 +1,23 @@
+/**
+ * @file
+ *  This file is part of PUML
+ *
+ *  For conditions of distribution and use, please see the copyright
+ *  notice in the file 'COPYING' at the root directory of this package
+ *  and the copyright notice at https://github.com/TUM-I5/PUML
+ *
+ * @copyright 2013 Technische Universitaet Muenchen
+ * @author Sebastian Rettenberger <rettenbs@in.tum.de>
+ */
+
+#include "PUML/TetBvh.h"
+
+const char* PUML::TetBvh::GROUP_NODE = "bvh_node";
+const char* PUML::TetBvh::GROUP_ORDER = "bvh_order";
+
+const char* PUML::TetBvh::DIM_BOX = "box_values";
+const char* PUML::TetBvh::DIM_LINK = "link_values";
+
+const char* PUML::TetBvh::ENTITY_BOX = "box";
+const char* PUML::TetBvh::ENTITY_LINK = "link";
+const char* PUML::TetBvh::ENTITY_ORDER = "order";
@@ -0,0 +1,21 @@
+/**
+ * @file
+ *  This file is part of PUML
+ *
+ *  For conditions of distribution and use, please see the copyright
+ *  notice in the file 'COPYING' at the root directory of this package
+ *  and the copyright notice at https://github.com/TUM-I5/PUML
+ *
+ * @copyright 2013 Technische Universitaet Muenchen
+ * @author Sebastian Rettenberger <rettenbs@in.tum.de>
+ */
+
+#include "PUML/TetGeometry.h"
+
+const char* PUML::TetGeometry::ENTITY_VOLUME = "volume";
+const char* PUML::TetGeometry::ENTITY_CENTROID = "centroid";
+const char* PUML::TetGeometry::ENTITY_JACOBIAN = "jacobian";
+const char* PUML::TetGeometry::ENTITY_QUALITY = "quality";
+
+const char* PUML::TetGeometry::DIM_CENTROID = "centroid_values";
+const char* PUML::TetGeometry::DIM_JACOBIAN = "jacobian_values";
@@ -0,0 +1,212 @@
+/**
+ * @file
+ *  This file is part of PUML
+ *
+ *  For conditions of distribution and use, please see the copyright
+ *  notice in the file 'COPYING' at the root directory of this package
+ *  and the copyright notice at https://github.com/TUM-I5/PUML
+ *
+ * @copyright 2013 Technische Universitaet Muenchen
+ * @author Sebastian Rettenberger <rettenbs@in.tum.de>
+ */
+
+#ifdef PARALLEL
+#include <mpi.h>
+#endif // PARALLEL
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#include <cxxtest/TestSuite.h>
+
+#include "PUML/Halo.h"
+#include "PUML/NetcdfPum.h"
+
+static const char* TEST_FILENAME = "test.nc.pum";
+
+class TestHalo : public CxxTest::TestSuite
+{
+private:
+	PUML::NetcdfPum m_ncPum;
+
+	/** Partitions of this rank */
+	std::vector<size_t> m_partitions;
+
+public:
+	/**
+	 * Creates a mesh with one tetrahedron per partition. The tetrahedra
+	 * of neighboring partitions share a face. Vertex <code>v</code> is
+	 * located at <code>(v, 0, 0)</code>.
+	 *
+	 * In the parallel version, each rank writes two partitions.
+	 */
+	void setUp()
+	{
+		m_partitions.clear();
+#ifdef PARALLEL
+		int r, s;
+		MPI_Comm_rank(MPI_COMM_WORLD, &r);
+		MPI_Comm_size(MPI_COMM_WORLD, &s);
+		TS_ASSERT(m_ncPum.create(TEST_FILENAME, 2*s, MPI_COMM_WORLD));
+		m_partitions.push_back(r);
+		m_partitions.push_back(r+s);
+#else // PARALLEL
+		TS_ASSERT(m_ncPum.create(TEST_FILENAME, 2));
+		m_partitions.push_back(0);
+		m_partitions.push_back(1);
+#endif // PARALLEL
+
+		PUML::Group* vertexGroup = m_ncPum.createVertexGroup();
+		TS_ASSERT(vertexGroup);
+		PUML::Group* cellGroup = m_ncPum.createCellGroup();
+		TS_ASSERT(cellGroup);
+		TS_ASSERT(cellGroup->createVertexEntity(PUML::TETRAHEDRON));
+
+		PUML::Dimension dim = vertexGroup->createDimension("dimension", 3);
+		TS_ASSERT(vertexGroup->createEntity("coordinate", PUML::Type::Double, 1, &dim));
+		TS_ASSERT(vertexGroup->addStatistics("coordinate"));
+
+		TS_ASSERT(m_ncPum.endDefinition());
+
+		for (std::vector<size_t>::const_iterator p = m_partitions.begin(); p != m_partitions.end(); p++) {
+			TS_ASSERT(vertexGroup->setSize(*p, 4));
+			TS_ASSERT(cellGroup->setSize(*p, 1));
+
+			unsigned long index[] = {*p, *p+1, *p+2, *p+3};
+			TS_ASSERT(vertexGroup->putIndex(*p, 4, index));
+
+			double coordinates[12] = {0};
+			for (int i = 0; i < 4; i++)
+				coordinates[i*3] = index[i];
+			TS_ASSERT(vertexGroup->getEntity("coordinate")->put(*p, 4, coordinates));
+
+			long cells[] = {0, 1, 2, 3};
+			TS_ASSERT(cellGroup->getEntity("vertex")->put(*p, 1, cells));
+		}
+
+		TS_ASSERT(m_ncPum.close());
+
+#ifdef PARALLEL
+		TS_ASSERT(m_ncPum.open(TEST_FILENAME, MPI_COMM_WORLD));
+#else // PARALLEL
+		TS_ASSERT(m_ncPum.open(TEST_FILENAME));
+#endif // PARALLEL
+	}
+
+	void tearDown()
+	{
+		if (!m_ncPum.isValid())
+			TS_FAIL(m_ncPum.errorMsg());
+		TS_ASSERT(m_ncPum.close());
+
+		// Remove generated test file
+		remove(TEST_FILENAME);
+	}
+
+	void testBuild()
+	{
+		PUML::Group* vertexGroup = m_ncPum.getGroup("vertex");
+		PUML::Group* cellGroup = m_ncPum.getGroup("cell");
+		TS_ASSERT(vertexGroup);
+		TS_ASSERT(cellGroup);
+		PUML::Entity* coordinates = vertexGroup->getEntity("coordinate");
+		TS_ASSERT(coordinates);
+
+		size_t numPartitions = vertexGroup->numPartitions();
+
+		std::vector<size_t> partitions(m_partitions);
+#ifdef PARALLEL
+		// The last rank hands its second partition to the first rank
+		int r, s;
+		MPI_Comm_rank(MPI_COMM_WORLD, &r);
+		MPI_Comm_size(MPI_COMM_WORLD, &s);
+		if (s > 1 && r == s-1)
+			partitions.pop_back();
+		if (s > 1 && r == 0)
+			partitions.push_back(2*s-1);
+#endif // PARALLEL
+
+		std::vector<PUML::Halo> halos;
+		TS_ASSERT(PUML::Halo::build(*cellGroup, *vertexGroup, coordinates,
+			partitions.size(), &partitions[0], halos));
+		TS_ASSERT_EQUALS(halos.size(), partitions.size());
+
+		for (size_t i = 0; i < halos.size() && i < partitions.size(); i++) {
+			size_t p = partitions[i];
+			PUML::Halo &halo = halos[i];
+
+			// Tetrahedra share at least one vertex with up to 3 partitions on each side
+			size_t numNeighbors = std::min(p, static_cast<size_t>(3))
+				+ std::min(numPartitions-1-p, static_cast<size_t>(3));
+			TS_ASSERT_EQUALS(halo.neighbors().size(), numNeighbors);
+			TS_ASSERT_EQUALS(halo.ghostCells().size(), numNeighbors);
+			TS_ASSERT_EQUALS(halo.sendCells().size(), numNeighbors);
+			TS_ASSERT_EQUALS(halo.recvCounts()[0], 1);
+			TS_ASSERT_EQUALS(halo.sendCounts()[0], 1);
+
+			if (p == 0) {
+				TS_ASSERT_EQUALS(halo.neighbors()[0], 1ul);
+				TS_ASSERT_EQUALS(halo.ghostVertices().size(), numNeighbors);
+				TS_ASSERT_EQUALS(halo.ghostVertices()[0], 4ul);
+
+				// Vertices of the ghost cell in local numbering
+				unsigned long vertices[] = {1, 2, 3, 4};
+				for (int j = 0; j < 4; j++)
+					TS_ASSERT_EQUALS(halo.ghostCellVertices()[j], vertices[j]);
+			}
+		}
+
+		// Coordinates of the ghost vertices (the same number of collective reads on all ranks)
+		unsigned long numHalos = halos.size();
+#ifdef PARALLEL
+		MPI_Allreduce(MPI_IN_PLACE, &numHalos, 1, MPI_UNSIGNED_LONG, MPI_MAX, MPI_COMM_WORLD);
+#endif // PARALLEL
+		for (size_t i = 0; i < numHalos; i++) {
+			if (i >= halos.size()) {
+				double dummy;
+				TS_ASSERT(coordinates->gather(0L, 0, &dummy));
+				continue;
+			}
+
+			const PUML::Halo &halo = halos[i];
+			std::vector<double> ghostCoordinates(halo.ghostVertices().size() * 3);
+			TS_ASSERT(halos[i].getGhostVertices(*coordinates, ghostCoordinates.empty() ? 0L : &ghostCoordinates[0]));
+			for (size_t j = 0; j < halo.ghostVertices().size(); j++)
+				TS_ASSERT_EQUALS(ghostCoordinates[j*3], static_cast<double>(halo.ghostVertices()[j]));
+		}
+	}
+
+	void testBuildPartition()
+	{
+		PUML::Group* vertexGroup = m_ncPum.getGroup("vertex");
+		PUML::Group* cellGroup = m_ncPum.getGroup("cell");
+		TS_ASSERT(vertexGroup);
+		TS_ASSERT(cellGroup);
+
+		PUML::Halo halo(*cellGroup, *vertexGroup, vertexGroup->getEntity("coordinate"));
+#ifdef PARALLEL
+		// Not all partitions are built -> the neighbors cannot be found
+		TS_ASSERT(!halo.build(m_partitions[0]));
+#else // PARALLEL
+		TS_ASSERT(halo.build(1));
+		TS_ASSERT_EQUALS(halo.neighbors().size(), 1ul);
+		TS_ASSERT_EQUALS(halo.neighbors()[0], 0ul);
+		TS_ASSERT_EQUALS(halo.ghostCells().size(), 1ul);
+#endif // PARALLEL
+	}
+
+#ifndef PARALLEL
+	void testBuildWithoutStatistics()
+	{
+		PUML::Group* vertexGroup = m_ncPum.getGroup("vertex");
+		PUML::Group* cellGroup = m_ncPum.getGroup("cell");
+		TS_ASSERT(vertexGroup);
+		TS_ASSERT(cellGroup);
+
+		// Without bounding boxes, the whole mesh would be read
+		PUML::Halo halo(*cellGroup, *vertexGroup);
+		TS_ASSERT(!halo.build(0));
+	}
+#endif // PARALLEL
+};
@@ -0,0 +1,303 @@
+/**
+ * @file
+ *  This file is part of PUML
+ *
+ *  For conditions of distribution and use, please see the copyright
+ *  notice in the file 'COPYING' at the root directory of this package
+ *  and the copyright notice at https://github.com/TUM-I5/PUML
+ *
+ * @copyright 2013 Technische Universitaet Muenchen
+ * @author Sebastian Rettenberger <rettenbs@in.tum.de>
+ */
+
+#ifdef PARALLEL
+#include <mpi.h>
+#endif // PARALLEL
+
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <cxxtest/TestSuite.h>
+
+#include "PUML/Hdf5Group.h"
+#include "PUML/Hdf5Pum.h"
+#include "PUML/NetcdfGroup.h"
+#include "PUML/NetcdfPum.h"
+#include "PUML/TetBvh.h"
+
+static const char* TEST_FILENAME = "test.h5.pum";
+
+class TestHdf5Pum : public CxxTest::TestSuite
+{
+private:
+	int m_rank;
+
+	int m_size;
+
+public:
+	void setUp()
+	{
+#ifdef PARALLEL
+		MPI_Comm_rank(MPI_COMM_WORLD, &m_rank);
+		MPI_Comm_size(MPI_COMM_WORLD, &m_size);
+#else // PARALLEL
+		m_rank = 0;
+		m_size = 1;
+#endif // PARALLEL
+	}
+
+	void tearDown()
+	{
+		// Remove generated test file
+#ifdef PARALLEL
+		MPI_Barrier(MPI_COMM_WORLD);
+#endif // PARALLEL
+		if (m_rank == 0)
+			remove(TEST_FILENAME);
+	}
+
+	void testCreateGroup()
+	{
+		PUML::Hdf5Pum pum;
+		TS_ASSERT(create(pum));
+
+		// The size is required
+		TS_ASSERT(!pum.createGroup("testGroup"));
+		TS_ASSERT(pum.createGroup("testGroup", 10));
+		TS_ASSERT(pum.endDefinition());
+		TS_ASSERT(pum.close());
+	}
+
+	void testNetcdfToHdf5()
+	{
+		PUML::NetcdfPum ncPum;
+		TS_ASSERT(create(ncPum));
+		PUML::NetcdfGroup* ncGroup = ncPum.createGroup("testGroup", 4*m_size);
+		TS_ASSERT(ncGroup);
+		TS_ASSERT(ncGroup->createEntity("testEntity", PUML::Type::Int));
+		TS_ASSERT(ncPum.endDefinition());
+		TS_ASSERT(putPartition(ncGroup, "testEntity"));
+		TS_ASSERT(ncPum.close());
+
+		PUML::Hdf5Pum pum;
+		TS_ASSERT(open(pum));
+		TS_ASSERT_EQUALS(pum.numPartitions(), static_cast<size_t>(m_size));
+		PUML::Hdf5Group* group = pum.getGroup("testGroup");
+		TS_ASSERT(group);
+		TS_ASSERT(checkPartition(group, "testEntity"));
+		TS_ASSERT(pum.close());
+	}
+
+	void testHdf5ToNetcdf()
+	{
+		PUML::Hdf5Pum pum;
+		pum.setPageSize(4096);
+		TS_ASSERT(create(pum));
+		PUML::Hdf5Group* group = pum.createGroup("testGroup", 4*m_size);
+		TS_ASSERT(group);
+		TS_ASSERT(group->createEntity("testEntity", PUML::Type::Int));
+		TS_ASSERT(pum.endDefinition());
+		TS_ASSERT(putPartition(group, "testEntity"));
+		if (!pum.isValid())
+			TS_FAIL(pum.errorMsg());
+		TS_ASSERT(pum.close());
+
+		PUML::NetcdfPum ncPum;
+		TS_ASSERT(open(ncPum));
+		PUML::NetcdfGroup* ncGroup = ncPum.getGroup("testGroup");
+		TS_ASSERT(ncGroup);
+		TS_ASSERT(checkPartition(ncGroup, "testEntity"));
+		TS_ASSERT(ncPum.close());
+	}
+
+	void testCheckpoint()
+	{
+		PUML::Hdf5Pum pum;
+		pum.setMetadataCache(1 << 22, false);
+		pum.setFlushPolicy(PUML::Pum::FLUSH_BYTES, 1024);
+		TS_ASSERT(create(pum));
+		PUML::Hdf5Group* group = pum.createGroup("testGroup", 4*m_size);
+		TS_ASSERT(group);
+		TS_ASSERT(group->createEntity("testEntity", PUML::Type::Int));
+		PUML::Dimension dim = group->createDimension("testDimension", 256);
+		PUML::Entity* largeEntity = group->createEntity("testLargeEntity", PUML::Type::Int, 1, &dim);
+		TS_ASSERT(largeEntity);
+		TS_ASSERT(pum.endDefinition());
+
+		// Not enough bytes written
+		TS_ASSERT(putPartition(group, "testEntity"));
+		TS_ASSERT(pum.checkpoint());
+		TS_ASSERT_EQUALS(pum.flushedBytes(), 0ul);
+
+		// 1024 bytes on the first rank synchronizes all ranks
+		if (m_rank == 0) {
+			std::vector<int> values(256, 1);
+			TS_ASSERT(largeEntity->put(0, 1, &values[0]));
+		}
+		TS_ASSERT(pum.checkpoint());
+		TS_ASSERT_EQUALS(pum.flushedBytes(), pum.counters().putBytes);
+		if (m_rank == 0)
+			TS_ASSERT_LESS_THAN(1024ul, pum.flushedBytes());
+		if (!pum.isValid())
+			TS_FAIL(pum.errorMsg());
+		TS_ASSERT(pum.close());
+
+		TS_ASSERT(open(pum));
+		group = pum.getGroup("testGroup");
+		TS_ASSERT(group);
+		TS_ASSERT(checkPartition(group, "testEntity"));
+		TS_ASSERT(pum.close());
+	}
+
+	void testRow()
+	{
+		PUML::Hdf5Pum pum;
+		TS_ASSERT(create(pum));
+		PUML::Hdf5Group* group = pum.createGroupIndexed("testGroup", 2*m_size, 2*m_size);
+		TS_ASSERT(group);
+		TS_ASSERT(group->createEntity("a", PUML::Type::Int));
+		TS_ASSERT(group->createEntity("b", PUML::Type::Double));
+		TS_ASSERT(pum.endDefinition());
+
+		// Two non-contiguous elements per partition (in reverse order)
+		int p = m_rank;
+		TS_ASSERT(group->setSize(p, 2));
+		unsigned long index[2] = {static_cast<unsigned long>(p+m_size), static_cast<unsigned long>(p)};
+		TS_ASSERT(group->putIndex(p, 2, index));
+#ifdef PARALLEL
+		MPI_Barrier(MPI_COMM_WORLD);
+#endif // PARALLEL
+
+		int aValues[2] = {p, p+2};
+		double bValues[2] = {p+.5, p+2.5};
+		std::map<std::string, const void*> putValues;
+		putValues["a"] = aValues;
+		putValues["b"] = bValues;
+		TS_ASSERT(group->putRow(p, putValues));
+		TS_ASSERT(pum.close());
+
+		TS_ASSERT(open(pum));
+		group = pum.getGroup("testGroup");
+		TS_ASSERT(group);
+		int aResult[2];
+		double bResult[2];
+		std::map<std::string, void*> getValues;
+		getValues["a"] = aResult;
+		getValues["b"] = bResult;
+		TS_ASSERT(group->getRow(p, getValues));
+		TS_ASSERT_EQUALS(aResult[0], p);
+		TS_ASSERT_EQUALS(aResult[1], p+2);
+		TS_ASSERT_EQUALS(bResult[1], p+2.5);
+		if (!pum.isValid())
+			TS_FAIL(pum.errorMsg());
+		TS_ASSERT(pum.close());
+	}
+
+	void testBvh()
+	{
+		// One cube per partition, shifted in x direction and split into 6 tetrahedra
+		static const unsigned int tets[6][4] = {
+			{0, 1, 3, 7}, {0, 1, 7, 5}, {0, 5, 7, 4},
+			{0, 3, 2, 7}, {0, 2, 6, 7}, {0, 6, 4, 7}};
+		std::vector<double> coords;
+		for (unsigned int c = 0; c < 8; c++) {
+			coords.push_back(c%2 + 2*m_rank);
+			coords.push_back((c/2)%2);
+			coords.push_back(c/4);
+		}
+		std::vector<unsigned long> cells(&tets[0][0], &tets[0][0] + 6*4);
+
+		PUML::TetBvh bvh;
+		TS_ASSERT(bvh.build(6, &cells[0], 8, &coords[0]));
+
+		PUML::Hdf5Pum pum;
+		TS_ASSERT(create(pum));
+		pum.planSize(PUML::TetBvh::GROUP_NODE, m_rank, bvh.numNodes());
+		pum.planSize(PUML::TetBvh::GROUP_ORDER, m_rank, 6);
+		TS_ASSERT(PUML::TetBvh::createGroups(pum));
+		TS_ASSERT(pum.endDefinition());
+		TS_ASSERT(bvh.put(pum, m_rank));
+		if (!pum.isValid())
+			TS_FAIL(pum.errorMsg());
+		TS_ASSERT(pum.close());
+
+		TS_ASSERT(open(pum));
+		PUML::TetBvh stored;
+		TS_ASSERT(stored.get(pum, m_rank, 6, &cells[0], 8, &coords[0]));
+		TS_ASSERT_EQUALS(stored.numNodes(), bvh.numNodes());
+		TS_ASSERT(pum.close());
+
+		// The centroid of each cell is found in the same cell
+		for (unsigned int i = 0; i < 6; i++) {
+			double point[3] = {0, 0, 0};
+			for (unsigned int j = 0; j < 4; j++) {
+				for (unsigned int k = 0; k < 3; k++)
+					point[k] += .25 * coords[tets[i][j]*3+k];
+			}
+			TS_ASSERT_EQUALS(stored.locate(point), static_cast<long>(i));
+			TS_ASSERT_EQUALS(stored.locate(point), bvh.locate(point));
+		}
+	}
+
+private:
+	bool create(PUML::Pum &pum)
+	{
+#ifdef PARALLEL
+		return pum.create(TEST_FILENAME, m_size, MPI_COMM_WORLD);
+#else // PARALLEL
+		return pum.create(TEST_FILENAME, m_size);
+#endif // PARALLEL
+	}
+
+	bool open(PUML::Pum &pum)
+	{
+#ifdef PARALLEL
+		return pum.open(TEST_FILENAME, MPI_COMM_WORLD);
+#else // PARALLEL
+		return pum.open(TEST_FILENAME);
+#endif // PARALLEL
+	}
+
+	/**
+	 * Writes 1+rank values to the partition of this rank
+	 */
+	bool putPartition(PUML::Group* group, const char* name)
+	{
+		int values[4];
+		for (int i = 0; i <= m_rank % 4; i++)
+			values[i] = 100*m_rank + i;
+
+		PUML::Entity* entity = group->getEntity(name);
+		if (!entity)
+			return false;
+
+		return group->setSize(m_rank, m_rank % 4 + 1)
+			&& entity->put(m_rank, m_rank % 4 + 1, values);
+	}
+
+	/**
+	 * Checks the values written by putPartition of the next rank
+	 */
+	bool checkPartition(PUML::Group* group, const char* name)
+	{
+		int p = (m_rank+1) % m_size;
+		if (group->size(p) != static_cast<size_t>(p % 4 + 1))
+			return false;
+
+		PUML::Entity* entity = group->getEntity(name);
+		if (!entity)
+			return false;
+
+		int values[4];
+		if (!entity->get(p, values))
+			return false;
+		for (int i = 0; i <= p % 4; i++) {
+			if (values[i] != 100*p + i)
+				return false;
+		}
+
+		return true;
+	}
+};
@@ -0,0 +1,171 @@
+/**
+ * @file
+ *  This file is part of PUML
+ *
+ *  For conditions of distribution and use, please see the copyright
+ *  notice in the file 'COPYING' at the root directory of this package
+ *  and the copyright notice at https://github.com/TUM-I5/PUML
+ *
+ * @copyright 2013 Technische Universitaet Muenchen
+ * @author Sebastian Rettenberger <rettenbs@in.tum.de>
+ */
+
+#include <mpi.h>
+
+#include <cstdio>
+#include <map>
+#include <string>
+
+#include <cxxtest/TestSuite.h>
+
+#include "PUML/MpiioGroup.h"
+#include "PUML/MpiioPum.h"
+
+static const char* TEST_FILENAME = "test.mpiio.pum";
+
+class TestMpiioPum : public CxxTest::TestSuite
+{
+private:
+	int m_rank;
+
+	int m_size;
+
+	PUML::MpiioPum m_pum;
+
+public:
+	void setUp()
+	{
+		MPI_Comm_rank(MPI_COMM_WORLD, &m_rank);
+		MPI_Comm_size(MPI_COMM_WORLD, &m_size);
+
+		TS_ASSERT(m_pum.create(TEST_FILENAME, 2*m_size, MPI_COMM_WORLD));
+	}
+
+	void tearDown()
+	{
+		if (!m_pum.isValid())
+			TS_FAIL(m_pum.errorMsg());
+		TS_ASSERT(m_pum.close());
+
+		// Remove generated test file
+		MPI_Barrier(MPI_COMM_WORLD);
+		if (m_rank == 0)
+			remove(TEST_FILENAME);
+	}
+
+	void testCreateGroup()
+	{
+		// The size is required
+		TS_ASSERT(!m_pum.createGroup("testGroup"));
+		PUML::MpiioGroup* group = m_pum.createGroup("testGroup", 10);
+		TS_ASSERT(group);
+		TS_ASSERT(m_pum.endDefinition());
+	}
+
+	void testPutGet()
+	{
+		// Each rank writes the partitions r and r+s
+		for (int p = m_rank; p < 2*m_size; p += m_size)
+			m_pum.planSize("testGroup", p, 2+p);
+
+		PUML::MpiioGroup* group = m_pum.createGroup("testGroup");
+		TS_ASSERT(group);
+		PUML::Entity* entity = group->createEntity("testEntity", PUML::Type::Int);
+		TS_ASSERT(entity);
+		TS_ASSERT(!entity->setCollective(false));
+		TS_ASSERT(m_pum.endDefinition());
+
+		for (int p = m_rank; p < 2*m_size; p += m_size) {
+			int values[64];
+			for (int i = 0; i < 2+p; i++)
+				values[i] = 100*p + i;
+			TS_ASSERT(entity->put(p, 2+p, values));
+		}
+		TS_ASSERT(m_pum.close());
+
+		TS_ASSERT(m_pum.open(TEST_FILENAME, MPI_COMM_WORLD));
+		TS_ASSERT_EQUALS(m_pum.numPartitions(), static_cast<size_t>(2*m_size));
+		group = m_pum.getGroup("testGroup");
+		TS_ASSERT(group);
+		entity = group->getEntity("testEntity");
+		TS_ASSERT(entity);
+		TS_ASSERT_EQUALS(std::string(entity->name()), "testEntity");
+
+		// Read a partition of another rank
+		int p = (m_rank+m_size+1) % (2*m_size);
+		TS_ASSERT_EQUALS(group->size(p), static_cast<size_t>(2+p));
+		int values[64];
+		TS_ASSERT(entity->get(p, values));
+		for (int i = 0; i < 2+p; i++)
+			TS_ASSERT_EQUALS(values[i], 100*p + i);
+	}
+
+	void testRow()
+	{
+		PUML::MpiioGroup* group = m_pum.createGroupIndexed("testGroup", 4*m_size, 4*m_size);
+		TS_ASSERT(group);
+		PUML::Entity* a = group->createEntity("a", PUML::Type::Int);
+		TS_ASSERT(a);
+		PUML::Entity* b = group->createEntity("b", PUML::Type::Double);
+		TS_ASSERT(b);
+		TS_ASSERT(m_pum.endDefinition());
+
+		// Two non-contiguous elements per partition
+		for (int p = m_rank; p < 2*m_size; p += m_size) {
+			TS_ASSERT(group->setSize(p, 2));
+			unsigned long index[2] = {static_cast<unsigned long>(p), static_cast<unsigned long>(p+2*m_size)};
+			TS_ASSERT(group->putIndex(p, 2, index));
+		}
+		MPI_Barrier(MPI_COMM_WORLD);
+
+		int p = m_rank;
+		int aValues[2] = {p, p+2};
+		double bValues[2] = {p+.5, p+2.5};
+		std::map<std::string, const void*> putValues;
+		putValues["a"] = aValues;
+		putValues["b"] = bValues;
+		TS_ASSERT(group->putRow(p, putValues));
+
+		MPI_Barrier(MPI_COMM_WORLD);
+
+		int aResult[2];
+		double bResult[2];
+		std::map<std::string, void*> getValues;
+		getValues["a"] = aResult;
+		getValues["b"] = bResult;
+		TS_ASSERT(group->getRow(p, getValues));
+		TS_ASSERT_EQUALS(aResult[0], p);
+		TS_ASSERT_EQUALS(bResult[1], p+2.5);
+	}
+
+	void testDeferredWrites()
+	{
+		PUML::MpiioGroup* group = m_pum.createGroupIndexed("testGroup", 2*m_size, 2*m_size);
+		TS_ASSERT(group);
+		PUML::Entity* entity = group->createEntity("testEntity", PUML::Type::Double);
+		TS_ASSERT(entity);
+		TS_ASSERT(m_pum.endDefinition());
+
+		m_pum.deferWrites();
+
+		int p = m_rank;
+		TS_ASSERT(group->setSize(p, 2));
+		unsigned long index[2] = {static_cast<unsigned long>(p+m_size), static_cast<unsigned long>(p)};
+		TS_ASSERT(group->putIndex(p, 2, index));
+
+		// Reading the index writes the deferred values first
+		int values[2] = {p, p+1};
+		TS_ASSERT(entity->put(p, 2, values));
+
+		// The buffer can be reused
+		values[0] = values[1] = -1;
+
+		TS_ASSERT(m_pum.beginFlush());
+		TS_ASSERT(m_pum.endFlush());
+
+		double result[2];
+		TS_ASSERT(entity->get(p, result));
+		TS_ASSERT_EQUALS(result[0], p);
+		TS_ASSERT_EQUALS(result[1], p+1);
+	}
+};
@@ -14,13 +14,18 @@
 #include <mpi.h>
 #endif // PARALLEL
 
+#include <algorithm>
 #include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
 
 #include <cxxtest/TestSuite.h>
 
 #include "PUML/NetcdfEntity.h"
 #include "PUML/NetcdfGroup.h"
 #include "PUML/NetcdfPum.h"
+#include "PUML/TypedEntity.h"
 
 static const char* TEST_FILENAME = "test.nc.pum";
 
@@ -33,6 +38,7 @@ private:
 	PUML::NetcdfEntity* m_ncEntity0;
 	PUML::NetcdfEntity* m_ncEntity1;
 	PUML::NetcdfEntity* m_ncIndexedEntity;
+	PUML::NetcdfEntity* m_ncIndexedEntity1;
 
 public:
 	void setUp()
@@ -54,6 +60,7 @@ public:
 		PUML::Dimension dim = m_ncGroup->createDimension("testDimension", 2);
 		m_ncEntity1 = m_ncGroup->createEntity("testEntity1", PUML::Type::Float, 1, &dim);
 		TS_ASSERT(m_ncEntity1);
+		TS_ASSERT(m_ncGroup->addStatistics("testEntity1"));
 
 		// Indexed group
 		m_ncIndexedGroup = m_ncPum.createGroupIndexed("testIndexedGroup");
@@ -62,6 +69,12 @@ public:
 		m_ncIndexedEntity = m_ncIndexedGroup->createEntity("testEntity", PUML::Type::Float);
 		TS_ASSERT(m_ncIndexedEntity);
 
+		// Indexed with extra dimension
+		PUML::Dimension indexedDim = m_ncIndexedGroup->createDimension("testDimension", 2);
+		m_ncIndexedEntity1 = m_ncIndexedGroup->createEntity("testEntity1", PUML::Type::Float, 1, &indexedDim);
+		TS_ASSERT(m_ncIndexedEntity1);
+		TS_ASSERT(m_ncIndexedGroup->addStatistics("testEntity1"));
+
 		TS_ASSERT(m_ncPum.endDefinition());
 
 		int r = 0;
@@ -165,6 +178,368 @@ public:
 		TS_ASSERT_EQUALS(values[4], 42);
 	}
 
+	void testAdaptive()
+	{
+		TS_ASSERT(m_ncEntity1->setAdaptive(true));
+		TS_ASSERT(m_ncEntity1->adaptive());
+		TS_ASSERT(m_ncIndexedEntity->setAdaptive(true));
+
+		int r = 0;
+#ifdef PARALLEL
+		MPI_Comm_rank(MPI_COMM_WORLD, &r);
+#endif // PARALLEL
+
+		// Enough calls to try both modes
+		float values[2*5];
+		for (int n = 0; n < 6; n++) {
+			for (int i = 0; i < 2*5; i++)
+				values[i] = i+1000*r+n;
+
+			TS_ASSERT(m_ncEntity1->put(r, 5, values));
+			TS_ASSERT(m_ncIndexedEntity->put(r, 5, values));
+
+#ifdef PARALLEL
+			// Collective I/O is tried first, then independent I/O
+			if (n < 4) {
+				TS_ASSERT_EQUALS(m_ncEntity1->ioCollective(), n < 2);
+				TS_ASSERT_EQUALS(m_ncIndexedEntity->ioCollective(), n < 2);
+			}
+#endif // PARALLEL
+		}
+
+#ifdef PARALLEL
+		// No data on any rank -> independent I/O
+		TS_ASSERT(m_ncEntity1->put(r, 0, values));
+		TS_ASSERT(!m_ncEntity1->ioCollective());
+
+		// A new class of accesses starts with collective I/O again
+		TS_ASSERT(m_ncEntity1->put(r, 1, values));
+		TS_ASSERT(m_ncEntity1->ioCollective());
+#endif // PARALLEL
+
+		// Empty partition on the first rank of an indexed group
+		TS_ASSERT(m_ncIndexedEntity->put(r, (r == 0 ? 0 : 5), values));
+		TS_ASSERT(m_ncIndexedEntity->get(r, (r == 0 ? 0 : 5), values));
+
+		for (int n = 0; n < 6; n++) {
+			TS_ASSERT(m_ncEntity1->get(r, values));
+			for (int i = 0; i < 2*5; i++)
+				TS_ASSERT_EQUALS(values[i], i+1000*r+5);
+
+			TS_ASSERT(m_ncIndexedEntity->get(r, values));
+			for (int i = 0; i < 4; i++)
+				TS_ASSERT_EQUALS(values[i], i+1000*r+5);
+		}
+
+		TS_ASSERT(m_ncEntity1->setAdaptive(false));
+		TS_ASSERT(!m_ncEntity1->adaptive());
+	}
+
+	void testIndexedStatistics()
+	{
+		TS_ASSERT(m_ncIndexedEntity1->setCollective(true));
+
+		int r = 0;
+#ifdef PARALLEL
+		MPI_Comm_rank(MPI_COMM_WORLD, &r);
+#endif // PARALLEL
+
+		// The last element is shared by all ranks
+		float values[2*5];
+		for (int i = 0; i < 2*4; i++)
+			values[i] = i+1000*r;
+		values[8] = 42;
+		values[9] = 43;
+		TS_ASSERT(m_ncIndexedEntity1->put(r, 5, values));
+
+		setUpOpen();
+
+		TS_ASSERT(m_ncIndexedEntity1->setCollective(true));
+
+		// All components of the scattered elements
+		float result[2*5];
+		TS_ASSERT(m_ncIndexedEntity1->get(r, result));
+		for (int i = 0; i < 2*4; i++)
+			TS_ASSERT_EQUALS(result[i], i+1000*r);
+		TS_ASSERT_EQUALS(result[8], 42);
+		TS_ASSERT_EQUALS(result[9], 43);
+
+		double min[2], max[2];
+		TS_ASSERT(m_ncIndexedEntity1->getStatistics(r, min, max));
+		TS_ASSERT_EQUALS(min[0], std::min(1000*r, 42));
+		TS_ASSERT_EQUALS(max[1], std::max(7+1000*r, 43));
+	}
+
+	void testGather()
+	{
+		testPut();
+
+		setUpOpen();
+
+		int r = 0;
+#ifdef PARALLEL
+		MPI_Comm_rank(MPI_COMM_WORLD, &r);
+#endif // PARALLEL
+
+		unsigned long ids[] = {5ul*r+3, 5ul*r, 5ul*r+1, 5ul*r+3};
+		unsigned long rows[] = {3, 0, 1, 3};
+
+		float values[2*4];
+		TS_ASSERT(m_ncEntity1->gather(ids, 4, values));
+		for (int i = 0; i < 4; i++) {
+			TS_ASSERT_EQUALS(values[i*2], 2*rows[i]+1000*r);
+			TS_ASSERT_EQUALS(values[i*2+1], 2*rows[i]+1+1000*r);
+		}
+
+#ifdef PARALLEL
+		// Values of the next rank
+		int s;
+		MPI_Comm_size(MPI_COMM_WORLD, &s);
+		int n = (r+1) % s;
+		unsigned long remoteIds[] = {5ul*n+4, 5ul*n+2};
+		TS_ASSERT(m_ncEntity1->gatherDistributed(remoteIds, 2, values));
+		TS_ASSERT_EQUALS(values[0], 8+1000*n);
+		TS_ASSERT_EQUALS(values[3], 5+1000*n);
+
+		// Different number of accesses on each rank
+		TS_ASSERT(m_ncEntity1->setCollective(true));
+		TS_ASSERT(m_ncEntity1->gather(ids, (r == 0 ? 4 : 1), values));
+		TS_ASSERT_EQUALS(values[0], 6+1000*r);
+
+		// An invalid id on one rank fails on all ranks
+		unsigned long invalidIds[] = {(r == 0 ? 1000000ul : 5ul*n)};
+		TS_ASSERT(!m_ncEntity1->gatherDistributed(invalidIds, 1, values));
+#endif // PARALLEL
+	}
+
+#ifdef PARALLEL
+	void testGetShared()
+	{
+		testPut();
+
+		setUpOpen();
+
+		TS_ASSERT(m_ncEntity1->setCollective(true));
+		TS_ASSERT(m_ncIndexedEntity->setCollective(true));
+
+		// All ranks read the first partition
+		PUML::SharedBuffer<float> buffer;
+		TS_ASSERT(m_ncEntity1->getShared(0, buffer));
+		TS_ASSERT_EQUALS(buffer.size(), 10ul);
+		for (int i = 0; i < 2*5; i++)
+			TS_ASSERT_EQUALS(buffer[i], i);
+
+		TS_ASSERT(m_ncEntity1->getaShared(6, 2, buffer));
+		TS_ASSERT_EQUALS(buffer.size(), 4ul);
+		TS_ASSERT_EQUALS(buffer[0], 1002);
+
+		// Indexed group
+		TS_ASSERT(m_ncIndexedEntity->getShared(0, buffer));
+		TS_ASSERT_EQUALS(buffer.size(), 5ul);
+		for (int i = 0; i < 4; i++)
+			TS_ASSERT_EQUALS(buffer[i], i);
+		TS_ASSERT_EQUALS(buffer[4], 42);
+	}
+#endif // PARALLEL
+
+	void testStatistics()
+	{
+		TS_ASSERT(m_ncEntity1->hasStatistics());
+		TS_ASSERT(!m_ncEntity0->hasStatistics());
+
+		testPut();
+
+		setUpOpen();
+
+		TS_ASSERT(m_ncEntity1->hasStatistics());
+		TS_ASSERT_EQUALS(m_ncEntity1->numComponents(), 2ul);
+
+		int r = 0;
+#ifdef PARALLEL
+		MPI_Comm_rank(MPI_COMM_WORLD, &r);
+#endif // PARALLEL
+
+		double min[2], max[2];
+		TS_ASSERT(m_ncEntity1->getStatistics(r, min, max));
+		TS_ASSERT_EQUALS(min[0], 1000*r);
+		TS_ASSERT_EQUALS(min[1], 1+1000*r);
+		TS_ASSERT_EQUALS(max[0], 8+1000*r);
+		TS_ASSERT_EQUALS(max[1], 9+1000*r);
+
+		// Only the first partition contains this value
+		double queryMin[] = {4, 0};
+		double queryMax[] = {4, 100};
+		std::vector<size_t> partitions;
+		TS_ASSERT(m_ncEntity1->selectPartitions(queryMin, queryMax, partitions));
+		TS_ASSERT_EQUALS(partitions.size(), 1ul);
+		TS_ASSERT_EQUALS(partitions[0], 0ul);
+	}
+
+	void testScan()
+	{
+		testPut();
+
+		setUpOpen();
+
+		int r = 0;
+#ifdef PARALLEL
+		MPI_Comm_rank(MPI_COMM_WORLD, &r);
+#endif // PARALLEL
+
+		std::vector<PUML::Entity*> entities;
+		entities.push_back(m_ncEntity1);
+		entities.push_back(m_ncEntity0);
+		std::vector<size_t> partitions(1, r);
+
+		// 20 bytes per element -> 2 elements per chunk
+		PUML::Scanner scanner = m_ncPum.scan(entities, 40, partitions);
+		size_t numChunks = 0;
+		size_t pos = 0;
+		while (scanner.next()) {
+			TS_ASSERT_EQUALS(scanner.partition(), static_cast<size_t>(r));
+			TS_ASSERT_EQUALS(scanner.start(), pos);
+			TS_ASSERT_LESS_THAN_EQUALS(scanner.size(), 2ul);
+
+			for (size_t i = 0; i < scanner.size(); i++) {
+				TS_ASSERT_EQUALS(scanner.ids()[i], 5*r + pos + i);
+				TS_ASSERT_EQUALS(scanner.values<float>(0)[i*2], 2*(pos+i)+1000*r);
+				TS_ASSERT_EQUALS(scanner.values<int>(1)[i], 1000*r + static_cast<int>(pos+i));
+			}
+
+			pos += scanner.size();
+			numChunks++;
+		}
+		TS_ASSERT(!scanner.failed());
+		TS_ASSERT_EQUALS(pos, 5ul);
+		TS_ASSERT_EQUALS(numChunks, 3ul);
+
+		// Indexed group
+		entities.assign(1, m_ncIndexedEntity);
+		scanner = m_ncPum.scan(entities, 1000, partitions);
+		TS_ASSERT(scanner.next());
+		TS_ASSERT_EQUALS(scanner.size(), 5ul);
+		for (int i = 0; i < 4; i++)
+			TS_ASSERT_EQUALS(scanner.values<float>(0)[i], i+1000*r);
+		TS_ASSERT_EQUALS(scanner.values<float>(0)[4], 42);
+		TS_ASSERT(!scanner.next());
+	}
+
+	void testRow()
+	{
+		testPut();
+
+		int r = 0;
+		int s = 1;
+#ifdef PARALLEL
+		MPI_Comm_rank(MPI_COMM_WORLD, &r);
+		MPI_Comm_size(MPI_COMM_WORLD, &s);
+#endif // PARALLEL
+
+		int values0[5];
+		for (int i = 0; i < 5; i++)
+			values0[i] = i-1000*r;
+		float values1[2*5] = {0};
+
+		std::map<std::string, const void*> putValues;
+		putValues["testEntity0"] = values0;
+		TS_ASSERT(m_ncGroup->putRow(r+s, putValues));
+
+		// Entities with statistics are not supported
+		putValues["testEntity1"] = values1;
+		TS_ASSERT(!m_ncGroup->putRow(r+s, putValues));
+
+		setUpOpen();
+
+		TS_ASSERT(m_ncEntity0->setCollective(true));
+		TS_ASSERT(m_ncIndexedEntity->setCollective(true));
+
+		std::map<std::string, void*> getValues;
+		getValues["testEntity0"] = values0;
+		getValues["testEntity1"] = values1;
+		TS_ASSERT(m_ncGroup->getRow(r, getValues));
+		for (int i = 0; i < 5; i++)
+			TS_ASSERT_EQUALS(values0[i], i+1000*r);
+		for (int i = 0; i < 2*5; i++)
+			TS_ASSERT_EQUALS(values1[i], i+1000*r);
+
+		getValues.erase("testEntity1");
+		TS_ASSERT(m_ncGroup->getRow(r+s, getValues));
+		for (int i = 0; i < 5; i++)
+			TS_ASSERT_EQUALS(values0[i], i-1000*r);
+
+		// Indexed group
+		getValues.clear();
+		getValues["testEntity"] = values1;
+		TS_ASSERT(m_ncIndexedGroup->getRow(r, getValues));
+		for (int i = 0; i < 4; i++)
+			TS_ASSERT_EQUALS(values1[i], i+1000*r);
+		TS_ASSERT_EQUALS(values1[4], 42);
+	}
+
+	void testTypedEntity()
+	{
+		testPut();
+
+		setUpOpen();
+
+		int r = 0;
+#ifdef PARALLEL
+		MPI_Comm_rank(MPI_COMM_WORLD, &r);
+#endif // PARALLEL
+
+		PUML::TypedEntity<float, 2> entity1;
+		TS_ASSERT(!entity1.bound());
+		TS_ASSERT(entity1.bind(m_ncEntity1));
+		TS_ASSERT(entity1.bound());
+
+		float values[2*5];
+		TS_ASSERT(entity1.get(r, 0, 5, values));
+		for (int i = 0; i < 2*5; i++)
+			TS_ASSERT_EQUALS(values[i], i+1000*r);
+
+		TS_ASSERT(entity1.get(r, 3, 2, values));
+		for (int i = 0; i < 2*2; i++)
+			TS_ASSERT_EQUALS(values[i], i+6+1000*r);
+
+		PUML::TypedEntity<int> entity0;
+		TS_ASSERT(entity0.bind(m_ncEntity0));
+
+		// Wrong type, wrong dimension, indexed group
+		PUML::TypedEntity<double, 2> wrongType;
+		TS_ASSERT(!wrongType.bind(m_ncEntity1));
+		PUML::TypedEntity<float, 3> wrongDim;
+		TS_ASSERT(!wrongDim.bind(m_ncEntity1));
+		PUML::TypedEntity<float> indexed;
+		TS_ASSERT(!indexed.bind(m_ncIndexedEntity));
+	}
+
+	void testCounters()
+	{
+		testPut();
+
+		const PUML::IOCounters &counters = m_ncEntity1->counters();
+		TS_ASSERT_EQUALS(counters.putCalls, 1ul);
+		TS_ASSERT_EQUALS(counters.putBytes, 2*5*sizeof(float));
+		TS_ASSERT_EQUALS(counters.getCalls, 0ul);
+
+		// Index {r, 2+r, 4+r, 6+r, 8} -> at least 3 ranges with one element
+		TS_ASSERT_LESS_THAN_EQUALS(3ul, m_ncIndexedEntity->counters().ranges[0]);
+
+		PUML::IOCounters total = m_ncPum.counters();
+		TS_ASSERT_LESS_THAN_EQUALS(3ul, total.putCalls);
+
+		static const char* COUNTERS_FILENAME = "test.counters.json";
+		TS_ASSERT(m_ncPum.writeCounters(COUNTERS_FILENAME));
+		FILE* f = fopen(COUNTERS_FILENAME, "r");
+		TS_ASSERT(f);
+		if (f)
+			fclose(f);
+		remove(COUNTERS_FILENAME);
+
+		m_ncPum.resetCounters();
+		TS_ASSERT_EQUALS(m_ncEntity1->counters().putCalls, 0ul);
+	}
+
 private:
 	void setUpOpen()
 	{
@@ -182,5 +557,6 @@ private:
 		m_ncEntity0 = m_ncGroup->getEntity("testEntity0");
 		m_ncEntity1 = m_ncGroup->getEntity("testEntity1");
 		m_ncIndexedEntity = m_ncIndexedGroup->getEntity("testEntity");
+		m_ncIndexedEntity1 = m_ncIndexedGroup->getEntity("testEntity1");
 	}
 };
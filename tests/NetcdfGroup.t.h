@@ -114,6 +114,21 @@ public:
 #endif // PARALLEL
 	}
 
+#ifdef PARALLEL
+	void testBroadcastMetadata()
+	{
+		testSetSize();
+
+		m_ncPum.setBroadcastMetadata(true);
+		setUpOpen();
+		m_ncPum.setBroadcastMetadata(false);
+
+		TS_ASSERT(m_ncGroup);
+		TS_ASSERT_EQUALS(m_ncGroup->size(0), 5ul);
+		TS_ASSERT_EQUALS(m_ncGroup->size(1), 5ul);
+	}
+#endif // PARALLEL
+
 	void testSetIndex()
 	{
 
@@ -137,6 +152,133 @@ public:
 		TS_ASSERT(m_ncIndexedGroup->putIndex(r, 5, index));
 	}
 
+	void testIndexedSize()
+	{
+		testSetIndex();
+
+		int r = 0;
+		int s = 1;
+#ifdef PARALLEL
+		MPI_Comm_rank(MPI_COMM_WORLD, &r);
+		MPI_Comm_size(MPI_COMM_WORLD, &s);
+#endif // PARALLEL
+
+		// Same number of (collective) calls on all ranks
+		unsigned long index[] = {0, 0, 0, 0, 0};
+		for (int p = r+s; p <= r+2*s; p += s) {
+			size_t size = (static_cast<size_t>(p) < m_ncIndexedGroup->numPartitions() ? 5 : 0);
+			TS_ASSERT(m_ncIndexedGroup->putIndex(p, size, index));
+		}
+
+		setUpOpen();
+
+		// The size of the last partition is computed from the index
+		m_ncIndexedGroup = m_ncPum.getGroup("testIndexedGroup");
+		TS_ASSERT(m_ncIndexedGroup);
+		TS_ASSERT_EQUALS(m_ncIndexedGroup->size(m_ncIndexedGroup->numPartitions()-1), 5ul);
+	}
+
+	void testMixedCells()
+	{
+		PUML::Group* cellGroup = m_ncPum.createCellGroup();
+		TS_ASSERT(cellGroup);
+
+		PUML::CellType types[] = {PUML::TETRAHEDRON, PUML::HEXAHEDRON};
+		TS_ASSERT(cellGroup->createMixedVertexEntity(2, types));
+
+		TS_ASSERT(m_ncPum.endDefinition());
+
+		int r = 0;
+#ifdef PARALLEL
+		MPI_Comm_rank(MPI_COMM_WORLD, &r);
+#endif // PARALLEL
+
+		TS_ASSERT(cellGroup->setSize(r, 3));
+
+		size_t sizes[PUML::NUM_CELL_TYPES] = {2, 1, 0, 0, 0};
+		TS_ASSERT(cellGroup->setTypeSizes(r, sizes));
+
+		long tets[2*PUML::CellTraits<PUML::TETRAHEDRON>::NUM_VERTICES];
+		for (unsigned int i = 0; i < 2*PUML::CellTraits<PUML::TETRAHEDRON>::NUM_VERTICES; i++)
+			tets[i] = i+100*r;
+		long hexs[PUML::CellTraits<PUML::HEXAHEDRON>::NUM_VERTICES];
+		for (unsigned int i = 0; i < PUML::CellTraits<PUML::HEXAHEDRON>::NUM_VERTICES; i++)
+			hexs[i] = i+1000*r;
+
+		TS_ASSERT(cellGroup->putCells<PUML::TETRAHEDRON>(r, tets));
+		TS_ASSERT(cellGroup->putCells<PUML::HEXAHEDRON>(r, hexs));
+
+		setUpOpen();
+
+		cellGroup = m_ncPum.getGroup("cell");
+		TS_ASSERT(cellGroup);
+
+		TS_ASSERT_EQUALS(cellGroup->numCells<PUML::TETRAHEDRON>(r), 2ul);
+		TS_ASSERT_EQUALS(cellGroup->numCells<PUML::HEXAHEDRON>(r), 1ul);
+		TS_ASSERT_EQUALS(cellGroup->numCells<PUML::PRISM>(r), 0ul);
+
+		long values[2*PUML::CellTraits<PUML::TETRAHEDRON>::NUM_VERTICES];
+		TS_ASSERT(cellGroup->getCells<PUML::TETRAHEDRON>(r, values));
+		for (unsigned int i = 0; i < 2*PUML::CellTraits<PUML::TETRAHEDRON>::NUM_VERTICES; i++)
+			TS_ASSERT_EQUALS(values[i], tets[i]);
+		TS_ASSERT(cellGroup->getCells<PUML::HEXAHEDRON>(r, values));
+		for (unsigned int i = 0; i < PUML::CellTraits<PUML::HEXAHEDRON>::NUM_VERTICES; i++)
+			TS_ASSERT_EQUALS(values[i], hexs[i]);
+	}
+
+	void testTimeEntity()
+	{
+		PUML::Dimension dim = m_ncGroup->createDimension("testDim", 2);
+		PUML::Entity* entity = m_ncGroup->createTimeEntity("testTime", PUML::Type::Double, 1, &dim);
+		TS_ASSERT(entity);
+		TS_ASSERT(entity->timeDependent());
+		TS_ASSERT(!m_ncGroup->addStatistics("testTime"));
+
+		testSetSize();
+
+		int r = 0;
+#ifdef PARALLEL
+		MPI_Comm_rank(MPI_COMM_WORLD, &r);
+#endif // PARALLEL
+
+		double values[2*5];
+		for (int step = 0; step < 3; step++) {
+			for (int i = 0; i < 2*5; i++)
+				values[i] = i + 100*step + 1000*r;
+			TS_ASSERT(entity->put(step, r, 5, values));
+		}
+
+		setUpOpen();
+
+		TS_ASSERT_EQUALS(m_ncGroup->numSteps(), 3ul);
+
+		entity = m_ncGroup->getEntity("testTime");
+		TS_ASSERT(entity);
+		TS_ASSERT(entity->timeDependent());
+		TS_ASSERT_EQUALS(entity->numComponents(), 2ul);
+
+		TS_ASSERT(entity->get(1, r, 5, values));
+		for (int i = 0; i < 2*5; i++)
+			TS_ASSERT_EQUALS(values[i], i + 100 + 1000*r);
+	}
+
+	void testUnderscoreEntity()
+	{
+		PUML::Entity* entity = m_ncGroup->createEntity("_testEnt", PUML::Type::Int);
+		TS_ASSERT(entity);
+		TS_ASSERT(m_ncGroup->addStatistics("_testEnt"));
+
+		testSetSize();
+
+		setUpOpen();
+
+		// User entities may start with '_', internal variables are still hidden
+		TS_ASSERT(m_ncGroup->getEntity("_testEnt"));
+		TS_ASSERT(m_ncGroup->getEntity("_testEnt")->hasStatistics());
+		TS_ASSERT(!m_ncGroup->getEntity("__testEnt_min"));
+		TS_ASSERT(!m_ncGroup->getEntity("_offset"));
+	}
+
 private:
 	void setUpOpen()
 	{
@@ -15,12 +15,16 @@
 #endif // PARALLEL
 
 #include <cstdio>
+#include <string>
+#include <vector>
 
 #include <cxxtest/GlobalFixture.h>
 #include <cxxtest/TestSuite.h>
 
+#include "PUML/CheckpointMerger.h"
 #include "PUML/NetcdfGroup.h"
 #include "PUML/NetcdfPum.h"
+#include "PUML/TypedEntity.h"
 
 #ifdef PARALLEL
 int cxxtest_main(int, char**);
@@ -56,6 +60,7 @@ static MPIFixture mpiFixture;
 #endif // PARALLEL
 
 static const char* TEST_FILENAME = "test.nc.pum";
+static const char* SUBFILES_FILENAME = "test.subfiles.nc.pum";
 
 class TestNetcdfPum : public CxxTest::TestSuite
 {
@@ -110,9 +115,523 @@ public:
 		TS_ASSERT(m_ncPum.endDefinition());
 	}
 
+	void testPlanSize()
+	{
+		int r = 0;
+		int s = 1;
+#ifdef PARALLEL
+		MPI_Comm_rank(MPI_COMM_WORLD, &r);
+		MPI_Comm_size(MPI_COMM_WORLD, &s);
+#endif // PARALLEL
+
+		// Each partition is declared by one rank only
+		for (int p = r; p < 2; p += s)
+			m_ncPum.planSize("testGroup", p, 3+p);
+
+		PUML::NetcdfGroup* ncGroup = m_ncPum.createGroup("testGroup");
+		TS_ASSERT(ncGroup);
+		PUML::Entity* entity = ncGroup->createEntity("testEntity", PUML::Type::Int);
+		TS_ASSERT(entity);
+		TS_ASSERT(m_ncPum.endDefinition());
+
+		// Fixed dimension and offsets without setSize
+		TS_ASSERT_EQUALS(ncGroup->dataSize(), 7ul);
+		TS_ASSERT_EQUALS(ncGroup->size(0), 3ul);
+		TS_ASSERT_EQUALS(ncGroup->start(1), 3ul);
+		TS_ASSERT_EQUALS(ncGroup->size(1), 4ul);
+
+		for (int p = r; p < 2; p += s) {
+			int values[4] = {p, p+1, p+2, p+3};
+			TS_ASSERT(entity->put(p, 3+p, values));
+		}
+	}
+
+	void testInMemory()
+	{
+#ifndef PARALLEL
+		// In-memory access is only available in the serial version
+		setUpOpen();
+
+		m_ncPum.setInMemory(true);
+		TS_ASSERT(m_ncPum.create(TEST_FILENAME, 2));
+		PUML::NetcdfGroup* ncGroup = m_ncPum.createGroup("testGroup", 4);
+		TS_ASSERT(ncGroup);
+		PUML::Entity* entity = ncGroup->createEntity("testEntity", PUML::Type::Int);
+		TS_ASSERT(entity);
+		TS_ASSERT(m_ncPum.endDefinition());
+		int values[2] = {1, 2};
+		TS_ASSERT(ncGroup->setSize(1, 2));
+		TS_ASSERT(entity->put(1, 2, values));
+		// Persisted by close
+		TS_ASSERT(m_ncPum.close());
+
+		m_ncPum.setInMemory(false);
+		TS_ASSERT(m_ncPum.open(TEST_FILENAME));
+		ncGroup = m_ncPum.getGroup("testGroup");
+		TS_ASSERT(ncGroup);
+		TS_ASSERT_EQUALS(ncGroup->size(1), 2ul);
+		TS_ASSERT(m_ncPum.close());
+
+		// Read the whole file into memory
+		m_ncPum.setInMemory(true);
+		TS_ASSERT(m_ncPum.open(TEST_FILENAME));
+		ncGroup = m_ncPum.getGroup("testGroup");
+		TS_ASSERT(ncGroup);
+		entity = ncGroup->getEntity("testEntity");
+		TS_ASSERT(entity);
+		int result[2];
+		TS_ASSERT(entity->get(1, result));
+		TS_ASSERT_EQUALS(result[1], 2);
+		m_ncPum.setInMemory(false);
+#endif // PARALLEL
+	}
+
+	void testDeferOffsets()
+	{
+		int r = 0;
+		int s = 1;
+#ifdef PARALLEL
+		MPI_Comm_rank(MPI_COMM_WORLD, &r);
+		MPI_Comm_size(MPI_COMM_WORLD, &s);
+#endif // PARALLEL
+
+		setUpOpen();
+
+		m_ncPum.setDeferOffsets(true);
+		m_ncPum.setFlushPolicy(PUML::Pum::FLUSH_BYTES, 1024);
+#ifdef PARALLEL
+		TS_ASSERT(m_ncPum.create(TEST_FILENAME, 2, MPI_COMM_WORLD));
+#else // PARALLEL
+		TS_ASSERT(m_ncPum.create(TEST_FILENAME, 2));
+#endif // PARALLEL
+		PUML::NetcdfGroup* ncGroup = m_ncPum.createGroup("testGroup");
+		TS_ASSERT(ncGroup);
+		PUML::Entity* entity = ncGroup->createEntity("testEntity", PUML::Type::Int);
+		TS_ASSERT(entity);
+		PUML::Dimension dim = ncGroup->createDimension("testDimension", 256);
+		PUML::Entity* largeEntity = ncGroup->createEntity("testLargeEntity", PUML::Type::Int, 1, &dim);
+		TS_ASSERT(largeEntity);
+		TS_ASSERT(m_ncPum.endDefinition());
+
+		// Same number of calls on all ranks
+		for (int p = 0; p < 2; p += s) {
+			int values[3] = {p, p+1, p+2};
+			size_t partition = p + r;
+			size_t size = (partition < 2 ? 2+partition : 0);
+			TS_ASSERT(ncGroup->setSize(partition, size));
+			if (partition < 2)
+				TS_ASSERT(entity->put(partition, size, values));
+
+			// Not enough bytes written, the offsets are not in the file
+			TS_ASSERT(m_ncPum.checkpoint());
+			TS_ASSERT_DIFFERS(fileOffset(*ncGroup, 1), 2ull);
+		}
+
+		// More than 1024 bytes on one rank synchronizes all ranks
+		if (r == 0) {
+			std::vector<int> values(2*256, 1);
+			TS_ASSERT(largeEntity->put(0, 2, &values[0]));
+		}
+		TS_ASSERT(m_ncPum.checkpoint());
+		TS_ASSERT_EQUALS(fileOffset(*ncGroup, 1), 2ull);
+
+		TS_ASSERT(m_ncPum.close());
+		m_ncPum.setDeferOffsets(false);
+		m_ncPum.setFlushPolicy(PUML::Pum::FLUSH_CHECKPOINT);
+
+#ifdef PARALLEL
+		TS_ASSERT(m_ncPum.open(TEST_FILENAME, MPI_COMM_WORLD));
+#else // PARALLEL
+		TS_ASSERT(m_ncPum.open(TEST_FILENAME));
+#endif // PARALLEL
+		ncGroup = m_ncPum.getGroup("testGroup");
+		TS_ASSERT(ncGroup);
+		TS_ASSERT_EQUALS(ncGroup->size(0), 2ul);
+		TS_ASSERT_EQUALS(ncGroup->start(1), 2ul);
+		TS_ASSERT_EQUALS(ncGroup->size(1), 3ul);
+	}
+
+	void testCheckpoint()
+	{
+		int r = 0;
+		int s = 1;
+#ifdef PARALLEL
+		MPI_Comm_rank(MPI_COMM_WORLD, &r);
+		MPI_Comm_size(MPI_COMM_WORLD, &s);
+#endif // PARALLEL
+
+		// Each rank writes the partitions r and r+s
+		char name[64];
+		sprintf(name, "test.checkpoint.%d", r);
+		std::vector<size_t> partitions;
+		partitions.push_back(r);
+		partitions.push_back(r+s);
+
+		PUML::NetcdfPum checkpoint;
+		TS_ASSERT(checkpoint.createCheckpoint(name, partitions, 2*s));
+		PUML::Group* group = checkpoint.createGroup("testGroup");
+		TS_ASSERT(group);
+		PUML::Entity* entity = group->createEntity("testEntity", PUML::Type::Int);
+		TS_ASSERT(entity);
+		PUML::Group* indexedGroup = checkpoint.createGroupIndexed("testIndexedGroup");
+		TS_ASSERT(indexedGroup);
+		PUML::Entity* indexedEntity = indexedGroup->createEntity("testEntity", PUML::Type::Double);
+		TS_ASSERT(indexedEntity);
+		TS_ASSERT(checkpoint.endDefinition());
+
+		// The partitions share the second element of the indexed group
+		for (int p = 0; p < 2; p++) {
+			TS_ASSERT(group->setSize(p, 2+p));
+			TS_ASSERT(indexedGroup->setSize(p, 2));
+
+			int values[3] = {100*(r+p*s), 100*(r+p*s)+1, 100*(r+p*s)+2};
+			TS_ASSERT(entity->put(p, 2+p, values));
+
+			unsigned long index[2] = {static_cast<unsigned long>(p), static_cast<unsigned long>(p+1)};
+			TS_ASSERT(indexedGroup->putIndex(p, 2, index));
+		}
+		double data[3] = {static_cast<double>(r), r+0.5, r+0.75};
+		TS_ASSERT(indexedEntity->puta(0, 3, data));
+		TS_ASSERT(checkpoint.close());
+
+		std::vector<std::string> checkpoints;
+		for (int i = 0; i < s; i++) {
+			sprintf(name, "test.checkpoint.%d", i);
+			checkpoints.push_back(name);
+		}
+
+		static const char* MERGED_FILENAME = "test.merged.nc.pum";
+		PUML::CheckpointMerger merger;
+#ifdef PARALLEL
+		TS_ASSERT(merger.merge(checkpoints, MERGED_FILENAME, MPI_COMM_WORLD));
+#else // PARALLEL
+		TS_ASSERT(merger.merge(checkpoints, MERGED_FILENAME));
+#endif // PARALLEL
+
+		PUML::NetcdfPum merged;
+#ifdef PARALLEL
+		TS_ASSERT(merged.open(MERGED_FILENAME, MPI_COMM_WORLD));
+#else // PARALLEL
+		TS_ASSERT(merged.open(MERGED_FILENAME));
+#endif // PARALLEL
+		TS_ASSERT_EQUALS(merged.numPartitions(), static_cast<size_t>(2*s));
+
+		group = merged.getGroup("testGroup");
+		TS_ASSERT(group);
+		entity = group->getEntity("testEntity");
+		TS_ASSERT(entity);
+		TS_ASSERT_EQUALS(group->size(r), 2ul);
+		TS_ASSERT_EQUALS(group->size(r+s), 3ul);
+
+		int values[3];
+		TS_ASSERT(entity->get(r+s, values));
+		for (int i = 0; i < 3; i++)
+			TS_ASSERT_EQUALS(values[i], 100*(r+s)+i);
+
+		indexedGroup = merged.getGroup("testIndexedGroup");
+		TS_ASSERT(indexedGroup);
+		indexedEntity = indexedGroup->getEntity("testEntity");
+		TS_ASSERT(indexedEntity);
+		TS_ASSERT(indexedEntity->setCollective(true));
+
+		double indexedValues[2];
+		TS_ASSERT(indexedEntity->get(r+s, indexedValues));
+		TS_ASSERT_EQUALS(indexedValues[0], r+0.5);
+		TS_ASSERT_EQUALS(indexedValues[1], r+0.75);
+
+		TS_ASSERT(merged.close());
+
+		remove(MERGED_FILENAME);
+		sprintf(name, "test.checkpoint.%d", r);
+		remove(name);
+	}
+
+	void testSubfiles()
+	{
+		int r = 0;
+		int s = 1;
+#ifdef PARALLEL
+		MPI_Comm_rank(MPI_COMM_WORLD, &r);
+		MPI_Comm_size(MPI_COMM_WORLD, &s);
+#endif // PARALLEL
+
+		PUML::NetcdfPum pum;
+		createSubfiles(pum);
+
+		PUML::Group* group = pum.getGroup("testGroup");
+		TS_ASSERT(group);
+		PUML::Entity* entity = group->getEntity("testEntity");
+		TS_ASSERT(entity);
+		TS_ASSERT_EQUALS(group->start(2*s-1) + group->size(2*s-1), static_cast<size_t>((2*s+3)*2*s/2));
+
+		// Read a partition of another rank (and subfile)
+		int p = (r+s+1) % (2*s);
+		std::vector<int> values(2+p);
+		TS_ASSERT(entity->get(p, &values[0]));
+		for (int i = 0; i < 2+p; i++)
+			TS_ASSERT_EQUALS(values[i], 100*p + i);
+
+		TS_ASSERT(pum.close());
+		removeSubfiles();
+	}
+
+	void testSubfilesTotalSize()
+	{
+		int r = 0;
+		int s = 1;
+#ifdef PARALLEL
+		MPI_Comm_rank(MPI_COMM_WORLD, &r);
+		MPI_Comm_size(MPI_COMM_WORLD, &s);
+#endif // PARALLEL
+
+		PUML::NetcdfPum pum;
+		createSubfiles(pum);
+		TS_ASSERT(pum.close());
+
+		// Loading a group must not require the subfiles
+		char name[64];
+		char hidden[64];
+#ifdef PARALLEL
+		MPI_Barrier(MPI_COMM_WORLD);
+#endif // PARALLEL
+		if (r == 0) {
+			for (int i = 0; i < 2; i++) {
+				sprintf(name, "%s.%d", SUBFILES_FILENAME, i);
+				sprintf(hidden, "%s.hidden.%d", SUBFILES_FILENAME, i);
+				rename(name, hidden);
+			}
+		}
+#ifdef PARALLEL
+		MPI_Barrier(MPI_COMM_WORLD);
+		TS_ASSERT(pum.open(SUBFILES_FILENAME, MPI_COMM_WORLD));
+#else // PARALLEL
+		TS_ASSERT(pum.open(SUBFILES_FILENAME));
+#endif // PARALLEL
+
+		PUML::Group* group = pum.getGroup("testGroup");
+		TS_ASSERT(group);
+		if (group)
+			TS_ASSERT_EQUALS(group->start(2*s-1) + group->size(2*s-1), static_cast<size_t>((2*s+3)*2*s/2));
+		TS_ASSERT(pum.close());
+
+#ifdef PARALLEL
+		MPI_Barrier(MPI_COMM_WORLD);
+#endif // PARALLEL
+		if (r == 0) {
+			for (int i = 0; i < 2; i++) {
+				sprintf(hidden, "%s.hidden.%d", SUBFILES_FILENAME, i);
+				remove(hidden);
+			}
+		}
+		removeSubfiles();
+	}
+
+	void testSubfilesGather()
+	{
+		int s = 1;
+#ifdef PARALLEL
+		MPI_Comm_size(MPI_COMM_WORLD, &s);
+#endif // PARALLEL
+
+		PUML::NetcdfPum pum;
+		createSubfiles(pum);
+
+		PUML::Group* group = pum.getGroup("testGroup");
+		TS_ASSERT(group);
+		PUML::Entity* entity = group->getEntity("testEntity");
+		TS_ASSERT(entity);
+
+		// The second element of each partition (in reverse order)
+		std::vector<unsigned long> ids;
+		for (int p = 2*s-1; p >= 0; p--)
+			ids.push_back(group->start(p) + 1);
+
+		std::vector<int> values(ids.size());
+		TS_ASSERT(entity->gather(&ids[0], ids.size(), &values[0]));
+		for (int p = 0; p < 2*s; p++)
+			TS_ASSERT_EQUALS(values[2*s-1-p], 100*p + 1);
+
+#ifdef PARALLEL
+		values.assign(ids.size(), 0);
+		TS_ASSERT(entity->gatherDistributed(&ids[0], ids.size(), &values[0]));
+		for (int p = 0; p < 2*s; p++)
+			TS_ASSERT_EQUALS(values[2*s-1-p], 100*p + 1);
+#endif // PARALLEL
+
+		TS_ASSERT(pum.close());
+		removeSubfiles();
+	}
+
+	void testSubfilesSelectPartitions()
+	{
+		int r = 0;
+		int s = 1;
+#ifdef PARALLEL
+		MPI_Comm_rank(MPI_COMM_WORLD, &r);
+		MPI_Comm_size(MPI_COMM_WORLD, &s);
+#endif // PARALLEL
+
+		PUML::NetcdfPum pum;
+		createSubfiles(pum);
+
+		PUML::Group* group = pum.getGroup("testGroup");
+		TS_ASSERT(group);
+		PUML::Entity* entity = group->getEntity("testEntity");
+		TS_ASSERT(entity);
+
+		// Partition p contains 100*p ... 100*p + p+1
+		int p = (r+1) % (2*s);
+		double query = 100*p + 1;
+		std::vector<size_t> partitions;
+		TS_ASSERT(entity->selectPartitions(&query, &query, partitions));
+		TS_ASSERT_EQUALS(partitions.size(), 1ul);
+		if (!partitions.empty())
+			TS_ASSERT_EQUALS(partitions[0], static_cast<size_t>(p));
+
+		TS_ASSERT(pum.close());
+		removeSubfiles();
+	}
+
+	void testSubfilesScan()
+	{
+		int s = 1;
+#ifdef PARALLEL
+		MPI_Comm_size(MPI_COMM_WORLD, &s);
+#endif // PARALLEL
+
+		PUML::NetcdfPum pum;
+		createSubfiles(pum);
+
+		PUML::Group* group = pum.getGroup("testGroup");
+		TS_ASSERT(group);
+		std::vector<PUML::Entity*> entities(1, group->getEntity("testEntity"));
+		TS_ASSERT(entities[0]);
+
+		// 12 bytes per element -> 2 elements per chunk
+		PUML::Scanner scanner = pum.scan(entities, 24);
+		size_t total = 0;
+		while (scanner.next()) {
+			size_t p = scanner.partition();
+			TS_ASSERT_LESS_THAN_EQUALS(scanner.size(), 2ul);
+
+			for (size_t i = 0; i < scanner.size(); i++) {
+				TS_ASSERT_EQUALS(scanner.ids()[i], group->start(p) + scanner.start() + i);
+				TS_ASSERT_EQUALS(scanner.values<int>(0)[i], static_cast<int>(100*p + scanner.start() + i));
+			}
+
+			total += scanner.size();
+		}
+		TS_ASSERT(!scanner.failed());
+		TS_ASSERT_EQUALS(total, static_cast<size_t>((2*s+3)*2*s/2));
+
+		TS_ASSERT(pum.close());
+		removeSubfiles();
+	}
+
+	void testSubfilesAbsolute()
+	{
+		PUML::NetcdfPum pum;
+		createSubfiles(pum);
+
+		PUML::Group* group = pum.getGroup("testGroup");
+		TS_ASSERT(group);
+		PUML::Entity* entity = group->getEntity("testEntity");
+		TS_ASSERT(entity);
+
+		if (pum.numSubfiles() > 0) {
+			// Positions in this file are not stored in the subfiles
+			int value;
+			TS_ASSERT(!entity->geta(0, 1, &value));
+			TS_ASSERT(!entity->getaRaw(0, 1, &value));
+
+			PUML::TypedEntity<int> typed;
+			TS_ASSERT(!typed.bind(entity));
+		}
+
+		TS_ASSERT(pum.close());
+		removeSubfiles();
+	}
+
 private:
 	void setUpOpen()
 	{
 		TS_ASSERT(m_ncPum.close());
 	}
+
+	/**
+	 * Writes a file with 2 subfiles and opens it again. Partition p has
+	 * 2+p elements with the values 100*p + i (and statistics).
+	 */
+	static void createSubfiles(PUML::NetcdfPum &pum)
+	{
+		int r = 0;
+		int s = 1;
+#ifdef PARALLEL
+		MPI_Comm_rank(MPI_COMM_WORLD, &r);
+		MPI_Comm_size(MPI_COMM_WORLD, &s);
+#endif // PARALLEL
+
+		pum.setSubfiles(2);
+#ifdef PARALLEL
+		TS_ASSERT(pum.create(SUBFILES_FILENAME, 2*s, MPI_COMM_WORLD));
+#else // PARALLEL
+		TS_ASSERT(pum.create(SUBFILES_FILENAME, 2*s));
+#endif // PARALLEL
+		// Subfiles require at least two ranks
+		TS_ASSERT_EQUALS(pum.numSubfiles(), (s > 1 ? 2ul : 0ul));
+
+		PUML::Group* group = pum.createGroup("testGroup");
+		TS_ASSERT(group);
+		PUML::Entity* entity = group->createEntity("testEntity", PUML::Type::Int);
+		TS_ASSERT(entity);
+		TS_ASSERT(group->addStatistics("testEntity"));
+		TS_ASSERT(pum.endDefinition());
+
+		// Each rank writes the partitions r and r+s
+		for (int p = r; p < 2*s; p += s) {
+			TS_ASSERT(group->setSize(p, 2+p));
+			std::vector<int> values(2+p);
+			for (int i = 0; i < 2+p; i++)
+				values[i] = 100*p + i;
+			TS_ASSERT(entity->put(p, 2+p, &values[0]));
+		}
+		TS_ASSERT(pum.close());
+
+#ifdef PARALLEL
+		TS_ASSERT(pum.open(SUBFILES_FILENAME, MPI_COMM_WORLD));
+#else // PARALLEL
+		TS_ASSERT(pum.open(SUBFILES_FILENAME));
+#endif // PARALLEL
+	}
+
+	static void removeSubfiles()
+	{
+		int r = 0;
+#ifdef PARALLEL
+		MPI_Comm_rank(MPI_COMM_WORLD, &r);
+		MPI_Barrier(MPI_COMM_WORLD);
+#endif // PARALLEL
+		if (r == 0) {
+			remove(SUBFILES_FILENAME);
+			char name[64];
+			for (int i = 0; i < 2; i++) {
+				sprintf(name, "%s.%d", SUBFILES_FILENAME, i);
+				remove(name);
+			}
+		}
+	}
+
+	/**
+	 * @return The start of a partition as stored in the file
+	 */
+	static unsigned long long fileOffset(PUML::NetcdfGroup &group, size_t partition)
+	{
+		int varId;
+		TS_ASSERT_EQUALS(nc_inq_varid(group.identifier(), "_offset", &varId), NC_NOERR);
+
+		size_t count = 1;
+		unsigned long long offset = 0;
+		TS_ASSERT_EQUALS(nc_get_vara_ulonglong(group.identifier(), varId, &partition, &count, &offset), NC_NOERR);
+		return offset;
+	}
 };
@@ -0,0 +1,261 @@
+/**
+ * @file
+ *  This file is part of PUML
+ *
+ *  For conditions of distribution and use, please see the copyright
+ *  notice in the file 'COPYING' at the root directory of this package
+ *  and the copyright notice at https://github.com/TUM-I5/PUML
+ *
+ * @copyright 2013 Technische Universitaet Muenchen
+ * @author Sebastian Rettenberger <rettenbs@in.tum.de>
+ */
+
+#ifdef PARALLEL
+#include <mpi.h>
+#endif // PARALLEL
+
+#include <cstdio>
+#include <vector>
+
+#include <cxxtest/TestSuite.h>
+
+#include "PUML/NetcdfPum.h"
+#include "PUML/TetBvh.h"
+#include "PUML/TetGeometry.h"
+
+static const char* BVH_FILENAME = "test.bvh.nc.pum";
+
+class TestTetBvh : public CxxTest::TestSuite
+{
+private:
+	/** Number of cubes in each direction */
+	static const unsigned int N = 4;
+
+	std::vector<double> m_coords;
+	std::vector<long> m_cells;
+
+public:
+	void setUp()
+	{
+		// Structured grid of cubes, each cube split into 6 tetrahedra
+		m_coords.clear();
+		for (unsigned int z = 0; z <= N; z++)
+			for (unsigned int y = 0; y <= N; y++)
+				for (unsigned int x = 0; x <= N; x++) {
+					m_coords.push_back(x);
+					m_coords.push_back(y);
+					m_coords.push_back(z);
+				}
+
+		static const unsigned int tets[6][4] = {
+			{0, 1, 3, 7}, {0, 1, 7, 5}, {0, 5, 7, 4},
+			{0, 3, 2, 7}, {0, 2, 6, 7}, {0, 6, 4, 7}};
+
+		m_cells.clear();
+		for (unsigned int z = 0; z < N; z++)
+			for (unsigned int y = 0; y < N; y++)
+				for (unsigned int x = 0; x < N; x++) {
+					long corners[8];
+					for (unsigned int c = 0; c < 8; c++)
+						corners[c] = ((z + c/4) * (N+1) + y + (c/2)%2) * (N+1) + x + c%2;
+
+					for (unsigned int t = 0; t < 6; t++)
+						for (unsigned int v = 0; v < 4; v++)
+							m_cells.push_back(corners[tets[t][v]]);
+				}
+	}
+
+	void testLocate()
+	{
+		size_t numCells = m_cells.size() / 4;
+		size_t numVertices = m_coords.size() / 3;
+
+		PUML::TetBvh bvh;
+		TS_ASSERT(bvh.build(numCells, &m_cells[0], numVertices, &m_coords[0]));
+		TS_ASSERT(bvh.numNodes() > 1);
+
+		PUML::TetGeometry geometry;
+		TS_ASSERT(geometry.compute(numCells, &m_cells[0], numVertices, &m_coords[0]));
+
+		// The centroid of each cell must be located in the cell
+		for (size_t i = 0; i < numCells; i++) {
+			double point[3] = {geometry.centroid(0)[i], geometry.centroid(1)[i], geometry.centroid(2)[i]};
+			TS_ASSERT_EQUALS(bvh.locate(point), static_cast<long>(i));
+		}
+
+		// Points outside
+		double outside[3] = {-0.5, 1, 1};
+		TS_ASSERT_EQUALS(bvh.locate(outside), -1l);
+		double outside2[3] = {N+0.1, N, N};
+		TS_ASSERT_EQUALS(bvh.locate(outside2), -1l);
+
+		// Corner
+		double corner[3] = {N, N, N};
+		TS_ASSERT(bvh.locate(corner) >= 0);
+	}
+
+	/**
+	 * Stores the hierarchy of each partition, loads it again and compares
+	 * the located cells and the selected partitions. Partition p is the
+	 * grid shifted by 2*N*p in x direction.
+	 */
+	void testPersistence()
+	{
+		int r = 0;
+		int s = 1;
+#ifdef PARALLEL
+		MPI_Comm_rank(MPI_COMM_WORLD, &r);
+		MPI_Comm_size(MPI_COMM_WORLD, &s);
+#endif // PARALLEL
+
+		size_t numCells = m_cells.size() / 4;
+		size_t numVertices = m_coords.size() / 3;
+
+		std::vector<double> coords(m_coords);
+		for (size_t i = 0; i < numVertices; i++)
+			coords[i*3] += 2*N*r;
+
+		// Centroids of some cells of all partitions
+		PUML::TetGeometry geometry;
+		TS_ASSERT(geometry.compute(numCells, &m_cells[0], numVertices, &m_coords[0]));
+		std::vector<double> points;
+		for (int p = 0; p < s; p++) {
+			for (size_t i = 0; i < numCells; i += 7) {
+				points.push_back(geometry.centroid(0)[i] + 2*N*p);
+				points.push_back(geometry.centroid(1)[i]);
+				points.push_back(geometry.centroid(2)[i]);
+			}
+		}
+		size_t numPoints = points.size() / 3;
+
+		PUML::TetBvh bvh;
+		TS_ASSERT(bvh.build(numCells, &m_cells[0], numVertices, &coords[0]));
+		std::vector<long> cells(numPoints);
+		bvh.locate(numPoints, &points[0], &cells[0]);
+
+		PUML::NetcdfPum pum;
+#ifdef PARALLEL
+		TS_ASSERT(pum.create(BVH_FILENAME, s, MPI_COMM_WORLD));
+#else // PARALLEL
+		TS_ASSERT(pum.create(BVH_FILENAME, s));
+#endif // PARALLEL
+		TS_ASSERT(PUML::TetBvh::createGroups(pum));
+		PUML::Group* vertexGroup = pum.createGroup("vertex");
+		TS_ASSERT(vertexGroup);
+		PUML::Dimension dim = vertexGroup->createDimension("dimension", 3);
+		TS_ASSERT(vertexGroup->createEntity("coordinate", PUML::Type::Double, 1, &dim));
+		TS_ASSERT(vertexGroup->addStatistics("coordinate"));
+		TS_ASSERT(pum.endDefinition());
+
+		TS_ASSERT(bvh.put(pum, r));
+		TS_ASSERT(vertexGroup->setSize(r, numVertices));
+		PUML::Entity* coordinates = vertexGroup->getEntity("coordinate");
+		TS_ASSERT(coordinates);
+		TS_ASSERT(coordinates->put(r, numVertices, &coords[0]));
+
+		std::vector<std::vector<size_t> > queries;
+		TS_ASSERT(PUML::TetBvh::selectPartitions(*coordinates, numPoints, &points[0], queries));
+		TS_ASSERT(pum.close());
+
+#ifdef PARALLEL
+		TS_ASSERT(pum.open(BVH_FILENAME, MPI_COMM_WORLD));
+#else // PARALLEL
+		TS_ASSERT(pum.open(BVH_FILENAME));
+#endif // PARALLEL
+		vertexGroup = pum.getGroup("vertex");
+		TS_ASSERT(vertexGroup);
+		coordinates = vertexGroup->getEntity("coordinate");
+		TS_ASSERT(coordinates);
+
+		PUML::TetBvh stored;
+		TS_ASSERT(stored.get(pum, r, numCells, &m_cells[0], numVertices, &coords[0]));
+		TS_ASSERT_EQUALS(stored.numNodes(), bvh.numNodes());
+
+		std::vector<std::vector<size_t> > storedQueries;
+		TS_ASSERT(PUML::TetBvh::selectPartitions(*coordinates, numPoints, &points[0], storedQueries));
+		TS_ASSERT_EQUALS(storedQueries.size(), queries.size());
+		for (size_t p = 0; p < storedQueries.size() && p < queries.size(); p++)
+			TS_ASSERT(storedQueries[p] == queries[p]);
+
+		// The points of this partition are found in the same cells
+		TS_ASSERT(static_cast<size_t>(r) < storedQueries.size());
+		if (static_cast<size_t>(r) < storedQueries.size()) {
+			const std::vector<size_t> &local = storedQueries[r];
+			TS_ASSERT(!local.empty());
+			for (std::vector<size_t>::const_iterator i = local.begin(); i != local.end(); i++) {
+				TS_ASSERT_EQUALS(stored.locate(&points[*i*3]), cells[*i]);
+				TS_ASSERT(cells[*i] >= 0);
+			}
+		}
+
+		TS_ASSERT(pum.close());
+
+#ifdef PARALLEL
+		MPI_Barrier(MPI_COMM_WORLD);
+#endif // PARALLEL
+		if (r == 0)
+			remove(BVH_FILENAME);
+	}
+
+	void testCorrupted()
+	{
+		int r = 0;
+		int s = 1;
+#ifdef PARALLEL
+		MPI_Comm_rank(MPI_COMM_WORLD, &r);
+		MPI_Comm_size(MPI_COMM_WORLD, &s);
+#endif // PARALLEL
+
+		size_t numCells = m_cells.size() / 4;
+		size_t numVertices = m_coords.size() / 3;
+
+		PUML::TetBvh bvh;
+		TS_ASSERT(bvh.build(numCells, &m_cells[0], numVertices, &m_coords[0]));
+
+		PUML::NetcdfPum pum;
+#ifdef PARALLEL
+		TS_ASSERT(pum.create(BVH_FILENAME, s, MPI_COMM_WORLD));
+#else // PARALLEL
+		TS_ASSERT(pum.create(BVH_FILENAME, s));
+#endif // PARALLEL
+		TS_ASSERT(PUML::TetBvh::createGroups(pum));
+		TS_ASSERT(pum.endDefinition());
+		TS_ASSERT(bvh.put(pum, r));
+
+		// The first child of the root links to a node that does not exist
+		PUML::Group* nodeGroup = pum.getGroup(PUML::TetBvh::GROUP_NODE);
+		TS_ASSERT(nodeGroup);
+		std::vector<long> links(bvh.numNodes() * 2 * PUML::TetBvh::WIDTH);
+		PUML::Entity* linkEntity = nodeGroup->getEntity("link");
+		TS_ASSERT(linkEntity);
+		TS_ASSERT(linkEntity->get(r, bvh.numNodes(), &links[0]));
+		links[0] = bvh.numNodes();
+		links[PUML::TetBvh::WIDTH] = 0;
+		TS_ASSERT(linkEntity->put(r, bvh.numNodes(), &links[0]));
+		TS_ASSERT(pum.close());
+
+#ifdef PARALLEL
+		TS_ASSERT(pum.open(BVH_FILENAME, MPI_COMM_WORLD));
+#else // PARALLEL
+		TS_ASSERT(pum.open(BVH_FILENAME));
+#endif // PARALLEL
+		PUML::TetBvh stored;
+		TS_ASSERT(!stored.get(pum, r, numCells, &m_cells[0], numVertices, &m_coords[0]));
+		TS_ASSERT(pum.close());
+
+#ifdef PARALLEL
+		MPI_Barrier(MPI_COMM_WORLD);
+#endif // PARALLEL
+		if (r == 0)
+			remove(BVH_FILENAME);
+	}
+
+	void testEmpty()
+	{
+		PUML::TetBvh bvh;
+		TS_ASSERT(bvh.build(0, &m_cells[0], 0, &m_coords[0]));
+
+		double point[3] = {0, 0, 0};
+		TS_ASSERT_EQUALS(bvh.locate(point), -1l);
+	}
+};
@@ -0,0 +1,238 @@
+/**
+ * @file
+ *  This file is part of PUML
+ *
+ *  For conditions of distribution and use, please see the copyright
+ *  notice in the file 'COPYING' at the root directory of this package
+ *  and the copyright notice at https://github.com/TUM-I5/PUML
+ *
+ * @copyright 2013 Technische Universitaet Muenchen
+ * @author Sebastian Rettenberger <rettenbs@in.tum.de>
+ */
+
+#ifdef PARALLEL
+#include <mpi.h>
+#endif // PARALLEL
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include <cxxtest/TestSuite.h>
+
+#include "PUML/NetcdfPum.h"
+#include "PUML/TetGeometry.h"
+
+static const char* GEOMETRY_FILENAME = "test.geometry.nc.pum";
+
+class TestTetGeometry : public CxxTest::TestSuite
+{
+private:
+	/** Unit tetrahedron, regular tetrahedron and a flat one */
+	static const size_t NUM_VERTICES = 8;
+	double m_coords[3*NUM_VERTICES];
+
+public:
+	void setUp()
+	{
+		const double coords[3*NUM_VERTICES] = {
+			0, 0, 0,
+			1, 0, 0,
+			0, 1, 0,
+			0, 0, 1,
+			1, 1, 1,
+			1, -1, -1,
+			-1, 1, -1,
+			-1, -1, 1 };
+		for (size_t i = 0; i < 3*NUM_VERTICES; i++)
+			m_coords[i] = coords[i];
+	}
+
+	void testCompute()
+	{
+		// unit, regular, inverted unit, flat
+		long cells[] = {0, 1, 2, 3,  4, 6, 5, 7,  0, 2, 1, 3,  0, 1, 2, 1};
+
+		PUML::TetGeometry geometry;
+		TS_ASSERT(geometry.compute(4, cells, NUM_VERTICES, m_coords));
+
+		TS_ASSERT_DELTA(geometry.volume()[0], 1./6., 1e-12);
+		TS_ASSERT_DELTA(geometry.volume()[1], 8./3., 1e-12);
+		TS_ASSERT_DELTA(geometry.volume()[2], -1./6., 1e-12);
+		TS_ASSERT_DELTA(geometry.volume()[3], 0., 1e-12);
+
+		TS_ASSERT_DELTA(geometry.centroid(0)[0], 0.25, 1e-12);
+		TS_ASSERT_DELTA(geometry.centroid(2)[1], 0., 1e-12);
+
+		TS_ASSERT_DELTA(geometry.jacobian(0, 0)[0], 1., 1e-12);
+		TS_ASSERT_DELTA(geometry.jacobian(1, 0)[0], 0., 1e-12);
+
+		TS_ASSERT_DELTA(geometry.quality()[1], 1., 1e-12);
+		TS_ASSERT_LESS_THAN(geometry.quality()[0], 1.);
+		TS_ASSERT_LESS_THAN(geometry.quality()[2], 0.);
+
+		PUML::TetGeometry::Report report;
+		TS_ASSERT(geometry.validate(report));
+		TS_ASSERT_EQUALS(report.inverted, 1ul);
+		TS_ASSERT_EQUALS(report.degenerate, 1ul);
+	}
+
+	void testInvalidVertex()
+	{
+		long cells[] = {0, 1, 2, NUM_VERTICES};
+
+		PUML::TetGeometry geometry;
+		TS_ASSERT(!geometry.compute(1, cells, NUM_VERTICES, m_coords));
+	}
+
+	/**
+	 * Stores the geometry of each partition and loads it from the cells and
+	 * coordinates in the file
+	 */
+	void testPutLoad()
+	{
+		int r = 0;
+#ifdef PARALLEL
+		MPI_Comm_rank(MPI_COMM_WORLD, &r);
+#endif // PARALLEL
+
+		PUML::NetcdfPum pum;
+		PUML::Group* cellGroup;
+		PUML::Group* vertexGroup;
+		create(pum, cellGroup, vertexGroup);
+
+		long cells[] = {0, 1, 2, 3,  4, 6, 5, 7,  0, 2, 1, 3,  0, 1, 2, 1};
+		PUML::TetGeometry geometry;
+		TS_ASSERT(geometry.compute(4, cells, NUM_VERTICES, m_coords));
+		TS_ASSERT(geometry.put(*cellGroup, r));
+		TS_ASSERT(pum.close());
+
+		open(pum, cellGroup, vertexGroup);
+
+		PUML::Entity* volume = cellGroup->getEntity("volume");
+		PUML::Entity* centroid = cellGroup->getEntity("centroid");
+		TS_ASSERT(volume);
+		TS_ASSERT(centroid);
+		TS_ASSERT(!cellGroup->getEntity("jacobian"));
+		double values[3*4];
+		TS_ASSERT(volume->get(r, values));
+		for (unsigned int i = 0; i < 4; i++)
+			TS_ASSERT_DELTA(values[i], geometry.volume()[i], 1e-12);
+		TS_ASSERT(centroid->get(r, values));
+		for (unsigned int i = 0; i < 4; i++)
+			TS_ASSERT_DELTA(values[i*3+1], geometry.centroid(1)[i], 1e-12);
+
+		PUML::TetGeometry loaded;
+		TS_ASSERT(loaded.load(*cellGroup, *vertexGroup, "coordinate", r));
+		TS_ASSERT_EQUALS(loaded.numCells(), 4ul);
+		for (unsigned int i = 0; i < 4; i++) {
+			TS_ASSERT_DELTA(loaded.quality()[i], geometry.quality()[i], 1e-12);
+			TS_ASSERT_DELTA(loaded.jacobian(2, 1)[i], geometry.jacobian(2, 1)[i], 1e-12);
+		}
+
+		TS_ASSERT(pum.close());
+		remove();
+	}
+
+	void testValidatePartitions()
+	{
+		int r = 0;
+		int s = 1;
+#ifdef PARALLEL
+		MPI_Comm_rank(MPI_COMM_WORLD, &r);
+		MPI_Comm_size(MPI_COMM_WORLD, &s);
+#endif // PARALLEL
+
+		PUML::NetcdfPum pum;
+		PUML::Group* cellGroup;
+		PUML::Group* vertexGroup;
+		create(pum, cellGroup, vertexGroup);
+		TS_ASSERT(pum.close());
+
+		open(pum, cellGroup, vertexGroup);
+
+		std::vector<PUML::TetGeometry::Report> reports;
+		size_t partition = r;
+		TS_ASSERT(PUML::TetGeometry::validate(*cellGroup, *vertexGroup, "coordinate", 1, &partition, reports
+#ifdef PARALLEL
+				, MPI_COMM_WORLD
+#endif // PARALLEL
+				));
+		TS_ASSERT_EQUALS(reports.size(), static_cast<size_t>(s));
+		for (size_t i = 0; i < reports.size(); i++) {
+			TS_ASSERT_EQUALS(reports[i].inverted, 1ul);
+			TS_ASSERT_EQUALS(reports[i].degenerate, 1ul);
+		}
+
+		// A missing coordinate entity fails on all ranks
+		TS_ASSERT(!PUML::TetGeometry::validate(*cellGroup, *vertexGroup, "unknown", 1, &partition, reports
+#ifdef PARALLEL
+				, MPI_COMM_WORLD
+#endif // PARALLEL
+				));
+
+		TS_ASSERT(pum.close());
+		remove();
+	}
+
+private:
+	/**
+	 * Creates a file with the test cells (unit, regular, inverted unit, flat)
+	 * in each partition
+	 */
+	void create(PUML::Pum &pum, PUML::Group* &cellGroup, PUML::Group* &vertexGroup)
+	{
+		int r = 0;
+		int s = 1;
+#ifdef PARALLEL
+		MPI_Comm_rank(MPI_COMM_WORLD, &r);
+		MPI_Comm_size(MPI_COMM_WORLD, &s);
+		TS_ASSERT(pum.create(GEOMETRY_FILENAME, s, MPI_COMM_WORLD));
+#else // PARALLEL
+		TS_ASSERT(pum.create(GEOMETRY_FILENAME, s));
+#endif // PARALLEL
+
+		cellGroup = pum.createGroup("cell");
+		TS_ASSERT(cellGroup);
+		PUML::Dimension cellDim = cellGroup->createDimension("cell_vertices", 4);
+		TS_ASSERT(cellGroup->createEntity("vertex", PUML::Type::Int64, 1, &cellDim));
+		TS_ASSERT(PUML::TetGeometry::createEntities(*cellGroup, PUML::TetGeometry::VOLUME | PUML::TetGeometry::CENTROID));
+
+		vertexGroup = pum.createGroup("vertex");
+		TS_ASSERT(vertexGroup);
+		PUML::Dimension vertexDim = vertexGroup->createDimension("dimension", 3);
+		TS_ASSERT(vertexGroup->createEntity("coordinate", PUML::Type::Double, 1, &vertexDim));
+		TS_ASSERT(pum.endDefinition());
+
+		long cells[] = {0, 1, 2, 3,  4, 6, 5, 7,  0, 2, 1, 3,  0, 1, 2, 1};
+		TS_ASSERT(cellGroup->setSize(r, 4));
+		TS_ASSERT(cellGroup->getEntity("vertex")->put(r, 4, cells));
+		TS_ASSERT(vertexGroup->setSize(r, NUM_VERTICES));
+		TS_ASSERT(vertexGroup->getEntity("coordinate")->put(r, NUM_VERTICES, m_coords));
+	}
+
+	void open(PUML::Pum &pum, PUML::Group* &cellGroup, PUML::Group* &vertexGroup)
+	{
+#ifdef PARALLEL
+		TS_ASSERT(pum.open(GEOMETRY_FILENAME, MPI_COMM_WORLD));
+#else // PARALLEL
+		TS_ASSERT(pum.open(GEOMETRY_FILENAME));
+#endif // PARALLEL
+
+		cellGroup = pum.getGroup("cell");
+		vertexGroup = pum.getGroup("vertex");
+		TS_ASSERT(cellGroup);
+		TS_ASSERT(vertexGroup);
+	}
+
+	void remove()
+	{
+		int r = 0;
+#ifdef PARALLEL
+		MPI_Comm_rank(MPI_COMM_WORLD, &r);
+		MPI_Barrier(MPI_COMM_WORLD);
+#endif // PARALLEL
+		if (r == 0)
+			::remove(GEOMETRY_FILENAME);
+	}
+};
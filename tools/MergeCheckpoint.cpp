@@ -0,0 +1,87 @@
+/**
+ * @file
+ *  This file is part of PUML
+ *
+ *  For conditions of distribution and use, please see the copyright
+ *  notice in the file 'COPYING' at the root directory of this package
+ *  and the copyright notice at https://github.com/TUM-I5/PUML
+ *
+ * @copyright 2013 Technische Universitaet Muenchen
+ * @author Sebastian Rettenberger <rettenbs@in.tum.de>
+ */
+
+/**
+ * Merges checkpoint files into a single PUM file
+ *
+ * Parameters (<code>--name=value</code>):
+ *  --input Prefix of the checkpoint files, file i is <code>input.i</code>
+ *  --files Number of checkpoint files
+ *  --output Name of the merged file
+ *
+ * The number of ranks can differ from the number of checkpoint files.
+ *
+ * @see PUML::NetcdfPum::createCheckpoint
+ */
+
+#ifdef PARALLEL
+#include <mpi.h>
+#endif // PARALLEL
+
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "PUML/CheckpointMerger.h"
+
+static void fail(const char* message)
+{
+	fprintf(stderr, "MergeCheckpoint: %s\n", message);
+#ifdef PARALLEL
+	MPI_Abort(MPI_COMM_WORLD, 1);
+#endif // PARALLEL
+	exit(1);
+}
+
+int main(int argc, char* argv[])
+{
+#ifdef PARALLEL
+	MPI_Init(&argc, &argv);
+#endif // PARALLEL
+
+	std::map<std::string, std::string> args;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		size_t pos = arg.find('=');
+		if (arg.compare(0, 2, "--") != 0 || pos == std::string::npos)
+			fail("Invalid argument, use --name=value");
+		args[arg.substr(2, pos-2)] = arg.substr(pos+1);
+	}
+
+	if (!args.count("input") || !args.count("files") || !args.count("output"))
+		fail("Missing argument, --input, --files and --output are required");
+
+	unsigned long numFiles = strtoul(args["files"].c_str(), 0L, 10);
+	std::vector<std::string> checkpoints;
+	for (unsigned long i = 0; i < numFiles; i++) {
+		std::ostringstream name;
+		name << args["input"] << '.' << i;
+		checkpoints.push_back(name.str());
+	}
+
+	PUML::CheckpointMerger merger;
+#ifdef PARALLEL
+	if (!merger.merge(checkpoints, args["output"].c_str(), MPI_COMM_WORLD))
+#else // PARALLEL
+	if (!merger.merge(checkpoints, args["output"].c_str()))
+#endif // PARALLEL
+		fail("Could not merge checkpoint files");
+
+#ifdef PARALLEL
+	MPI_Finalize();
+#endif // PARALLEL
+
+	return 0;
+}
@@ -0,0 +1,349 @@
+/**
+ * @file
+ *  This file is part of PUML
+ *
+ *  For conditions of distribution and use, please see the copyright
+ *  notice in the file 'COPYING' at the root directory of this package
+ *  and the copyright notice at https://github.com/TUM-I5/PUML
+ *
+ * @copyright 2013 Technische Universitaet Muenchen
+ * @author Sebastian Rettenberger <rettenbs@in.tum.de>
+ */
+
+/**
+ * Generates a tetrahedral box mesh of arbitrary size
+ *
+ * The box consists of nx * ny * nz cubes, each is split into 6 tetrahedra
+ * (Kuhn subdivision, conforming across cubes). The cubes are partitioned into
+ * px * py * pz blocks. Each block is one partition of the cell group and
+ * the vertex group. Vertices on block boundaries are stored once in the file
+ * and referenced by the index of all partitions that contain them.
+ *
+ * Partitions are generated and written one at a time by each rank, the memory
+ * usage only depends on the size of a partition.
+ *
+ * Parameters (<code>--name=value</code>):
+ *  --file Name of the output file
+ *  --nx, --ny, --nz Number of cubes in each direction
+ *  --partitions Number of partitions (a multiple of the number of ranks)
+ *  --jitter Random displacement of inner vertices in percent of the cube size (max. 10)
+ *
+ * The vertex group contains the entity "coordinates" (with statistics), the
+ * cell group the entity "vertex" that references the vertices of the partition.
+ */
+
+#ifdef PARALLEL
+#include <mpi.h>
+#endif // PARALLEL
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "PUML/NetcdfPum.h"
+
+/**
+ * A partition of the box
+ */
+struct Block
+{
+	/** First cube in each direction */
+	unsigned long start[3];
+	/** Number of cubes in each direction */
+	unsigned long size[3];
+};
+
+/**
+ * The box mesh
+ */
+class BoxMesh
+{
+private:
+	/** Number of cubes in each direction */
+	unsigned long m_cubes[3];
+
+	/** Number of blocks in each direction */
+	unsigned long m_blocks[3];
+
+	/** Jitter in percent of the cube size */
+	unsigned long m_jitter;
+
+public:
+	BoxMesh(const unsigned long cubes[3], unsigned long numPartitions, unsigned long jitter)
+		: m_jitter(std::min(jitter, 10ul))
+	{
+		for (int i = 0; i < 3; i++) {
+			m_cubes[i] = cubes[i];
+			m_blocks[i] = 1;
+		}
+
+		// Assign the prime factors (largest first) to the direction with the
+		// largest blocks -> small block surface
+		std::vector<unsigned long> factors;
+		for (unsigned long f = 2; numPartitions > 1; ) {
+			if (numPartitions % f == 0) {
+				factors.push_back(f);
+				numPartitions /= f;
+			} else
+				f++;
+		}
+
+		for (std::vector<unsigned long>::reverse_iterator f = factors.rbegin(); f != factors.rend(); f++) {
+			int d = 0;
+			for (int i = 1; i < 3; i++) {
+				if (m_cubes[i] * m_blocks[d] > m_cubes[d] * m_blocks[i])
+					d = i;
+			}
+			m_blocks[d] *= *f;
+		}
+	}
+
+	/**
+	 * @return False if a block contains no cubes
+	 */
+	bool valid() const
+	{
+		for (int i = 0; i < 3; i++) {
+			if (m_blocks[i] > m_cubes[i])
+				return false;
+		}
+		return true;
+	}
+
+	Block block(unsigned long partition) const
+	{
+		unsigned long b[3] = {
+			partition % m_blocks[0],
+			(partition / m_blocks[0]) % m_blocks[1],
+			partition / (m_blocks[0] * m_blocks[1])};
+
+		Block block;
+		for (int i = 0; i < 3; i++) {
+			block.start[i] = b[i] * m_cubes[i] / m_blocks[i];
+			block.size[i] = (b[i]+1) * m_cubes[i] / m_blocks[i] - block.start[i];
+		}
+		return block;
+	}
+
+	unsigned long numVertices() const
+	{
+		return (m_cubes[0]+1) * (m_cubes[1]+1) * (m_cubes[2]+1);
+	}
+
+	unsigned long numCells() const
+	{
+		return 6 * m_cubes[0] * m_cubes[1] * m_cubes[2];
+	}
+
+	/**
+	 * Generates the index (global vertex ids) and the coordinates of a block
+	 */
+	void vertices(const Block &block, std::vector<unsigned long> &index, std::vector<double> &coords) const
+	{
+		index.clear();
+		coords.clear();
+
+		for (unsigned long z = block.start[2]; z <= block.start[2]+block.size[2]; z++) {
+			for (unsigned long y = block.start[1]; y <= block.start[1]+block.size[1]; y++) {
+				for (unsigned long x = block.start[0]; x <= block.start[0]+block.size[0]; x++) {
+					unsigned long id = (z * (m_cubes[1]+1) + y) * (m_cubes[0]+1) + x;
+					index.push_back(id);
+
+					unsigned long v[3] = {x, y, z};
+					bool inner = true;
+					for (int i = 0; i < 3; i++)
+						inner &= (v[i] > 0 && v[i] < m_cubes[i]);
+
+					for (int i = 0; i < 3; i++) {
+						double c = v[i];
+						if (inner)
+							// Depends only on the vertex id -> identical in all partitions
+							c += (hash(3*id + i) * 2. - 1.) * m_jitter * 0.01;
+						coords.push_back(c / m_cubes[i]);
+					}
+				}
+			}
+		}
+	}
+
+	/**
+	 * Generates the cells of a block. Vertices are referenced by their
+	 * position in the block.
+	 */
+	void cells(const Block &block, std::vector<long> &cells) const
+	{
+		cells.clear();
+
+		// Kuhn subdivision: one tetrahedron for each permutation of the axes
+		static const int PERMUTATIONS[6][3] = {
+			{0, 1, 2}, {1, 2, 0}, {2, 0, 1}, // even
+			{0, 2, 1}, {1, 0, 2}, {2, 1, 0}  // odd
+		};
+
+		unsigned long sx = block.size[0] + 1;
+		unsigned long sy = block.size[1] + 1;
+		unsigned long step[3] = {1, sx, sx * sy};
+
+		for (unsigned long z = 0; z < block.size[2]; z++) {
+			for (unsigned long y = 0; y < block.size[1]; y++) {
+				for (unsigned long x = 0; x < block.size[0]; x++) {
+					long base = (z * sy + y) * sx + x;
+
+					for (int p = 0; p < 6; p++) {
+						long v[4];
+						v[0] = base;
+						for (int i = 0; i < 3; i++)
+							v[i+1] = v[i] + step[PERMUTATIONS[p][i]];
+
+						// Odd permutations have a negative orientation
+						if (p >= 3)
+							std::swap(v[2], v[3]);
+
+						cells.insert(cells.end(), v, v+4);
+					}
+				}
+			}
+		}
+	}
+
+private:
+	/**
+	 * @return A pseudo random number in [0,1) for an integer
+	 */
+	static double hash(unsigned long i)
+	{
+		i = (i ^ (i >> 30)) * 0xbf58476d1ce4e5b9ul;
+		i = (i ^ (i >> 27)) * 0x94d049bb133111ebul;
+		i = i ^ (i >> 31);
+		return (i >> 11) * (1. / 9007199254740992.);
+	}
+};
+
+static unsigned long param(const std::map<std::string, std::string> &args, const char* name, unsigned long defaultValue)
+{
+	std::map<std::string, std::string>::const_iterator it = args.find(name);
+	if (it == args.end())
+		return defaultValue;
+
+	return strtoul(it->second.c_str(), 0L, 10);
+}
+
+static void fail(const char* message)
+{
+	fprintf(stderr, "MeshGenerator: %s\n", message);
+#ifdef PARALLEL
+	MPI_Abort(MPI_COMM_WORLD, 1);
+#endif // PARALLEL
+	exit(1);
+}
+
+int main(int argc, char* argv[])
+{
+	int rank = 0;
+	int size = 1;
+#ifdef PARALLEL
+	MPI_Init(&argc, &argv);
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	MPI_Comm_size(MPI_COMM_WORLD, &size);
+#endif // PARALLEL
+
+	std::map<std::string, std::string> args;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		size_t pos = arg.find('=');
+		if (arg.compare(0, 2, "--") != 0 || pos == std::string::npos)
+			fail("Invalid argument, use --name=value");
+		args[arg.substr(2, pos-2)] = arg.substr(pos+1);
+	}
+
+	std::string file = (args.count("file") ? args["file"] : "mesh.nc.pum");
+	unsigned long cubes[3] = {
+		param(args, "nx", 10),
+		param(args, "ny", 10),
+		param(args, "nz", 10)};
+	unsigned long numPartitions = param(args, "partitions", size);
+	unsigned long jitter = param(args, "jitter", 0);
+
+	if (numPartitions == 0 || numPartitions % size != 0)
+		fail("The number of partitions must be a multiple of the number of ranks");
+
+	BoxMesh mesh(cubes, numPartitions, jitter);
+	if (!mesh.valid())
+		fail("Too many partitions for the number of cubes");
+
+	// Define the file
+	PUML::NetcdfPum pum;
+#ifdef PARALLEL
+	if (!pum.create(file.c_str(), numPartitions, MPI_COMM_WORLD))
+#else // PARALLEL
+	if (!pum.create(file.c_str(), numPartitions))
+#endif // PARALLEL
+		fail("Could not create file");
+
+	PUML::Group* vertexGroup = pum.createVertexGroup();
+	PUML::Group* cellGroup = pum.createCellGroup();
+	if (!vertexGroup || !cellGroup)
+		fail("Could not create groups");
+
+	PUML::Dimension dim = vertexGroup->createDimension("coordinate", 3);
+	PUML::Entity* coordEntity = vertexGroup->createEntity("coordinates", PUML::Type::Double, 1, &dim);
+	if (!coordEntity || !vertexGroup->addStatistics("coordinates"))
+		fail("Could not create coordinates");
+
+	PUML::Entity* cellEntity = cellGroup->createVertexEntity<PUML::TETRAHEDRON>();
+	if (!cellEntity)
+		fail("Could not create vertex entity");
+
+	if (!pum.endDefinition())
+		fail("Could not define file");
+
+	coordEntity->setCollective(true);
+	cellEntity->setCollective(true);
+
+	// Generate and write one partition per rank at a time
+	std::vector<unsigned long> index;
+	std::vector<double> coords;
+	std::vector<long> cells;
+	unsigned long numLocalVertices = 0;
+	for (unsigned long p = rank; p < numPartitions; p += size) {
+		Block block = mesh.block(p);
+		mesh.vertices(block, index, coords);
+		mesh.cells(block, cells);
+
+		if (!vertexGroup->setSize(p, index.size()) || !cellGroup->setSize(p, cells.size() / 4))
+			fail("Could not set partition size");
+
+		if (!vertexGroup->putIndex(p, index.size(), &index[0]))
+			fail("Could not write index");
+		if (!coordEntity->put(p, index.size(), &coords[0]))
+			fail("Could not write coordinates");
+		if (!cellEntity->put(p, cells.size() / 4, &cells[0]))
+			fail("Could not write cells");
+
+		numLocalVertices += index.size();
+	}
+
+	if (!pum.close())
+		fail("Could not close file");
+
+#ifdef PARALLEL
+	MPI_Allreduce(MPI_IN_PLACE, &numLocalVertices, 1, MPI_UNSIGNED_LONG, MPI_SUM, MPI_COMM_WORLD);
+#endif // PARALLEL
+
+	if (rank == 0) {
+		unsigned long numVertices = mesh.numVertices();
+		printf("{\"file\": \"%s\", \"partitions\": %lu, \"cells\": %lu, \"vertices\": %lu, "
+			"\"partitionVertices\": %lu, \"sharedFraction\": %g}\n",
+			file.c_str(), numPartitions, mesh.numCells(), numVertices, numLocalVertices,
+			static_cast<double>(numLocalVertices - numVertices) / numVertices);
+	}
+
+#ifdef PARALLEL
+	MPI_Finalize();
+#endif // PARALLEL
+
+	return 0;
+}